@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__CLOCK_H
+#define __WATERLINE__CLOCK_H
+
+#include <glib.h>
+#include <time.h>
+
+/* Shared wall clock ticker.
+ * All subscribers are driven by a single wakeup aligned to second or minute boundaries.
+ * Subscribers are also called immediately when the system time is set or after resume. */
+
+typedef enum {
+    WTL_CLOCK_SECOND = 1,
+    WTL_CLOCK_MINUTE = 60
+} WtlClockResolution;
+
+typedef void (*WtlClockFunc)(gpointer user_data);
+
+extern guint wtl_clock_add(WtlClockResolution resolution, WtlClockFunc func, gpointer user_data);
+extern void wtl_clock_set_resolution(guint id, WtlClockResolution resolution);
+extern void wtl_clock_remove(guint id);
+
+/* Like localtime_r(), but for the given timezone (NULL or empty for the local one).
+ * Timezone data is loaded once per zone; the process TZ is never touched. */
+extern struct tm * wtl_clock_localtime(const char * timezone, time_t t, struct tm * result);
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__ICON_CACHE_H
+#define __WATERLINE__ICON_CACHE_H
+
+#include <gtk/gtk.h>
+
+/* Icons shared by all panels and plugins, keyed by name, size and fallback flag.
+ * The cache is dropped when the icon theme changes. Returns a new reference or NULL. */
+extern GdkPixbuf * wtl_icon_cache_load(const char * name, int size, gboolean use_fallback);
+
+/* Icon theme change notification.
+ *
+ * The default GtkIconTheme is watched once for the whole process. When it changes,
+ * the watchers are called back from idle handlers, a few at a time, those with
+ * a mapped widget first. The widget is optional; it is only used for ordering. */
+
+typedef void (*WtlIconThemeChangedFunc)(gpointer data);
+
+extern guint wtl_icon_theme_add_watch(GtkWidget * widget, WtlIconThemeChangedFunc func, gpointer data);
+extern void wtl_icon_theme_remove_watch(guint id);
+
+#endif
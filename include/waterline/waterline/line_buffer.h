@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__LINE_BUFFER_H
+#define __WATERLINE__LINE_BUFFER_H
+
+#include <glib.h>
+
+/* Growable buffer that splits a byte stream into lines.
+ * Only newly arrived bytes are scanned for newlines, and lines are handed out
+ * in place without copying. A returned line is valid until the next call to
+ * wtl_line_buffer_reserve(), wtl_line_buffer_clear() or wtl_line_buffer_free(). */
+
+typedef struct _WtlLineBuffer WtlLineBuffer;
+
+/* Lines longer than max_line_length are split; 0 means no limit. */
+extern WtlLineBuffer * wtl_line_buffer_new(gsize max_line_length);
+extern void wtl_line_buffer_free(WtlLineBuffer * buffer);
+extern void wtl_line_buffer_clear(WtlLineBuffer * buffer);
+
+/* Get space for at least size bytes to read into, then commit the number of bytes actually read. */
+extern gchar * wtl_line_buffer_reserve(WtlLineBuffer * buffer, gsize size);
+extern void wtl_line_buffer_commit(WtlLineBuffer * buffer, gsize bytes);
+
+/* Get the next complete line without the line terminator, or NULL if there is none yet.
+ * If flush is TRUE, an incomplete trailing line is returned as well (use at end of stream). */
+extern gchar * wtl_line_buffer_next_line(WtlLineBuffer * buffer, gboolean flush);
+extern gboolean wtl_line_buffer_has_line(WtlLineBuffer * buffer);
+
+#endif
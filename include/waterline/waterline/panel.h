@@ -61,6 +61,7 @@ extern gboolean panel_is_composite_available(Panel * p);
 
 extern void panel_draw_label_text(Panel * p, GtkWidget * label, const  char * text, unsigned style);
 extern void panel_draw_label_text_with_font(Panel * p, GtkWidget * label, const char * text, unsigned style, const char * custom_font_desc);
+extern void panel_draw_label_text_full(Panel * p, GtkWidget * label, const char * text, unsigned style, const char * custom_font_desc, const GdkColor * custom_color);
 
 extern void panel_image_set_from_file(Panel * p, GtkWidget * image, char * file);
 extern gboolean panel_image_set_icon_theme(Panel * p, GtkWidget * image, const gchar * icon);
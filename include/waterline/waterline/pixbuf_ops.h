@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__PIXBUF_OPS_H
+#define __WATERLINE__PIXBUF_OPS_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <cairo.h>
+
+/* Per-pixel effects on 8-bit RGB(A) pixbufs.
+ * The inner loops work on whole RGBA rows, with SSE2 or NEON code where available and a scalar fallback.
+ * Functions returning a pixbuf return a new RGBA pixbuf, or NULL if the source format is not supported. */
+
+/* Mix two pixbufs: level 0.0 gives src1, level 1.0 gives src2. The result has the size of the smaller one. */
+extern GdkPixbuf * wtl_pixbuf_blend(GdkPixbuf * src1, GdkPixbuf * src2, float level);
+
+/* Add an 0xRRGGBB color to all the pixels which are not fully transparent, saturating at white. */
+extern GdkPixbuf * wtl_pixbuf_highlight(GdkPixbuf * src, gulong color);
+
+/* Fade an RGBA pixbuf in place: move colors halfway to gray and halve the opacity. */
+extern void wtl_pixbuf_dim(GdkPixbuf * pixbuf);
+
+/* Make a CAIRO_FORMAT_ARGB32 image surface, with colors premultiplied by alpha, from an RGB(A) pixbuf.
+ * This is the conversion gdk_cairo_set_source_pixbuf() does on every call; a pixbuf painted repeatedly
+ * can be converted once instead. Returns NULL if the source format is not supported. */
+extern cairo_surface_t * wtl_pixbuf_create_surface(GdkPixbuf * pixbuf);
+
+/* Make an RGBA pixbuf from packed 0xAARRGGBB values stored in longs, as in _NET_WM_ICON. */
+extern GdkPixbuf * wtl_pixbuf_new_from_argb(const gulong * data, int width, int height);
+
+#endif
@@ -151,4 +151,15 @@ extern json_t * plugin_inner_json(Plugin * plugin);
 
 extern gchar * plugin_get_display_name(Plugin * plugin);
 
+/* Registration wrappers that account call counts, time and wakeups to the plugin instance.
+ * Timeouts, idle callbacks and signal handlers are removed with the usual GLib calls;
+ * event filters must be removed with plugin_remove_event_filter(). */
+extern guint plugin_timeout_add(Plugin * plugin, guint interval, GSourceFunc func, gpointer data);
+extern guint plugin_timeout_add_seconds(Plugin * plugin, guint interval, GSourceFunc func, gpointer data);
+extern guint plugin_idle_add(Plugin * plugin, GSourceFunc func, gpointer data);
+extern guint plugin_idle_add_full(Plugin * plugin, gint priority, GSourceFunc func, gpointer data, GDestroyNotify notify);
+extern void plugin_add_event_filter(Plugin * plugin, GdkFilterFunc func, gpointer data);
+extern void plugin_remove_event_filter(Plugin * plugin, GdkFilterFunc func, gpointer data);
+extern gulong plugin_signal_connect(Plugin * plugin, gpointer instance, const char * signal, GCallback func, gpointer data);
+
 #endif
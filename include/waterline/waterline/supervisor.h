@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__SUPERVISOR_H
+#define __WATERLINE__SUPERVISOR_H
+
+#include <glib.h>
+
+/* Supervisor of child processes spawned by the panel.
+ * Output of all children is read through a single epoll set and split into lines,
+ * children are reaped through pidfds where available, and commands that keep failing
+ * are restarted with exponential backoff instead of at every interval. */
+
+typedef struct _WtlProcess WtlProcess;
+
+typedef enum {
+    WTL_PROCESS_USE_PTY = 1 << 0    /* Connect stdout to a pseudo terminal, so that the command line-buffers its output */
+} WtlProcessFlags;
+
+typedef struct {
+    guint64 cpu_time;               /* CPU time of all runs, in milliseconds */
+    gsize rss;                      /* Resident set size of the running child, in KiB */
+    gsize max_rss;                  /* Peak resident set size of finished runs, in KiB */
+    guint runs;                     /* Number of times the command has been started */
+    guint failures;                 /* Number of consecutive failed runs */
+    gboolean throttled;             /* The command keeps failing and its restarts are delayed */
+} WtlProcessUsage;
+
+typedef void (*WtlProcessLineFunc)(WtlProcess * process, gchar * line, gpointer user_data);
+typedef void (*WtlProcessExitFunc)(WtlProcess * process, int status, gpointer user_data);
+typedef void (*WtlProcessFunc)(WtlProcess * process, gpointer user_data);
+
+extern WtlProcess * wtl_process_new(const char * command, WtlProcessFlags flags,
+    WtlProcessLineFunc line_func, WtlProcessExitFunc exit_func, gpointer user_data);
+extern void wtl_process_free(WtlProcess * process);
+
+/* Restart the command the given number of milliseconds after it was started; 0 disables restarting. */
+extern void wtl_process_set_restart_interval(WtlProcess * process, int interval);
+/* Pass at most the given number of lines per main loop iteration; 0 means no limit. */
+extern void wtl_process_set_lines_per_iteration(WtlProcess * process, int lines);
+
+extern gboolean wtl_process_start(WtlProcess * process);
+/* Send SIGTERM to the process group of the command and SIGKILL a while later if it is still alive.
+ * Does not wait for the command to exit. */
+extern void wtl_process_stop(WtlProcess * process);
+extern gboolean wtl_process_is_running(WtlProcess * process);
+
+extern const char * wtl_process_get_command(WtlProcess * process);
+extern void wtl_process_get_usage(WtlProcess * process, WtlProcessUsage * usage);
+
+/* Call func for every process that has not been freed. func must not free processes. */
+extern void wtl_process_foreach(WtlProcessFunc func, gpointer user_data);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__THUMBNAIL_CACHE_H
+#define __WATERLINE__THUMBNAIL_CACHE_H
+
+#include <gtk/gtk.h>
+#include <X11/X.h>
+
+/* Window thumbnails shared by all panels and plugins.
+ *
+ * The contents of a window (its frame, if it has one) are taken from the XComposite
+ * backing pixmap and scaled down by the X server, so only the small image is transferred.
+ * There is one image per window, as large as the largest watch asks for. It is refreshed
+ * when XDamage reports a change, at most once per refresh interval of the most eager watch.
+ * Unmapped windows keep their last image. */
+
+typedef struct _WtlThumbnailWatch WtlThumbnailWatch;
+
+/* Called with the new image each time it is refreshed. The pixbuf is owned by the cache. */
+typedef void (*WtlThumbnailFunc)(GdkPixbuf * pixbuf, gpointer user_data);
+
+/* TRUE if the X server has the Composite and Damage extensions. */
+extern gboolean wtl_thumbnail_is_available(void);
+
+/* Start watching a window. Returns NULL if thumbnails are not available.
+ * The image may already be there; get it with wtl_thumbnail_watch_get_pixbuf. */
+extern WtlThumbnailWatch * wtl_thumbnail_watch(Window win, int max_width, int max_height, guint refresh_interval,
+    WtlThumbnailFunc func, gpointer user_data);
+extern void wtl_thumbnail_unwatch(WtlThumbnailWatch * watch);
+
+extern void wtl_thumbnail_watch_set_size(WtlThumbnailWatch * watch, int max_width, int max_height);
+
+/* Refresh the image even if no damage was reported, e.g. after the window was mapped. */
+extern void wtl_thumbnail_watch_refresh(WtlThumbnailWatch * watch);
+
+/* Borrowed reference or NULL. */
+extern GdkPixbuf * wtl_thumbnail_watch_get_pixbuf(WtlThumbnailWatch * watch);
+
+#endif
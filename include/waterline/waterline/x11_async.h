@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__X11_ASYNC_H
+#define __WATERLINE__X11_ASYNC_H
+
+#include <glib.h>
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+/* Asynchronous property reads.
+ *
+ * Requests are queued and sent together from an idle handler once the pending events
+ * have been dispatched, so a burst of PropertyNotify events costs one round trip instead
+ * of one per event. A request that repeats a queued one is dropped. Errors such as
+ * BadWindow come back with the reply of the request that caused them and never reach
+ * the Xlib error handler. */
+
+typedef struct {
+    Window window;
+    Atom property;
+    Atom type;             /* Actual type of the property, None if it does not exist */
+    int format;            /* 8, 16 or 32 */
+    int nitems;            /* Number of items in data */
+    void * data;           /* Items as XGetWindowProperty returns them (format 32 as long); NULL if missing or of another type */
+    gboolean window_gone;  /* The window was destroyed before the request was processed */
+} WtlX11Property;
+
+/* The property and its data are only valid during the call. */
+typedef void (*WtlX11PropertyFunc)(const WtlX11Property * property, gpointer user_data);
+
+/* Queue a read of a property of the given type (AnyPropertyType for any). */
+extern void wtl_x11_request_property(Window win, Atom prop, Atom type, WtlX11PropertyFunc func, gpointer user_data);
+
+/* Drop the queued and in-flight requests made with user_data, e.g. when the object it points to is freed. */
+extern void wtl_x11_cancel_property_requests(gpointer user_data);
+
+/* Send the queued requests and deliver their replies now. */
+extern void wtl_x11_flush_property_requests(void);
+
+#endif
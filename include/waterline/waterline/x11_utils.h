@@ -70,6 +70,11 @@ extern int wtl_x11_get_wm_state (Window win);
 extern void wtl_x11_get_net_wm_state(Window win, NetWMState *nws);
 extern void wtl_x11_get_net_wm_window_type(Window win, NetWMWindowType *nwwt);
 
+/* Decode property values already fetched, e.g. by wtl_x11_request_property(). */
+extern void wtl_x11_decode_net_wm_state(const Atom * atoms, int count, NetWMState * nws);
+extern void wtl_x11_decode_net_wm_window_type(const Atom * atoms, int count, NetWMWindowType * nwwt);
+extern int wtl_x11_decode_mvm_decorations(const void * data, int nitems);
+
 extern void set_decorations (Window win, gboolean decorate);
 extern int get_mvm_decorations(Window win);
 extern gboolean get_decorations (Window win, NetWMState * nws);
@@ -0,0 +1,330 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+#endif
+
+#include <glib.h>
+#include <sde-utils.h>
+
+#include <waterline/clock.h>
+
+/********************************************************************/
+
+typedef struct {
+    guint id;
+    int resolution;             /* Seconds between calls */
+    time_t next_due;            /* Wall time of the next call */
+    WtlClockFunc func;
+    gpointer user_data;
+} WtlClockSubscriber;
+
+static GList * subscribers = NULL;
+static guint next_subscriber_id = 1;
+
+static int armed_interval = 0;  /* Period of the armed timer in seconds; 0 if disarmed */
+static time_t last_tick = 0;
+
+#ifdef HAVE_SYS_TIMERFD_H
+static int timer_fd = -1;
+static guint timer_fd_watch = 0;
+#endif
+static guint timeout_source = 0; /* Fallback when timerfd is not available */
+
+static GHashTable * timezones = NULL;
+
+static void wtl_clock_arm(gboolean force);
+
+/********************************************************************/
+
+static time_t next_boundary(time_t t, int resolution)
+{
+    return (t / resolution + 1) * resolution;
+}
+
+static WtlClockSubscriber * wtl_clock_find(guint id)
+{
+    GList * l;
+    for (l = subscribers; l; l = l->next)
+    {
+        WtlClockSubscriber * s = (WtlClockSubscriber *) l->data;
+        if (s->id == id)
+            return s;
+    }
+    return NULL;
+}
+
+/* Call the subscribers that are due. If time_changed, call all of them. */
+static void wtl_clock_dispatch(gboolean time_changed)
+{
+    time_t now = time(NULL);
+
+    /* Fallback timer: detect jumps of the wall clock ourselves. */
+    if (last_tick != 0 && (now < last_tick || now > last_tick + armed_interval + 2))
+        time_changed = TRUE;
+    last_tick = now;
+
+    /* Callbacks may add or remove subscribers, so iterate over a snapshot of ids. */
+    GArray * ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    GList * l;
+    for (l = subscribers; l; l = l->next)
+    {
+        WtlClockSubscriber * s = (WtlClockSubscriber *) l->data;
+        if (time_changed || now >= s->next_due)
+            g_array_append_val(ids, s->id);
+    }
+
+    guint i;
+    for (i = 0; i < ids->len; i++)
+    {
+        WtlClockSubscriber * s = wtl_clock_find(g_array_index(ids, guint, i));
+        if (!s)
+            continue;
+        s->next_due = next_boundary(now, s->resolution);
+        s->func(s->user_data);
+    }
+
+    g_array_free(ids, TRUE);
+}
+
+static int wtl_clock_required_interval(void)
+{
+    int interval = 0;
+    GList * l;
+    for (l = subscribers; l; l = l->next)
+    {
+        WtlClockSubscriber * s = (WtlClockSubscriber *) l->data;
+        if (interval == 0 || s->resolution < interval)
+            interval = s->resolution;
+    }
+    return interval;
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+
+static gboolean wtl_clock_on_timer_fd(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    guint64 expirations = 0;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        if (errno == ECANCELED)
+        {
+            /* The wall clock has been set. Realign the timer and update everyone. */
+            wtl_clock_arm(TRUE);
+            wtl_clock_dispatch(TRUE);
+        }
+        return TRUE;
+    }
+
+    /* More than one expiration means we have been suspended or starved. */
+    wtl_clock_dispatch(expirations > 1);
+    return TRUE;
+}
+
+static gboolean wtl_clock_arm_timer_fd(int interval)
+{
+    if (timer_fd < 0)
+    {
+        timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0)
+            return FALSE;
+
+        GIOChannel * channel = g_io_channel_unix_new(timer_fd);
+        timer_fd_watch = g_io_add_watch(channel, G_IO_IN, wtl_clock_on_timer_fd, NULL);
+        g_io_channel_unref(channel);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = next_boundary(now.tv_sec, interval);
+    spec.it_interval.tv_sec = interval;
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == 0)
+        return TRUE;
+
+    /* Kernels before 3.0 do not know TFD_TIMER_CANCEL_ON_SET. */
+    return timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0;
+}
+
+static void wtl_clock_disarm_timer_fd(void)
+{
+    if (timer_fd_watch)
+    {
+        g_source_remove(timer_fd_watch);
+        timer_fd_watch = 0;
+    }
+    if (timer_fd >= 0)
+    {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+}
+
+#endif
+
+static gboolean wtl_clock_on_timeout(gpointer data)
+{
+    timeout_source = 0;
+    wtl_clock_arm(TRUE);
+    wtl_clock_dispatch(FALSE);
+    return FALSE;
+}
+
+static void wtl_clock_arm_timeout(int interval)
+{
+    if (timeout_source)
+        g_source_remove(timeout_source);
+
+    gint64 now = g_get_real_time();
+    gint64 boundary = (gint64) next_boundary(now / G_USEC_PER_SEC, interval) * G_USEC_PER_SEC;
+    guint milliseconds = (boundary - now) / 1000 + 1;
+
+    timeout_source = g_timeout_add(milliseconds, wtl_clock_on_timeout, NULL);
+}
+
+static void wtl_clock_arm(gboolean force)
+{
+    int interval = wtl_clock_required_interval();
+
+    if (interval == armed_interval && !force)
+        return;
+
+    armed_interval = interval;
+
+    if (interval == 0)
+    {
+#ifdef HAVE_SYS_TIMERFD_H
+        wtl_clock_disarm_timer_fd();
+#endif
+        if (timeout_source)
+        {
+            g_source_remove(timeout_source);
+            timeout_source = 0;
+        }
+        last_tick = 0;
+        return;
+    }
+
+#ifdef HAVE_SYS_TIMERFD_H
+    if (wtl_clock_arm_timer_fd(interval))
+        return;
+    wtl_clock_disarm_timer_fd();
+#endif
+
+    wtl_clock_arm_timeout(interval);
+}
+
+/********************************************************************/
+
+guint wtl_clock_add(WtlClockResolution resolution, WtlClockFunc func, gpointer user_data)
+{
+    WtlClockSubscriber * s = g_new0(WtlClockSubscriber, 1);
+    s->id = next_subscriber_id++;
+    s->resolution = resolution;
+    s->next_due = next_boundary(time(NULL), resolution);
+    s->func = func;
+    s->user_data = user_data;
+
+    subscribers = g_list_append(subscribers, s);
+
+    wtl_clock_arm(FALSE);
+
+    return s->id;
+}
+
+void wtl_clock_set_resolution(guint id, WtlClockResolution resolution)
+{
+    WtlClockSubscriber * s = wtl_clock_find(id);
+    if (!s || s->resolution == (int) resolution)
+        return;
+
+    s->resolution = resolution;
+    s->next_due = next_boundary(time(NULL), resolution);
+
+    wtl_clock_arm(FALSE);
+}
+
+void wtl_clock_remove(guint id)
+{
+    WtlClockSubscriber * s = wtl_clock_find(id);
+    if (!s)
+        return;
+
+    subscribers = g_list_remove(subscribers, s);
+    g_free(s);
+
+    wtl_clock_arm(FALSE);
+}
+
+/********************************************************************/
+
+static GTimeZone * wtl_clock_get_timezone(const char * name)
+{
+    if (!timezones)
+        timezones = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_time_zone_unref);
+
+    GTimeZone * tz = g_hash_table_lookup(timezones, name);
+    if (!tz)
+    {
+        tz = g_time_zone_new(name);
+        g_hash_table_insert(timezones, g_strdup(name), tz);
+    }
+    return tz;
+}
+
+struct tm * wtl_clock_localtime(const char * timezone, time_t t, struct tm * result)
+{
+    if (su_str_empty(timezone))
+        return localtime_r(&t, result);
+
+    GTimeZone * tz = wtl_clock_get_timezone(timezone);
+    gint interval = g_time_zone_find_interval(tz, G_TIME_TYPE_UNIVERSAL, t);
+    if (interval < 0)
+        interval = 0;
+
+    gint32 offset = g_time_zone_get_offset(tz, interval);
+    time_t local = t + offset;
+    gmtime_r(&local, result);
+
+    result->tm_isdst = g_time_zone_is_dst(tz, interval);
+#ifdef HAVE_STRUCT_TM_TM_GMTOFF
+    result->tm_gmtoff = offset;
+#endif
+#ifdef HAVE_STRUCT_TM_TM_ZONE
+    /* The abbreviation is owned by the cached GTimeZone, which lives as long as the process. */
+    result->tm_zone = (char *) g_time_zone_get_abbreviation(tz, interval);
+#endif
+
+    return result;
+}
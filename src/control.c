@@ -0,0 +1,598 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <sde-utils.h>
+
+#include <waterline/line_buffer.h>
+#include "control.h"
+
+/********************************************************************/
+
+#define READ_SIZE 4096
+#define MAX_REQUEST_LENGTH 4096
+#define MAX_PENDING_OUTPUT (1024 * 1024) /* Subscribers that do not read their events are dropped */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+    int fd;
+    guint input_watch;
+    guint output_watch;
+    WtlLineBuffer * input;
+    GString * output;
+    gboolean subscribed;
+    GHashTable * events;        /* Names of subscribed events; NULL means all of them */
+    gboolean eof;               /* The client will not send more requests */
+    gboolean closed;            /* Waiting to be freed */
+} WtlControlClient;
+
+static int listen_fd = -1;
+static guint listen_watch = 0;
+static gchar * socket_path = NULL;
+static WtlControlRequestFunc request_func = NULL;
+
+static GList * clients = NULL;
+static int subscriber_count = 0;
+static guint reap_idle = 0;
+
+static void client_flush(WtlControlClient * client);
+
+/********************************************************************/
+
+static gboolean set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return FALSE;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+/* Must match the path waterlinectl computes. */
+static gchar * get_socket_path(const char * display_name)
+{
+    const char * runtime_dir = g_getenv("XDG_RUNTIME_DIR");
+    if (su_str_empty(runtime_dir) || su_str_empty(display_name))
+        return NULL;
+
+    /* ":0" and ":0.0" name the same server. */
+    gchar * display = g_strdup(display_name);
+    char * colon = strrchr(display, ':');
+    if (colon)
+    {
+        char * dot = strchr(colon, '.');
+        if (dot)
+            *dot = 0;
+    }
+    g_strdelimit(display, "/", '_');
+
+    gchar * file_name = g_strdup_printf("waterline-%s.socket", display);
+    gchar * path = g_build_filename(runtime_dir, file_name, NULL);
+    g_free(file_name);
+    g_free(display);
+    return path;
+}
+
+/********************************************************************/
+
+static gboolean on_reap_idle(gpointer data)
+{
+    reap_idle = 0;
+
+    GList * l = clients;
+    while (l)
+    {
+        GList * next = l->next;
+        WtlControlClient * client = (WtlControlClient *) l->data;
+        if (client->closed)
+        {
+            clients = g_list_delete_link(clients, l);
+            wtl_line_buffer_free(client->input);
+            g_string_free(client->output, TRUE);
+            g_free(client);
+        }
+        l = next;
+    }
+
+    return FALSE;
+}
+
+/* Clients are closed from inside their own callbacks and from wtl_control_emit(),
+ * so the memory is released later from an idle handler. */
+static void client_close(WtlControlClient * client)
+{
+    if (client->closed)
+        return;
+
+    client->closed = TRUE;
+
+    if (client->input_watch)
+    {
+        g_source_remove(client->input_watch);
+        client->input_watch = 0;
+    }
+    if (client->output_watch)
+    {
+        g_source_remove(client->output_watch);
+        client->output_watch = 0;
+    }
+
+    close(client->fd);
+    client->fd = -1;
+
+    if (client->subscribed)
+        subscriber_count--;
+    client->subscribed = FALSE;
+    if (client->events)
+    {
+        g_hash_table_destroy(client->events);
+        client->events = NULL;
+    }
+
+    if (!reap_idle)
+        reap_idle = g_idle_add(on_reap_idle, NULL);
+}
+
+static gboolean client_on_output(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    WtlControlClient * client = (WtlControlClient *) data;
+    client->output_watch = 0;
+    client_flush(client);
+    return FALSE;
+}
+
+static void client_flush(WtlControlClient * client)
+{
+    if (client->closed)
+        return;
+
+    while (client->output->len > 0)
+    {
+        ssize_t n = send(client->fd, client->output->str, client->output->len, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            g_string_erase(client->output, 0, n);
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if (!client->output_watch)
+            {
+                GIOChannel * channel = g_io_channel_unix_new(client->fd);
+                client->output_watch = g_io_add_watch(channel, G_IO_OUT | G_IO_ERR | G_IO_HUP, client_on_output, client);
+                g_io_channel_unref(channel);
+            }
+            return;
+        }
+
+        client_close(client);
+        return;
+    }
+
+    if (client->output_watch)
+    {
+        g_source_remove(client->output_watch);
+        client->output_watch = 0;
+    }
+
+    /* Subscribers stay connected after sending their last request. */
+    if (client->eof && !client->subscribed)
+        client_close(client);
+}
+
+/********************************************************************/
+
+static gboolean client_subscribe(WtlControlClient * client, char ** events, int count, gchar ** error)
+{
+    if (!client->subscribed)
+    {
+        client->subscribed = TRUE;
+        subscriber_count++;
+        if (count > 0)
+            client->events = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    else if (count == 0 && client->events)
+    {
+        g_hash_table_destroy(client->events);
+        client->events = NULL;
+    }
+
+    if (client->events)
+    {
+        int i;
+        for (i = 0; i < count; i++)
+            g_hash_table_insert(client->events, g_strdup(events[i]), GINT_TO_POINTER(1));
+    }
+
+    return TRUE;
+}
+
+static gboolean client_unsubscribe(WtlControlClient * client, char ** events, int count, gchar ** error)
+{
+    if (!client->subscribed)
+        return TRUE;
+
+    if (count > 0)
+    {
+        if (!client->events)
+        {
+            *error = g_strdup("cannot unsubscribe from some events after subscribing to all of them");
+            return FALSE;
+        }
+
+        int i;
+        for (i = 0; i < count; i++)
+            g_hash_table_remove(client->events, events[i]);
+
+        if (g_hash_table_size(client->events) > 0)
+            return TRUE;
+    }
+
+    client->subscribed = FALSE;
+    subscriber_count--;
+    if (client->events)
+    {
+        g_hash_table_destroy(client->events);
+        client->events = NULL;
+    }
+
+    return TRUE;
+}
+
+static void client_append_reply(WtlControlClient * client, const char * data, gboolean ok, const char * error)
+{
+    const char * line = data;
+    while (*line)
+    {
+        const char * end = strchr(line, '\n');
+        gsize length = end ? (gsize) (end - line) : strlen(line);
+        g_string_append(client->output, "DATA ");
+        g_string_append_len(client->output, line, length);
+        g_string_append_c(client->output, '\n');
+        line += length;
+        if (*line)
+            line++;
+    }
+
+    if (ok)
+    {
+        g_string_append(client->output, "OK\n");
+    }
+    else
+    {
+        /* The message must stay on one line. */
+        gchar * message = g_strdup(error ? error : "request failed");
+        g_strdelimit(message, "\r\n", ' ');
+        g_string_append_printf(client->output, "ERROR %s\n", message);
+        g_free(message);
+    }
+}
+
+static void client_handle_request(WtlControlClient * client, const char * line)
+{
+    while (g_ascii_isspace(*line))
+        line++;
+
+    if (*line == 0 || *line == '#')
+        return;
+
+    int argc = 0;
+    gchar ** argv = NULL;
+    GError * parse_error = NULL;
+
+    if (!g_shell_parse_argv(line, &argc, &argv, &parse_error))
+    {
+        client_append_reply(client, "", FALSE, parse_error->message);
+        g_error_free(parse_error);
+        return;
+    }
+
+    GString * reply = g_string_new(NULL);
+    gchar * error = NULL;
+    gboolean ok;
+
+    if (strcmp(argv[0], "subscribe") == 0)
+        ok = client_subscribe(client, argv + 1, argc - 1, &error);
+    else if (strcmp(argv[0], "unsubscribe") == 0)
+        ok = client_unsubscribe(client, argv + 1, argc - 1, &error);
+    else if (strcmp(argv[0], "ping") == 0)
+        ok = TRUE;
+    else
+        ok = request_func(argv, argc, reply, &error);
+
+    if (!client->closed)
+        client_append_reply(client, reply->str, ok, error);
+
+    g_free(error);
+    g_string_free(reply, TRUE);
+    g_strfreev(argv);
+}
+
+static gboolean client_on_hangup(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    WtlControlClient * client = (WtlControlClient *) data;
+    client->input_watch = 0;
+    client_close(client);
+    return FALSE;
+}
+
+static gboolean client_on_input(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    WtlControlClient * client = (WtlControlClient *) data;
+
+    /* One read per wakeup, then every complete request in it is answered in one write. */
+    gchar * buffer = wtl_line_buffer_reserve(client->input, READ_SIZE);
+    ssize_t n = read(client->fd, buffer, READ_SIZE);
+    if (n > 0)
+        wtl_line_buffer_commit(client->input, n);
+    else if (n == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+        client->eof = TRUE;
+
+    gchar * line;
+    while (!client->closed && (line = wtl_line_buffer_next_line(client->input, client->eof)) != NULL)
+        client_handle_request(client, line);
+
+    if (client->closed)
+        return FALSE;
+
+    gboolean keep_watch = TRUE;
+    if (client->eof)
+    {
+        /* The socket stays readable at end of stream, so stop polling for input.
+         * A subscriber is only watched for the connection going away. */
+        client->input_watch = 0;
+        keep_watch = FALSE;
+        if (client->subscribed)
+        {
+            GIOChannel * channel = g_io_channel_unix_new(client->fd);
+            client->input_watch = g_io_add_watch(channel, G_IO_ERR | G_IO_HUP, client_on_hangup, client);
+            g_io_channel_unref(channel);
+        }
+    }
+
+    client_flush(client);
+
+    return keep_watch && !client->closed;
+}
+
+static gboolean on_accept(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    while (TRUE)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (!set_nonblocking(fd))
+        {
+            close(fd);
+            continue;
+        }
+
+        WtlControlClient * client = g_new0(WtlControlClient, 1);
+        client->fd = fd;
+        client->input = wtl_line_buffer_new(MAX_REQUEST_LENGTH);
+        client->output = g_string_new(NULL);
+
+        GIOChannel * channel = g_io_channel_unix_new(fd);
+        client->input_watch = g_io_add_watch(channel, G_IO_IN | G_IO_ERR | G_IO_HUP, client_on_input, client);
+        g_io_channel_unref(channel);
+
+        clients = g_list_prepend(clients, client);
+    }
+
+    return TRUE;
+}
+
+/********************************************************************/
+
+typedef enum {
+    SOCKET_FREE,        /* Nothing is listening; a file left behind may be removed */
+    SOCKET_IN_USE,      /* Another instance answers on the socket */
+    SOCKET_UNKNOWN      /* The socket could not be checked */
+} SocketState;
+
+static SocketState probe_socket(struct sockaddr_un * address)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || !set_nonblocking(fd))
+    {
+        if (fd >= 0)
+            close(fd);
+        return SOCKET_UNKNOWN;
+    }
+
+    SocketState state = SOCKET_IN_USE;
+    if (connect(fd, (struct sockaddr *) address, sizeof(*address)) < 0)
+    {
+        /* EAGAIN means the listener is alive but its backlog is full. */
+        if (errno == ECONNREFUSED || errno == ENOENT)
+            state = SOCKET_FREE;
+        else if (errno != EAGAIN && errno != EINPROGRESS)
+            state = SOCKET_UNKNOWN;
+    }
+
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return state;
+}
+
+gboolean wtl_control_start(const char * display_name, WtlControlRequestFunc func, gboolean * in_use)
+{
+    if (in_use)
+        *in_use = FALSE;
+
+    if (listen_fd >= 0)
+        return TRUE;
+
+    request_func = func;
+
+    socket_path = get_socket_path(display_name);
+    if (!socket_path)
+        return FALSE;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        su_print_error_message("control socket path is too long: %s\n", socket_path);
+        goto error;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || !set_nonblocking(listen_fd))
+    {
+        su_print_error_message("can't create control socket: %s\n", g_strerror(errno));
+        goto error;
+    }
+
+    /* Remove a socket left behind by a dead instance, but never take over a live one:
+     * its owner would lose its clients and remove our socket on exit. */
+    switch (probe_socket(&address))
+    {
+        case SOCKET_FREE:
+            unlink(socket_path);
+            break;
+        case SOCKET_IN_USE:
+            if (in_use)
+                *in_use = TRUE;
+            su_print_error_message("another instance is listening on %s\n", socket_path);
+            goto error;
+        case SOCKET_UNKNOWN:
+            su_print_error_message("can't check control socket %s: %s\n", socket_path, g_strerror(errno));
+            goto error;
+    }
+
+    mode_t old_umask = umask(0077);
+    int result = bind(listen_fd, (struct sockaddr *) &address, sizeof(address));
+    umask(old_umask);
+
+    if (result < 0 || listen(listen_fd, 8) < 0)
+    {
+        su_print_error_message("can't listen on %s: %s\n", socket_path, g_strerror(errno));
+        goto error;
+    }
+
+    GIOChannel * channel = g_io_channel_unix_new(listen_fd);
+    listen_watch = g_io_add_watch(channel, G_IO_IN, on_accept, NULL);
+    g_io_channel_unref(channel);
+
+    return TRUE;
+
+error:
+    if (listen_fd >= 0)
+        close(listen_fd);
+    listen_fd = -1;
+    g_free(socket_path);
+    socket_path = NULL;
+    return FALSE;
+}
+
+void wtl_control_stop(void)
+{
+    GList * l;
+    for (l = clients; l; l = l->next)
+    {
+        WtlControlClient * client = (WtlControlClient *) l->data;
+        /* Best effort: deliver what is already queued. */
+        client_flush(client);
+        client_close(client);
+    }
+
+    if (reap_idle)
+        g_source_remove(reap_idle);
+    on_reap_idle(NULL);
+
+    if (listen_watch)
+    {
+        g_source_remove(listen_watch);
+        listen_watch = 0;
+    }
+
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+
+    g_free(socket_path);
+    socket_path = NULL;
+}
+
+void wtl_control_emit(const char * event, const char * format, ...)
+{
+    if (subscriber_count == 0)
+        return;
+
+    va_list ap;
+    va_start(ap, format);
+    gchar * arguments = g_strdup_vprintf(format, ap);
+    va_end(ap);
+
+    g_strdelimit(arguments, "\r\n", ' ');
+
+    GList * l;
+    for (l = clients; l; l = l->next)
+    {
+        WtlControlClient * client = (WtlControlClient *) l->data;
+        if (!client->subscribed)
+            continue;
+        if (client->events && !g_hash_table_lookup(client->events, event))
+            continue;
+
+        if (su_str_empty(arguments))
+            g_string_append_printf(client->output, "EVENT %s\n", event);
+        else
+            g_string_append_printf(client->output, "EVENT %s %s\n", event, arguments);
+
+        if (client->output->len > MAX_PENDING_OUTPUT)
+            client_close(client);
+        else
+            client_flush(client);
+    }
+
+    g_free(arguments);
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__CONTROL_H
+#define __WATERLINE__CONTROL_H
+
+#include <glib.h>
+#include <waterline/symbol_visibility.h>
+
+/* Control socket used by waterlinectl.
+ *
+ * The socket lives in $XDG_RUNTIME_DIR/waterline-<display>.socket. Each request is
+ * one line of shell-quoted words. The reply is any number of "DATA <text>" lines
+ * followed by either "OK" or "ERROR <message>". Requests may be pipelined; replies
+ * come back in order. After "subscribe [event...]" the client also receives
+ * "EVENT <name> <arguments>" lines as things change in the panel. */
+
+/* Handle a request. Lines appended to reply are sent back as DATA lines.
+ * On failure, return FALSE and optionally set *error to a newly allocated message. */
+typedef gboolean (*WtlControlRequestFunc)(char ** argv, int argc, GString * reply, gchar ** error);
+
+/* Returns FALSE if the socket cannot be created. *in_use is set if another running instance owns it;
+ * the socket of a live instance is never removed. */
+extern SYMBOL_HIDDEN gboolean wtl_control_start(const char * display_name, WtlControlRequestFunc func, gboolean * in_use);
+extern SYMBOL_HIDDEN void wtl_control_stop(void);
+
+/* Send an event to the subscribed clients. Cheap when nobody is subscribed. */
+extern SYMBOL_HIDDEN void wtl_control_emit(const char * event, const char * format, ...) G_GNUC_PRINTF(2, 3);
+
+#endif
@@ -35,6 +35,7 @@
 #include <waterline/x11_wrappers.h>
 #include <waterline/ev.h>
 #include <waterline/misc.h>
+#include "event_stats.h"
 
 
 struct _FbEvClass {
@@ -209,6 +210,11 @@ fb_ev_emit(FbEv *ev, int signal)
 {
     //su_log_debug("signal=%d\n", signal);
     g_assert(signal >=0 && signal < EV_LAST_SIGNAL);
+
+    /* Covers the whole fan-out to the plugins' handlers. */
+    WtlEventProbe probe;
+    wtl_event_stats_begin(&probe);
+
     if (signal == EV_ACTIVE_WINDOW)
     {
         ev->active_window = None;
@@ -219,11 +225,16 @@ fb_ev_emit(FbEv *ev, int signal)
         }
     }
     g_signal_emit(ev, signals [signal], 0);
+
+    wtl_event_stats_end(&probe, g_signal_name(signals[signal]));
 }
 
 void fb_ev_emit_destroy(FbEv *ev, Window win)
 {
+    WtlEventProbe probe;
+    wtl_event_stats_begin(&probe);
     g_signal_emit(ev, signals [EV_DESTROY_WINDOW], 0, win );
+    wtl_event_stats_end(&probe, "destroy_window");
 }
 
 static void
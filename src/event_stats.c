@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+#include <waterline/x11_wrappers.h>
+#include "wtl_private.h"
+#include "event_stats.h"
+
+/********************************************************************/
+
+/* Bucket i counts latencies below 2^i microseconds; the last one counts the rest. */
+#define BUCKETS 24
+
+typedef struct {
+    guint64 count;
+    gint64 total_time;
+    gint64 max_time;
+    guint64 requests;
+    guint64 round_trips;
+    guint64 buckets[BUCKETS];
+} WtlEventStatsEntry;
+
+gboolean wtl_event_stats_enabled = FALSE;
+
+static GHashTable * entries = NULL;
+
+/********************************************************************/
+
+void wtl_event_stats_begin(WtlEventProbe * probe)
+{
+    if (!wtl_event_stats_enabled)
+    {
+        probe->started = 0;
+        return;
+    }
+
+    probe->started = g_get_monotonic_time();
+    probe->request = NextRequest(wtl_x11_display());
+    probe->round_trips = wtl_x11_round_trips;
+}
+
+void wtl_event_stats_end(WtlEventProbe * probe, const char * name)
+{
+    if (!probe->started || !wtl_event_stats_enabled)
+        return;
+
+    gint64 elapsed = g_get_monotonic_time() - probe->started;
+
+    if (!entries)
+        entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    WtlEventStatsEntry * entry = g_hash_table_lookup(entries, name);
+    if (!entry)
+    {
+        entry = g_new0(WtlEventStatsEntry, 1);
+        g_hash_table_insert(entries, g_strdup(name), entry);
+    }
+
+    entry->count++;
+    entry->total_time += elapsed;
+    if (elapsed > entry->max_time)
+        entry->max_time = elapsed;
+    entry->requests += NextRequest(wtl_x11_display()) - probe->request;
+    entry->round_trips += wtl_x11_round_trips - probe->round_trips;
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && elapsed >= ((gint64) 1 << bucket))
+        bucket++;
+    entry->buckets[bucket]++;
+}
+
+/* Upper bound of the bucket holding the given fraction of samples, in milliseconds. */
+static double entry_percentile(WtlEventStatsEntry * entry, double fraction)
+{
+    guint64 wanted = (guint64) (entry->count * fraction);
+    guint64 seen = 0;
+    int bucket;
+    for (bucket = 0; bucket < BUCKETS - 1; bucket++)
+    {
+        seen += entry->buckets[bucket];
+        if (seen > wanted)
+            return ((gint64) 1 << bucket) / 1000.0;
+    }
+    return entry->max_time / 1000.0;
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+void wtl_event_stats_format(GString * out)
+{
+    if (!entries)
+        return;
+
+    GPtrArray * names = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        g_ptr_array_add(names, key);
+    g_ptr_array_sort(names, compare_names);
+
+    guint i;
+    for (i = 0; i < names->len; i++)
+    {
+        const char * name = g_ptr_array_index(names, i);
+        WtlEventStatsEntry * entry = g_hash_table_lookup(entries, name);
+        g_string_append_printf(out,
+            "%s count %" G_GUINT64_FORMAT " mean %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f"
+            " requests %.1f round-trips %.1f\n",
+            name, entry->count,
+            entry->total_time / 1000.0 / entry->count,
+            entry_percentile(entry, 0.50),
+            entry_percentile(entry, 0.90),
+            entry_percentile(entry, 0.99),
+            entry->max_time / 1000.0,
+            (double) entry->requests / entry->count,
+            (double) entry->round_trips / entry->count);
+    }
+
+    g_ptr_array_free(names, TRUE);
+}
+
+void wtl_event_stats_reset(void)
+{
+    if (entries)
+        g_hash_table_remove_all(entries);
+}
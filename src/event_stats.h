@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__EVENT_STATS_H
+#define __WATERLINE__EVENT_STATS_H
+
+#include <glib.h>
+#include <waterline/symbol_visibility.h>
+
+/* Latency histograms of the X event hot paths.
+ * Disabled by default; enabled with --event-stats or "waterlinectl event-stats on".
+ * Each probe records the wall time, the number of X requests issued and the number
+ * of round trips made through the wtl_x11_get_* helpers. */
+
+typedef struct {
+    gint64 started;             /* 0 if the probe is not armed */
+    unsigned long request;
+    guint64 round_trips;
+} WtlEventProbe;
+
+extern SYMBOL_HIDDEN gboolean wtl_event_stats_enabled;
+
+extern SYMBOL_HIDDEN void wtl_event_stats_begin(WtlEventProbe * probe);
+extern SYMBOL_HIDDEN void wtl_event_stats_end(WtlEventProbe * probe, const char * name);
+
+extern SYMBOL_HIDDEN void wtl_event_stats_format(GString * out);
+extern SYMBOL_HIDDEN void wtl_event_stats_reset(void);
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include <waterline/icon_cache.h>
+#include <waterline/misc.h>
+
+/********************************************************************/
+
+#define ICON_CACHE_MAX_ENTRIES 512
+
+/* Time to spend calling back watchers in one idle iteration, in microseconds.
+ * Keeps the panel responsive while a theme switch is being processed. */
+#define ICON_THEME_DISPATCH_BUDGET 5000
+
+typedef struct {
+    guint id;
+    GtkWidget * widget;
+    WtlIconThemeChangedFunc func;
+    gpointer data;
+    gboolean pending;               /* Queued in icon_theme_pending */
+} IconThemeWatch;
+
+static GHashTable * icon_cache = NULL;      /* "size:fallback:name" -> GdkPixbuf or NULL for missing icons */
+
+static GList * icon_theme_watches = NULL;
+static GQueue icon_theme_pending = G_QUEUE_INIT; /* Watches to call back, those with a mapped widget first */
+static guint icon_theme_last_watch_id = 0;
+static gulong icon_theme_changed_handler = 0;
+static guint icon_theme_dispatch_idle = 0;
+
+static void icon_theme_connect(void);
+
+/********************************************************************/
+
+static void icon_cache_value_free(gpointer value)
+{
+    if (value)
+        g_object_unref(value);
+}
+
+GdkPixbuf * wtl_icon_cache_load(const char * name, int size, gboolean use_fallback)
+{
+    if (!name)
+        name = "";
+
+    icon_theme_connect();
+
+    if (!icon_cache)
+        icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, icon_cache_value_free);
+
+    gchar * key = g_strdup_printf("%d:%d:%s", size, use_fallback ? 1 : 0, name);
+
+    gpointer value = NULL;
+    if (g_hash_table_lookup_extended(icon_cache, key, NULL, &value))
+    {
+        g_free(key);
+        return value ? g_object_ref(value) : NULL;
+    }
+
+    /* Keep the cache bounded; something cycling through many names just starts over. */
+    if (g_hash_table_size(icon_cache) >= ICON_CACHE_MAX_ENTRIES)
+        g_hash_table_remove_all(icon_cache);
+
+    GdkPixbuf * pixbuf = wtl_load_icon(name, size, size, use_fallback);
+    g_hash_table_insert(icon_cache, key, pixbuf);
+
+    return pixbuf ? g_object_ref(pixbuf) : NULL;
+}
+
+/********************************************************************/
+
+static gboolean icon_theme_dispatch(gpointer user_data)
+{
+    gint64 started = g_get_monotonic_time();
+
+    /* The callback may remove any watch; removed watches are taken out of the queue. */
+    IconThemeWatch * watch;
+    while ((watch = g_queue_pop_head(&icon_theme_pending)) != NULL)
+    {
+        watch->pending = FALSE;
+        watch->func(watch->data);
+
+        if (g_get_monotonic_time() - started >= ICON_THEME_DISPATCH_BUDGET)
+            break;
+    }
+
+    if (!g_queue_is_empty(&icon_theme_pending))
+        return TRUE;
+
+    icon_theme_dispatch_idle = 0;
+    return FALSE;
+}
+
+static void on_icon_theme_changed(GtkIconTheme * theme, gpointer user_data)
+{
+    if (icon_cache)
+        g_hash_table_remove_all(icon_cache);
+
+    /* Order the watchers once per theme change: visible ones first. */
+    g_queue_clear(&icon_theme_pending);
+    GList * l;
+    for (l = icon_theme_watches; l; l = l->next)
+    {
+        IconThemeWatch * watch = (IconThemeWatch *) l->data;
+        watch->pending = watch->widget && gtk_widget_get_mapped(watch->widget);
+        if (watch->pending)
+            g_queue_push_tail(&icon_theme_pending, watch);
+    }
+    for (l = icon_theme_watches; l; l = l->next)
+    {
+        IconThemeWatch * watch = (IconThemeWatch *) l->data;
+        if (!watch->pending)
+        {
+            watch->pending = TRUE;
+            g_queue_push_tail(&icon_theme_pending, watch);
+        }
+    }
+
+    if (!g_queue_is_empty(&icon_theme_pending) && !icon_theme_dispatch_idle)
+        icon_theme_dispatch_idle = g_idle_add(icon_theme_dispatch, NULL);
+}
+
+static void icon_theme_connect(void)
+{
+    if (icon_theme_changed_handler == 0)
+        icon_theme_changed_handler = g_signal_connect(gtk_icon_theme_get_default(),
+            "changed", G_CALLBACK(on_icon_theme_changed), NULL);
+}
+
+/********************************************************************/
+
+guint wtl_icon_theme_add_watch(GtkWidget * widget, WtlIconThemeChangedFunc func, gpointer data)
+{
+    icon_theme_connect();
+
+    IconThemeWatch * watch = g_new0(IconThemeWatch, 1);
+    watch->id = ++icon_theme_last_watch_id;
+    watch->widget = widget;
+    watch->func = func;
+    watch->data = data;
+
+    if (widget)
+        g_object_add_weak_pointer(G_OBJECT(widget), (gpointer *) &watch->widget);
+
+    icon_theme_watches = g_list_append(icon_theme_watches, watch);
+
+    return watch->id;
+}
+
+void wtl_icon_theme_remove_watch(guint id)
+{
+    GList * l;
+    for (l = icon_theme_watches; l; l = l->next)
+    {
+        IconThemeWatch * watch = (IconThemeWatch *) l->data;
+        if (watch->id != id)
+            continue;
+
+        if (watch->pending)
+            g_queue_remove(&icon_theme_pending, watch);
+        if (watch->widget)
+            g_object_remove_weak_pointer(G_OBJECT(watch->widget), (gpointer *) &watch->widget);
+        icon_theme_watches = g_list_delete_link(icon_theme_watches, l);
+        g_free(watch);
+        break;
+    }
+
+    if (g_queue_is_empty(&icon_theme_pending) && icon_theme_dispatch_idle)
+    {
+        g_source_remove(icon_theme_dispatch_idle);
+        icon_theme_dispatch_idle = 0;
+    }
+}
@@ -104,6 +104,36 @@ static void on_stretch_render(GtkTreeViewColumn * column, GtkCellRenderer * rend
         NULL);
 }
 
+static void on_cpu_time_render(GtkTreeViewColumn * column, GtkCellRenderer * renderer, GtkTreeModel * model, GtkTreeIter * iter, gpointer data)
+{
+    Plugin * pl;
+    gtk_tree_model_get(model, iter, COL_DATA, &pl, -1);
+    gchar * text = g_strdup_printf("%.1f", plugin_timing_get_total_time(pl) / 1000.0);
+    g_object_set(renderer, "text", text, NULL);
+    g_free(text);
+}
+
+static void on_wakeups_render(GtkTreeViewColumn * column, GtkCellRenderer * renderer, GtkTreeModel * model, GtkTreeIter * iter, gpointer data)
+{
+    Plugin * pl;
+    gtk_tree_model_get(model, iter, COL_DATA, &pl, -1);
+    gchar * text = g_strdup_printf("%.2f", plugin_timing_get_wakeup_rate(pl));
+    g_object_set(renderer, "text", text, NULL);
+    g_free(text);
+}
+
+/* The timing columns are computed while rendering, so redrawing the view refreshes them. */
+static gboolean on_timing_refresh_timeout(GtkWidget * view)
+{
+    gtk_widget_queue_draw(view);
+    return TRUE;
+}
+
+static void on_plugin_list_destroy(GtkWidget * view, gpointer data)
+{
+    g_source_remove(GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(view), "timing_refresh_timeout")));
+}
+
 static void init_plugin_list( Panel* p, GtkTreeView* view, GtkWidget* label )
 {
     GtkListStore* list;
@@ -132,6 +162,24 @@ static void init_plugin_list( Panel* p, GtkTreeView* view, GtkWidget* label )
     gtk_tree_view_column_set_cell_data_func(col, render, on_stretch_render, NULL, NULL);
     gtk_tree_view_append_column( view, col );
 
+    render = gtk_cell_renderer_text_new();
+    g_object_set( render, "xalign", 1.0, NULL );
+    col = gtk_tree_view_column_new_with_attributes( _("CPU, ms"), render, NULL );
+    gtk_tree_view_column_set_expand( col, FALSE );
+    gtk_tree_view_column_set_cell_data_func(col, render, on_cpu_time_render, NULL, NULL);
+    gtk_tree_view_append_column( view, col );
+
+    render = gtk_cell_renderer_text_new();
+    g_object_set( render, "xalign", 1.0, NULL );
+    col = gtk_tree_view_column_new_with_attributes( _("Wakeups/s"), render, NULL );
+    gtk_tree_view_column_set_expand( col, FALSE );
+    gtk_tree_view_column_set_cell_data_func(col, render, on_wakeups_render, NULL, NULL);
+    gtk_tree_view_append_column( view, col );
+
+    guint timeout = g_timeout_add(2000, (GSourceFunc) on_timing_refresh_timeout, view);
+    g_object_set_data( G_OBJECT(view), "timing_refresh_timeout", GUINT_TO_POINTER(timeout) );
+    g_signal_connect( view, "destroy", G_CALLBACK(on_plugin_list_destroy), NULL );
+
     list = gtk_list_store_new( N_COLS, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_POINTER );
     for( l = p->plugins; l; l = l->next )
     {
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <waterline/line_buffer.h>
+
+/********************************************************************/
+
+struct _WtlLineBuffer {
+    gchar * data;
+    gsize allocated;
+    gsize start;            /* Beginning of the first line not handed out yet */
+    gsize scanned;          /* Bytes before this offset are known to contain no newline */
+    gsize end;              /* End of the data */
+    gsize max_line_length;
+    gboolean skipping;      /* The rest of a truncated line is being dropped */
+};
+
+WtlLineBuffer * wtl_line_buffer_new(gsize max_line_length)
+{
+    WtlLineBuffer * buffer = g_new0(WtlLineBuffer, 1);
+    buffer->max_line_length = max_line_length;
+    return buffer;
+}
+
+void wtl_line_buffer_free(WtlLineBuffer * buffer)
+{
+    if (!buffer)
+        return;
+
+    g_free(buffer->data);
+    g_free(buffer);
+}
+
+void wtl_line_buffer_clear(WtlLineBuffer * buffer)
+{
+    buffer->start = buffer->scanned = buffer->end = 0;
+    buffer->skipping = FALSE;
+}
+
+gchar * wtl_line_buffer_reserve(WtlLineBuffer * buffer, gsize size)
+{
+    /* Move the pending part of the buffer to the beginning.
+     * Only an incomplete line or not yet handed out lines are moved, so the cost stays linear. */
+    if (buffer->start > 0)
+    {
+        memmove(buffer->data, buffer->data + buffer->start, buffer->end - buffer->start);
+        buffer->end -= buffer->start;
+        buffer->scanned -= buffer->start;
+        buffer->start = 0;
+    }
+
+    /* One extra byte for the terminating NUL of a flushed trailing line. */
+    gsize required = buffer->end + size + 1;
+    if (required > buffer->allocated)
+    {
+        gsize allocated = MAX(buffer->allocated, 256);
+        while (allocated < required)
+            allocated *= 2;
+        buffer->data = g_realloc(buffer->data, allocated);
+        buffer->allocated = allocated;
+    }
+
+    return buffer->data + buffer->end;
+}
+
+void wtl_line_buffer_commit(WtlLineBuffer * buffer, gsize bytes)
+{
+    g_assert(buffer->end + bytes < buffer->allocated);
+    buffer->end += bytes;
+}
+
+static gchar * wtl_line_buffer_take(WtlLineBuffer * buffer, gsize line_end, gsize next_start)
+{
+    gchar * line = buffer->data + buffer->start;
+
+    if (line_end > buffer->start && buffer->data[line_end - 1] == '\r')
+        line_end--;
+    buffer->data[line_end] = 0;
+
+    buffer->start = buffer->scanned = next_start;
+    return line;
+}
+
+/* Drop the rest of a truncated line. Returns TRUE if its end has been reached. */
+static gboolean wtl_line_buffer_skip(WtlLineBuffer * buffer)
+{
+    gchar * newline = memchr(buffer->data + buffer->start, '\n', buffer->end - buffer->start);
+    if (!newline)
+    {
+        buffer->start = buffer->scanned = buffer->end;
+        return FALSE;
+    }
+
+    buffer->start = buffer->scanned = newline - buffer->data + 1;
+    buffer->skipping = FALSE;
+    return TRUE;
+}
+
+gchar * wtl_line_buffer_next_line(WtlLineBuffer * buffer, gboolean flush)
+{
+    if (buffer->skipping && !wtl_line_buffer_skip(buffer))
+        return NULL;
+
+    if (buffer->start == buffer->end)
+        return NULL;
+
+    if (buffer->scanned < buffer->end)
+    {
+        gchar * newline = memchr(buffer->data + buffer->scanned, '\n', buffer->end - buffer->scanned);
+        if (newline)
+        {
+            gsize line_end = newline - buffer->data;
+            if (!buffer->max_line_length || line_end - buffer->start <= buffer->max_line_length)
+                return wtl_line_buffer_take(buffer, line_end, line_end + 1);
+        }
+        buffer->scanned = buffer->end;
+    }
+
+    /* Truncate overlong lines, so that a runaway writer cannot grow the buffer without bounds.
+     * The byte after the truncated part is overwritten by the terminating NUL and dropped with the rest of the line. */
+    if (buffer->max_line_length && buffer->end - buffer->start > buffer->max_line_length)
+    {
+        gsize line_end = buffer->start + buffer->max_line_length;
+        gchar * line = wtl_line_buffer_take(buffer, line_end, line_end + 1);
+        buffer->skipping = TRUE;
+        return line;
+    }
+
+    if (flush)
+        return wtl_line_buffer_take(buffer, buffer->end, buffer->end);
+
+    return NULL;
+}
+
+gboolean wtl_line_buffer_has_line(WtlLineBuffer * buffer)
+{
+    if (buffer->skipping && !wtl_line_buffer_skip(buffer))
+        return FALSE;
+
+    if (buffer->start == buffer->end)
+        return FALSE;
+
+    if (buffer->max_line_length && buffer->end - buffer->start > buffer->max_line_length)
+        return TRUE;
+
+    if (buffer->scanned < buffer->end && memchr(buffer->data + buffer->scanned, '\n', buffer->end - buffer->scanned))
+        return TRUE;
+
+    buffer->scanned = buffer->end;
+    return FALSE;
+}
@@ -43,7 +43,10 @@
 #include "panel_internal.h"
 #include "panel_private.h"
 #include <waterline/misc.h>
+#include <waterline/supervisor.h>
 #include "bg.h"
+#include "control.h"
+#include "event_stats.h"
 #include <waterline/x11_utils.h>
 #include <waterline/x11_wrappers.h>
 #include <waterline/gtkcompat.h>
@@ -58,7 +61,9 @@
 /* forward declarations */
 
 static void panel_destroy(Panel *p);
-static int panel_start(Panel *p, const char * configuration, const char * source);
+static int panel_start(Panel *p, json_t * json);
+static void panel_start_plugins(Panel *p);
+static void panel_startup_forget_panel(Panel *p);
 static void panel_start_gui(Panel *p);
 static void panel_size_position_changed(Panel *p, gboolean position_changed);
 static void panel_calculate_position(Panel *p);
@@ -90,6 +95,9 @@ static GtkWindowGroup* window_group; /* window group used to limit the scope of
 static gboolean force_compositing_wm_disabled = FALSE;
 static gboolean force_composite_disabled = FALSE;
 
+static gboolean profile_startup = FALSE;
+static gint64 profile_startup_origin = 0;
+
 /******************************************************************************/
 
 const char * wtl_license = "This program is free software; you can redistribute it and/or\nmodify it under the terms of the GNU General Public License\nas published by the Free Software Foundation; either version 2\nof the License, or (at your option) any later version.\n\nThis program is distributed in the hope that it will be useful,\nbut WITHOUT ANY WARRANTY; without even the implied warranty of\nMERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\nGNU General Public License for more details.\n";
@@ -107,6 +115,33 @@ const char* wtl_agent_id(void)
 
 /******************************************************************************/
 
+/*= startup profiling =*/
+
+/* Print a line of the startup timeline: time since process start, duration of the step, and the step description.
+ * Called from both the main thread and the startup worker. */
+static void panel_profile_startup(gint64 started, const char * format, ...) G_GNUC_PRINTF(2, 3);
+static void panel_profile_startup(gint64 started, const char * format, ...)
+{
+    if (!profile_startup)
+        return;
+
+    gint64 now = g_get_monotonic_time();
+
+    va_list ap;
+    va_start(ap, format);
+    gchar * message = g_strdup_vprintf(format, ap);
+    va_end(ap);
+
+    fprintf(stderr, "startup: %9.3f ms %9.3f ms  %s\n",
+        (now - profile_startup_origin) / 1000.0,
+        (now - started) / 1000.0,
+        message);
+
+    g_free(message);
+}
+
+/******************************************************************************/
+
 /* A hack used to be compatible with Gnome panel for gtk+ themes.
  * Some gtk+ themes define special styles for desktop panels.
  * http://live.gnome.org/GnomeArt/Tutorials/GtkThemes/GnomePanel
@@ -435,6 +470,7 @@ static void panel_set_autohide_visibility(Panel *p, gboolean visible)
     if (p->autohide_visible != autohide_visible)
     {
         p->autohide_visible = autohide_visible;
+        wtl_control_emit("autohide-visible", "%s %d", p->name, autohide_visible);
 
         if (!autohide_visible)
             gtk_widget_hide(p->plugin_box);
@@ -665,17 +701,41 @@ static Panel * panel_get_by_name(gchar * name)
     return NULL;
 }
 
-static void cmd_panel_visible(Panel * panel, char ** argv, int argc)
+/* Set *error for the control socket; the X property interface has no way to report it. */
+static gboolean command_error(gchar ** error, const char * format, ...) G_GNUC_PRINTF(2, 3);
+static gboolean command_error(gchar ** error, const char * format, ...)
 {
-    gboolean visible = !panel->visible;
-
-    if (argc > 1)
+    if (error && !*error)
     {
-        if (strcmp(argv[1], "true") == 0 || strcmp(argv[1], "1") == 0)
-            visible = TRUE;
-        else if (strcmp(argv[1], "false") == 0 || strcmp(argv[1], "0") == 0)
-            visible = FALSE;
+        va_list ap;
+        va_start(ap, format);
+        *error = g_strdup_vprintf(format, ap);
+        va_end(ap);
     }
+    return FALSE;
+}
+
+static gboolean parse_bool_argument(char ** argv, int argc, gboolean * value)
+{
+    if (argc < 2)
+        return TRUE;
+
+    if (strcmp(argv[1], "true") == 0 || strcmp(argv[1], "1") == 0)
+        *value = TRUE;
+    else if (strcmp(argv[1], "false") == 0 || strcmp(argv[1], "0") == 0)
+        *value = FALSE;
+    else
+        return FALSE;
+
+    return TRUE;
+}
+
+static gboolean cmd_panel_visible(Panel * panel, char ** argv, int argc, gchar ** error)
+{
+    gboolean visible = !panel->visible;
+
+    if (!parse_bool_argument(argv, argc, &visible))
+        return command_error(error, "invalid value: %s", argv[1]);
 
     if (visible != panel->visible)
     {
@@ -694,49 +754,54 @@ static void cmd_panel_visible(Panel * panel, char ** argv, int argc)
 
             panel_set_wm_state(panel);
         }
+        wtl_control_emit("visible", "%s %d", panel->name, visible);
     }
+
+    return TRUE;
 }
 
-static void cmd_panel_autohide(Panel * panel, char ** argv, int argc)
+static gboolean cmd_panel_autohide(Panel * panel, char ** argv, int argc, gchar ** error)
 {
     gboolean autohide_old_value = (panel->visibility_mode == VISIBILITY_AUTOHIDE);
     gboolean autohide = !autohide_old_value;
 
-    if (argc > 1)
-    {
-        if (strcmp(argv[1], "true") == 0 || strcmp(argv[1], "1") == 0)
-            autohide = TRUE;
-        else if (strcmp(argv[1], "false") == 0 || strcmp(argv[1], "0") == 0)
-            autohide = FALSE;
-    }
+    if (!parse_bool_argument(argv, argc, &autohide))
+        return command_error(error, "invalid value: %s", argv[1]);
 
     if (autohide != autohide_old_value)
     {
         panel->visibility_mode = autohide ? VISIBILITY_AUTOHIDE : VISIBILITY_ALWAYS;
         panel_update_geometry(panel);
+        wtl_control_emit("autohide", "%s %d", panel->name, autohide);
     }
+
+    return TRUE;
 }
 
-static void cmd_panel(Panel * panel, char ** argv, int argc)
+static gboolean cmd_panel(Panel * panel, char ** argv, int argc, gchar ** error)
 {
-    if (!panel)
-        return;
-
     if (argc < 1)
-        return;
+        return command_error(error, "missing panel command");
 
     if (strcmp(argv[0], "visible") == 0)
-        cmd_panel_visible(panel, argv, argc);
+        return cmd_panel_visible(panel, argv, argc, error);
     else if (strcmp(argv[0], "autohide") == 0)
-        cmd_panel_autohide(panel, argv, argc);
-    else if (strcmp(argv[0], "plugin") == 0 && argc >= 3)
+        return cmd_panel_autohide(panel, argv, argc, error);
+    else if (strcmp(argv[0], "plugin") == 0)
     {
+        if (argc < 3)
+            return command_error(error, "usage: panel <panel> plugin <plugin> <command> [argument...]");
+
         Plugin * pl = panel_get_plugin_by_name(panel, argv[1]);
-        if (pl)
-        {
-            plugin_run_command(pl, argv + 2, argc - 2);
-        }
+        if (!pl)
+            return command_error(error, "no such plugin: %s", argv[1]);
+        if (!pl->class->run_command)
+            return command_error(error, "plugin %s does not accept commands", argv[1]);
+        plugin_run_command(pl, argv + 2, argc - 2);
+        return TRUE;
     }
+
+    return command_error(error, "unknown panel command: %s", argv[0]);
 }
 
 
@@ -792,15 +857,17 @@ static void cmd_exit(char ** argv, int argc)
     gtk_main_quit();
 }
 
-static void process_command(char ** argv, int argc)
+static gboolean process_command(char ** argv, int argc, gchar ** error)
 {
     if (argc < 1)
-        return;
+        return command_error(error, "empty command");
 
     if (strcmp(argv[0], "panel") == 0 && argc > 1)
     {
         Panel * p = panel_get_by_name(argv[1]);
-        cmd_panel(p, argv + 2, argc - 2);
+        if (!p)
+            return command_error(error, "no such panel: %s", argv[1]);
+        return cmd_panel(p, argv + 2, argc - 2, error);
     }
     else if (strcmp(argv[0], "run") == 0)
         cmd_run(argv + 1, argc - 1);
@@ -812,13 +879,215 @@ static void process_command(char ** argv, int argc)
         cmd_restart(argv + 1, argc - 1);
     else if (strcmp(argv[0], "exit") == 0)
         cmd_exit(argv + 1, argc - 1);
+    else
+        return command_error(error, "unknown command: %s", argv[0]);
+
+    return TRUE;
+}
+
+/******************************************************************************/
+
+/*= control socket queries =*/
+
+/* Plugin instance name as accepted by panel_get_plugin_by_name(): "type-N". */
+static gchar * panel_get_plugin_instance_name(Panel * p, Plugin * plugin)
+{
+    int index = 0;
+    GList * l;
+    for (l = p->plugins; l; l = l->next)
+    {
+        Plugin * pl = (Plugin *) l->data;
+        if (pl->class == plugin->class)
+            index++;
+        if (pl == plugin)
+            break;
+    }
+    return g_strdup_printf("%s-%d", plugin->class->type, index);
+}
+
+static gboolean query_panels(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    /* all_panels is in reverse creation order. */
+    GSList * panels = g_slist_reverse(g_slist_copy(all_panels));
+    GSList * l;
+    for (l = panels; l; l = l->next)
+    {
+        Panel * p = (Panel *) l->data;
+        g_string_append_printf(reply, "%s\n", p->name);
+    }
+    g_slist_free(panels);
+    return TRUE;
+}
+
+static gboolean query_plugins(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    if (argc < 2)
+        return command_error(error, "missing panel name");
+
+    Panel * p = panel_get_by_name(argv[1]);
+    if (!p)
+        return command_error(error, "no such panel: %s", argv[1]);
+
+    GList * l;
+    for (l = p->plugins; l; l = l->next)
+    {
+        gchar * name = panel_get_plugin_instance_name(p, (Plugin *) l->data);
+        g_string_append_printf(reply, "%s\n", name);
+        g_free(name);
+    }
+    return TRUE;
+}
+
+static gboolean query_geometry(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    if (argc < 2)
+        return command_error(error, "missing panel name");
+
+    Panel * p = panel_get_by_name(argv[1]);
+    if (!p)
+        return command_error(error, "no such panel: %s", argv[1]);
+
+    g_string_append_printf(reply, "%d %d %d %d\n", p->cx, p->cy, p->cw, p->ch);
+    return TRUE;
+}
+
+static gboolean query_state(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    if (argc < 2)
+        return command_error(error, "missing panel name");
+
+    Panel * p = panel_get_by_name(argv[1]);
+    if (!p)
+        return command_error(error, "no such panel: %s", argv[1]);
+
+    g_string_append_printf(reply, "visible %d\n", p->visible);
+    g_string_append_printf(reply, "autohide %d\n", p->visibility_mode == VISIBILITY_AUTOHIDE);
+    g_string_append_printf(reply, "autohide-visible %d\n", p->autohide_visible);
+    g_string_append_printf(reply, "desktop %d\n", p->curdesk);
+    return TRUE;
+}
+
+static gboolean query_stats(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    GSList * panels = g_slist_reverse(g_slist_copy(all_panels));
+    GSList * l;
+    for (l = panels; l; l = l->next)
+    {
+        Panel * p = (Panel *) l->data;
+        if (argc > 1 && strcmp(argv[1], p->name) != 0)
+            continue;
+
+        GList * l2;
+        for (l2 = p->plugins; l2; l2 = l2->next)
+        {
+            Plugin * pl = (Plugin *) l2->data;
+            gchar * name = panel_get_plugin_instance_name(p, pl);
+
+            g_string_append_printf(reply, "%s %s startup load %.3f construct %.3f\n",
+                p->name, name, pl->load_time / 1000.0, pl->construct_time / 1000.0);
+            g_string_append_printf(reply, "%s %s wakeups %" G_GUINT64_FORMAT " rate %.2f\n",
+                p->name, name, pl->timing->wakeups, plugin_timing_get_wakeup_rate(pl));
+
+            int kind;
+            for (kind = 0; kind < PLUGIN_TIMING_KINDS; kind++)
+            {
+                PluginTimingCounter * counter = &pl->timing->counters[kind];
+                if (counter->calls == 0)
+                    continue;
+                g_string_append_printf(reply, "%s %s %s calls %" G_GUINT64_FORMAT " total %.3f max %.3f\n",
+                    p->name, name, plugin_timing_kind_name(kind), counter->calls,
+                    counter->total_time / 1000.0, counter->max_time / 1000.0);
+            }
+
+            g_free(name);
+        }
+    }
+    g_slist_free(panels);
+    return TRUE;
+}
+
+static gboolean query_stats_reset(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    GSList * l;
+    for (l = all_panels; l; l = l->next)
+    {
+        Panel * p = (Panel *) l->data;
+        if (argc > 1 && strcmp(argv[1], p->name) != 0)
+            continue;
+
+        GList * l2;
+        for (l2 = p->plugins; l2; l2 = l2->next)
+            plugin_timing_reset((Plugin *) l2->data);
+    }
+    return TRUE;
+}
+
+static gboolean query_event_stats(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    if (argc < 2)
+    {
+        if (!wtl_event_stats_enabled)
+            return command_error(error, "event statistics are disabled; enable them with \"event-stats on\"");
+        wtl_event_stats_format(reply);
+    }
+    else if (strcmp(argv[1], "on") == 0)
+        wtl_event_stats_enabled = TRUE;
+    else if (strcmp(argv[1], "off") == 0)
+        wtl_event_stats_enabled = FALSE;
+    else if (strcmp(argv[1], "reset") == 0)
+        wtl_event_stats_reset();
+    else
+        return command_error(error, "unknown event-stats argument: %s", argv[1]);
+
+    return TRUE;
+}
+
+static void query_processes_append(WtlProcess * process, gpointer user_data)
+{
+    GString * reply = (GString *) user_data;
+    WtlProcessUsage usage;
+    wtl_process_get_usage(process, &usage);
+
+    g_string_append_printf(reply, "%s\n", wtl_process_get_command(process));
+    g_string_append_printf(reply, "  running %d runs %u failures %u throttled %d\n",
+        wtl_process_is_running(process), usage.runs, usage.failures, usage.throttled);
+    g_string_append_printf(reply, "  cpu %.3f rss %" G_GSIZE_FORMAT " max-rss %" G_GSIZE_FORMAT "\n",
+        usage.cpu_time / 1000.0, usage.rss, usage.max_rss);
+}
+
+static gboolean query_processes(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    wtl_process_foreach(query_processes_append, reply);
+    return TRUE;
+}
+
+static gboolean panel_control_request(char ** argv, int argc, GString * reply, gchar ** error)
+{
+    if (strcmp(argv[0], "panels") == 0)
+        return query_panels(argv, argc, reply, error);
+    else if (strcmp(argv[0], "plugins") == 0)
+        return query_plugins(argv, argc, reply, error);
+    else if (strcmp(argv[0], "geometry") == 0)
+        return query_geometry(argv, argc, reply, error);
+    else if (strcmp(argv[0], "state") == 0)
+        return query_state(argv, argc, reply, error);
+    else if (strcmp(argv[0], "stats") == 0)
+        return query_stats(argv, argc, reply, error);
+    else if (strcmp(argv[0], "stats-reset") == 0)
+        return query_stats_reset(argv, argc, reply, error);
+    else if (strcmp(argv[0], "event-stats") == 0)
+        return query_event_stats(argv, argc, reply, error);
+    else if (strcmp(argv[0], "processes") == 0)
+        return query_processes(argv, argc, reply, error);
+    else
+        return process_command(argv, argc, error);
 }
 
 /******************************************************************************/
 
 /*= panel's handlers for WM events =*/
 
-static GdkFilterReturn panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer not_used)
+static GdkFilterReturn panel_handle_x_event(GdkXEvent *xevent, GdkEvent *event)
 {
     Atom at;
     Window win;
@@ -845,10 +1114,13 @@ static GdkFilterReturn panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gp
         }
         else if (at == a_NET_CURRENT_DESKTOP)
         {
+            /* Read the property once; the control event reuses it. */
+            int curdesk = wtl_x11_get_net_current_desktop();
             GSList* l;
             for( l = all_panels; l; l = l->next )
-                ((Panel*)l->data)->curdesk = wtl_x11_get_net_current_desktop();
+                ((Panel*)l->data)->curdesk = curdesk;
             fb_ev_emit(fbev, EV_CURRENT_DESKTOP);
+            wtl_control_emit("desktop", "%d", curdesk);
         }
         else if (at == a_NET_NUMBER_OF_DESKTOPS)
         {
@@ -899,7 +1171,7 @@ static GdkFilterReturn panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gp
             {
                 unsigned char b[1];
                 XChangeProperty (wtl_x11_display(), wtl_x11_root(), a_WATERLINE_TEXT_CMD, XA_STRING, 8, PropModeReplace, b, 0);
-                process_command(remote_command_argv, remote_command_argc);
+                process_command(remote_command_argv, remote_command_argc, NULL);
             }
             g_strfreev(remote_command_argv);
         }
@@ -915,6 +1187,15 @@ static GdkFilterReturn panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gp
     return GDK_FILTER_CONTINUE;
 }
 
+static GdkFilterReturn panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer not_used)
+{
+    WtlEventProbe probe;
+    wtl_event_stats_begin(&probe);
+    GdkFilterReturn result = panel_handle_x_event(xevent, event);
+    wtl_event_stats_end(&probe, "panel_event_filter");
+    return result;
+}
+
 /******************************************************************************/
 
 static gboolean panel_expose_event(GtkWidget *widget, GdkEventExpose *event, Panel *p)
@@ -1455,6 +1736,8 @@ static  gboolean panel_configure_event (GtkWidget *widget, GdkEventConfigure *e,
 
     panel_size_position_changed(p, position_changed);
 
+    wtl_control_emit("geometry", "%s %d %d %d %d", p->name, p->cx, p->cy, p->cw, p->ch);
+
     return FALSE;
 }
 
@@ -1696,6 +1979,7 @@ void create_empty_panel(void)
 
     panel_save_configuration(new_panel);
     all_panels = g_slist_prepend(all_panels, new_panel);
+    wtl_control_emit("panel-added", "%s", new_panel->name);
 }
 
 /******************************************************************************/
@@ -1703,6 +1987,7 @@ void create_empty_panel(void)
 void delete_panel(Panel * panel)
 {
     all_panels = g_slist_remove( all_panels, panel );
+    wtl_control_emit("panel-removed", "%s", panel->name);
 
     /* delete the config file of this panel */
     gchar * dir = wtl_get_config_path("panels", SU_PATH_CONFIG_USER_W);
@@ -1940,21 +2225,89 @@ static void panel_update_pref_gui(Panel * p)
         p->pref_dialog.update_gui(p);
 }
 
+/* State of a label drawn by panel_draw_label_text_full(), attached to the label widget.
+ * The attribute list is rebuilt only when the style parameters change;
+ * drawing the same text again is a no-op. */
+typedef struct {
+    unsigned style;
+    int font_size;
+    gboolean use_color;
+    GdkColor color;
+    gchar * font_desc;
+    gchar * text;
+    PangoAttrList * attrs;
+} PanelLabelCache;
+
+static void panel_label_cache_free(PanelLabelCache * cache)
+{
+    if (cache->attrs)
+        pango_attr_list_unref(cache->attrs);
+    g_free(cache->font_desc);
+    g_free(cache->text);
+    g_free(cache);
+}
+
+static PanelLabelCache * panel_label_get_cache(GtkWidget * label)
+{
+    static GQuark quark = 0;
+    if (!quark)
+        quark = g_quark_from_static_string("waterline-label-cache");
+
+    PanelLabelCache * cache = g_object_get_qdata(G_OBJECT(label), quark);
+    if (!cache)
+    {
+        cache = g_new0(PanelLabelCache, 1);
+        g_object_set_qdata_full(G_OBJECT(label), quark, cache, (GDestroyNotify) panel_label_cache_free);
+    }
+    return cache;
+}
+
+static PangoAttrList * panel_label_build_attrs(PanelLabelCache * cache)
+{
+    PangoAttrList * attrs = pango_attr_list_new();
+
+    if (cache->font_desc)
+    {
+        PangoFontDescription * desc = pango_font_description_from_string(cache->font_desc);
+        pango_attr_list_insert(attrs, pango_attr_font_desc_new(desc));
+        pango_font_description_free(desc);
+    }
+    else if (cache->font_size > 0)
+    {
+        pango_attr_list_insert(attrs, pango_attr_size_new(cache->font_size * PANGO_SCALE));
+    }
+
+    if (cache->use_color)
+        pango_attr_list_insert(attrs, pango_attr_foreground_new(cache->color.red, cache->color.green, cache->color.blue));
+
+    if (cache->style & STYLE_BOLD)
+        pango_attr_list_insert(attrs, pango_attr_weight_new(PANGO_WEIGHT_BOLD));
+    if (cache->style & STYLE_ITALIC)
+        pango_attr_list_insert(attrs, pango_attr_style_new(PANGO_STYLE_ITALIC));
+    if (cache->style & STYLE_UNDERLINE)
+        pango_attr_list_insert(attrs, pango_attr_underline_new(PANGO_UNDERLINE_SINGLE));
+
+    return attrs;
+}
+
 void panel_draw_label_text(Panel * p, GtkWidget * label, const char * text, unsigned style)
 {
-    panel_draw_label_text_with_font(p, label, text, style, NULL);
+    panel_draw_label_text_full(p, label, text, style, NULL, NULL);
 }
 
 void panel_draw_label_text_with_font(Panel * p, GtkWidget * label, const char * text, unsigned style, const char * custom_font_desc)
 {
-    gboolean bold = style & STYLE_BOLD;
-    gboolean italic  = style & STYLE_ITALIC;
-    gboolean underline = style & STYLE_UNDERLINE;
-    gboolean custom_color = style & STYLE_CUSTOM_COLOR;
-    gboolean allow_markup = style & STYLE_MARKUP;
+    panel_draw_label_text_full(p, label, text, style, custom_font_desc, NULL);
+}
+
+void panel_draw_label_text_full(Panel * p, GtkWidget * label, const char * text, unsigned style, const char * custom_font_desc, const GdkColor * custom_color)
+{
+    PanelLabelCache * cache = panel_label_get_cache(label);
 
     if (text == NULL)
     {
+        g_free(cache->text);
+        cache->text = NULL;
         gtk_label_set_text(GTK_LABEL(label), NULL);
         return;
     }
@@ -1976,59 +2329,78 @@ void panel_draw_label_text_with_font(Panel * p, GtkWidget * label, const char *
         }
     }
 
-    /* Check the string for characters that need to be escaped.
-     * If any are found, create the properly escaped string and use it instead. */
-    const char * valid_markup = text;
-    char * escaped_text = NULL;
-    if (!allow_markup)
+    gboolean use_color = FALSE;
+    GdkColor color;
+    if (custom_color)
     {
-        const char * q;
-        for (q = text; *q != '\0'; q += 1)
-        {
-            if ((*q == '<') || (*q == '>') || (*q == '&'))
-            {
-                escaped_text = g_markup_escape_text(text, -1);
-                valid_markup = escaped_text;
-                break;
-            }
-        }
+        color = *custom_color;
+        use_color = TRUE;
+    }
+    else if ((style & STYLE_CUSTOM_COLOR) && (p->use_font_color))
+    {
+        color = p->font_color;
+        use_color = TRUE;
     }
 
-    gchar * attr_color = "";
-    gchar * attr_color_allocated = NULL;
-    if ((custom_color) && (p->use_font_color))
-        attr_color_allocated =  attr_color = g_strdup_printf(" color=\"#%06x\"", wtl_util_gdkcolor_to_uint32(&p->font_color));
+    if (su_str_empty(custom_font_desc))
+        custom_font_desc = NULL;
 
-    gchar * attr_desc = "";
-    gchar * attr_desc_allocated = NULL;
-    if (!su_str_empty(custom_font_desc))
+    gboolean attrs_changed = !cache->attrs
+        || cache->style != style
+        || cache->font_size != font_size
+        || cache->use_color != use_color
+        || (use_color && !gdk_color_equal(&cache->color, &color))
+        || g_strcmp0(cache->font_desc, custom_font_desc) != 0;
+
+    gboolean text_changed = g_strcmp0(cache->text, text) != 0;
+
+    if (!attrs_changed && !text_changed)
+        return;
+
+    if (attrs_changed)
     {
-        gchar * custom_font_desc_escaped = g_markup_escape_text(custom_font_desc, -1);
-        attr_desc_allocated = attr_desc = g_strdup_printf(" font_desc=\"%s\"", custom_font_desc_escaped);
-        g_free(custom_font_desc_escaped);
+        cache->style = style;
+        cache->font_size = font_size;
+        cache->use_color = use_color;
+        if (use_color)
+            cache->color = color;
+        g_free(cache->font_desc);
+        cache->font_desc = g_strdup(custom_font_desc);
+
+        if (cache->attrs)
+            pango_attr_list_unref(cache->attrs);
+        cache->attrs = panel_label_build_attrs(cache);
     }
-    else if (font_size > 0)
+
+    if (text_changed)
     {
-        attr_desc_allocated = attr_desc = g_strdup_printf(" font_desc=\"%d\"", font_size);
+        g_free(cache->text);
+        cache->text = g_strdup(text);
     }
 
-    gchar * markup_text = g_strdup_printf("<span%s%s>%s%s%s%s%s%s%s</span>",
-            attr_desc, attr_color,
-            ((bold) ? "<b>" : ""),
-            ((italic) ? "<i>" : ""),
-            ((underline) ? "<u>" : ""),
-            valid_markup,
-            ((underline) ? "</u>" : ""),
-            ((italic) ? "</i>" : ""),
-            ((bold) ? "</b>" : ""));
-    gtk_label_set_markup(GTK_LABEL(label), markup_text);
-
-    g_free(markup_text);
-
-    g_free(attr_desc_allocated);
-    g_free(attr_color_allocated);
-    g_free(escaped_text);
+    if (style & STYLE_MARKUP)
+    {
+        /* Markup attributes are merged on top of the base attributes, like nested spans. */
+        PangoAttrList * markup_attrs = NULL;
+        gchar * plain_text = NULL;
+        if (pango_parse_markup(text, -1, 0, &markup_attrs, &plain_text, NULL, NULL))
+        {
+            PangoAttrList * attrs = pango_attr_list_copy(cache->attrs);
+            pango_attr_list_splice(attrs, markup_attrs, 0, 0);
+            gtk_label_set_attributes(GTK_LABEL(label), attrs);
+            gtk_label_set_text(GTK_LABEL(label), plain_text);
+            pango_attr_list_unref(attrs);
+            pango_attr_list_unref(markup_attrs);
+            g_free(plain_text);
+            return;
+        }
+        /* Invalid markup: display it as plain text. */
+        attrs_changed = TRUE;
+    }
 
+    if (attrs_changed)
+        gtk_label_set_attributes(GTK_LABEL(label), cache->attrs);
+    gtk_label_set_text(GTK_LABEL(label), text);
 }
 
 void panel_update_toplevel_alignment(Panel *p)
@@ -2061,6 +2433,8 @@ void panel_update_toplevel_alignment(Panel *p)
 
 static void panel_notify_plugins_on_configuration_change(Panel *p)
 {
+    wtl_control_emit("configuration", "%s", p->name);
+
     GList* l;
     for (l = p->plugins; l; l = l->next) {
         Plugin* pl = (Plugin*)l->data;
@@ -2118,6 +2492,9 @@ panel_parse_plugin(Panel *p, json_t * json_plugin)
     Plugin * plugin = NULL;
     gchar * type = NULL;
 
+    gint64 load_started = g_get_monotonic_time();
+    gint64 start_started = load_started;
+
     su_json_dot_get_string(json_plugin, "type", "", &type);
 
     if (su_str_empty(type) || !(plugin = plugin_load(type))) {
@@ -2135,6 +2512,8 @@ panel_parse_plugin(Panel *p, json_t * json_plugin)
     json_decref(plugin->json);
     plugin->json = json_incref(json_plugin);
 
+    start_started = g_get_monotonic_time();
+
     if (!plugin_start(plugin)) {
         su_print_error_message( "can't start plugin %s\n", type);
         goto error;
@@ -2142,6 +2521,14 @@ panel_parse_plugin(Panel *p, json_t * json_plugin)
 
     p->plugins = g_list_append(p->plugins, plugin);
 
+    plugin->load_time = start_started - load_started;
+    plugin->construct_time = g_get_monotonic_time() - start_started;
+
+    panel_profile_startup(load_started, "panel %s: plugin %s (load %.3f ms, construct %.3f ms)",
+        p->name, type,
+        plugin->load_time / 1000.0,
+        plugin->construct_time / 1000.0);
+
     g_free(type);
 
     return 1;
@@ -2149,6 +2536,7 @@ panel_parse_plugin(Panel *p, json_t * json_plugin)
  error:
     if (plugin != NULL)
         plugin_unload(plugin);
+    panel_profile_startup(load_started, "panel %s: plugin %s failed", p->name, type ? type : "(null)");
     g_free(type);
 
     return 0;
@@ -2164,41 +2552,61 @@ static gchar * format_json_error(const json_error_t * error, const char * source
     return result;
 }
 
-int panel_start(Panel *p, const char * configuration, const char * source)
+/* Read, parse and validate a panel configuration file.
+ * Does not touch GTK, so it can be run on the startup worker. */
+static json_t * panel_load_configuration(const char * config_file)
 {
+    gchar * configuration = NULL;
+
+    if (!g_file_get_contents(config_file, &configuration, NULL, NULL))
+        return NULL;
+
     json_error_t error;
     json_t * json = json_loads(configuration, 0, &error);
+    g_free(configuration);
+
     if (!json)
     {
-        gchar * error_message = format_json_error(&error, source);
+        gchar * error_message = format_json_error(&error, config_file);
         su_print_error_message("%s\n", error_message);
         g_free(error_message);
-        return 0;
+        return NULL;
     }
 
     if (!json_is_object(json))
     {
-        su_print_error_message("%s: toplevel item should be object\n", source);
+        su_print_error_message("%s: toplevel item should be object\n", config_file);
         json_decref(json);
-        return 0;
+        return NULL;
     }
 
-    json_decref(p->json);
-    p->json = json;
-
     json_t * json_global = json_object_get(json, "global");
     if (!json_is_object(json_global))
     {
-        su_print_error_message( "%s: configuration file must contain global section\n", source);
+        su_print_error_message( "%s: configuration file must contain global section\n", config_file);
     }
 
+    return json;
+}
+
+/* Apply the global configuration and show the panel frame. Plugins are started separately by panel_start_plugins(). */
+static int panel_start(Panel *p, json_t * json)
+{
+    json_decref(p->json);
+    p->json = json_incref(json);
+
     panel_read_global_configuration_from_json_object(p);
 
     panel_normalize_configuration(p);
 
     panel_start_gui(p);
 
-    json_t * json_plugins = json_object_get(json, "plugins");
+    return 1;
+}
+
+static void panel_start_plugins(Panel *p)
+{
+    json_t * json_plugins = json_object_get(p->json, "plugins");
 
     size_t index;
     json_t * json_plugin;
@@ -2208,8 +2616,6 @@ int panel_start(Panel *p, const char * configuration, const char * source)
 
     panel_update_toplevel_alignment(p);
     panel_update_background(p);
-
-    return 1;
 }
 
 static void
@@ -2220,6 +2626,8 @@ delete_plugin(gpointer data, gpointer udata)
 
 static void panel_destroy(Panel *p)
 {
+    panel_startup_forget_panel(p);
+
     json_decref(p->json);
 
     g_signal_handlers_disconnect_by_func(G_OBJECT(p->screen), panel_screen_monitors_changed_event, p);
@@ -2280,35 +2688,269 @@ static void panel_destroy(Panel *p)
     g_free(p);
 }
 
-static Panel * panel_new(const char * config_file, const char * config_name)
+/*= startup pipeline =*/
+
+/*
+ * Panels are started in three stages:
+ *
+ * 1. A worker thread reads, parses and validates all panel configurations,
+ *    then opens the dynamic plugin modules those configurations refer to.
+ * 2. The main loop keeps running meanwhile. As soon as the configurations
+ *    are parsed, the worker posts an idle callback, from which the main thread
+ *    creates and maps all panel frames, while the worker keeps loading modules.
+ * 3. When the worker is done, it posts another idle callback, which joins the
+ *    finished thread and registers the preloaded plugin classes. Then, from
+ *    idle callbacks, one panel per main loop iteration, the main thread
+ *    constructs the plugins.
+ */
+
+typedef struct {
+    gchar * name;
+    gchar * config_path;
+    json_t * json;          /* Filled by the worker */
+    Panel * panel;          /* Filled by the main thread in stage 2 */
+} PanelStartupConfig;
+
+typedef struct {
+    GList * configs;        /* PanelStartupConfig */
+    GList * preloads;       /* PluginPreload, filled by the worker */
+    GList * current;        /* Next config to start plugins for */
+    GThread * thread;
+    gboolean frames_shown;  /* Stage 2 is done */
+    gboolean modules_ready; /* The worker is done and its plugin classes are registered */
+    gboolean save_panels;
+    gint64 started;
+} PanelStartup;
+
+static PanelStartup * panel_startup = NULL;
+static guint panel_startup_idle = 0;
+
+static gboolean panel_startup_frames_idle(gpointer data);
+static gboolean panel_startup_worker_done_idle(gpointer data);
+
+static gpointer panel_startup_worker(PanelStartup * startup)
 {
-    gchar * fp;
+    GHashTable * types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-    if (!config_file)
-        return NULL;
+    GList * l;
+    for (l = startup->configs; l; l = l->next)
+    {
+        PanelStartupConfig * config = (PanelStartupConfig *) l->data;
+        gint64 started = g_get_monotonic_time();
 
-    g_file_get_contents(config_file, &fp, NULL, NULL);
-    if (!fp)
-        return NULL;
+        config->json = panel_load_configuration(config->config_path);
 
-    Panel* panel = panel_allocate();
-    panel->orientation = ORIENT_NONE;
-    panel->name = g_strdup(config_name);
+        panel_profile_startup(started, "[worker] panel %s: read and parse %s", config->name, config->config_path);
+
+        json_t * json_plugins = json_object_get(config->json, "plugins");
+        size_t index;
+        json_t * json_plugin;
+        json_array_foreach(json_plugins, index, json_plugin) {
+            const char * type = json_string_value(json_object_get(json_plugin, "type"));
+            if (!su_str_empty(type))
+                g_hash_table_insert(types, g_strdup(type), NULL);
+        }
+    }
 
-    panel->widget_name = g_strdup("PanelToplevel");
+    g_idle_add(panel_startup_frames_idle, startup);
 
-    if (!panel_start(panel, fp, config_file))
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, types);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
     {
-        su_print_error_message( "can't start panel\n");
-        panel_destroy(panel);
-        panel = NULL;
+        gint64 started = g_get_monotonic_time();
+        PluginPreload * preload = plugin_preload((const char *) key);
+        if (preload)
+        {
+            startup->preloads = g_list_prepend(startup->preloads, preload);
+            panel_profile_startup(started, "[worker] plugin module %s", (const char *) key);
+        }
     }
 
-    g_free(fp);
+    g_hash_table_destroy(types);
 
-    return panel;
+    g_idle_add(panel_startup_worker_done_idle, startup);
+
+    return NULL;
 }
 
+static void panel_startup_free(PanelStartup * startup)
+{
+    if (startup->thread)
+        g_thread_join(startup->thread);
+
+    g_list_foreach(startup->preloads, (GFunc) plugin_preload_free, NULL);
+    g_list_free(startup->preloads);
+
+    GList * l;
+    for (l = startup->configs; l; l = l->next)
+    {
+        PanelStartupConfig * config = (PanelStartupConfig *) l->data;
+        json_decref(config->json);
+        g_free(config->config_path);
+        g_free(config->name);
+        g_free(config);
+    }
+    g_list_free(startup->configs);
+
+    g_free(startup);
+}
+
+static gboolean panel_startup_plugins_idle(gpointer data)
+{
+    PanelStartup * startup = (PanelStartup *) data;
+
+    /* Start plugins for one panel per main loop iteration so that already started panels get painted. */
+    while (startup->current)
+    {
+        PanelStartupConfig * config = (PanelStartupConfig *) startup->current->data;
+        startup->current = startup->current->next;
+
+        /* The panel may have been deleted by the user in the meantime. */
+        if (!config->panel)
+            continue;
+
+        gint64 started = g_get_monotonic_time();
+        panel_start_plugins(config->panel);
+        if (startup->save_panels)
+            panel_save_configuration(config->panel);
+        panel_profile_startup(started, "panel %s: plugins", config->name);
+
+        return TRUE;
+    }
+
+    panel_profile_startup(startup->started, "all panels started");
+
+    panel_startup_idle = 0;
+    panel_startup = NULL;
+    panel_startup_free(startup);
+    return FALSE;
+}
+
+/* Called when a panel is destroyed, so that the startup does not try to construct its plugins. */
+static void panel_startup_forget_panel(Panel *p)
+{
+    if (!panel_startup)
+        return;
+
+    GList * l;
+    for (l = panel_startup->configs; l; l = l->next)
+    {
+        PanelStartupConfig * config = (PanelStartupConfig *) l->data;
+        if (config->panel == p)
+            config->panel = NULL;
+    }
+}
+
+/* Abort a startup still in progress, e.g. when restarting before all plugins have been constructed.
+ * Called after the main loop has quit, so waiting for the worker here does not hold up the panels. */
+static void panel_startup_cancel(void)
+{
+    if (panel_startup_idle)
+    {
+        g_source_remove(panel_startup_idle);
+        panel_startup_idle = 0;
+    }
+
+    if (panel_startup)
+    {
+        /* Once joined, the worker cannot post anything more; drop what it has posted already. */
+        if (panel_startup->thread)
+        {
+            g_thread_join(panel_startup->thread);
+            panel_startup->thread = NULL;
+        }
+        while (g_idle_remove_by_data(panel_startup))
+            ;
+
+        panel_startup_free(panel_startup);
+        panel_startup = NULL;
+    }
+}
+
+/* Stage 3 begins when both the frames are shown and the plugin classes are registered, in either order. */
+static void panel_startup_plugins(PanelStartup * startup)
+{
+    if (!startup->frames_shown || !startup->modules_ready)
+        return;
+
+    startup->current = startup->configs;
+    panel_startup_idle = g_idle_add(panel_startup_plugins_idle, startup);
+}
+
+/* Posted by the worker when it has loaded all modules. */
+static gboolean panel_startup_worker_done_idle(gpointer data)
+{
+    PanelStartup * startup = (PanelStartup *) data;
+
+    /* The worker returns right after posting this, so the join does not wait for any work. */
+    g_thread_join(startup->thread);
+    startup->thread = NULL;
+
+    gint64 started = g_get_monotonic_time();
+    g_list_foreach(startup->preloads, (GFunc) plugin_preload_finish, NULL);
+    g_list_free(startup->preloads);
+    startup->preloads = NULL;
+    panel_profile_startup(started, "register preloaded plugin classes");
+
+    startup->modules_ready = TRUE;
+    panel_startup_plugins(startup);
+    return FALSE;
+}
+
+/* Posted by the worker when it has parsed the configurations. */
+static gboolean panel_startup_frames_idle(gpointer data)
+{
+    PanelStartup * startup = (PanelStartup *) data;
+
+    /* Stage 2: show the panel frames. */
+    GList * l;
+    for (l = startup->configs; l; l = l->next)
+    {
+        PanelStartupConfig * config = (PanelStartupConfig *) l->data;
+        if (!config->json)
+            continue;
+
+        su_log_debug("loading panel %s from %s\n", config->name, config->config_path);
+
+        gint64 started = g_get_monotonic_time();
+
+        Panel * panel = panel_allocate();
+        panel->orientation = ORIENT_NONE;
+        panel->name = g_strdup(config->name);
+        panel->widget_name = g_strdup("PanelToplevel");
+
+        if (!panel_start(panel, config->json))
+        {
+            su_print_error_message( "can't start panel\n");
+            panel_destroy(panel);
+            continue;
+        }
+
+        config->panel = panel;
+        all_panels = g_slist_prepend(all_panels, panel);
+        wtl_control_emit("panel-added", "%s", panel->name);
+
+        panel_profile_startup(started, "panel %s: frame", config->name);
+    }
+
+    if (!all_panels)
+    {
+        su_print_error_message("No panels started. Creating an empty panel...\n");
+        create_empty_panel();
+    }
+
+    gdk_flush();
+
+    /* Stage 3: construct plugins from the main loop once the modules are loaded. */
+    startup->frames_shown = TRUE;
+    panel_startup_plugins(startup);
+    return FALSE;
+}
+
+/* Start all configured panels.
+ * Return FALSE if there is nothing to start; otherwise the panels appear from the main loop. */
 static gboolean start_all_panels(void)
 {
     gchar * panel_dir = wtl_get_config_path("panels", SU_PATH_CONFIG_USER);
@@ -2320,9 +2962,15 @@ static gboolean start_all_panels(void)
 
     if (!dir)
     {
+        g_free(panel_dir);
+        g_free(panel_dir_w);
         return all_panels != NULL;
     }
 
+    PanelStartup * startup = g_new0(PanelStartup, 1);
+    startup->save_panels = save_panels;
+    startup->started = g_get_monotonic_time();
+
     const gchar* file_name;
     while ((file_name = g_dir_read_name(dir)) != NULL)
     {
@@ -2330,23 +2978,11 @@ static gboolean start_all_panels(void)
             file_name[0] != '.' && /* Skip hidden files. */
             g_str_has_suffix(file_name, PANEL_FILE_SUFFIX))
         {
-            char* name = g_strdup(file_name);
-            name[strlen(name) - strlen(PANEL_FILE_SUFFIX)] = 0;
-
-            char* panel_config = g_build_filename( panel_dir, file_name, NULL );
-
-            su_log_debug("loading panel %s from %s\n", name, panel_config);
-
-            Panel* panel = panel_new( panel_config, name );
-            if (panel)
-            {
-                all_panels = g_slist_prepend(all_panels, panel);
-                if (save_panels)
-                    panel_save_configuration(panel);
-            }
-
-            g_free( panel_config );
-            g_free( name );
+            PanelStartupConfig * config = g_new0(PanelStartupConfig, 1);
+            config->name = g_strdup(file_name);
+            config->name[strlen(config->name) - strlen(PANEL_FILE_SUFFIX)] = 0;
+            config->config_path = g_build_filename( panel_dir, file_name, NULL );
+            startup->configs = g_list_prepend(startup->configs, config);
         }
     }
 
@@ -2354,7 +2990,23 @@ static gboolean start_all_panels(void)
     g_free(panel_dir);
     g_free(panel_dir_w);
 
-    return all_panels != NULL;
+    if (!startup->configs)
+    {
+        panel_startup_free(startup);
+        return all_panels != NULL;
+    }
+
+    /* Stage 1: parse configurations and preload plugin modules on the worker. */
+#if GLIB_CHECK_VERSION(2,32,0)
+    startup->thread = g_thread_new("panel-startup", (GThreadFunc) panel_startup_worker, startup);
+#else
+    startup->thread = g_thread_create((GThreadFunc) panel_startup_worker, startup, TRUE, NULL);
+#endif
+
+    /* Stages 2 and 3 run from idle callbacks the worker posts. */
+    panel_startup = startup;
+
+    return TRUE;
 }
 
 /******************************************************************************/
@@ -2471,6 +3123,8 @@ static void usage(gboolean error)
     print("\n");
     print("  --quit-in-menu     %s\n", _("Display 'quit' command in popup menu"));
     print("  --colormap <name>  %s\n", _("Force specified colormap (rgba, rgb, system, default)"));
+    print("  --profile-startup  %s\n", _("Print per-panel and per-plugin startup timing"));
+    print("  --event-stats      %s\n", _("Collect X event latency statistics (see waterlinectl event-stats)"));
     print("  --force-compositing-wm-disabled\n"
             "                     %s\n", _("Behave as if no compositing wm avaiable"));
     print("  --force-composite-disabled\n"
@@ -2498,6 +3152,8 @@ int main(int argc, char *argv[], char *env[])
 {
     int i;
 
+    profile_startup_origin = g_get_monotonic_time();
+
     _wtl_agent_id = su_path_resolve_agent_id_by_pointer(main, "waterline");
     su_path_register_default_agent_prefix(_wtl_agent_id, PACKAGE_INSTALLATION_PREFIX);
 
@@ -2558,6 +3214,10 @@ int main(int argc, char *argv[], char *env[])
             force_compositing_wm_disabled = TRUE;
         } else if (!strcmp(argv[i], "--force-composite-disabled")) {
             force_composite_disabled = TRUE;
+        } else if (!strcmp(argv[i], "--profile-startup")) {
+            profile_startup = TRUE;
+        } else if (!strcmp(argv[i], "--event-stats")) {
+            wtl_event_stats_enabled = TRUE;
         } else if (!strcmp(argv[i], "--glib-mem-profiler") || !strcmp(argv[i], "--glib_mem_profiler")) {
             /* nothing */
         } else if (!strcmp(argv[i], "--colormap")) {
@@ -2577,6 +3237,15 @@ int main(int argc, char *argv[], char *env[])
         exit(2);
     }
 
+    /* The X property interface stays available if the socket cannot be created,
+     * but a panel that answers on the socket means another instance runs on this display. */
+    gboolean control_in_use = FALSE;
+    wtl_control_start(gdk_display_get_name(gdk_display_get_default()), panel_control_request, &control_in_use);
+    if (control_in_use) {
+        printf("There is already an instance of waterline.  Now to exit\n");
+        exit(2);
+    }
+
     /* Add our own icons to the search path of icon theme */
     gchar * images_path = wtl_resolve_own_resource("", "images", 0);
     gtk_icon_theme_append_search_path(gtk_icon_theme_get_default(), images_path);
@@ -2604,6 +3273,8 @@ restart:
 
     gtk_main();
 
+    panel_startup_cancel();
+
     XSelectInput (wtl_x11_display(), wtl_x11_root(), NoEventMask);
     gdk_window_remove_filter(gdk_get_default_root_window (), (GdkFilterFunc)panel_event_filter, NULL);
 
@@ -2617,6 +3288,8 @@ restart:
     if( is_restarting )
         goto restart;
 
+    wtl_control_stop();
+
     g_object_unref(window_group);
     g_object_unref(fbev);
 
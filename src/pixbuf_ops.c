@@ -0,0 +1,451 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <cairo.h>
+
+#include <waterline/pixbuf_ops.h>
+
+/********************************************************************/
+
+/* Row kernels. They take plain arrays and keep the per-pixel work free of branches and function calls.
+ * Where SSE2 or NEON is available, the bulk of a row goes through intrinsics; the rest, and the whole row
+ * on other targets, goes through the scalar loop, which gcc and clang can still vectorize on their own.
+ * Both paths compute exactly the same values; tests/pixbuf_ops_test checks that.
+ * gcc only vectorizes loops at -O3 by default, so ask for it explicitly. */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define KERNEL __attribute__((optimize("tree-vectorize")))
+#else
+#define KERNEL
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#elif defined(__ARM_NEON) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+
+#ifdef USE_SSE2
+
+/* Swap bytes 0 and 2 of every 32-bit lane: RGBA <-> BGRA. */
+static inline __m128i sse2_swap_red_blue(__m128i v)
+{
+    __m128i rb = _mm_and_si128(v, _mm_set1_epi32(0x00FF00FF));
+    __m128i ag = _mm_and_si128(v, _mm_set1_epi32((int) 0xFF00FF00));
+    return _mm_or_si128(ag, _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16)));
+}
+
+/* c * a / 255 on 16-bit lanes, rounded the same way as mul_div_255(). */
+static inline __m128i sse2_mul_div_255(__m128i c, __m128i a)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* Premultiply two RGBA pixels held in 16-bit lanes; alpha is multiplied by 255, which leaves it as is. */
+static inline __m128i sse2_premultiply_2px(__m128i v)
+{
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i alpha_lane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    a = _mm_or_si128(_mm_andnot_si128(alpha_lane, a), _mm_and_si128(alpha_lane, _mm_set1_epi16(255)));
+    return sse2_mul_div_255(v, a);
+}
+
+/* Dim two RGBA pixels held in 16-bit lanes. */
+static inline __m128i sse2_dim_2px(__m128i v)
+{
+    /* The weighted sum is at most 255 * 256, so it fits in 16 bits. */
+    __m128i t = _mm_mullo_epi16(v, _mm_set_epi16(0, 28, 151, 77, 0, 28, 151, 77));
+    t = _mm_add_epi16(t, _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)));
+    t = _mm_add_epi16(t, _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128i gray = _mm_and_si128(_mm_srli_epi16(t, 8), _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1));
+    return _mm_srli_epi16(_mm_add_epi16(v, gray), 1);
+}
+
+#endif
+
+static KERNEL void blend_row(guchar * restrict dst, const guchar * restrict src1, const guchar * restrict src2,
+    int n, unsigned int weight)
+{
+    unsigned int inverse = 256 - weight;
+    int i = 0;
+
+#if defined(USE_SSE2)
+    /* At most 255 * 256, so the sums fit in 16 bits. */
+    __m128i zero = _mm_setzero_si128();
+    __m128i w1 = _mm_set1_epi16(inverse);
+    __m128i w2 = _mm_set1_epi16(weight);
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *) (src1 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (src2 + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w1),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w2));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w1),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w2));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#elif defined(USE_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t a = vld1q_u8(src1 + i);
+        uint8x16_t b = vld1q_u8(src2 + i);
+        uint16x8_t lo = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_low_u8(a)), inverse), vmovl_u8(vget_low_u8(b)), weight);
+        uint16x8_t hi = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_high_u8(a)), inverse), vmovl_u8(vget_high_u8(b)), weight);
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#endif
+
+    for (; i < n; i++)
+        dst[i] = (src1[i] * inverse + src2[i] * weight) >> 8;
+}
+
+static KERNEL void highlight_row(guchar * restrict p, int width, unsigned int r, unsigned int g, unsigned int b)
+{
+    int i = 0;
+
+#if defined(USE_SSE2)
+    __m128i color = _mm_set1_epi32((int) (r | (g << 8) | (b << 16)));
+    __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    for (; i + 4 <= width; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i * 4));
+        __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(v, alpha), _mm_setzero_si128());
+        v = _mm_adds_epu8(v, _mm_andnot_si128(transparent, color));
+        _mm_storeu_si128((__m128i *) (p + i * 4), v);
+    }
+#elif defined(USE_NEON)
+    uint8x8_t vr = vdup_n_u8(r), vg = vdup_n_u8(g), vb = vdup_n_u8(b);
+    for (; i + 8 <= width; i += 8)
+    {
+        uint8x8x4_t px = vld4_u8(p + i * 4);
+        uint8x8_t mask = vtst_u8(px.val[3], px.val[3]);
+        px.val[0] = vqadd_u8(px.val[0], vand_u8(vr, mask));
+        px.val[1] = vqadd_u8(px.val[1], vand_u8(vg, mask));
+        px.val[2] = vqadd_u8(px.val[2], vand_u8(vb, mask));
+        vst4_u8(p + i * 4, px);
+    }
+#endif
+
+    for (; i < width; i++)
+    {
+        guchar * px = p + i * 4;
+        unsigned int mask = px[3] ? 0xFF : 0;
+        unsigned int vr = px[0] + (r & mask);
+        unsigned int vg = px[1] + (g & mask);
+        unsigned int vb = px[2] + (b & mask);
+        px[0] = vr > 255 ? 255 : vr;
+        px[1] = vg > 255 ? 255 : vg;
+        px[2] = vb > 255 ? 255 : vb;
+    }
+}
+
+static KERNEL void dim_row(guchar * restrict p, int width)
+{
+    int i = 0;
+
+#if defined(USE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= width; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i * 4));
+        __m128i lo = sse2_dim_2px(_mm_unpacklo_epi8(v, zero));
+        __m128i hi = sse2_dim_2px(_mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i *) (p + i * 4), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(USE_NEON)
+    for (; i + 8 <= width; i += 8)
+    {
+        uint8x8x4_t px = vld4_u8(p + i * 4);
+        uint16x8_t sum = vmull_u8(px.val[0], vdup_n_u8(77));
+        sum = vmlal_u8(sum, px.val[1], vdup_n_u8(151));
+        sum = vmlal_u8(sum, px.val[2], vdup_n_u8(28));
+        uint8x8_t gray = vshrn_n_u16(sum, 8);
+        px.val[0] = vhadd_u8(px.val[0], gray);
+        px.val[1] = vhadd_u8(px.val[1], gray);
+        px.val[2] = vhadd_u8(px.val[2], gray);
+        px.val[3] = vshr_n_u8(px.val[3], 1);
+        vst4_u8(p + i * 4, px);
+    }
+#endif
+
+    for (; i < width; i++)
+    {
+        guchar * px = p + i * 4;
+        unsigned int gray = (px[0] * 77 + px[1] * 151 + px[2] * 28) >> 8;
+        px[0] = (px[0] + gray) >> 1;
+        px[1] = (px[1] + gray) >> 1;
+        px[2] = (px[2] + gray) >> 1;
+        px[3] = px[3] >> 1;
+    }
+}
+
+/* c * a / 255, rounded, without a division. */
+static inline unsigned int mul_div_255(unsigned int c, unsigned int a)
+{
+    unsigned int t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#ifdef USE_NEON
+static inline uint8x8_t neon_mul_div_255(uint8x8_t c, uint8x8_t a)
+{
+    uint16x8_t t = vaddq_u16(vmull_u8(c, a), vdupq_n_u16(128));
+    return vshrn_n_u16(vsraq_n_u16(t, t, 8), 8);
+}
+#endif
+
+/* Convert RGBA to premultiplied native-endian 0xAARRGGBB, the layout of CAIRO_FORMAT_ARGB32. */
+static KERNEL void premultiply_row(guint32 * restrict dst, const guchar * restrict src, int width)
+{
+    int i = 0;
+
+#if defined(USE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= width; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+        __m128i lo = sse2_premultiply_2px(_mm_unpacklo_epi8(v, zero));
+        __m128i hi = sse2_premultiply_2px(_mm_unpackhi_epi8(v, zero));
+        /* x86 is little-endian: 0xAARRGGBB is stored as B, G, R, A. */
+        _mm_storeu_si128((__m128i *) (dst + i), sse2_swap_red_blue(_mm_packus_epi16(lo, hi)));
+    }
+#elif defined(USE_NEON)
+    for (; i + 8 <= width; i += 8)
+    {
+        uint8x8x4_t px = vld4_u8(src + i * 4);
+        uint8x8x4_t out;
+        out.val[0] = neon_mul_div_255(px.val[2], px.val[3]);
+        out.val[1] = neon_mul_div_255(px.val[1], px.val[3]);
+        out.val[2] = neon_mul_div_255(px.val[0], px.val[3]);
+        out.val[3] = px.val[3];
+        vst4_u8((guchar *) (dst + i), out);
+    }
+#endif
+
+    for (; i < width; i++)
+    {
+        const guchar * px = src + i * 4;
+        unsigned int a = px[3];
+        dst[i] = (a << 24) | (mul_div_255(px[0], a) << 16) | (mul_div_255(px[1], a) << 8) | mul_div_255(px[2], a);
+    }
+}
+
+static KERNEL void argb_unpack_row(guchar * restrict dst, const gulong * restrict src, int width)
+{
+    int i = 0;
+
+#if defined(USE_SSE2)
+    for (; i + 4 <= width; i += 4)
+    {
+#if GLIB_SIZEOF_LONG == 8
+        /* Keep the low halves of the longs. */
+        __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (src + i)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (src + i + 2)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i v = _mm_unpacklo_epi64(a, b);
+#else
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+#endif
+        _mm_storeu_si128((__m128i *) (dst + i * 4), sse2_swap_red_blue(v));
+    }
+#elif defined(USE_NEON)
+    for (; i + 4 <= width; i += 4)
+    {
+#if GLIB_SIZEOF_LONG == 8
+        uint32x4_t v = vcombine_u32(vmovn_u64(vld1q_u64((const uint64_t *) (src + i))),
+                                    vmovn_u64(vld1q_u64((const uint64_t *) (src + i + 2))));
+#else
+        uint32x4_t v = vld1q_u32((const uint32_t *) (src + i));
+#endif
+        uint32x4_t rb = vandq_u32(v, vdupq_n_u32(0x00FF00FF));
+        uint32x4_t ag = vandq_u32(v, vdupq_n_u32(0xFF00FF00));
+        v = vorrq_u32(ag, vorrq_u32(vshlq_n_u32(rb, 16), vshrq_n_u32(rb, 16)));
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(v));
+    }
+#endif
+
+    for (; i < width; i++)
+    {
+        guint32 argb = (guint32) src[i];
+        dst[i * 4 + 0] = argb >> 16;
+        dst[i * 4 + 1] = argb >> 8;
+        dst[i * 4 + 2] = argb;
+        dst[i * 4 + 3] = argb >> 24;
+    }
+}
+
+/********************************************************************/
+
+static gboolean pixbuf_is_rgba(GdkPixbuf * pixbuf)
+{
+    return gdk_pixbuf_get_colorspace(pixbuf) == GDK_COLORSPACE_RGB
+        && gdk_pixbuf_get_bits_per_sample(pixbuf) == 8
+        && gdk_pixbuf_get_n_channels(pixbuf) == 4;
+}
+
+/* Get a new reference to an RGBA version of the pixbuf, so that the kernels need not care about channel counts. */
+static GdkPixbuf * pixbuf_ref_rgba(GdkPixbuf * pixbuf)
+{
+    if (!pixbuf)
+        return NULL;
+    if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB
+    ||  gdk_pixbuf_get_bits_per_sample(pixbuf) != 8)
+        return NULL;
+    if (gdk_pixbuf_get_n_channels(pixbuf) == 4)
+        return g_object_ref(pixbuf);
+    return gdk_pixbuf_add_alpha(pixbuf, FALSE, 0, 0, 0);
+}
+
+/********************************************************************/
+
+GdkPixbuf * wtl_pixbuf_blend(GdkPixbuf * src1, GdkPixbuf * src2, float level)
+{
+    GdkPixbuf * rgba1 = pixbuf_ref_rgba(src1);
+    GdkPixbuf * rgba2 = pixbuf_ref_rgba(src2);
+    GdkPixbuf * dst = NULL;
+
+    if (!rgba1 || !rgba2)
+        goto out;
+
+    int w = MIN(gdk_pixbuf_get_width(rgba1), gdk_pixbuf_get_width(rgba2));
+    int h = MIN(gdk_pixbuf_get_height(rgba1), gdk_pixbuf_get_height(rgba2));
+
+    dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w, h);
+    if (!dst)
+        goto out;
+
+    if (level < 0)
+        level = 0;
+    if (level > 1)
+        level = 1;
+    unsigned int weight = level * 256 + 0.5;
+
+    guchar * dst_pixels = gdk_pixbuf_get_pixels(dst);
+    const guchar * src1_pixels = gdk_pixbuf_get_pixels(rgba1);
+    const guchar * src2_pixels = gdk_pixbuf_get_pixels(rgba2);
+    int dst_stride = gdk_pixbuf_get_rowstride(dst);
+    int src1_stride = gdk_pixbuf_get_rowstride(rgba1);
+    int src2_stride = gdk_pixbuf_get_rowstride(rgba2);
+
+    int y;
+    for (y = 0; y < h; y++)
+        blend_row(dst_pixels + y * dst_stride, src1_pixels + y * src1_stride, src2_pixels + y * src2_stride, w * 4, weight);
+
+out:
+    if (rgba1)
+        g_object_unref(rgba1);
+    if (rgba2)
+        g_object_unref(rgba2);
+    return dst;
+}
+
+GdkPixbuf * wtl_pixbuf_highlight(GdkPixbuf * src, gulong color)
+{
+    if (!src)
+        return NULL;
+    if (gdk_pixbuf_get_colorspace(src) != GDK_COLORSPACE_RGB
+    ||  gdk_pixbuf_get_bits_per_sample(src) != 8)
+        return NULL;
+
+    /* Always a copy, even if src already has alpha. */
+    GdkPixbuf * pixbuf = gdk_pixbuf_add_alpha(src, FALSE, 0, 0, 0);
+    if (!pixbuf)
+        return NULL;
+
+    guchar * pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int stride = gdk_pixbuf_get_rowstride(pixbuf);
+    int w = gdk_pixbuf_get_width(pixbuf);
+    int h = gdk_pixbuf_get_height(pixbuf);
+
+    int y;
+    for (y = 0; y < h; y++)
+        highlight_row(pixels + y * stride, w, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+
+    return pixbuf;
+}
+
+void wtl_pixbuf_dim(GdkPixbuf * pixbuf)
+{
+    if (!pixbuf || !pixbuf_is_rgba(pixbuf))
+        return;
+
+    guchar * pixels = gdk_pixbuf_get_pixels(pixbuf);
+    int stride = gdk_pixbuf_get_rowstride(pixbuf);
+    int w = gdk_pixbuf_get_width(pixbuf);
+    int h = gdk_pixbuf_get_height(pixbuf);
+
+    int y;
+    for (y = 0; y < h; y++)
+        dim_row(pixels + y * stride, w);
+}
+
+cairo_surface_t * wtl_pixbuf_create_surface(GdkPixbuf * pixbuf)
+{
+    GdkPixbuf * rgba = pixbuf_ref_rgba(pixbuf);
+    if (!rgba)
+        return NULL;
+
+    int w = gdk_pixbuf_get_width(rgba);
+    int h = gdk_pixbuf_get_height(rgba);
+    cairo_surface_t * surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(surface);
+        g_object_unref(rgba);
+        return NULL;
+    }
+
+    cairo_surface_flush(surface);
+
+    guchar * dst_pixels = cairo_image_surface_get_data(surface);
+    int dst_stride = cairo_image_surface_get_stride(surface);
+    const guchar * src_pixels = gdk_pixbuf_get_pixels(rgba);
+    int src_stride = gdk_pixbuf_get_rowstride(rgba);
+
+    int y;
+    for (y = 0; y < h; y++)
+        premultiply_row((guint32 *) (dst_pixels + y * dst_stride), src_pixels + y * src_stride, w);
+
+    cairo_surface_mark_dirty(surface);
+    g_object_unref(rgba);
+    return surface;
+}
+
+GdkPixbuf * wtl_pixbuf_new_from_argb(const gulong * data, int width, int height)
+{
+    if (!data || width <= 0 || height <= 0)
+        return NULL;
+
+    guchar * pixels = g_new(guchar, (gsize) width * height * 4);
+    argb_unpack_row(pixels, data, width * height);
+
+    return gdk_pixbuf_new_from_data(
+        pixels,
+        GDK_COLORSPACE_RGB,
+        TRUE, 8, /* has_alpha, bits_per_sample */
+        width, height, width * 4,
+        (GdkPixbufDestroyNotify) g_free,
+        NULL);
+}
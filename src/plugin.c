@@ -28,24 +28,36 @@
 #include <gdk/gdk.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <waterline/paths.h>
 #include <waterline/misc.h>
 #include "bg.h"
 #include "panel_internal.h"
 #include "panel_private.h"
+#include "event_stats.h"
 
 #include <glib/gi18n.h>
 #include <glib-object.h>
 
-static GList * pcl = NULL; /* List of PluginClass structures */
+static GHashTable * plugin_classes = NULL; /* Registered PluginClass structures keyed by case-folded type */
 
 static PluginClass * register_plugin_class(PluginClass * pc, gboolean dynamic);
 static void init_plugin_class_list(void);
 static PluginClass * plugin_find_class(const char * type);
+static GModule * plugin_open_dynamic(const char * type, const gchar * path, PluginClass ** ppc);
 static PluginClass * plugin_load_dynamic(const char * type, const gchar * path);
 static void plugin_class_unref(PluginClass * pc);
 
+/* A dynamic plugin module opened and validated, but not registered yet. */
+struct _PluginPreload {
+    gchar * type;
+    GModule * gmodule;
+    PluginClass * pc;
+};
+
 /* Dynamic parameter for static (built-in) plugins must be FALSE so we will not try to unload them */
 #define REGISTER_STATIC_PLUGIN_CLASS(pc) \
 do {\
@@ -64,7 +76,7 @@ static PluginClass * register_plugin_class(PluginClass * pc, gboolean dynamic)
     memcpy(pc1, pc, pc->structure_actual_size);
     pc = pc1;
 
-    pcl = g_list_append(pcl, pc);
+    g_hash_table_insert(plugin_classes, g_ascii_strdown(pc->type, -1), pc);
     pc->dynamic = dynamic;
     pc->internal = g_new0(PluginClassInternal, 1);
 
@@ -74,6 +86,8 @@ static PluginClass * register_plugin_class(PluginClass * pc, gboolean dynamic)
 /* Initialize the static plugins. */
 static void init_plugin_class_list(void)
 {
+    plugin_classes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
 #ifndef DISABLE_MENU
 #ifdef STATIC_LAUNCHBAR
     REGISTER_STATIC_PLUGIN_CLASS(launchbar_plugin_class);
@@ -106,18 +120,18 @@ static void init_plugin_class_list(void)
 /* Look up a plugin class by name. */
 static PluginClass * plugin_find_class(const char * type)
 {
-    GList * tmp;
-    for (tmp = pcl; tmp != NULL; tmp = g_list_next(tmp))
-    {
-        PluginClass * pc = (PluginClass *) tmp->data;
-        if (g_ascii_strcasecmp(type, pc->type) == 0)
-            return pc;
-    }
-    return NULL;
+    if (plugin_classes == NULL)
+        return NULL;
+
+    gchar * key = g_ascii_strdown(type, -1);
+    PluginClass * pc = (PluginClass *) g_hash_table_lookup(plugin_classes, key);
+    g_free(key);
+    return pc;
 }
 
-/* Load a dynamic plugin. */
-static PluginClass * plugin_load_dynamic(const char * type, const gchar * path)
+/* Open a dynamic plugin module and validate its PluginClass.
+ * Does not touch the class list, so it is safe to call from a worker thread. */
+static GModule * plugin_open_dynamic(const char * type, const gchar * path, PluginClass ** ppc)
 {
     PluginClass * pc = NULL;
 
@@ -180,13 +194,10 @@ static PluginClass * plugin_load_dynamic(const char * type, const gchar * path)
         goto err;
     }
 
-    /* Register the newly loaded and valid plugin. */
-    pc = register_plugin_class(pc, TRUE);
-    pc->internal->gmodule = m;
-
     g_free(class_name);
 
-    return pc;
+    *ppc = pc;
+    return m;
 
 err:
     if (m)
@@ -195,17 +206,120 @@ err:
     return NULL;
 }
 
+/* Load a dynamic plugin. */
+static PluginClass * plugin_load_dynamic(const char * type, const gchar * path)
+{
+    PluginClass * pc = NULL;
+    GModule * m = plugin_open_dynamic(type, path, &pc);
+    if (!m)
+        return NULL;
+
+    /* Register the newly loaded and valid plugin. */
+    pc = register_plugin_class(pc, TRUE);
+    pc->internal->gmodule = m;
+
+    return pc;
+}
+
+/* Open a dynamic plugin module ahead of its first instantiation.
+ * Only dlopen()s and validates the module; may be called from any thread.
+ * Returns NULL if there is no such module (e.g. the plugin is built-in). */
+PluginPreload * plugin_preload(const char * type)
+{
+#ifndef DISABLE_PLUGINS_LOADING
+    if (!g_module_supported())
+        return NULL;
+
+    gchar * soname = g_strdup_printf("%s.so", type);
+    gchar * path = wtl_resolve_own_resource("lib", "plugins", soname, 0);
+    g_free(soname);
+
+    if (!path || !g_file_test(path, G_FILE_TEST_IS_REGULAR))
+    {
+        g_free(path);
+        return NULL;
+    }
+
+    PluginClass * pc = NULL;
+    GModule * m = plugin_open_dynamic(type, path, &pc);
+    g_free(path);
+    if (!m)
+        return NULL;
+
+    PluginPreload * preload = g_new0(PluginPreload, 1);
+    preload->type = g_strdup(type);
+    preload->gmodule = m;
+    preload->pc = pc;
+    return preload;
+#else
+    return NULL;
+#endif
+}
+
+/* Register a preloaded plugin class and free the preload record.
+ * Must be called from the main thread. */
+void plugin_preload_finish(PluginPreload * preload)
+{
+    if (!preload)
+        return;
+
+    /* Initialize static plugins on first call. */
+    if (plugin_classes == NULL)
+        init_plugin_class_list();
+
+    if (plugin_find_class(preload->type) == NULL)
+    {
+        PluginClass * pc = register_plugin_class(preload->pc, TRUE);
+        pc->internal->gmodule = preload->gmodule;
+    }
+    else
+    {
+        g_module_close(preload->gmodule);
+    }
+
+    g_free(preload->type);
+    g_free(preload);
+}
+
+/* Drop a preloaded module without registering it. */
+void plugin_preload_free(PluginPreload * preload)
+{
+    if (!preload)
+        return;
+
+    g_module_close(preload->gmodule);
+    g_free(preload->type);
+    g_free(preload);
+}
+
 /* Unreference a dynamic plugin. */
 static void plugin_class_unref(PluginClass * pc)
 {
     pc->internal->count -= 1;
 
+    /* Stubs made from the manifest own their strings and are never registered. */
+    if (pc->internal->stub)
+    {
+        if (pc->internal->count == 0)
+        {
+            g_free(pc->type);
+            g_free(pc->name);
+            g_free(pc->version);
+            g_free(pc->description);
+            g_free(pc->internal);
+            g_free(pc);
+        }
+        return;
+    }
+
     /* If the reference count drops to zero, unload the plugin if it is dynamic and has declared itself unloadable. */
     if ((pc->internal->count == 0)
     && (pc->dynamic)
     && ( ! pc->not_unloadable))
     {
-        pcl = g_list_remove(pcl, pc);
+        gchar * key = g_ascii_strdown(pc->type, -1);
+        g_hash_table_remove(plugin_classes, key);
+        g_free(key);
         PluginClassInternal * internal = pc->internal;
         g_module_close(internal->gmodule);
         g_free(internal);
@@ -213,12 +327,597 @@ static void plugin_class_unref(PluginClass * pc)
     }
 }
 
+/******************************************************************************/
+
+/*= plugin manifest =*/
+
+/* Metadata of the dynamic plugin modules, cached on disk so that listing the
+ * available plugins does not require dlopen()ing every module. A module is
+ * opened again only if its file has changed since the entry was made. */
+
+#define PLUGIN_MANIFEST_VERSION 1
+
+typedef struct {
+    gchar * type;
+    gchar * path;
+    gint64 mtime;
+    gint64 size;
+    gboolean valid;             /* FALSE if the module failed to load; keeps us from retrying it */
+    gchar * name;
+    gchar * version;
+    gchar * description;
+    int category;
+    gboolean one_per_system;
+    gboolean expand_available;
+    gboolean expand_default;
+} PluginManifestEntry;
+
+static GHashTable * plugin_manifest = NULL; /* PluginManifestEntry structures keyed by case-folded type */
+
+static void plugin_manifest_entry_free(PluginManifestEntry * entry)
+{
+    g_free(entry->type);
+    g_free(entry->path);
+    g_free(entry->name);
+    g_free(entry->version);
+    g_free(entry->description);
+    g_free(entry);
+}
+
+static void plugin_manifest_entry_fill(PluginManifestEntry * entry, PluginClass * pc)
+{
+    g_free(entry->name);
+    g_free(entry->version);
+    g_free(entry->description);
+
+    entry->valid = TRUE;
+    entry->name = g_strdup(pc->name);
+    entry->version = g_strdup(pc->version);
+    entry->description = g_strdup(pc->description);
+    entry->category = pc->category;
+    entry->one_per_system = pc->one_per_system;
+    entry->expand_available = pc->expand_available;
+    entry->expand_default = pc->expand_default;
+}
+
+static gchar * plugin_manifest_path(void)
+{
+    return g_build_filename(g_get_user_cache_dir(), "sde", "waterline", "plugins.json", NULL);
+}
+
+static void plugin_manifest_read(void)
+{
+    plugin_manifest = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, (GDestroyNotify) plugin_manifest_entry_free);
+
+    gchar * path = plugin_manifest_path();
+    json_t * json = json_load_file(path, 0, NULL);
+    g_free(path);
+
+    if (!json)
+        return;
+
+    json_t * json_plugins = json_object_get(json, "plugins");
+    if (su_json_dot_get_int(json, "version", 0) != PLUGIN_MANIFEST_VERSION || !json_is_array(json_plugins))
+    {
+        json_decref(json);
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < json_array_size(json_plugins); i++)
+    {
+        json_t * json_entry = json_array_get(json_plugins, i);
+
+        PluginManifestEntry * entry = g_new0(PluginManifestEntry, 1);
+        su_json_dot_get_string(json_entry, "type", "", &entry->type);
+        su_json_dot_get_string(json_entry, "path", "", &entry->path);
+        entry->mtime = json_integer_value(json_object_get(json_entry, "mtime"));
+        entry->size = json_integer_value(json_object_get(json_entry, "size"));
+        entry->valid = su_json_dot_get_bool(json_entry, "valid", FALSE);
+        if (entry->valid)
+        {
+            su_json_dot_get_string(json_entry, "name", "", &entry->name);
+            su_json_dot_get_string(json_entry, "version", "", &entry->version);
+            su_json_dot_get_string(json_entry, "description", "", &entry->description);
+            entry->category = su_json_dot_get_int(json_entry, "category", 0);
+            entry->one_per_system = su_json_dot_get_bool(json_entry, "one_per_system", FALSE);
+            entry->expand_available = su_json_dot_get_bool(json_entry, "expand_available", FALSE);
+            entry->expand_default = su_json_dot_get_bool(json_entry, "expand_default", FALSE);
+        }
+
+        if (su_str_empty(entry->type) || su_str_empty(entry->path))
+        {
+            plugin_manifest_entry_free(entry);
+            continue;
+        }
+
+        g_hash_table_replace(plugin_manifest, g_ascii_strdown(entry->type, -1), entry);
+    }
+
+    json_decref(json);
+}
+
+static void plugin_manifest_write(void)
+{
+    json_t * json = json_object();
+    json_t * json_plugins = json_array();
+    su_json_dot_set_int(json, "version", PLUGIN_MANIFEST_VERSION);
+    json_object_set_new(json, "plugins", json_plugins);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, plugin_manifest);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        PluginManifestEntry * entry = (PluginManifestEntry *) value;
+        json_t * json_entry = json_object();
+        su_json_dot_set_string(json_entry, "type", entry->type);
+        su_json_dot_set_string(json_entry, "path", entry->path);
+        json_object_set_new(json_entry, "mtime", json_integer(entry->mtime));
+        json_object_set_new(json_entry, "size", json_integer(entry->size));
+        su_json_dot_set_bool(json_entry, "valid", entry->valid);
+        if (entry->valid)
+        {
+            su_json_dot_set_string(json_entry, "name", entry->name ? entry->name : "");
+            su_json_dot_set_string(json_entry, "version", entry->version ? entry->version : "");
+            su_json_dot_set_string(json_entry, "description", entry->description ? entry->description : "");
+            su_json_dot_set_int(json_entry, "category", entry->category);
+            su_json_dot_set_bool(json_entry, "one_per_system", entry->one_per_system);
+            su_json_dot_set_bool(json_entry, "expand_available", entry->expand_available);
+            su_json_dot_set_bool(json_entry, "expand_default", entry->expand_default);
+        }
+        json_array_append_new(json_plugins, json_entry);
+    }
+
+    /* Write to a temporary file and rename it, so that a concurrently starting panel never sees a partial file. */
+    gchar * path = plugin_manifest_path();
+    gchar * dir = g_path_get_dirname(path);
+    gchar * tmp_path = g_strdup_printf("%s.%d", path, (int) getpid());
+    g_mkdir_with_parents(dir, 0700);
+    if (json_dump_file(json, tmp_path, JSON_INDENT(4)) == 0)
+    {
+        if (rename(tmp_path, path) != 0)
+            unlink(tmp_path);
+    }
+    g_free(tmp_path);
+    g_free(dir);
+    g_free(path);
+
+    json_decref(json);
+}
+
+/* Bring the manifest in sync with the plugin directory.
+ * Only modules which are new or have changed on disk are opened. */
+static void plugin_manifest_refresh(void)
+{
+#ifndef DISABLE_PLUGINS_LOADING
+    if (!g_module_supported())
+        return;
+
+    if (plugin_manifest == NULL)
+        plugin_manifest_read();
+
+    gchar * plugin_dir = wtl_resolve_own_resource("lib", "plugins", 0);
+    GDir * dir = plugin_dir ? g_dir_open(plugin_dir, 0, NULL) : NULL;
+    if (dir == NULL)
+    {
+        g_free(plugin_dir);
+        return;
+    }
+
+    gboolean changed = FALSE;
+    GHashTable * seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    const char * file;
+    while ((file = g_dir_read_name(dir)) != NULL)
+    {
+        if (!g_str_has_suffix(file, ".so"))
+            continue;
+
+        gchar * path = g_build_filename(plugin_dir, file, NULL);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            g_free(path);
+            continue;
+        }
+
+        gchar * type = g_strndup(file, strlen(file) - 3);
+        gchar * key = g_ascii_strdown(type, -1);
+        g_hash_table_replace(seen, g_strdup(key), NULL);
+
+        PluginManifestEntry * entry = (PluginManifestEntry *) g_hash_table_lookup(plugin_manifest, key);
+        if (entry
+        && strcmp(entry->path, path) == 0
+        && entry->mtime == (gint64) st.st_mtime
+        && entry->size == (gint64) st.st_size)
+        {
+            g_free(key);
+            g_free(type);
+            g_free(path);
+            continue;
+        }
+
+        if (!entry)
+        {
+            entry = g_new0(PluginManifestEntry, 1);
+            g_hash_table_replace(plugin_manifest, g_strdup(key), entry);
+        }
+
+        g_free(entry->type);
+        g_free(entry->path);
+        entry->type = g_strdup(type);
+        entry->path = g_strdup(path);
+        entry->mtime = st.st_mtime;
+        entry->size = st.st_size;
+        entry->valid = FALSE;
+        changed = TRUE;
+
+        PluginClass * pc = plugin_find_class(type);
+        if (pc != NULL)
+        {
+            plugin_manifest_entry_fill(entry, pc);
+        }
+        else
+        {
+            GModule * m = plugin_open_dynamic(type, path, &pc);
+            if (m)
+            {
+                plugin_manifest_entry_fill(entry, pc);
+                if (pc->not_unloadable)
+                {
+                    /* Closing it would be unsafe; keep it registered instead. */
+                    pc = register_plugin_class(pc, TRUE);
+                    pc->internal->gmodule = m;
+                }
+                else
+                {
+                    g_module_close(m);
+                }
+            }
+        }
+
+        g_free(key);
+        g_free(type);
+        g_free(path);
+    }
+    g_dir_close(dir);
+    g_free(plugin_dir);
+
+    /* Drop the entries for the modules which have gone away. */
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, plugin_manifest);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        if (!g_hash_table_lookup_extended(seen, key, NULL, NULL))
+        {
+            g_hash_table_iter_remove(&iter);
+            changed = TRUE;
+        }
+    }
+    g_hash_table_destroy(seen);
+
+    if (changed)
+        plugin_manifest_write();
+#endif
+}
+
+/* Make an unloaded PluginClass describing a manifest entry. */
+static PluginClass * plugin_manifest_entry_to_stub(PluginManifestEntry * entry)
+{
+    PluginClass * pc = g_new0(PluginClass, 1);
+    pc->internal = g_new0(PluginClassInternal, 1);
+    pc->internal->stub = TRUE;
+    pc->internal->count = 1;
+    pc->dynamic = TRUE;
+    pc->one_per_system = entry->one_per_system;
+    pc->expand_available = entry->expand_available;
+    pc->expand_default = entry->expand_default;
+    pc->type = g_strdup(entry->type);
+    pc->name = g_strdup(entry->name);
+    pc->version = g_strdup(entry->version);
+    pc->description = su_str_empty(entry->description) ? NULL : g_strdup(entry->description);
+    pc->category = entry->category;
+    return pc;
+}
+
+/******************************************************************************/
+
+/*= callback accounting =*/
+
+typedef struct {
+    PluginTiming * timing;
+    PluginTimingKind kind;
+    GSourceFunc func;
+    gpointer data;
+    GDestroyNotify notify;
+} PluginSourceRecord;
+
+typedef struct {
+    PluginTiming * timing;
+    GdkFilterFunc func;
+    gpointer data;
+    const gchar * stats_name;   /* Name in the event statistics; interned, so it stays valid after the record is freed */
+} PluginFilterRecord;
+
+typedef struct {
+    PluginTiming * timing;
+    PluginTimingKind kind;
+    int depth;                  /* Handlers may be reentered; only the outermost call is timed */
+    gint64 started;
+} PluginClosureGuard;
+
+static PluginTiming * plugin_timing_new(void)
+{
+    PluginTiming * timing = g_new0(PluginTiming, 1);
+    timing->refcount = 1;
+    timing->started = g_get_monotonic_time();
+    return timing;
+}
+
+static PluginTiming * plugin_timing_ref(PluginTiming * timing)
+{
+    timing->refcount++;
+    return timing;
+}
+
+static void plugin_timing_unref(PluginTiming * timing)
+{
+    if (--timing->refcount == 0)
+        g_free(timing);
+}
+
+static void plugin_timing_account(PluginTiming * timing, PluginTimingKind kind, gint64 started)
+{
+    gint64 elapsed = g_get_monotonic_time() - started;
+    PluginTimingCounter * counter = &timing->counters[kind];
+    counter->calls++;
+    counter->total_time += elapsed;
+    if (elapsed > counter->max_time)
+        counter->max_time = elapsed;
+}
+
+/* Move the wakeup window forward to the given second, clearing the buckets of the seconds that have passed. */
+static void plugin_timing_advance_wakeups(PluginTiming * timing, gint64 second)
+{
+    gint64 gap = second - timing->wakeup_second;
+    if (gap <= 0)
+        return;
+
+    if (gap >= PLUGIN_WAKEUP_WINDOW)
+        memset(timing->wakeup_buckets, 0, sizeof(timing->wakeup_buckets));
+    else
+    {
+        gint64 s;
+        for (s = timing->wakeup_second + 1; s <= second; s++)
+            timing->wakeup_buckets[s % PLUGIN_WAKEUP_WINDOW] = 0;
+    }
+    timing->wakeup_second = second;
+}
+
+static void plugin_timing_count_wakeup(PluginTiming * timing)
+{
+    gint64 second = g_get_monotonic_time() / G_USEC_PER_SEC;
+    plugin_timing_advance_wakeups(timing, second);
+    timing->wakeup_buckets[second % PLUGIN_WAKEUP_WINDOW]++;
+    timing->wakeups++;
+}
+
+static gboolean plugin_source_dispatch(gpointer data)
+{
+    /* GLib keeps the callback data alive until we return, even if the source removes itself. */
+    PluginSourceRecord * record = (PluginSourceRecord *) data;
+    plugin_timing_count_wakeup(record->timing);
+    gint64 started = g_get_monotonic_time();
+    gboolean result = record->func(record->data);
+    plugin_timing_account(record->timing, record->kind, started);
+    return result;
+}
+
+static void plugin_source_record_free(gpointer data)
+{
+    PluginSourceRecord * record = (PluginSourceRecord *) data;
+    if (record->notify)
+        record->notify(record->data);
+    plugin_timing_unref(record->timing);
+    g_free(record);
+}
+
+static PluginSourceRecord * plugin_source_record_new(Plugin * plugin, PluginTimingKind kind, GSourceFunc func, gpointer data, GDestroyNotify notify)
+{
+    PluginSourceRecord * record = g_new0(PluginSourceRecord, 1);
+    record->timing = plugin_timing_ref(plugin->timing);
+    record->kind = kind;
+    record->func = func;
+    record->data = data;
+    record->notify = notify;
+    return record;
+}
+
+guint plugin_timeout_add(Plugin * plugin, guint interval, GSourceFunc func, gpointer data)
+{
+    return g_timeout_add_full(G_PRIORITY_DEFAULT, interval, plugin_source_dispatch,
+        plugin_source_record_new(plugin, PLUGIN_TIMING_TIMEOUT, func, data, NULL), plugin_source_record_free);
+}
+
+guint plugin_timeout_add_seconds(Plugin * plugin, guint interval, GSourceFunc func, gpointer data)
+{
+    return g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, interval, plugin_source_dispatch,
+        plugin_source_record_new(plugin, PLUGIN_TIMING_TIMEOUT, func, data, NULL), plugin_source_record_free);
+}
+
+guint plugin_idle_add_full(Plugin * plugin, gint priority, GSourceFunc func, gpointer data, GDestroyNotify notify)
+{
+    return g_idle_add_full(priority, plugin_source_dispatch,
+        plugin_source_record_new(plugin, PLUGIN_TIMING_IDLE, func, data, notify), plugin_source_record_free);
+}
+
+guint plugin_idle_add(Plugin * plugin, GSourceFunc func, gpointer data)
+{
+    return plugin_idle_add_full(plugin, G_PRIORITY_DEFAULT_IDLE, func, data, NULL);
+}
+
+static GdkFilterReturn plugin_event_filter(GdkXEvent * xevent, GdkEvent * event, gpointer data)
+{
+    /* The filter may remove itself, so do not touch the record after the call. */
+    PluginFilterRecord * record = (PluginFilterRecord *) data;
+    PluginTiming * timing = plugin_timing_ref(record->timing);
+    const gchar * stats_name = record->stats_name;
+
+    WtlEventProbe probe;
+    wtl_event_stats_begin(&probe);
+    gint64 started = g_get_monotonic_time();
+
+    GdkFilterReturn result = record->func(xevent, event, record->data);
+
+    plugin_timing_account(timing, PLUGIN_TIMING_EVENT_FILTER, started);
+    plugin_timing_unref(timing);
+    wtl_event_stats_end(&probe, stats_name);
+    return result;
+}
+
+static void plugin_filter_record_free(PluginFilterRecord * record)
+{
+    gdk_window_remove_filter(NULL, plugin_event_filter, record);
+    plugin_timing_unref(record->timing);
+    g_free(record);
+}
+
+void plugin_add_event_filter(Plugin * plugin, GdkFilterFunc func, gpointer data)
+{
+    PluginFilterRecord * record = g_new0(PluginFilterRecord, 1);
+    record->timing = plugin_timing_ref(plugin->timing);
+    record->func = func;
+    record->data = data;
+    gchar * stats_name = g_strdup_printf("event-filter:%s", plugin->class->type);
+    record->stats_name = g_intern_string(stats_name);
+    g_free(stats_name);
+    plugin->event_filters = g_list_prepend(plugin->event_filters, record);
+    gdk_window_add_filter(NULL, plugin_event_filter, record);
+}
+
+void plugin_remove_event_filter(Plugin * plugin, GdkFilterFunc func, gpointer data)
+{
+    GList * l;
+    for (l = plugin->event_filters; l; l = l->next)
+    {
+        PluginFilterRecord * record = (PluginFilterRecord *) l->data;
+        if (record->func == func && record->data == data)
+        {
+            plugin->event_filters = g_list_delete_link(plugin->event_filters, l);
+            plugin_filter_record_free(record);
+            return;
+        }
+    }
+}
+
+static void plugin_closure_pre_marshal(gpointer data, GClosure * closure)
+{
+    PluginClosureGuard * guard = (PluginClosureGuard *) data;
+    if (guard->depth++ == 0)
+        guard->started = g_get_monotonic_time();
+}
+
+static void plugin_closure_post_marshal(gpointer data, GClosure * closure)
+{
+    PluginClosureGuard * guard = (PluginClosureGuard *) data;
+    if (--guard->depth == 0)
+        plugin_timing_account(guard->timing, guard->kind, guard->started);
+}
+
+static void plugin_closure_finalize(gpointer data, GClosure * closure)
+{
+    PluginClosureGuard * guard = (PluginClosureGuard *) data;
+    plugin_timing_unref(guard->timing);
+    g_free(guard);
+}
+
+/* The handler stays a plain C closure of func and data, so g_signal_handlers_disconnect_by_func() still finds it. */
+gulong plugin_signal_connect(Plugin * plugin, gpointer instance, const char * signal, GCallback func, gpointer data)
+{
+    PluginClosureGuard * guard = g_new0(PluginClosureGuard, 1);
+    guard->timing = plugin_timing_ref(plugin->timing);
+    guard->kind = (strcmp(signal, "expose_event") == 0 || strcmp(signal, "expose-event") == 0) ?
+        PLUGIN_TIMING_EXPOSE : PLUGIN_TIMING_SIGNAL;
+
+    GClosure * closure = g_cclosure_new(func, data, NULL);
+    g_closure_add_marshal_guards(closure, guard, plugin_closure_pre_marshal, guard, plugin_closure_post_marshal);
+    g_closure_add_finalize_notifier(closure, guard, plugin_closure_finalize);
+
+    return g_signal_connect_closure(instance, signal, closure, FALSE);
+}
+
+const char * plugin_timing_kind_name(int kind)
+{
+    switch (kind)
+    {
+        case PLUGIN_TIMING_TIMEOUT: return "timeout";
+        case PLUGIN_TIMING_IDLE: return "idle";
+        case PLUGIN_TIMING_EVENT_FILTER: return "event-filter";
+        case PLUGIN_TIMING_EXPOSE: return "expose";
+        case PLUGIN_TIMING_SIGNAL: return "signal";
+    }
+    return "unknown";
+}
+
+gint64 plugin_timing_get_total_time(Plugin * plugin)
+{
+    gint64 total = 0;
+    int kind;
+    for (kind = 0; kind < PLUGIN_TIMING_KINDS; kind++)
+        total += plugin->timing->counters[kind].total_time;
+    return total;
+}
+
+/* Wakeups per second over the last PLUGIN_WAKEUP_WINDOW seconds, so that the figure follows what the plugin does now. */
+double plugin_timing_get_wakeup_rate(Plugin * plugin)
+{
+    PluginTiming * timing = plugin->timing;
+    gint64 now = g_get_monotonic_time();
+    plugin_timing_advance_wakeups(timing, now / G_USEC_PER_SEC);
+
+    guint64 wakeups = 0;
+    int i;
+    for (i = 0; i < PLUGIN_WAKEUP_WINDOW; i++)
+        wakeups += timing->wakeup_buckets[i];
+
+    /* The window is the full seconds before the current one plus the part of the current one,
+     * or less if accounting started more recently. */
+    gint64 span = (PLUGIN_WAKEUP_WINDOW - 1) * G_USEC_PER_SEC + now % G_USEC_PER_SEC;
+    span = MIN(span, now - timing->started);
+    if (span <= 0)
+        return 0;
+    return wakeups / (span / (double) G_USEC_PER_SEC);
+}
+
+void plugin_timing_reset(Plugin * plugin)
+{
+    PluginTiming * timing = plugin->timing;
+    memset(timing->counters, 0, sizeof(timing->counters));
+    memset(timing->wakeup_buckets, 0, sizeof(timing->wakeup_buckets));
+    timing->wakeups = 0;
+    timing->started = g_get_monotonic_time();
+}
+
+/* Filters left behind by the destructor would call into freed plugin data. */
+static void plugin_release_timing(Plugin * plugin)
+{
+    g_list_foreach(plugin->event_filters, (GFunc) plugin_filter_record_free, NULL);
+    g_list_free(plugin->event_filters);
+    plugin->event_filters = NULL;
+    plugin_timing_unref(plugin->timing);
+    plugin->timing = NULL;
+}
+
+/******************************************************************************/
 
 /* Create an instance of a plugin with a specified name, loading it if external. */
 Plugin * plugin_load(const char * type)
 {
     /* Initialize static plugins on first call. */
-    if (pcl == NULL)
+    if (plugin_classes == NULL)
         init_plugin_class_list();
 
     /* Look up the PluginClass. */
@@ -228,11 +927,25 @@ Plugin * plugin_load(const char * type)
     /* If not found and dynamic loading is available, try to locate an external plugin. */
     if ((pc == NULL) && (g_module_supported()))
     {
-        gchar * soname = g_strdup_printf("%s.so", type);
-        gchar * path = wtl_resolve_own_resource("lib", "plugins", soname, 0);
-        pc = plugin_load_dynamic(type, path);
+        /* Prefer the path recorded in the manifest, if it has been read already. */
+        gchar * path = NULL;
+        if (plugin_manifest != NULL)
+        {
+            gchar * key = g_ascii_strdown(type, -1);
+            PluginManifestEntry * entry = (PluginManifestEntry *) g_hash_table_lookup(plugin_manifest, key);
+            if (entry && entry->valid)
+                path = g_strdup(entry->path);
+            g_free(key);
+        }
+        if (!path)
+        {
+            gchar * soname = g_strdup_printf("%s.so", type);
+            path = wtl_resolve_own_resource("lib", "plugins", soname, 0);
+            g_free(soname);
+        }
+        if (path)
+            pc = plugin_load_dynamic(type, path);
         g_free(path);
-        g_free(soname);
     }
 #endif  /* DISABLE_PLUGINS_LOADING */
 
@@ -246,6 +959,7 @@ Plugin * plugin_load(const char * type)
     pc->internal->count += 1;
 
     plug->json = json_object();
+    plug->timing = plugin_timing_new();
 
     return plug;
 }
@@ -286,6 +1000,7 @@ void plugin_unload(Plugin * plugin)
 {
     plugin_class_unref(plugin->class);
     json_decref(plugin->json);
+    plugin_release_timing(plugin);
     g_free(plugin);
 }
 
@@ -319,6 +1034,7 @@ void plugin_delete(Plugin * plugin)
     plugin_class_unref(pc);
 
     json_decref(plugin->json);
+    plugin_release_timing(plugin);
 
     /* Free the Plugin structure. */
     g_free(plugin);
@@ -329,51 +1045,36 @@ void plugin_delete(Plugin * plugin)
 GList * plugin_get_available_classes(void)
 {
     /* Initialize static plugins on first call. */
-    if (pcl == NULL)
+    if (plugin_classes == NULL)
         init_plugin_class_list();
 
+    plugin_manifest_refresh();
+
     /* Loop over all classes to formulate the result.
      * Increase the reference count; it will be decreased in plugin_class_list_free. */
     GList * classes = NULL;
-    GList * l;
-    for (l = pcl; l != NULL; l = l->next)
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, plugin_classes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
     {
-        PluginClass * pc = (PluginClass *) l->data;
+        PluginClass * pc = (PluginClass *) value;
         classes = g_list_prepend(classes, pc);
         pc->internal->count += 1;
     }
 
-#ifndef DISABLE_PLUGINS_LOADING
-    gchar * plugin_dir = wtl_resolve_own_resource("lib", "plugins", 0);
-    GDir * dir = g_dir_open(plugin_dir, 0, NULL);
-    g_free(plugin_dir);
-
-    if (dir != NULL)
+    /* Describe the modules that are not loaded with stubs made from the manifest. */
+    if (plugin_manifest != NULL)
     {
-        const char * file;
-        while ((file = g_dir_read_name(dir)) != NULL)
+        g_hash_table_iter_init(&iter, plugin_manifest);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
         {
-            if (g_str_has_suffix(file, ".so"))
-            {
-                char * type = g_strndup(file, strlen(file) - 3);
-                if (plugin_find_class(type) == NULL)
-                {
-                    /* If it has not been loaded, do it.  If successful, add it to the result. */
-                    char * path = wtl_resolve_own_resource("lib", "plugins", file, 0);
-                    PluginClass * pc = plugin_load_dynamic(type, path);
-                    if (pc != NULL)
-                    {
-                        pc->internal->count += 1;
-                        classes = g_list_prepend(classes, pc);
-                    }
-                    g_free(path);
-                }
-                g_free(type);
-            }
+            PluginManifestEntry * entry = (PluginManifestEntry *) value;
+            if (entry->valid && plugin_find_class(entry->type) == NULL)
+                classes = g_list_prepend(classes, plugin_manifest_entry_to_stub(entry));
         }
-        g_dir_close(dir);
     }
-#endif
+
     return classes;
 }
 
@@ -31,6 +31,16 @@ extern void plugin_delete(Plugin * pl);             /* Delete an instance of a p
 extern GList * plugin_get_available_classes(void);  /* Get a list of all plugin classes; free with plugin_class_list_free */
 extern void plugin_class_list_free(GList * list);   /* Free the list allocated by plugin_get_available_classes */
 
+typedef struct _PluginPreload PluginPreload;
+extern PluginPreload * plugin_preload(const char * type);      /* Open a dynamic plugin module; may be called from any thread */
+extern void plugin_preload_finish(PluginPreload * preload);    /* Register a preloaded plugin class (main thread) */
+extern void plugin_preload_free(PluginPreload * preload);      /* Drop a preloaded module without registering it */
+
+extern const char * plugin_timing_kind_name(int kind);  /* PluginTimingKind */
+extern gint64 plugin_timing_get_total_time(Plugin * plugin); /* Microseconds spent in all accounted callbacks */
+extern double plugin_timing_get_wakeup_rate(Plugin * plugin); /* Wakeups per second over the last few seconds */
+extern void plugin_timing_reset(Plugin * plugin);
+
 //#pragma GCC visibility pop
 
 #endif
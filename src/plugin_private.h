@@ -26,8 +26,38 @@ struct _PluginClassInternal {
     char * fname;               /* Plugin file pathname */
     int count;                  /* Reference count */
     GModule * gmodule;          /* Associated GModule structure */
+    gboolean stub;              /* Not loaded; describes a manifest entry for plugin_get_available_classes */
 };
 
+typedef enum {
+    PLUGIN_TIMING_TIMEOUT,
+    PLUGIN_TIMING_IDLE,
+    PLUGIN_TIMING_EVENT_FILTER,
+    PLUGIN_TIMING_EXPOSE,
+    PLUGIN_TIMING_SIGNAL,
+    PLUGIN_TIMING_KINDS
+} PluginTimingKind;
+
+typedef struct {
+    guint64 calls;
+    gint64 total_time;          /* Microseconds */
+    gint64 max_time;            /* Microseconds */
+} PluginTimingCounter;
+
+/* Length of the sliding window the wakeup rate is measured over, in seconds. */
+#define PLUGIN_WAKEUP_WINDOW 10
+
+/* Time spent in callbacks registered through the plugin_* wrappers.
+ * Reference counted, since a source or a signal connection may outlive the plugin. */
+typedef struct {
+    int refcount;
+    gint64 started;             /* Start of accounting */
+    guint64 wakeups;            /* Dispatches of the plugin's own timeouts and idle callbacks */
+    guint wakeup_buckets[PLUGIN_WAKEUP_WINDOW]; /* Wakeups in each of the last seconds, indexed by second modulo the window */
+    gint64 wakeup_second;       /* Second of the monotonic clock the newest bucket counts */
+    PluginTimingCounter counters[PLUGIN_TIMING_KINDS];
+} PluginTiming;
+
 /* Representative of a loaded and active plugin attached to a panel. */
 struct _Plugin {
     PluginClass * class;        /* Back pointer to plugin class */
@@ -49,6 +79,12 @@ struct _Plugin {
     json_t * json;
 
     GtkWidget * icon_size_dialog;
+
+    gint64 load_time;           /* Startup timing in microseconds, reported by waterlinectl stats */
+    gint64 construct_time;
+
+    PluginTiming * timing;
+    GList * event_filters;      /* Filters added with plugin_add_event_filter() */
 };
 
 /* FIXME: optional definitions */
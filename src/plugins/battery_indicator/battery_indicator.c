@@ -588,7 +588,7 @@ constructor(Plugin *p)
           G_CALLBACK (configureEvent), (gpointer) iplugin);
     g_signal_connect (G_OBJECT (iplugin->drawingArea), "size-request",
           G_CALLBACK (sizeRequest), (gpointer) iplugin);
-    g_signal_connect (G_OBJECT (iplugin->drawingArea), "expose_event",
+    plugin_signal_connect(p, G_OBJECT (iplugin->drawingArea), "expose_event",
           G_CALLBACK (exposeEvent), (gpointer) iplugin);
 
     sem_init(&(iplugin->alarmProcessLock), 0, 1);
@@ -612,7 +612,7 @@ constructor(Plugin *p)
     battery_indicator_panel_configuration_changed(p);
 
     /* Start the update loop */
-    iplugin->timer = g_timeout_add_seconds( 3, (GSourceFunc) update_timout, (gpointer) iplugin);
+    iplugin->timer = plugin_timeout_add_seconds(p, 3, (GSourceFunc) update_timout, (gpointer) iplugin);
 
     return TRUE;
 }
@@ -325,7 +325,7 @@ static void cpu_apply_configuration(Plugin * p)
 
         /* Connect signals. */
         g_signal_connect(G_OBJECT(c->da), "configure_event", G_CALLBACK(configure_event), (gpointer) c);
-        g_signal_connect(G_OBJECT(c->da), "expose_event", G_CALLBACK(expose_event), (gpointer) c);
+        plugin_signal_connect(p, G_OBJECT(c->da), "expose_event", G_CALLBACK(expose_event), (gpointer) c);
         g_signal_connect(c->da, "button-press-event", G_CALLBACK(plugin_button_press_event), p);
     }
 
@@ -339,7 +339,7 @@ static void cpu_apply_configuration(Plugin * p)
 
     if (c->timer)
         g_source_remove(c->timer);
-    c->timer = g_timeout_add(c->update_interval, (GSourceFunc) cpu_update, (gpointer) c);
+    c->timer = plugin_timeout_add(p, c->update_interval, (GSourceFunc) cpu_update, (gpointer) c);
 }
 
 /* Plugin constructor. */
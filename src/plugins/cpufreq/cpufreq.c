@@ -391,7 +391,7 @@ cpufreq_constructor(Plugin *p)
 
     }*/
     update_tooltip(cf);
-    cf->timer = g_timeout_add(2000, (GSourceFunc)update_tooltip, (gpointer)cf);
+    cf->timer = plugin_timeout_add(p, 2000, (GSourceFunc)update_tooltip, (gpointer)cf);
 
     gtk_widget_show(cf->namew);
 
@@ -21,7 +21,6 @@
 #endif
 
 #include <time.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +31,7 @@
 #define PLUGIN_PRIV_TYPE DClockPlugin
 
 #include <waterline/symbol_visibility.h>
+#include <waterline/clock.h>
 #include <waterline/paths.h>
 #include <waterline/panel.h>
 #include <waterline/misc.h>
@@ -55,7 +55,7 @@ typedef struct {
     char * action;                  /* Command to execute on a click */
     char * timezone;                /* Timezone */
     char * font;
-    guint timer;                    /* Timer for periodic update */
+    guint timer;                    /* Subscription to the shared clock ticker */
     enum {
         AWAITING_FIRST_CHANGE,      /* Experimenting to determine interval, waiting for first change */
         AWAITING_SECOND_CHANGE,     /* Experimenting to determine interval, waiting for second change */
@@ -66,6 +66,7 @@ typedef struct {
     char * prev_clock_value;        /* Previous value of clock */
     char * prev_tooltip_value;      /* Previous value of tooltip */
     char * timezones;
+    struct tm current_time;         /* Time being displayed */
 } DClockPlugin;
 
 static void dclock_popup_map(GtkWidget * widget, DClockPlugin * dc);
@@ -295,53 +296,25 @@ static gboolean dclock_button_press_event(GtkWidget * widget, GdkEventButton * e
     return TRUE;
 }
 
-/* Set the timer. */
-static void dclock_timer_set(DClockPlugin * dc)
+static void dclock_tick(DClockPlugin * dc)
 {
-    int milliseconds = 1000;
-
-    /* Get current time to millisecond resolution. */
-    struct timeval current_time;
-    if (gettimeofday(&current_time, NULL) >= 0)
-    {
-        /* Compute number of milliseconds until next second boundary. */
-        milliseconds = 1000 - (current_time.tv_usec / 1000);
+    dclock_update_display(dc);
+}
 
-        /* If the expiration interval is the minute boundary,
-         * add number of milliseconds after that until next minute boundary. */
-        if (dc->expiration_interval == ONE_MINUTE_INTERVAL)
-        {
-            time_t seconds = 60 - (current_time.tv_sec - (current_time.tv_sec / 60) * 60);
-            milliseconds += seconds * 1000;
-        }
-    }
+/* Subscribe to the shared clock ticker, or adjust the resolution of the existing subscription. */
+static void dclock_timer_set(DClockPlugin * dc)
+{
+    WtlClockResolution resolution = (dc->expiration_interval == ONE_MINUTE_INTERVAL) ? WTL_CLOCK_MINUTE : WTL_CLOCK_SECOND;
 
-    /* Be defensive, and set the timer. */
-    if (milliseconds <= 0)
-        milliseconds = 1000;
-    dc->timer = g_timeout_add(milliseconds, (GSourceFunc) dclock_update_display, (gpointer) dc);
+    if (dc->timer == 0)
+        dc->timer = wtl_clock_add(resolution, (WtlClockFunc) dclock_tick, dc);
+    else
+        wtl_clock_set_resolution(dc->timer, resolution);
 }
 
 static struct tm * _get_time_to_display(DClockPlugin * dc)
 {
-    time_t now;
-    time(&now);
-
-    struct tm * current_time = NULL;
-    gchar* oldtz = NULL;
-
-    if (!su_str_empty(dc->timezone)) {
-        oldtz = g_strdup(g_getenv("TZ"));
-        g_setenv("TZ", dc->timezone, 1);
-        current_time = localtime(&now);
-        if (oldtz)
-            g_setenv("TZ", oldtz, 1);
-        else
-            g_unsetenv("TZ");
-    } else
-        current_time = localtime(&now);
-
-    return current_time;
+    return wtl_clock_localtime(dc->timezone, time(NULL), &dc->current_time);
 }
 
 /* Periodic timer callback.
@@ -474,7 +447,7 @@ static gboolean dclock_update_display(DClockPlugin * dc)
         }
     }
 
-    /* Reset the timer and return. */
+    /* Adjust the timer resolution and return. */
     dclock_timer_set(dc);
     return FALSE;
 }
@@ -522,7 +495,7 @@ static void dclock_destructor(Plugin * p)
 
     /* Remove the timer. */
     if (dc->timer != 0)
-        g_source_remove(dc->timer);
+        wtl_clock_remove(dc->timer);
 
     /* Ensure that the calendar is dismissed. */
     if (dc->calendar_window != NULL)
@@ -555,11 +528,6 @@ static void dclock_apply_configuration(Plugin * p)
     dc->prev_clock_value = NULL;
     dc->prev_tooltip_value = NULL;
 
-    /* Remove the timer before calling dclock_update_display(),
-       as dclock_timer_set() overwrites dc->timer without removing old one. */
-    if (dc->timer != 0)
-        g_source_remove(dc->timer);
-
     dclock_update_display(dc);
 
     /* Hide the calendar. */
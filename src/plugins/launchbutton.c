@@ -27,18 +27,6 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 
-#include <sys/wait.h>
-#include <signal.h>
-#include <unistd.h>
-#include <fcntl.h>
-
-#ifdef __FreeBSD__
-#include <termios.h>
-#include <libutil.h>
-#else
-#include <pty.h>
-#endif
-
 #include <sde-utils.h>
 #include <sde-utils-jansson.h>
 
@@ -49,28 +37,30 @@
 #include <waterline/misc.h>
 #include <waterline/launch.h>
 #include <waterline/wtl_button.h>
+#include <waterline/supervisor.h>
 
 #include <waterline/gtkcompat.h>
 
 struct _lb_t;
 
 typedef struct {
-    guint input_source_id;
-    guint input_hup_source_id;
-    guint input_err_source_id;
-    guint process_source_id;
-    GIOChannel * input_channel;
-    pid_t child_pid;
-
-    gboolean eof;
-
-    gchar * input_buffer;
+    WtlProcess * process;
 
     gchar * command;
 
     struct _lb_t * lb;
 } input_t;
 
+/* Appearance set by the interactive update command. NULL fields are not set. */
+typedef struct {
+    gchar * title;
+    gboolean title_markup;
+    gchar * tooltip;
+    gboolean tooltip_markup;
+    gchar * icon;
+    gchar * bg_color;
+} lb_state_t;
+
 typedef struct _lb_t {
     char * icon_path;
     char * title;
@@ -104,11 +94,15 @@ typedef struct _lb_t {
 */
     input_t input_general;
 
-    int input_restart_interval;
+    int input_restart_interval;     /* Milliseconds between restarts of the command; 0 means no restart */
+    int input_lines_per_iteration;  /* Lines handled per main loop iteration; 0 means no limit */
+    int input_update_interval;      /* Milliseconds to collect updates before applying them; 0 means one main loop iteration */
 
-    gboolean interactive_update;
+    lb_state_t pending_state;       /* Updates received but not applied yet */
+    lb_state_t displayed_state;     /* Updates currently shown */
+    guint pending_state_source_id;
 
-    guint input_timeout;
+    gboolean interactive_update;
 
     gchar *  bg_color_s;
     GdkColor bg_color_c;
@@ -132,6 +126,8 @@ static su_json_option_definition option_definitions[] = {
 
     SU_JSON_OPTION(bool, interactive_update),
     SU_JSON_OPTION(int, input_restart_interval),
+    SU_JSON_OPTION(int, input_lines_per_iteration),
+    SU_JSON_OPTION(int, input_update_interval),
 /*
     SU_JSON_OPTION(string, input_title.command),
     SU_JSON_OPTION(string, input_tooltip.command),
@@ -148,217 +144,33 @@ static void lb_input(lb_t * lb, input_t * input, gchar * line);
 
 /*****************************************************************************/
 
-static int _set_nonblocking(int fd)
-{
-    int flags;
-    if (-1 == (flags = fcntl(fd, F_GETFL, 0)))
-        flags = 0;
-    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-}
-
-static gboolean input_on_child_input(GIOChannel *source, GIOCondition condition, gpointer _input)
+static void input_on_line(WtlProcess * process, gchar * line, gpointer _input)
 {
     input_t * input = _input;
-
-    int i;
-
-    if (!source)
-        return TRUE;
-
-    gchar buf[1024];
-    buf[0] = 0;
-    gsize bytes_read = 0;
-
-    input->eof |= (condition == G_IO_HUP) || (condition == G_IO_ERR);
-
-    GIOStatus status = 0;
-
-    if (!input->eof)
-    {
-        status = g_io_channel_read_chars(source, buf, 1023, &bytes_read, NULL);
-        buf[bytes_read] = 0;
-    }
-
-    //g_print("condition %d\n", (int)condition);
-    //g_print("bs %d\n", (int)bytes_read);
-    //g_print("input->eof %d\n", (int)input->eof);
-
-    input->eof |= (status == G_IO_STATUS_EOF) || (status == G_IO_STATUS_ERROR);
-
-    if (bytes_read > 0)
-    {
-        gchar * newbuffer = g_strconcat(input->input_buffer ? input->input_buffer : "", buf, NULL);
-        g_free(input->input_buffer);
-        input->input_buffer = newbuffer;
-
-        gchar ** lines = g_strsplit(input->input_buffer, "\n", 0);
-        int line_nr = g_strv_length(lines);
-
-        g_free(input->input_buffer);
-
-        for (i = 0; i < line_nr - (input->eof ? 0 : 1); i++)
-        {
-            int l = strlen(lines[i]);
-            if (lines[i][l - 1] == '\r')
-                lines[i][l - 1] = 0;
-
-            //g_print("== %s\n", lines[i]);
-
-            lb_input(input->lb, input, lines[i]);
-        }
-
-        if (!input->eof)
-            input->input_buffer = g_strdup(lines[line_nr - 1]);
-
-        g_strfreev(lines);
-    }
-
-    if (input->eof)
-    {
-        if (input->input_source_id)
-        {
-            g_source_remove(input->input_source_id);
-            input->input_source_id = 0;
-        }
-
-        if (input->input_hup_source_id)
-        {
-            g_source_remove(input->input_hup_source_id);
-            input->input_hup_source_id = 0;
-        }
-
-        if (input->input_err_source_id)
-        {
-            g_source_remove(input->input_err_source_id);
-            input->input_err_source_id = 0;
-        }
-
-        if (input->input_channel)
-        {
-            g_io_channel_shutdown(input->input_channel, FALSE, NULL);
-            g_io_channel_unref(input->input_channel);
-            input->input_channel = NULL;
-        }
-    }
-
-    return input->eof ? FALSE : TRUE;
-}
-
-static void input_on_child_exit(GPid pid, gint status, gpointer _input)
-{
-    input_t * input = _input;
-    input->process_source_id = 0; /* Glib will reap the watch source for us.  */
-    input->child_pid = 0;
-    input_on_child_input(input->input_channel, 0, input);
+    lb_input(input->lb, input, line);
 }
 
 static void input_stop(input_t * input)
 {
-    if (input->input_source_id)
-    {
-        g_source_remove(input->input_source_id);
-        input->input_source_id = 0;
-    }
-
-    if (input->input_hup_source_id)
-    {
-        g_source_remove(input->input_hup_source_id);
-        input->input_hup_source_id = 0;
-    }
-
-    if (input->input_err_source_id)
-    {
-        g_source_remove(input->input_err_source_id);
-        input->input_err_source_id = 0;
-    }
-
-    if (input->input_channel)
-    {
-        g_io_channel_shutdown(input->input_channel, FALSE, NULL);
-        g_io_channel_unref(input->input_channel);
-        input->input_channel = NULL;
-    }
-
-    if (input->process_source_id)
-    {
-        g_source_remove(input->process_source_id);
-        input->process_source_id = 0;
-    }
-
-    if (input->child_pid)
+    if (input->process)
     {
-        kill(input->child_pid, SIGKILL);
-        int stat_loc;
-        waitpid(input->child_pid, &stat_loc, 0);
-        input->child_pid = 0;
+        wtl_process_free(input->process);
+        input->process = NULL;
     }
-
-    if (input->input_buffer)
-    {
-        g_free(input->input_buffer);
-        input->input_buffer = NULL;
-    }
-
 }
 
 static void input_start(input_t * input)
 {
     input_stop(input);
 
-    input->eof = TRUE;
-
     if (su_str_empty(input->command))
         return;
 
-    gboolean use_pty = TRUE;
-
-    int fds[2];
-    if (use_pty)
-    {
-        openpty(&fds[0], &fds[1], NULL, NULL, NULL);
-    }
-    else
-    {
-        pipe(fds);
-    }
-
-    pid_t pid = fork();
-
-    if (pid == 0)
-    {
-        if (use_pty)
-        {
-            setsid();
-            ioctl(fds[1], TIOCSCTTY, (char *)NULL);
-        }
-
-        close(fds[0]);
-
-        dup2(fds[1],1);
-        close(fds[1]);
-
-        execlp ("sh", "sh", "-c", input->command, (char *) NULL);
-        _exit(-1);
-    }
-
-    close(fds[1]);
-
-    if (pid < 0)
-    {
-        close(fds[0]);
-    }
-    else
-    {
-        input->eof = FALSE;
-        input->child_pid = pid;
-        _set_nonblocking(fds[0]);
-        input->input_channel = g_io_channel_unix_new(fds[0]);
-        input->input_source_id = g_io_add_watch(input->input_channel, G_IO_IN, input_on_child_input, input);
-        input->input_hup_source_id = g_io_add_watch(input->input_channel, G_IO_HUP, input_on_child_input, input);
-        input->input_err_source_id = g_io_add_watch(input->input_channel, G_IO_ERR, input_on_child_input, input);
-        input->process_source_id = g_child_watch_add(pid, input_on_child_exit, input);
-    }
-
+    /* The supervisor restarts the command and throttles it if it keeps failing. */
+    input->process = wtl_process_new(input->command, WTL_PROCESS_USE_PTY, input_on_line, NULL, input);
+    wtl_process_set_restart_interval(input->process, input->lb->input_restart_interval);
+    wtl_process_set_lines_per_iteration(input->process, input->lb->input_lines_per_iteration);
+    wtl_process_start(input->process);
 }
 
 /*****************************************************************************/
@@ -427,6 +239,93 @@ static void lb_set_bgcolor(lb_t * lb, gchar * color_s)
 
 /*****************************************************************************/
 
+static void lb_state_clear(lb_state_t * state)
+{
+    g_free(state->title);
+    g_free(state->tooltip);
+    g_free(state->icon);
+    g_free(state->bg_color);
+    memset(state, 0, sizeof(lb_state_t));
+}
+
+/* Move a pending value to the displayed state. Returns TRUE if it differs from the displayed one. */
+static gboolean lb_state_take_text(gchar ** pending, gboolean pending_markup, gchar ** displayed, gboolean * displayed_markup)
+{
+    gboolean changed = !*displayed || strcmp(*pending, *displayed) != 0
+        || (displayed_markup && *displayed_markup != pending_markup);
+
+    g_free(*displayed);
+    *displayed = *pending;
+    *pending = NULL;
+    if (displayed_markup)
+        *displayed_markup = pending_markup;
+
+    return changed;
+}
+
+/* Apply the updates collected since the last call, skipping the ones that do not change anything. */
+static gboolean lb_apply_pending_state(lb_t * lb)
+{
+    lb->pending_state_source_id = 0;
+
+    lb_state_t * pending = &lb->pending_state;
+    lb_state_t * displayed = &lb->displayed_state;
+
+    if (pending->title && lb_state_take_text(&pending->title, pending->title_markup, &displayed->title, &displayed->title_markup))
+    {
+        if (displayed->title_markup)
+            wtl_button_set_label_markup(lb->button, displayed->title);
+        else
+            wtl_button_set_label_text(lb->button, displayed->title);
+    }
+
+    if (pending->tooltip && lb_state_take_text(&pending->tooltip, pending->tooltip_markup, &displayed->tooltip, &displayed->tooltip_markup))
+    {
+        if (displayed->tooltip_markup)
+            gtk_widget_set_tooltip_markup(lb->button, displayed->tooltip);
+        else
+            gtk_widget_set_tooltip_text(lb->button, displayed->tooltip);
+    }
+
+    if (pending->icon && lb_state_take_text(&pending->icon, FALSE, &displayed->icon, NULL))
+        wtl_button_set_image_name(lb->button, displayed->icon, plugin_get_icon_size(lb->plug));
+
+    if (pending->bg_color && lb_state_take_text(&pending->bg_color, FALSE, &displayed->bg_color, NULL))
+        lb_set_bgcolor(lb, displayed->bg_color);
+
+    return FALSE;
+}
+
+/* Record an update to be applied with the others received in the same main loop iteration or update interval. */
+static void lb_state_set_text(lb_t * lb, gchar ** field, gboolean * markup, const gchar * value, gboolean use_markup)
+{
+    g_free(*field);
+    *field = g_strdup(value);
+    if (markup)
+        *markup = use_markup;
+
+    if (!lb->pending_state_source_id)
+    {
+        if (lb->input_update_interval > 0)
+            lb->pending_state_source_id = plugin_timeout_add(lb->plug, lb->input_update_interval, (GSourceFunc) lb_apply_pending_state, lb);
+        else
+            lb->pending_state_source_id = plugin_idle_add(lb->plug, (GSourceFunc) lb_apply_pending_state, lb);
+    }
+}
+
+static void lb_state_reset(lb_t * lb)
+{
+    if (lb->pending_state_source_id)
+    {
+        g_source_remove(lb->pending_state_source_id);
+        lb->pending_state_source_id = 0;
+    }
+    lb_state_clear(&lb->pending_state);
+    lb_state_clear(&lb->displayed_state);
+}
+
+/*****************************************************************************/
+
 static void lb_input(lb_t * lb, input_t * input, gchar * line)
 {
 /*
@@ -449,18 +348,15 @@ static void lb_input(lb_t * lb, input_t * input, gchar * line)
         if (g_strv_length(parts) == 2)
         {
             if (g_ascii_strcasecmp(parts[0], "Title") == 0)
-                wtl_button_set_label_markup(lb->button, parts[1]);
+                lb_state_set_text(lb, &lb->pending_state.title, &lb->pending_state.title_markup, parts[1], TRUE);
             else if (g_ascii_strcasecmp(parts[0], "TitlePlainText") == 0)
-                wtl_button_set_label_text(lb->button, parts[1]);
+                lb_state_set_text(lb, &lb->pending_state.title, &lb->pending_state.title_markup, parts[1], FALSE);
             else if (g_ascii_strcasecmp(parts[0], "Tooltip") == 0)
-                gtk_widget_set_tooltip_markup(lb->button, parts[1]);
+                lb_state_set_text(lb, &lb->pending_state.tooltip, &lb->pending_state.tooltip_markup, parts[1], TRUE);
             else if (g_ascii_strcasecmp(parts[0], "TooltipPlainText") == 0)
-                gtk_widget_set_tooltip_text(lb->button, parts[1]);
+                lb_state_set_text(lb, &lb->pending_state.tooltip, &lb->pending_state.tooltip_markup, parts[1], FALSE);
             else if (g_ascii_strcasecmp(parts[0], "IconPath") == 0 || g_ascii_strcasecmp(parts[0], "Icon") == 0)
-            {
-                int icon_size = plugin_get_icon_size(lb->plug);
-                wtl_button_set_image_name(lb->button, parts[1], icon_size);
-            }
+                lb_state_set_text(lb, &lb->pending_state.icon, NULL, parts[1], FALSE);
             else if (g_ascii_strcasecmp(parts[0], "Command1") == 0)
             {
                 g_free(lb->command1_override);
@@ -487,9 +383,7 @@ static void lb_input(lb_t * lb, input_t * input, gchar * line)
                 lb->scroll_down_command_override = g_strdup(parts[1]);
             }
             else if (g_ascii_strcasecmp(parts[0], "BgColor") == 0)
-            {
-                lb_set_bgcolor(lb, parts[1]);
-            }
+                lb_state_set_text(lb, &lb->pending_state.bg_color, NULL, parts[1], FALSE);
         }
         g_strfreev(parts);
     }
@@ -563,23 +457,6 @@ static gboolean lb_scroll_event(GtkWidget * widget, GdkEventScroll * event, lb_t
     return TRUE;
 }
 
-static gboolean lb_input_timeout(lb_t * lb)
-{
-/*
-    if (lb->input_title.eof)
-        input_start(&lb->input_title);
-    if (lb->input_tooltip.eof)
-        input_start(&lb->input_tooltip);
-    if (lb->input_icon.eof)
-        input_start(&lb->input_icon);
-*/
-    if (lb->input_general.eof)
-        input_start(&lb->input_general);
-
-    return TRUE;
-}
-
-
 /* Callback when the configuration dialog has recorded a configuration change. */
 static void lb_apply_configuration(Plugin * p)
 {
@@ -690,14 +567,11 @@ static void lb_apply_configuration(Plugin * p)
         g_free(tooltip);
     }
 
-    if (lb->input_timeout)
-    {
-        g_source_remove(lb->input_timeout);
-        lb->input_timeout = 0;
-    }
-
     lb_set_bgcolor(lb, "");
 
+    /* The configured appearance has been restored, so forget what the update command set. */
+    lb_state_reset(lb);
+
     if (lb->interactive_update)
     {
 /*
@@ -706,9 +580,6 @@ static void lb_apply_configuration(Plugin * p)
         input_start(&lb->input_icon);
 */
         input_start(&lb->input_general);
-
-        if (lb->input_restart_interval)
-            lb->input_timeout = g_timeout_add(lb->input_restart_interval, (GSourceFunc) lb_input_timeout, lb);
     }
     else
     {
@@ -747,6 +618,8 @@ static int lb_constructor(Plugin *p)
     lb->img    = NULL;
     lb->label  = NULL;
 
+    lb->input_lines_per_iteration = 32;
+
     su_json_read_options(plugin_inner_json(p), option_definitions, lb);
 
     #define DEFAULT_STRING(f, v) \
@@ -780,8 +653,6 @@ static void lb_destructor(Plugin * p)
 {
     lb_t * lb = PRIV(p);
 
-    if (lb->input_timeout)
-        g_source_remove(lb->input_timeout);
 /*
     input_stop(&lb->input_title);
     input_stop(&lb->input_tooltip);
@@ -789,6 +660,8 @@ static void lb_destructor(Plugin * p)
 */
     input_stop(&lb->input_general);
 
+    lb_state_reset(lb);
+
     if (lb->bg_color_s)
     {
         g_free(lb->bg_color_s);
@@ -831,6 +704,10 @@ static void lb_configure(Plugin * p, GtkWindow * parent)
 
     int min_input_restart_interval = 0;
     int max_input_restart_interval = 100000;
+    int min_input_lines_per_iteration = 0;
+    int max_input_lines_per_iteration = 10000;
+    int min_input_update_interval = 0;
+    int max_input_update_interval = 10000;
 
     GtkWidget * dialog = wtl_create_generic_config_dialog(
         _(plugin_class(p)->name),
@@ -855,6 +732,12 @@ static void lb_configure(Plugin * p, GtkWindow * parent)
         _("Command restart interval"), (gpointer)&lb->input_restart_interval, (GType)CONF_TYPE_INT,
         "int-min-value", (gpointer)&min_input_restart_interval, (GType)CONF_TYPE_SET_PROPERTY,
         "int-max-value", (gpointer)&max_input_restart_interval, (GType)CONF_TYPE_SET_PROPERTY,
+        _("Lines handled at once (0 = no limit)"), (gpointer)&lb->input_lines_per_iteration, (GType)CONF_TYPE_INT,
+        "int-min-value", (gpointer)&min_input_lines_per_iteration, (GType)CONF_TYPE_SET_PROPERTY,
+        "int-max-value", (gpointer)&max_input_lines_per_iteration, (GType)CONF_TYPE_SET_PROPERTY,
+        _("Collect updates for (ms)"), (gpointer)&lb->input_update_interval, (GType)CONF_TYPE_INT,
+        "int-min-value", (gpointer)&min_input_update_interval, (GType)CONF_TYPE_SET_PROPERTY,
+        "int-max-value", (gpointer)&max_input_update_interval, (GType)CONF_TYPE_SET_PROPERTY,
         "", 0, (GType)CONF_TYPE_BEGIN_TABLE,
 /*
         _("Title update command")  , &lb->input_title.command, (GType)CONF_TYPE_STR,
@@ -45,6 +45,7 @@
 #include <waterline/global.h>
 #include <waterline/panel.h>
 #include <waterline/misc.h>
+#include <waterline/icon_cache.h>
 #include <waterline/launch.h>
 #include <waterline/plugin.h>
 #include <waterline/paths.h>
@@ -417,9 +417,14 @@ static void unload_old_icons(GtkMenu* menu, GtkIconTheme* theme)
     g_list_free( children );
 }
 
+static void on_icon_theme_changed(GtkMenu * menu)
+{
+    unload_old_icons(menu, gtk_icon_theme_get_default());
+}
+
 static void remove_change_handler(gpointer id, GObject* menu)
 {
-    g_signal_handler_disconnect(gtk_icon_theme_get_default(), GPOINTER_TO_INT(id));
+    wtl_icon_theme_remove_watch(GPOINTER_TO_UINT(id));
 }
 
 /*
@@ -440,8 +445,9 @@ static void sys_menu_insert_items( menup* m, GtkMenu* menu, int position )
     else
         su_log_debug("menu_cache_get_root_dir() returned NULL");
 
-    change_handler = g_signal_connect_swapped( gtk_icon_theme_get_default(), "changed", G_CALLBACK(unload_old_icons), menu );
-    g_object_weak_ref( G_OBJECT(menu), remove_change_handler, GINT_TO_POINTER(change_handler) );
+    /* Menus are mostly hidden; unload_old_icons() reloads the mapped items itself, so no widget is needed for ordering. */
+    change_handler = wtl_icon_theme_add_watch(NULL, (WtlIconThemeChangedFunc) on_icon_theme_changed, menu);
+    g_object_weak_ref( G_OBJECT(menu), remove_change_handler, GUINT_TO_POINTER(change_handler) );
 }
 
 
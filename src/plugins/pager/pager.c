@@ -40,9 +40,12 @@
 #include <waterline/global.h>
 #include <waterline/panel.h>
 #include <waterline/misc.h>
+#include <waterline/pixbuf_ops.h>
 #include <waterline/plugin.h>
+#include <waterline/thumbnail_cache.h>
 #include <waterline/x11_utils.h>
 #include <waterline/x11_wrappers.h>
+#include <waterline/x11_async.h>
 
 struct _task;
 struct _desk;
@@ -50,25 +53,40 @@ struct _pager;
 
 static const int ALL_DESKTOPS = 0xFFFFFFFF; /* 64-bit clean */
 #define BORDER_WIDTH   2
+#define GEOMETRY_UPDATE_INTERVAL (1000 / 60) /* Coalesce ConfigureNotify bursts to one update per frame */
+#define MINIATURE_REFRESH_INTERVAL 500       /* Shortest interval between refreshes of a window miniature */
 
 /* Structure representing a "task", an open window. */
 typedef struct _task {
     struct _pager * pager;
     struct _task * task_flink; /* Forward link of task list */
     Window win;                /* X window ID */
-    int x;                     /* Geometry as reported by X server */
+    int x;                     /* Geometry in root coordinates, tracked from ConfigureNotify */
     int y;
     guint w;
     guint h;
-    int stacking;              /* Stacking order as reported by NET_WM_CLIENT_STACKING */
+    int parent_x;              /* Root coordinates of the origin of the parent (usually the frame) window */
+    int parent_y;
+    int frame_left;            /* NET_FRAME_EXTENTS value */
+    int frame_right;
+    int frame_top;
+    int frame_bottom;
+    int stacking;              /* Stacking order as reported by NET_WM_CLIENT_STACKING, -1 for a new task */
     int desktop;               /* Desktop that contains task */
     int ws;                    /* WM_STATE value */
     NetWMState nws;            /* NET_WM_STATE value */
     NetWMWindowType nwwt;      /* NET_WM_WINDOW_TYPE value */
     guint focused : 1;         /* True if window has focus */
     guint present_in_client_list : 1; /* State during WM_CLIENT_LIST processing to detect deletions */
+    guint geometry_pending : 1; /* True if geometry changed and the representation is not updated yet */
+    guint geometry_query_needed : 1; /* True if the window was reparented and the parent origin is unknown */
     gboolean visible_on_pixmap;
+    int drawn_desktop;         /* Desktop, geometry and shading the representation on the pixmaps is drawn with */
+    GdkRectangle drawn_geometry;
+    gboolean drawn_shaded;
     guint dirty_deferred_timeout;
+    WtlThumbnailWatch * miniature_watch; /* Watch on the shared thumbnail cache, NULL if miniatures are off */
+    cairo_surface_t * miniature_surface; /* Latest miniature, converted once for all the redraws */
 } PagerTask;
 
 /* Structure representing a desktop. */
@@ -78,6 +96,7 @@ typedef struct _desk {
     GdkPixmap * pixmap;        /* Pixmap to be drawn on drawing area */
     int desktop_number;        /* Desktop number */
     gboolean dirty;            /* True if needs to be recomputed */
+    GdkRegion * damage;        /* Part of the pixmap that needs to be recomputed, if not dirty */
     gfloat scale_x;            /* Horizontal scale factor */
     gfloat scale_y;            /* Vertical scale factor */
 } PagerDesktop;
@@ -93,17 +112,35 @@ typedef struct _pager {
     gfloat aspect_ratio;            /* Aspect ratio of screen image */
     int client_count;               /* Count of tasks in stacking order */
     PagerTask * * tasks_in_stacking_order; /* Vector of tasks in stacking order */
-    PagerTask * task_list;          /* Tasks in window ID order */
+    PagerTask * task_list;          /* Tasks in no particular order */
+    GHashTable * task_table;        /* Window -> PagerTask */
     PagerTask * focused_task;       /* Task that has focus */
+    guint geometry_update_timeout;  /* Timer to redraw tasks that got ConfigureNotify */
+    Atom a_net_frame_extents;       /* _NET_FRAME_EXTENTS atom */
+    gboolean show_miniatures;       /* User preference: draw window contents instead of plain rectangles */
+    gboolean miniatures;            /* Miniatures are drawn: preferred and compositing is available */
 } PagerPlugin;
 
+#define SU_JSON_OPTION_STRUCTURE PagerPlugin
+static su_json_option_definition option_definitions[] = {
+    SU_JSON_OPTION(bool, show_miniatures),
+    {0,}
+};
+
 static gboolean task_is_visible(PagerTask * tk);
 static PagerTask * task_lookup(PagerPlugin * pg, Window win);
 static void task_delete(PagerTask * tk, gboolean unlink);
 static void task_get_geometry(PagerTask * tk);
-static void task_update_pixmap(PagerTask * tk, PagerDesktop * d);
+static void task_get_frame_geometry(PagerTask * tk, GdkRectangle * geometry);
+static void task_frame_extents_reply(const WtlX11Property * property, PagerTask * tk);
+static void task_miniature_changed(GdkPixbuf * pixbuf, PagerTask * tk);
+static void task_update_miniature(PagerTask * tk);
+static gboolean task_get_pixmap_area(PagerDesktop * d, const GdkRectangle * geometry, gboolean shaded, GdkRectangle * area);
+static void task_update_pixmap(PagerTask * tk, PagerDesktop * d, cairo_t * cr, GdkRegion * region);
 static void desktop_set_dirty(PagerDesktop * d);
-static void pager_set_dirty_all_desktops(PagerPlugin * pg);
+static void desktop_set_damaged(PagerDesktop * d, const GdkRectangle * geometry, gboolean shaded);
+static void pager_set_damaged(PagerPlugin * pg, int desktop, const GdkRectangle * geometry, gboolean shaded);
+static void desktop_repaint(PagerDesktop * d, GdkRegion * region);
 static void task_set_desktop_dirty(PagerTask * tk);
 static gboolean desktop_configure_event(GtkWidget * widget, GdkEventConfigure * event, PagerDesktop * d);
 static gboolean desktop_expose_event(GtkWidget * widget, GdkEventExpose * event, PagerDesktop * d);
@@ -113,13 +150,18 @@ static void desktop_new(PagerPlugin * pg, int desktop_number);
 static void desktop_free(PagerPlugin * pg, int desktop_number);
 static void pager_property_notify_event(PagerPlugin * p, XEvent * ev);
 static void pager_configure_notify_event(PagerPlugin * pg, XEvent * ev);
+static void pager_reparent_notify_event(PagerPlugin * pg, XEvent * ev);
 static GdkFilterReturn pager_event_filter(XEvent * xev, GdkEvent * event, PagerPlugin * pg);
 static void pager_net_active_window(FbEv * ev, PagerPlugin * pg);
 static void pager_net_desktop_names(FbEv * ev, PagerPlugin * pg);
 static void pager_net_number_of_desktops(FbEv * ev, PagerPlugin * pg);
+static void pager_invalidate_restacked_tasks(PagerTask * * tasks, int count);
 static void pager_net_client_list_stacking(FbEv * ev, PagerPlugin * pg);
 static int pager_constructor(Plugin * plug);
 static void pager_destructor(Plugin * p);
+static void pager_apply_configuration(Plugin * p);
+static void pager_configure(Plugin * p, GtkWindow * parent);
+static void pager_save_configuration(Plugin * p);
 static void pager_panel_configuration_changed(Plugin * p);
 
 /*****************************************************************
@@ -135,25 +177,20 @@ static gboolean task_is_visible(PagerTask * tk)
     return ( ! ((tk->nws.hidden) || (tk->nws.skip_pager) || (tk->nwwt.dock) || (tk->nwwt.desktop)));
 }
 
-/* Look up a task in the task list. */
+/* Look up a task by X window handle. */
 static PagerTask * task_lookup(PagerPlugin * pg, Window win)
 {
-    PagerTask * tk;
-    for (tk = pg->task_list; tk != NULL; tk = tk->task_flink)
-    {
-        if (tk->win == win)
-            return tk;
-        if (tk->win > win)
-            break;
-    }
-    return NULL;
+    return (PagerTask *) g_hash_table_lookup(pg->task_table, GUINT_TO_POINTER(win));
 }
 
 /* Delete a task and optionally unlink it from the task list. */
 static void task_delete(PagerTask * tk, gboolean unlink)
 {
     PagerPlugin * pg = tk->pager;
-    task_set_desktop_dirty(tk);
+
+    /* Erase the representation of the window. */
+    if (tk->visible_on_pixmap)
+        pager_set_damaged(pg, tk->drawn_desktop, &tk->drawn_geometry, tk->drawn_shaded);
 
     if (tk->dirty_deferred_timeout)
     {
@@ -161,10 +198,18 @@ static void task_delete(PagerTask * tk, gboolean unlink)
         tk->dirty_deferred_timeout = 0;
     }
 
+    /* Drop the property reads still queued for the task. */
+    wtl_x11_cancel_property_requests(tk);
+    wtl_thumbnail_unwatch(tk->miniature_watch);
+    if (tk->miniature_surface)
+        cairo_surface_destroy(tk->miniature_surface);
+
     /* If we think this task had focus, remove that. */
     if (pg->focused_task == tk)
         pg->focused_task = NULL;
 
+    g_hash_table_remove(pg->task_table, GUINT_TO_POINTER(tk->win));
+
     /* If requested, unlink the task from the task list.
      * If not requested, the caller will do this. */
     if (unlink)
@@ -189,7 +234,9 @@ static void task_delete(PagerTask * tk, gboolean unlink)
     g_free(tk);
 }
 
-/* Get the geometry of a task window in screen coordinates. */
+/* Query the geometry of a task window in screen coordinates.
+ * This costs two round trips, so it is only done when a task is created or reparented.
+ * Afterwards the geometry is tracked from ConfigureNotify events. */
 static void task_get_geometry(PagerTask * tk)
 {
     /* Install an error handler that ignores BadWindow and BadDrawable.
@@ -209,6 +256,10 @@ static void task_get_geometry(PagerTask * tk)
         tk->y = ry;
         tk->w = win_attributes.width;
         tk->h = win_attributes.height;
+
+        /* Remember where the parent is, so that events relative to it can be translated. */
+        tk->parent_x = rx - win_attributes.x;
+        tk->parent_y = ry - win_attributes.y;
     }
     else
     {
@@ -219,59 +270,169 @@ static void task_get_geometry(PagerTask * tk)
         {
             tk->x = tk->y = tk->w = tk->h = 2;
         }
+        tk->parent_x = tk->parent_y = 0;
     }
 
     XSetErrorHandler(previous_error_handler);
 }
 
-/* Draw the representation of a task's window on the backing pixmap. */
-static void task_update_pixmap(PagerTask * tk, PagerDesktop * d)
+/* Get the geometry of a task window including the decorations drawn by the window manager. */
+static void task_get_frame_geometry(PagerTask * tk, GdkRectangle * geometry)
 {
-    if (!d->pixmap)
+    geometry->x = tk->x - tk->frame_left;
+    geometry->y = tk->y - tk->frame_top;
+    geometry->width = tk->w + tk->frame_left + tk->frame_right;
+    geometry->height = tk->h + tk->frame_top + tk->frame_bottom;
+}
+
+/* Handle the reply to a NET_FRAME_EXTENTS read.
+ * The extents change rarely, so they are read once per window and on PropertyNotify. */
+static void task_frame_extents_reply(const WtlX11Property * property, PagerTask * tk)
+{
+    if (property->window_gone)
         return;
 
-    tk->visible_on_pixmap = task_is_visible(tk);
+    int extents[4] = { 0, 0, 0, 0 };
+    if (property->data && property->nitems >= 4)
+    {
+        int i;
+        for (i = 0; i < 4; i++)
+            extents[i] = MAX(0, (int) ((long *) property->data)[i]);
+    }
 
-    if (!tk->visible_on_pixmap)
-        return;
+    if ((extents[0] != tk->frame_left) || (extents[1] != tk->frame_right)
+    ||  (extents[2] != tk->frame_top)  || (extents[3] != tk->frame_bottom))
+    {
+        tk->frame_left = extents[0];
+        tk->frame_right = extents[1];
+        tk->frame_top = extents[2];
+        tk->frame_bottom = extents[3];
+        task_set_desktop_dirty(tk);
+    }
+}
+
+/* Handler for a refresh of the window content by the shared thumbnail cache. */
+static void task_miniature_changed(GdkPixbuf * pixbuf, PagerTask * tk)
+{
+    if (tk->miniature_surface)
+        cairo_surface_destroy(tk->miniature_surface);
+    tk->miniature_surface = wtl_pixbuf_create_surface(pixbuf);
 
-    if ((tk->desktop != ALL_DESKTOPS) && (tk->desktop != d->desktop_number))
+    if (tk->visible_on_pixmap)
+        pager_set_damaged(tk->pager, tk->drawn_desktop, &tk->drawn_geometry, tk->drawn_shaded);
+}
+
+/* Start, resize or stop watching the window content.
+ * The miniature is never larger than the representation of the window on the pager,
+ * so its cost does not depend on the size of the window. */
+static void task_update_miniature(PagerTask * tk)
+{
+    PagerPlugin * pg = tk->pager;
+
+    if (!pg->miniatures || pg->number_of_desktops < 1)
+    {
+        wtl_thumbnail_unwatch(tk->miniature_watch);
+        tk->miniature_watch = NULL;
+        if (tk->miniature_surface)
+        {
+            cairo_surface_destroy(tk->miniature_surface);
+            tk->miniature_surface = NULL;
+        }
         return;
+    }
 
-    /* Scale the representation of the window to the drawing area. */
-    int x = (gfloat) tk->x * d->scale_x;
-    int y = (gfloat) tk->y * d->scale_y;
-    int w = (gfloat) tk->w * d->scale_x;
-    int h = ((tk->nws.shaded) ? 3 : (gfloat) tk->h * d->scale_y);
-    if ((w >= 3) && (h >= 3))
+    PagerDesktop * d = pg->desks[0];
+    int width = MAX(1, (int) ((gfloat) tk->drawn_geometry.width * d->scale_x));
+    int height = MAX(1, (int) ((gfloat) tk->drawn_geometry.height * d->scale_y));
+
+    if (!tk->miniature_watch)
+    {
+        tk->miniature_watch = wtl_thumbnail_watch(tk->win, width, height, MINIATURE_REFRESH_INTERVAL,
+            (WtlThumbnailFunc) task_miniature_changed, tk);
+        /* The window may already be watched by someone else; use the image the cache has until it refreshes. */
+        GdkPixbuf * pixbuf = wtl_thumbnail_watch_get_pixbuf(tk->miniature_watch);
+        if (pixbuf)
+            task_miniature_changed(pixbuf, tk);
+    }
+    else
     {
-        /* Draw the window representation and a border. */
-        GtkWidget * widget = GTK_WIDGET(d->da);
+        wtl_thumbnail_watch_set_size(tk->miniature_watch, width, height);
+    }
+}
+
+/* Compute the area of the backing pixmap covered by the representation of a window, including its border.
+ * Returns FALSE if the window is too small to be drawn. */
+static gboolean task_get_pixmap_area(PagerDesktop * d, const GdkRectangle * geometry, gboolean shaded, GdkRectangle * area)
+{
+    /* Scale the representation of the window to the drawing area. */
+    int x = (gfloat) geometry->x * d->scale_x;
+    int y = (gfloat) geometry->y * d->scale_y;
+    int w = (gfloat) geometry->width * d->scale_x;
+    int h = ((shaded) ? 3 : (gfloat) geometry->height * d->scale_y);
+    if ((w < 3) || (h < 3))
+        return FALSE;
 
-        cairo_t * cr = gdk_cairo_create(d->pixmap);
+    area->x = x;
+    area->y = y;
+    area->width = w;
+    area->height = h;
+    return TRUE;
+}
 
-        cairo_set_line_width (cr, 1.0);
-        cairo_set_line_cap (cr, CAIRO_LINE_CAP_SQUARE);
+/* Draw the representation of a task's window on the backing pixmap, if it intersects the region being repainted. */
+static void task_update_pixmap(PagerTask * tk, PagerDesktop * d, cairo_t * cr, GdkRegion * region)
+{
+    if (!tk->visible_on_pixmap)
+        return;
 
-        if (d->pg->focused_task == tk)
-            gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_SELECTED]);
-        else
-            gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_NORMAL]);
+    if ((tk->drawn_desktop != ALL_DESKTOPS) && (tk->drawn_desktop != d->desktop_number))
+        return;
 
-        cairo_rectangle(cr, x + 0.5, y + 0.5, w, h);
-        cairo_fill(cr);
+    GdkRectangle area;
+    if (!task_get_pixmap_area(d, &tk->drawn_geometry, tk->drawn_shaded, &area))
+        return;
 
-        if (d->pg->focused_task == tk)
-            gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_SELECTED]);
-        else
-            gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_NORMAL]);
+    /* The border is stroked along the right and bottom edges, one pixel outside of the area. */
+    GdkRectangle bounds = area;
+    bounds.width += 1;
+    bounds.height += 1;
+    if (gdk_region_rect_in(region, &bounds) == GDK_OVERLAP_RECTANGLE_OUT)
+        return;
 
-        cairo_rectangle(cr, x + 0.5, y + 0.5, w, h);
-        cairo_stroke(cr);
+    /* Draw the window representation and a border. */
+    GtkWidget * widget = GTK_WIDGET(d->da);
 
-        cairo_destroy(cr);
+    if (d->pg->focused_task == tk)
+        gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_SELECTED]);
+    else
+        gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_NORMAL]);
 
+    cairo_rectangle(cr, area.x + 0.5, area.y + 0.5, area.width, area.height);
+    cairo_fill(cr);
+
+    /* Draw the window content over the background, if there is a miniature of it. */
+    cairo_surface_t * miniature = (tk->drawn_shaded) ? NULL : tk->miniature_surface;
+    if (miniature != NULL)
+    {
+        cairo_save(cr);
+        cairo_rectangle(cr, area.x + 1, area.y + 1, area.width - 1, area.height - 1);
+        cairo_clip(cr);
+        cairo_translate(cr, area.x + 1, area.y + 1);
+        cairo_scale(cr,
+            (double) (area.width - 1) / cairo_image_surface_get_width(miniature),
+            (double) (area.height - 1) / cairo_image_surface_get_height(miniature));
+        cairo_set_source_surface(cr, miniature, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
     }
+
+    if (d->pg->focused_task == tk)
+        gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_SELECTED]);
+    else
+        gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_NORMAL]);
+
+    cairo_rectangle(cr, area.x + 0.5, area.y + 0.5, area.width, area.height);
+    cairo_stroke(cr);
 }
 
 /*****************************************************************
@@ -282,29 +443,67 @@ static void task_update_pixmap(PagerTask * tk, PagerDesktop * d)
 static void desktop_set_dirty(PagerDesktop * d)
 {
     d->dirty = TRUE;
+    if (d->damage != NULL)
+    {
+        gdk_region_destroy(d->damage);
+        d->damage = NULL;
+    }
     gtk_widget_queue_draw(d->da);
 }
 
-/* Mark all desktops for redraw. */
-static void pager_set_dirty_all_desktops(PagerPlugin * pg)
+/* Mark the area of a desktop covered by a window representation for redraw. */
+static void desktop_set_damaged(PagerDesktop * d, const GdkRectangle * geometry, gboolean shaded)
+{
+    /* Nothing to do if the whole desktop is going to be redrawn anyway. */
+    if ((d->dirty) || (d->pixmap == NULL))
+        return;
+
+    GdkRectangle area;
+    if (!task_get_pixmap_area(d, geometry, shaded, &area))
+        return;
+
+    /* Include the border and antialiasing spill. */
+    area.x -= 1;
+    area.y -= 1;
+    area.width += 3;
+    area.height += 3;
+
+    if (d->damage == NULL)
+        d->damage = gdk_region_rectangle(&area);
+    else
+        gdk_region_union_with_rect(d->damage, &area);
+
+    gtk_widget_queue_draw_area(d->da, area.x, area.y, area.width, area.height);
+}
+
+/* Mark the area covered by a window representation for redraw on every desktop it is shown on. */
+static void pager_set_damaged(PagerPlugin * pg, int desktop, const GdkRectangle * geometry, gboolean shaded)
 {
     int i;
     for (i = 0; i < pg->number_of_desktops; i++)
-        desktop_set_dirty(pg->desks[i]);
+    {
+        if ((desktop == ALL_DESKTOPS) || (desktop == i))
+            desktop_set_damaged(pg->desks[i], geometry, shaded);
+    }
 }
 
-/* Mark the desktop on which a specified window resides for redraw. */
+/* Mark the old and the new representation of a specified window for redraw. */
 static void task_set_desktop_dirty(PagerTask * tk)
 {
     PagerPlugin * pg = tk->pager;
 
-    if (tk->visible_on_pixmap || task_is_visible(tk))
-    {
-        if (tk->desktop >= 0 && tk->desktop < pg->number_of_desktops)
-            desktop_set_dirty(pg->desks[tk->desktop]);
-        else
-            pager_set_dirty_all_desktops(pg);
-    }
+    if (tk->visible_on_pixmap)
+        pager_set_damaged(pg, tk->drawn_desktop, &tk->drawn_geometry, tk->drawn_shaded);
+
+    tk->visible_on_pixmap = task_is_visible(tk);
+    tk->drawn_desktop = tk->desktop;
+    task_get_frame_geometry(tk, &tk->drawn_geometry);
+    tk->drawn_shaded = tk->nws.shaded;
+
+    if (tk->visible_on_pixmap)
+        pager_set_damaged(pg, tk->drawn_desktop, &tk->drawn_geometry, tk->drawn_shaded);
+
+    task_update_miniature(tk);
 }
 
 static gboolean on_task_set_desktop_dirty_deferred_timeout(PagerTask * tk)
@@ -317,7 +516,7 @@ static gboolean on_task_set_desktop_dirty_deferred_timeout(PagerTask * tk)
 static void task_set_desktop_dirty_deferred(PagerTask * tk)
 {
     if (!tk->dirty_deferred_timeout)
-        tk->dirty_deferred_timeout = g_timeout_add(250, (GSourceFunc) on_task_set_desktop_dirty_deferred_timeout, tk);
+        tk->dirty_deferred_timeout = plugin_timeout_add(tk->pager->plugin, 250, (GSourceFunc) on_task_set_desktop_dirty_deferred_timeout, tk);
 }
 
 /* Handler for configure_event on drawing area. */
@@ -337,6 +536,14 @@ static gboolean desktop_configure_event(GtkWidget * widget, GdkEventConfigure *
         d->scale_y = (gfloat) widget->allocation.height / (gfloat) gdk_screen_height();
         d->scale_x = (gfloat) widget->allocation.width  / (gfloat) gdk_screen_width();
         desktop_set_dirty(d);
+
+        /* The miniatures follow the size of the desktop representation. */
+        if (d->desktop_number == 0)
+        {
+            PagerTask * tk;
+            for (tk = d->pg->task_list; tk != NULL; tk = tk->task_flink)
+                task_update_miniature(tk);
+        }
      }
 
     /* Resize to optimal size. */
@@ -346,39 +553,55 @@ static gboolean desktop_configure_event(GtkWidget * widget, GdkEventConfigure *
     return FALSE;
 }
 
+/* Recompute the part of the backing pixmap covered by a region. */
+static void desktop_repaint(PagerDesktop * d, GdkRegion * region)
+{
+    PagerPlugin * pg = d->pg;
+    GtkWidget * widget = GTK_WIDGET(d->da);
+
+    cairo_t * cr = gdk_cairo_create(d->pixmap);
+    gdk_cairo_region(cr, region);
+    cairo_clip(cr);
+
+    /* Erase the pixmap. */
+    if (d->desktop_number == pg->current_desktop)
+        gdk_cairo_set_source_color(cr, &widget->style->dark[GTK_STATE_SELECTED]);
+    else
+        gdk_cairo_set_source_color(cr, &widget->style->dark[GTK_STATE_NORMAL]);
+    cairo_paint(cr);
+
+    /* Draw tasks onto the pixmap. */
+    cairo_set_line_width (cr, 1.0);
+    cairo_set_line_cap (cr, CAIRO_LINE_CAP_SQUARE);
+
+    int j;
+    for (j = 0; j < pg->client_count; j++)
+        task_update_pixmap(pg->tasks_in_stacking_order[j], d, cr, region);
+
+    cairo_destroy(cr);
+}
+
 /* Handler for expose_event on drawing area. */
 static gboolean desktop_expose_event(GtkWidget * widget, GdkEventExpose * event, PagerDesktop * d)
 {
     if (d->pixmap != NULL)
     {
-        /* Recompute the pixmap if needed. */
+        /* Recompute the pixmap if needed: entirely if dirty, otherwise only the damaged area. */
+        GdkRegion * region = d->damage;
+        d->damage = NULL;
         if (d->dirty)
         {
             d->dirty = FALSE;
-            PagerPlugin * pg = d->pg;
-
-            /* Erase the pixmap. */
-            if (d->pixmap != NULL)
-            {
-                GtkWidget * widget = GTK_WIDGET(d->da);
-
-                cairo_t * cr = gdk_cairo_create(d->pixmap);
-
-                if (d->desktop_number == d->pg->current_desktop)
-                    gdk_cairo_set_source_color(cr, &widget->style->dark[GTK_STATE_SELECTED]);
-                else
-                    gdk_cairo_set_source_color(cr, &widget->style->dark[GTK_STATE_NORMAL]);
-
-                cairo_rectangle(cr, 0, 0, widget->allocation.width, widget->allocation.height);
-                cairo_fill(cr);
-
-                cairo_destroy(cr);
-            }
+            if (region != NULL)
+                gdk_region_destroy(region);
+            GdkRectangle all = { 0, 0, widget->allocation.width, widget->allocation.height };
+            region = gdk_region_rectangle(&all);
+        }
 
-            /* Draw tasks onto the pixmap. */
-            int j;
-            for (j = 0; j < pg->client_count; j++)
-                task_update_pixmap(pg->tasks_in_stacking_order[j], d);
+        if (region != NULL)
+        {
+            desktop_repaint(d, region);
+            gdk_region_destroy(region);
         }
 
         /* Draw the requested part of the pixmap onto the drawing area. */
@@ -443,7 +666,7 @@ static void desktop_new(PagerPlugin * pg, int desktop_number)
     gtk_widget_add_events (d->da, GDK_EXPOSURE_MASK | GDK_BUTTON_PRESS_MASK);
 
     /* Connect signals. */
-    g_signal_connect(G_OBJECT(d->da), "expose_event", G_CALLBACK(desktop_expose_event), (gpointer) d);
+    plugin_signal_connect(pg->plugin, G_OBJECT(d->da), "expose_event", G_CALLBACK(desktop_expose_event), (gpointer) d);
     g_signal_connect(G_OBJECT(d->da), "configure_event", G_CALLBACK(desktop_configure_event), (gpointer) d);
     g_signal_connect(G_OBJECT(d->da), "scroll-event", G_CALLBACK(desktop_scroll_event), (gpointer) d);
     g_signal_connect(G_OBJECT(d->da), "button_press_event", G_CALLBACK(desktop_button_press_event), (gpointer) d);
@@ -467,6 +690,9 @@ static void desktop_free(PagerPlugin * pg, int desktop_number)
     if (d->pixmap != NULL)
         g_object_unref(d->pixmap);
 
+    if (d->damage != NULL)
+        gdk_region_destroy(d->damage);
+
     g_free(d);
 }
 
@@ -511,10 +737,14 @@ static void pager_property_notify_event(PagerPlugin * pg, XEvent * ev)
                 {
                     /* Window changed desktop.
                      * Mark both old and new desktops for redraw. */
-                    task_set_desktop_dirty(tk);
                     tk->desktop = wtl_x11_get_net_wm_desktop(tk->win);
                     task_set_desktop_dirty(tk);
                 }
+                else if (at == pg->a_net_frame_extents)
+                {
+                    /* Window manager changed the decorations. */
+                    wtl_x11_request_property(tk->win, pg->a_net_frame_extents, XA_CARDINAL, (WtlX11PropertyFunc) task_frame_extents_reply, tk);
+                }
 
                 XSetErrorHandler(previous_error_handler);
             }
@@ -522,26 +752,110 @@ static void pager_property_notify_event(PagerPlugin * pg, XEvent * ev)
     }
 }
 
-/* Handle ConfigureNotify event. */
+/* Redraw the tasks that were moved or resized since the last update. */
+static gboolean on_pager_geometry_update_timeout(PagerPlugin * pg)
+{
+    pg->geometry_update_timeout = 0;
+
+    PagerTask * tk;
+    for (tk = pg->task_list; tk != NULL; tk = tk->task_flink)
+    {
+        if (!tk->geometry_pending)
+            continue;
+        tk->geometry_pending = FALSE;
+
+        /* A reparented window is the only case that needs a query. */
+        if (tk->geometry_query_needed)
+        {
+            tk->geometry_query_needed = FALSE;
+            task_get_geometry(tk);
+        }
+
+        GdkRectangle geometry;
+        task_get_frame_geometry(tk, &geometry);
+        if ((geometry.x != tk->drawn_geometry.x) || (geometry.y != tk->drawn_geometry.y)
+        ||  (geometry.width != tk->drawn_geometry.width) || (geometry.height != tk->drawn_geometry.height))
+            task_set_desktop_dirty(tk);
+    }
+
+    return FALSE;
+}
+
+/* Remember that a task needs its representation updated. */
+static void task_schedule_geometry_update(PagerTask * tk)
+{
+    PagerPlugin * pg = tk->pager;
+    tk->geometry_pending = TRUE;
+    if (!pg->geometry_update_timeout)
+        pg->geometry_update_timeout = plugin_timeout_add(pg->plugin, GEOMETRY_UPDATE_INTERVAL, (GSourceFunc) on_pager_geometry_update_timeout, pg);
+}
+
+/* Handle ConfigureNotify event.
+ * The geometry is taken from the event, so no request is sent to the X server.
+ * Interactive moves and resizes produce a burst of events, so the redraw is coalesced. */
 static void pager_configure_notify_event(PagerPlugin * pg, XEvent * ev)
 {
-    Window win = ev->xconfigure.window;
-    PagerTask * tk = task_lookup(pg, win);
+    XConfigureEvent * xce = &ev->xconfigure;
+    if (xce->event != xce->window)
+        return;
+
+    PagerTask * tk = task_lookup(pg, xce->window);
     if (tk != NULL)
     {
-        task_get_geometry(tk);
-        task_set_desktop_dirty(tk);
+        if (xce->send_event)
+        {
+            /* Synthetic event from the window manager: the position is in root coordinates (ICCCM 4.1.5).
+             * The frame moved, so move the parent origin along with it. */
+            tk->parent_x += xce->x - tk->x;
+            tk->parent_y += xce->y - tk->y;
+            tk->x = xce->x;
+            tk->y = xce->y;
+        }
+        else
+        {
+            /* Real event: the position is relative to the parent. */
+            tk->x = tk->parent_x + xce->x;
+            tk->y = tk->parent_y + xce->y;
+        }
+        tk->w = xce->width;
+        tk->h = xce->height;
+        task_schedule_geometry_update(tk);
+    }
+}
+
+/* Handle ReparentNotify event.
+ * Reparenting into the root window needs no query; reparenting into a frame does. */
+static void pager_reparent_notify_event(PagerPlugin * pg, XEvent * ev)
+{
+    XReparentEvent * xre = &ev->xreparent;
+    if (xre->event != xre->window)
+        return;
+
+    PagerTask * tk = task_lookup(pg, xre->window);
+    if (tk != NULL)
+    {
+        if (xre->parent == wtl_x11_root())
+        {
+            tk->parent_x = tk->parent_y = 0;
+            tk->x = xre->x;
+            tk->y = xre->y;
+        }
+        else
+            tk->geometry_query_needed = TRUE;
+        task_schedule_geometry_update(tk);
     }
 }
 
 /* GDK event filter. */
 static GdkFilterReturn pager_event_filter(XEvent * xev, GdkEvent * event, PagerPlugin * pg)
 {
-    /* Look for PropertyNotify and ConfigureNotify events and update state. */
+    /* Look for PropertyNotify, ConfigureNotify and ReparentNotify events and update state. */
     if (xev->type == PropertyNotify)
         pager_property_notify_event(pg, xev);
     else if (xev->type == ConfigureNotify)
         pager_configure_notify_event(pg, xev);
+    else if (xev->type == ReparentNotify)
+        pager_reparent_notify_event(pg, xev);
     return GDK_FILTER_CONTINUE;
 }
 
@@ -668,92 +982,131 @@ static void pager_net_number_of_desktops(FbEv * ev, PagerPlugin * pg)
     pager_net_client_list_stacking(NULL, pg);
 }
 
+/* Mark for redraw the tasks that were raised or lowered relative to the others.
+ * The tasks that kept their relative order form the longest increasing subsequence of their old positions;
+ * only the rest can change what is drawn on top, so raising one window redraws just that window. */
+static void pager_invalidate_restacked_tasks(PagerTask * * tasks, int count)
+{
+    if (count == 0)
+        return;
+
+    int * tails = g_new(int, count);        /* Index of the smallest tail of an increasing run of each length */
+    int * predecessors = g_new(int, count);
+    gboolean * kept = g_new0(gboolean, count);
+    int length = 0;
+
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        int stacking = tasks[i]->stacking;
+        predecessors[i] = -1;
+        if (stacking < 0)
+            continue;
+
+        /* Binary search for the longest run that this task can extend. */
+        int low = 0;
+        int high = length;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (tasks[tails[middle]]->stacking < stacking)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        if (low > 0)
+            predecessors[i] = tails[low - 1];
+        tails[low] = i;
+        if (low == length)
+            length++;
+    }
+
+    if (length > 0)
+    {
+        for (i = tails[length - 1]; i >= 0; i = predecessors[i])
+            kept[i] = TRUE;
+    }
+
+    /* New tasks were already drawn when they were created. */
+    for (i = 0; i < count; i++)
+    {
+        if (!kept[i] && tasks[i]->stacking >= 0)
+            task_set_desktop_dirty(tasks[i]);
+    }
+
+    g_free(tails);
+    g_free(predecessors);
+    g_free(kept);
+}
+
 /* Handler for "net-client-list-stacking" event from root window listener. */
 static void pager_net_client_list_stacking(FbEv * ev, PagerPlugin * pg)
 {
     /* Get the NET_CLIENT_LIST_STACKING property. */
-    Window * client_list = wtl_x11_get_xa_property(wtl_x11_root(), a_NET_CLIENT_LIST_STACKING, XA_WINDOW, &pg->client_count);
-    g_free(pg->tasks_in_stacking_order);
+    int client_count = 0;
+    Window * client_list = wtl_x11_get_xa_property(wtl_x11_root(), a_NET_CLIENT_LIST_STACKING, XA_WINDOW, &client_count);
+    if (client_list == NULL)
+        client_count = 0;
+
     /* g_new returns NULL if if n_structs == 0 */
-    pg->tasks_in_stacking_order = g_new(PagerTask *, pg->client_count);
+    PagerTask * * tasks_in_stacking_order = g_new(PagerTask *, client_count);
 
-    if (client_list != NULL)
+    /* Loop over client list, correlating it with task list.
+     * Also generate a vector of task pointers in stacking order. */
+    int i;
+    for (i = 0; i < client_count; i++)
     {
-        /* Loop over client list, correlating it with task list.
-         * Also generate a vector of task pointers in stacking order. */
-        int i;
-        for (i = 0; i < pg->client_count; i++)
-        {
-            /* Search for the window in the task list.  Set up context to do an insert right away if needed. */
-            PagerTask * tk_pred = NULL;
-            PagerTask * tk_cursor;
-            PagerTask * tk = NULL;
-            for (tk_cursor = pg->task_list; tk_cursor != NULL; tk_pred = tk_cursor, tk_cursor = tk_cursor->task_flink)
-            {
-                if (tk_cursor->win == client_list[i])
-                {
-                    tk = tk_cursor;
-                    break;
-                }
-                if (tk_cursor->win > client_list[i])
-                    break;
-            }
-
-            /* Task is already in task list. */
-            if (tk != NULL)
-            {
-                tk->present_in_client_list = TRUE;
-
-                /* If the stacking position changed, redraw the desktop. */
-                if (tk->stacking != i)
-                {
-                    tk->stacking = i;
-                    task_set_desktop_dirty(tk);
-                }
-            }
+        PagerTask * tk = task_lookup(pg, client_list[i]);
 
-            /* Task is not in task list. */
+        /* Task is not in task list. */
+        if (tk == NULL)
+        {
+            /* Allocate and initialize new task structure. */
+            tk = g_new0(PagerTask, 1);
+            tk->pager = pg;
+            tk->stacking = -1;
+            tk->win = client_list[i];
+            if (!wtl_x11_is_my_own_window(tk->win))
+                XSelectInput(wtl_x11_display(), tk->win, PropertyChangeMask | StructureNotifyMask);
+            tk->ws = wtl_x11_get_wm_state(tk->win);
+            tk->desktop = wtl_x11_get_net_wm_desktop(tk->win);
+            wtl_x11_get_net_wm_state(tk->win, &tk->nws);
+            wtl_x11_get_net_wm_window_type(tk->win, &tk->nwwt);
+            task_get_geometry(tk);
+            wtl_x11_request_property(tk->win, pg->a_net_frame_extents, XA_CARDINAL, (WtlX11PropertyFunc) task_frame_extents_reply, tk);
+
+            /*
+                Sometimes 0 means WM just has not set the value yet.
+                We are deferring updating the image and waiting for some time to avoid flickering.
+            */
+            if (tk->desktop == 0)
+                task_set_desktop_dirty_deferred(tk);
             else
-            {
-                /* Allocate and initialize new task structure. */
-                tk = g_new0(PagerTask, 1);
-                tk->pager = pg;
-                tk->present_in_client_list = TRUE;
-                tk->win = client_list[i];
-                if (!wtl_x11_is_my_own_window(tk->win))
-                    XSelectInput(wtl_x11_display(), tk->win, PropertyChangeMask | StructureNotifyMask);
-                tk->ws = wtl_x11_get_wm_state(tk->win);
-                tk->desktop = wtl_x11_get_net_wm_desktop(tk->win);
-                wtl_x11_get_net_wm_state(tk->win, &tk->nws);
-                wtl_x11_get_net_wm_window_type(tk->win, &tk->nwwt);
-                task_get_geometry(tk);
-
-                /*
-                    Sometimes 0 means WM just has not set the value yet.
-                    We are deferring updating the image and waiting for some time to avoid flickering.
-                */
-                if (tk->desktop == 0)
-                    task_set_desktop_dirty_deferred(tk);
-                else
-                    task_set_desktop_dirty(tk);
+                task_set_desktop_dirty(tk);
 
-                /* Link the task structure into the task list. */
-                if (tk_pred == NULL)
-                {
-                    tk->task_flink = pg->task_list;
-                    pg->task_list = tk;
-                }
-                else
-                {
-                    tk->task_flink = tk_pred->task_flink;
-                    tk_pred->task_flink = tk;
-                }
-            }
-            pg->tasks_in_stacking_order[i] = tk;
+            /* Link the task structure into the task list and the index. */
+            tk->task_flink = pg->task_list;
+            pg->task_list = tk;
+            g_hash_table_insert(pg->task_table, GUINT_TO_POINTER(tk->win), tk);
         }
-        XFree(client_list);
+
+        tk->present_in_client_list = TRUE;
+        tasks_in_stacking_order[i] = tk;
     }
 
+    if (client_list != NULL)
+        XFree(client_list);
+
+    /* Redraw only the windows whose stacking relative to the others changed. */
+    pager_invalidate_restacked_tasks(tasks_in_stacking_order, client_count);
+    for (i = 0; i < client_count; i++)
+        tasks_in_stacking_order[i]->stacking = i;
+
+    g_free(pg->tasks_in_stacking_order);
+    pg->tasks_in_stacking_order = tasks_in_stacking_order;
+    pg->client_count = client_count;
+
     /* Remove windows from the task list that are not present in the NET_CLIENT_LIST_STACKING. */
     PagerTask * tk_pred = NULL;
     PagerTask * tk = pg->task_list;
@@ -783,6 +1136,13 @@ static int pager_constructor(Plugin * plug)
     PagerPlugin * pg = g_new0(PagerPlugin, 1);
     plugin_set_priv(plug, pg);
     pg->plugin = plug;
+    pg->task_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    pg->a_net_frame_extents = gdk_x11_get_xatom_by_name("_NET_FRAME_EXTENTS");
+
+    su_json_read_options(plugin_inner_json(plug), option_definitions, pg);
+    pg->miniatures = pg->show_miniatures
+        && panel_is_composite_available(plugin_panel(plug))
+        && wtl_thumbnail_is_available();
 
     /* Compute aspect ratio of screen image. */
     pg->aspect_ratio = (gfloat) gdk_screen_width() / (gfloat) gdk_screen_height();
@@ -804,14 +1164,14 @@ static int pager_constructor(Plugin * plug)
     //icon_grid_debug_output(pg->icon_grid, TRUE);
 
     /* Add GDK event filter. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) pager_event_filter, pg);
+    plugin_add_event_filter(pg->plugin, (GdkFilterFunc) pager_event_filter, pg);
 
     /* Connect signals to receive root window events and initialize root window properties. */
-    g_signal_connect(G_OBJECT(fbev), "current_desktop", G_CALLBACK(pager_net_current_desktop), (gpointer) pg);
-    g_signal_connect(G_OBJECT(fbev), "active_window", G_CALLBACK(pager_net_active_window), (gpointer) pg);
-    g_signal_connect(G_OBJECT(fbev), "desktop_names", G_CALLBACK(pager_net_desktop_names), (gpointer) pg);
-    g_signal_connect(G_OBJECT(fbev), "number_of_desktops", G_CALLBACK(pager_net_number_of_desktops), (gpointer) pg);
-    g_signal_connect(G_OBJECT(fbev), "client_list_stacking", G_CALLBACK(pager_net_client_list_stacking), (gpointer) pg);
+    plugin_signal_connect(pg->plugin, G_OBJECT(fbev), "current_desktop", G_CALLBACK(pager_net_current_desktop), (gpointer) pg);
+    plugin_signal_connect(pg->plugin, G_OBJECT(fbev), "active_window", G_CALLBACK(pager_net_active_window), (gpointer) pg);
+    plugin_signal_connect(pg->plugin, G_OBJECT(fbev), "desktop_names", G_CALLBACK(pager_net_desktop_names), (gpointer) pg);
+    plugin_signal_connect(pg->plugin, G_OBJECT(fbev), "number_of_desktops", G_CALLBACK(pager_net_number_of_desktops), (gpointer) pg);
+    plugin_signal_connect(pg->plugin, G_OBJECT(fbev), "client_list_stacking", G_CALLBACK(pager_net_client_list_stacking), (gpointer) pg);
 
     /* Allocate per-desktop structures. */
     pager_net_number_of_desktops(fbev, pg);
@@ -827,7 +1187,7 @@ static void pager_destructor(Plugin * p)
     icon_grid_to_be_removed(pg->icon_grid);
 
     /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) pager_event_filter, pg);
+    plugin_remove_event_filter(pg->plugin, (GdkFilterFunc) pager_event_filter, pg);
 
     /* Remove root window signal handlers. */
     g_signal_handlers_disconnect_by_func(G_OBJECT(fbev), pager_net_current_desktop, pg);
@@ -835,6 +1195,9 @@ static void pager_destructor(Plugin * p)
     g_signal_handlers_disconnect_by_func(G_OBJECT(fbev), pager_net_number_of_desktops, pg);
     g_signal_handlers_disconnect_by_func(G_OBJECT(fbev), pager_net_client_list_stacking, pg);
 
+    if (pg->geometry_update_timeout)
+        g_source_remove(pg->geometry_update_timeout);
+
     /* Deallocate task list. */
     while (pg->task_list != NULL)
         task_delete(pg->task_list, TRUE);
@@ -846,10 +1209,51 @@ static void pager_destructor(Plugin * p)
 
     /* Deallocate all memory. */
     icon_grid_free(pg->icon_grid);
+    g_hash_table_destroy(pg->task_table);
     g_free(pg->tasks_in_stacking_order);
     g_free(pg);
 }
 
+/* Callback when the configuration dialog changes a setting. */
+static void pager_apply_configuration(Plugin * p)
+{
+    PagerPlugin * pg = PRIV(p);
+
+    /* Fall back to plain rectangles if the X server cannot provide window contents. */
+    pg->miniatures = pg->show_miniatures
+        && panel_is_composite_available(plugin_panel(p))
+        && wtl_thumbnail_is_available();
+
+    PagerTask * tk;
+    for (tk = pg->task_list; tk != NULL; tk = tk->task_flink)
+        task_update_miniature(tk);
+
+    int i;
+    for (i = 0; i < pg->number_of_desktops; i++)
+        desktop_set_dirty(pg->desks[i]);
+}
+
+/* Callback when the configuration dialog is to be shown. */
+static void pager_configure(Plugin * p, GtkWindow * parent)
+{
+    PagerPlugin * pg = PRIV(p);
+    GtkWidget * dialog = wtl_create_generic_config_dialog(
+        _(plugin_class(p)->name),
+        GTK_WIDGET(parent),
+        (GSourceFunc) pager_apply_configuration, (gpointer) p,
+        _("Show window contents (requires compositing)"), &pg->show_miniatures, (GType)CONF_TYPE_BOOL,
+        NULL);
+    if (dialog)
+        gtk_window_present(GTK_WINDOW(dialog));
+}
+
+/* Callback when the configuration is to be saved. */
+static void pager_save_configuration(Plugin * p)
+{
+    PagerPlugin * pg = PRIV(p);
+    su_json_write_options(plugin_inner_json(p), option_definitions, pg);
+}
+
 /* Callback when panel configuration changes. */
 static void pager_panel_configuration_changed(Plugin * p)
 {
@@ -876,5 +1280,7 @@ SYMBOL_PLUGIN_CLASS PluginClass pager_plugin_class = {
 
     constructor : pager_constructor,
     destructor  : pager_destructor,
+    show_properties : pager_configure,
+    save_configuration : pager_save_configuration,
     panel_configuration_changed : pager_panel_configuration_changed
 };
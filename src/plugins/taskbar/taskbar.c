@@ -35,11 +35,11 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
-#include <X11/extensions/Xcomposite.h>
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gdk-pixbuf-xlib/gdk-pixbuf-xlib.h>
 #include <gdk/gdk.h>
+#include <gdk/gdkkeysyms.h>
 #include <glib/gi18n.h>
 
 #include <sde-utils.h>
@@ -53,8 +53,12 @@
 #include <waterline/global.h>
 #include <waterline/panel.h>
 #include <waterline/misc.h>
+#include <waterline/icon_cache.h>
+#include <waterline/pixbuf_ops.h>
 #include <waterline/launch.h>
 #include <waterline/plugin.h>
+#include <waterline/thumbnail_cache.h>
+#include <waterline/x11_async.h>
 #include <waterline/x11_utils.h>
 #include <waterline/x11_wrappers.h>
 
@@ -221,6 +225,9 @@ struct _taskbar;
 struct _task_class;
 struct _task;
 
+/* Desktops beyond this share one slot in the per-desktop counters and class index. */
+#define MAX_COUNTED_DESKTOPS 64
+
 /* Structure representing a class. */
 typedef struct _task_class {
     struct _task_class * task_class_flink; /* Forward link */
@@ -231,9 +238,14 @@ typedef struct _task_class {
     int visible_count;                     /* Count of tasks that are visible in current desktop */
     int timestamp;
 
+    int * desktop_task_count;              /* Count of tasks on each desktop, indexed by desktop number */
+    int desktop_task_count_size;           /* Allocated size of desktop_task_count */
+    int other_desktop_task_count;          /* Count of tasks on desktops beyond MAX_COUNTED_DESKTOPS */
+
     int manual_order;
 
     gboolean fold_by_count;
+    gboolean fold_by_count_planned;        /* Scratch flag of the fold-by-count planner */
 
     gboolean unfold;
     gboolean manual_unfold_state;
@@ -252,6 +264,10 @@ typedef struct _task {
     char * name_shaded;             /* Taskbar label when shaded */
     Atom name_source;               /* Atom that is the source of taskbar label */
     gboolean name_changed;
+    gboolean name_pending;          /* The title has changed, but has not been fetched yet */
+    Atom pending_name_source;       /* Atom that changed, or None if several did */
+    guint name_update_timer;        /* Deferred fetch of the title */
+    gint64 name_fetch_time;         /* When the title was last fetched */
 
     char * wm_class;
 
@@ -286,7 +302,18 @@ typedef struct _task {
     unsigned int entered_state : 1;     /* True if cursor is inside taskbar button */
     unsigned int present_in_client_list : 1; /* State during WM_CLIENT_LIST processing to detect deletions */
 
-    unsigned int deferred_iconified_update : 1;
+    /* Last decoded WM_HINTS. */
+    unsigned int wm_hints_valid : 1;    /* True if the fields below have been fetched */
+    long wm_hints_flags;                /* Flags word of WM_HINTS */
+    Pixmap wm_hints_icon_pixmap;        /* Icon pixmap, if IconPixmapHint is set */
+    Pixmap wm_hints_icon_mask;          /* Icon mask, if IconMaskHint is set */
+
+    /* Render state. */
+    unsigned int dirty;                /* TASK_DIRTY_* parts of the button that need to be redrawn */
+    char * drawn_label;                /* Label text last drawn, to skip relayout when nothing changed */
+    unsigned int drawn_label_style;    /* Label style last drawn */
+    char * drawn_tooltip;              /* Tooltip last set on the button */
+    char * drawn_preview_name;         /* Name last set on the preview item */
 
     int timestamp;
 
@@ -314,14 +341,16 @@ typedef struct _task {
     GdkPixbuf * icon_for_bgcolor;
     guint update_bgcolor_cb;
 
-    Pixmap backing_pixmap;             /* Backing pixmap of the window. (0 if not visible) */
-    GdkPixbuf * thumbnail;             /* Latest copy of window content (full size). If backing_pixmap became 0, thumbnail stays valid.*/
+    WtlThumbnailWatch * thumbnail_watch; /* Watch on the shared thumbnail cache, NULL if thumbnails are off */
+    GdkPixbuf * thumbnail;             /* Latest copy of window content, scaled down to preview size. Stays valid while the window is hidden. */
     GdkPixbuf * thumbnail_icon;        /* thumbnail, scaled to icon_size */
     GdkPixbuf * thumbnail_preview;     /* thumbnail, scaled to preview size */
-    guint update_composite_thumbnail_timeout; /* update_composite_thumbnail event source id */
-    guint update_composite_thumbnail_idle;
-    gboolean require_update_composite_thumbnail;
-    int update_composite_thumbnail_repeat_count;
+
+    /* Window list popup. */
+    GtkTreeIter window_list_iter;      /* Row in the window list model, valid if window_list_row is set */
+    gboolean window_list_row;
+    GdkPixbuf * window_list_icon;      /* Button icon scaled to menu size */
+    GdkPixbuf * window_list_icon_source; /* Pixbuf that window_list_icon was scaled from */
     guint update_thumbnail_preview_idle; /* update_thumbnail_preview event source id */
 
     PreviewPanelTaskItem preview_item;
@@ -342,6 +371,7 @@ typedef struct _taskbar {
     Plugin * plug;               /* Back pointer to Plugin */
     Task * task_list;            /* List of tasks to be displayed in taskbar */
     TaskClass * task_class_list; /* Window class list */
+    GHashTable * desktop_classes[MAX_COUNTED_DESKTOPS + 1]; /* Classes having tasks on each desktop */
     IconGrid * icon_grid;        /* Manager for taskbar buttons */
 
     int task_timestamp;                         /* To sort tasks and task classes by creation time. */
@@ -374,10 +404,24 @@ typedef struct _taskbar {
 
     /* Task popup: group menu or preview panel. */
 
-    GtkWidget * group_menu;              /* Group menu */
+    GtkWidget * group_menu;              /* Group menu: the window list while it is shown */
     GtkAllocation group_menu_alloc;
     gboolean group_menu_opened_as_popup;
 
+    GtkListStore * window_list_store;    /* One row per task, in taskbar order */
+    GtkTreeModel * window_list_filter;   /* Rows shown in the window list */
+    GtkWidget * window_list_window;
+    GtkWidget * window_list_scroll;
+    GtkWidget * window_list_view;
+    GtkCellRenderer * window_list_text_renderer;
+    gboolean window_list_grabbed;
+    Task * window_list_single_task;      /* Show only this task, if set */
+    gboolean window_list_by_class;       /* Show only tasks of window_list_class */
+    TaskClass * window_list_class;
+    gboolean window_list_filter_valid;   /* The filter is up to date with the selection and desktop below */
+    int window_list_filter_desktop;      /* Current desktop when the filter was last evaluated */
+    int preview_panel_orientation;       /* Orientation preview_panel_box1 was built for */
+
     GtkWidget * preview_panel_window;
     GtkWidget * preview_panel_box;
     GtkWidget * preview_panel_box1;
@@ -517,6 +561,11 @@ typedef struct _taskbar {
     gboolean moving_task_now;
 
     GdkColormap * color_map; /* cached value of panel_get_color_map(plug->panel) */
+
+    guint icon_theme_watch;
+
+    guint render_idle_cb;          /* Pending flush of dirty task buttons */
+    gboolean render_layout;        /* Flush also updates separators and window positions */
 } TaskbarPlugin;
 
 /******************************************************************************/
@@ -606,6 +655,17 @@ static gchar *taskbar_rc = "style 'taskbar-style'\n"
 #define ALL_WORKSPACES       0xFFFFFFFF /* 64-bit clean */
 #define ICON_ONLY_EXTRA      6          /* Amount needed to have button lay out symmetrically */
 #define BUTTON_HEIGHT_EXTRA  4          /* Amount needed to have button not clip icon */
+#define THUMBNAIL_PREVIEW_WIDTH     150
+#define THUMBNAIL_PREVIEW_HEIGHT    100
+#define THUMBNAIL_REFRESH_INTERVAL  1000 /* Shortest interval between refreshes of a thumbnail, in milliseconds */
+
+/* Parts of a task button that need to be redrawn. */
+#define TASK_DIRTY_STATE      (1 << 0)  /* Toggle and relief state */
+#define TASK_DIRTY_LABEL      (1 << 1)  /* Label text and style */
+#define TASK_DIRTY_TOOLTIP    (1 << 2)  /* Tooltips of the button and the preview item */
+#define TASK_DIRTY_ICON       (1 << 3)  /* Icon update deferred while the button was hidden or a desktop switch was pending */
+#define TASK_DIRTY_VISIBILITY (1 << 4)  /* Visibility in the icon grid */
+#define TASK_DIRTY_ALL        (TASK_DIRTY_STATE | TASK_DIRTY_LABEL | TASK_DIRTY_TOOLTIP | TASK_DIRTY_ICON | TASK_DIRTY_VISIBILITY)
 
 static void set_timer_on_task(Task * tk);
 
@@ -626,7 +686,7 @@ static void taskbar_redraw(TaskbarPlugin * tb);
 static gboolean accept_net_wm_state(NetWMState * nws);
 static gboolean accept_net_wm_window_type(NetWMWindowType * nwwt);
 static void task_free_names(Task * tk);
-static void task_set_names(Task * tk, Atom source);
+static gboolean task_set_names(Task * tk, Atom source);
 
 static void task_unlink_class(Task * tk);
 static TaskClass * taskbar_enter_class(TaskbarPlugin * tb, char * class_name, gboolean * name_consumed);
@@ -644,6 +704,10 @@ static void task_update_sorting(Task * tk, int sort_by);
 static void taskbar_check_hide_popup(TaskbarPlugin * tb);
 static void taskbar_hide_popup(TaskbarPlugin * tb);
 
+static void task_place_in_window_list(Task * tk);
+static void task_window_list_row_changed(Task * tk);
+static void task_remove_from_window_list(Task * tk);
+
 static gboolean flash_window_timeout(Task * tk);
 static void task_set_urgency(Task * tk);
 static void task_clear_urgency(Task * tk);
@@ -672,6 +736,7 @@ static void taskbar_net_current_desktop(GtkWidget * widget, TaskbarPlugin * tb);
 static void taskbar_net_number_of_desktops(GtkWidget * widget, TaskbarPlugin * tb);
 static void taskbar_net_desktop_names(FbEv * fbev, TaskbarPlugin * tb);
 static void taskbar_net_active_window(GtkWidget * widget, TaskbarPlugin * tb);
+static gboolean task_update_wm_hints(Task * tk);
 static gboolean task_has_urgency(Task * tk);
 static void taskbar_property_notify_event(TaskbarPlugin * tb, XEvent *ev);
 static GdkFilterReturn taskbar_event_filter(XEvent * xev, GdkEvent * event, TaskbarPlugin * tb);
@@ -701,7 +766,7 @@ static void set_timer_on_task(Task * tk)
 
     gint interval;
     g_object_get(gtk_widget_get_settings(tk->button), "gtk-cursor-blink-time", &interval, NULL);
-    tk->flash_timeout = g_timeout_add(interval, (GSourceFunc) flash_window_timeout, tk);
+    tk->flash_timeout = plugin_timeout_add(tk->tb->plug, interval, (GSourceFunc) flash_window_timeout, tk);
 }
 
 /******************************************************************************/
@@ -749,7 +814,7 @@ static gboolean taskbar_has_visible_tasks_on_desktop(TaskbarPlugin * tb, int des
 
 /* Task class getters. */
 
-static int task_class_is_folded(TaskbarPlugin * tb, TaskClass * tc)
+static int task_class_is_folded_ex(TaskbarPlugin * tb, TaskClass * tc, gboolean consider_fold_by_count)
 {
     if (!tb->grouped_tasks)
         return FALSE;
@@ -760,13 +825,18 @@ static int task_class_is_folded(TaskbarPlugin * tb, TaskClass * tc)
     if ((tb->_unfold_focused_group || tb->_show_single_group) && tb->focused && tb->focused->task_class == tc)
         return FALSE;
 
-    if (tc && tc->fold_by_count)
+    if (consider_fold_by_count && tc && tc->fold_by_count)
         return TRUE;
 
     int visible_count = tc ? tc->visible_count : 1;
     return (tb->_group_fold_threshold > 0) && (visible_count >= tb->_group_fold_threshold);
 }
 
+static int task_class_is_folded(TaskbarPlugin * tb, TaskClass * tc)
+{
+    return task_class_is_folded_ex(tb, tc, TRUE);
+}
+
 /******************************************************************************/
 
 /* Task getters. */
@@ -861,6 +931,47 @@ static void taskbar_notify_panel_class_visibility_changed(TaskbarPlugin * tb, gb
 
 /******************************************************************************/
 
+/* Fold-by-count planner.
+ *
+ * When the panel holds more buttons than _panel_fold_threshold, the classes with the most
+ * visible tasks are folded one by one, largest first, until the button count fits.
+ * The candidates are kept in a binary max-heap keyed on the visible count, so the planner
+ * costs O(classes + folds * log(classes)) instead of a full scan of the class list per fold.
+ * Only the classes whose fold state actually flips are recomputed. */
+
+typedef struct {
+    TaskClass * tc;
+    int visible_count;
+    int order;         /* Position in the class list, to break ties the same way every time */
+} FoldCandidate;
+
+static gboolean fold_candidate_before(FoldCandidate * a, FoldCandidate * b)
+{
+    if (a->visible_count != b->visible_count)
+        return a->visible_count > b->visible_count;
+    return a->order < b->order;
+}
+
+static void fold_heap_sift_down(FoldCandidate * heap, int size, int i)
+{
+    for (;;)
+    {
+        int top = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < size && fold_candidate_before(&heap[left], &heap[top]))
+            top = left;
+        if (right < size && fold_candidate_before(&heap[right], &heap[top]))
+            top = right;
+        if (top == i)
+            break;
+        FoldCandidate t = heap[i];
+        heap[i] = heap[top];
+        heap[top] = t;
+        i = top;
+    }
+}
+
 static void taskbar_recompute_fold_by_count(TaskbarPlugin * tb)
 {
     if (tb->_panel_fold_threshold < 1)
@@ -869,45 +980,59 @@ static void taskbar_recompute_fold_by_count(TaskbarPlugin * tb)
     if (!tb->grouped_tasks)
         return;
 
+    /* Count the buttons as they would be without folding by count and collect the classes that could be folded. */
+    GArray * candidates = g_array_new(FALSE, FALSE, sizeof(FoldCandidate));
+    int total_visible_count = 0;
+    int order = 0;
     TaskClass * tc;
-
-    for (tc = tb->task_class_list; tc != NULL; tc = tc->task_class_flink)
+    for (tc = tb->task_class_list; tc != NULL; tc = tc->task_class_flink, order++)
     {
-        tc->fold_by_count = FALSE;
+        int visible_count = tc->visible_count;
+        if (visible_count > 1 && task_class_is_folded_ex(tb, tc, FALSE))
+            visible_count = 1;
+
+        total_visible_count += visible_count;
+
+        if (visible_count > 1)
+        {
+            FoldCandidate c = { tc, visible_count, order };
+            g_array_append_val(candidates, c);
+        }
     }
 
-    int total_visible_count;
-    int max_visible_count;
+    /* Heapify. */
+    FoldCandidate * heap = (FoldCandidate *) candidates->data;
+    int size = candidates->len;
+    int i;
+    for (i = size / 2 - 1; i >= 0; i--)
+        fold_heap_sift_down(heap, size, i);
 
-    do
+    /* Pop the largest classes until the buttons fit.  Popped entries are kept past the end of the heap. */
+    while (total_visible_count > tb->_panel_fold_threshold && size > 0)
     {
-        total_visible_count = 0;
-        max_visible_count = 1;
-
-        TaskClass *  max_tc = NULL;
+        total_visible_count -= heap[0].visible_count - 1;
+        size--;
+        FoldCandidate t = heap[0];
+        heap[0] = heap[size];
+        heap[size] = t;
+        fold_heap_sift_down(heap, size, 0);
+    }
 
-        for (tc = tb->task_class_list; tc != NULL; tc = tc->task_class_flink)
-        {
-            int visible_count = tc->visible_count;
-            if (visible_count > 1 && task_class_is_folded(tb, tc))
-                visible_count = 1;
+    /* Mark the new fold set, then apply the changes. */
+    for (i = size; i < (int) candidates->len; i++)
+        heap[i].tc->fold_by_count_planned = TRUE;
 
-            total_visible_count += visible_count;
-            if (visible_count > max_visible_count && !tc->fold_by_count)
-            {
-                max_tc = tc;
-                max_visible_count = visible_count;
-            }
-        }
-
-        if (total_visible_count > tb->_panel_fold_threshold && max_visible_count > 1)
+    for (tc = tb->task_class_list; tc != NULL; tc = tc->task_class_flink)
+    {
+        if (tc->fold_by_count != tc->fold_by_count_planned)
         {
-            total_visible_count -= max_visible_count - 1;
-            max_tc->fold_by_count = TRUE;
-            recompute_group_visibility_for_class(tb, max_tc);
+            tc->fold_by_count = tc->fold_by_count_planned;
+            recompute_group_visibility_for_class(tb, tc);
         }
-    } while (total_visible_count > tb->_panel_fold_threshold && max_visible_count > 1) ;
+        tc->fold_by_count_planned = FALSE;
+    }
 
+    g_array_free(candidates, TRUE);
 }
 
 /******************************************************************************/
@@ -1006,7 +1131,7 @@ static void recompute_group_visibility_for_class(TaskbarPlugin * tb, TaskClass *
         task_button_redraw(prev_visible_task);
 }
 
-/* Recompute the visible task for all classes when the desktop changes. */
+/* Recompute the visible task for all classes. */
 static void recompute_group_visibility_on_current_desktop(TaskbarPlugin * tb)
 {
     TaskClass * tc;
@@ -1018,6 +1143,101 @@ static void recompute_group_visibility_on_current_desktop(TaskbarPlugin * tb)
 
 /******************************************************************************/
 
+/* Per-class desktop counters.
+ * Every class keeps the number of its tasks on each desktop, and every desktop keeps the set
+ * of classes having tasks on it, so that a desktop switch only has to visit the classes that
+ * have tasks on the desktops being left or entered.
+ * Tasks on all desktops are not counted, since their visibility does not depend on the current desktop. */
+
+static int desktop_class_slot(int desktop)
+{
+    if (desktop < 0 || desktop >= MAX_COUNTED_DESKTOPS)
+        return MAX_COUNTED_DESKTOPS;
+    return desktop;
+}
+
+static void task_class_count_desktop(TaskbarPlugin * tb, TaskClass * tc, int desktop, int delta)
+{
+    if (!tc || desktop == ALL_WORKSPACES)
+        return;
+
+    int * count;
+    if (desktop < 0 || desktop >= MAX_COUNTED_DESKTOPS)
+    {
+        count = &tc->other_desktop_task_count;
+    }
+    else
+    {
+        if (desktop >= tc->desktop_task_count_size)
+        {
+            int size = desktop + 1;
+            tc->desktop_task_count = g_renew(int, tc->desktop_task_count, size);
+            memset(tc->desktop_task_count + tc->desktop_task_count_size, 0, (size - tc->desktop_task_count_size) * sizeof(int));
+            tc->desktop_task_count_size = size;
+        }
+        count = &tc->desktop_task_count[desktop];
+    }
+
+    *count += delta;
+
+    /* Enter or leave the class index of the desktop when the first task arrives or the last one leaves. */
+    int slot = desktop_class_slot(desktop);
+    if (*count == delta && delta > 0)
+    {
+        if (!tb->desktop_classes[slot])
+            tb->desktop_classes[slot] = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(tb->desktop_classes[slot], tc, tc);
+    }
+    else if (*count == 0 && tb->desktop_classes[slot])
+    {
+        g_hash_table_remove(tb->desktop_classes[slot], tc);
+    }
+}
+
+/* Set the desktop of a task, keeping the counters of its class up to date. */
+static void task_set_desktop(Task * tk, int desktop)
+{
+    task_class_count_desktop(tk->tb, tk->task_class, tk->desktop, -1);
+    tk->desktop = desktop;
+    task_class_count_desktop(tk->tb, tk->task_class, tk->desktop, 1);
+    task_window_list_row_changed(tk);
+}
+
+/* Recompute the visible task for the classes affected by switching from one desktop to another.
+ * The representative of each such class is still chosen by walking its tasks,
+ * since the visible name and the urgency transfer need that walk anyway. */
+static void recompute_group_visibility_on_desktop_switch(TaskbarPlugin * tb, int old_desktop, int new_desktop)
+{
+    /* Visibility does not depend on the desktop at all. */
+    if (tb->show_all_desks)
+        return;
+
+    GHashTable * old_classes = old_desktop == ALL_WORKSPACES ? NULL : tb->desktop_classes[desktop_class_slot(old_desktop)];
+    GHashTable * new_classes = new_desktop == ALL_WORKSPACES ? NULL : tb->desktop_classes[desktop_class_slot(new_desktop)];
+    GHashTableIter iter;
+    gpointer key;
+
+    if (old_classes)
+    {
+        g_hash_table_iter_init(&iter, old_classes);
+        while (g_hash_table_iter_next(&iter, &key, NULL))
+            recompute_group_visibility_for_class(tb, (TaskClass *) key);
+    }
+
+    if (new_classes && new_classes != old_classes)
+    {
+        g_hash_table_iter_init(&iter, new_classes);
+        while (g_hash_table_iter_next(&iter, &key, NULL))
+        {
+            TaskClass * tc = (TaskClass *) key;
+            if (!old_classes || !g_hash_table_lookup(old_classes, tc))
+                recompute_group_visibility_for_class(tb, tc);
+        }
+    }
+}
+
+/******************************************************************************/
+
 static void taskbar_update_x_window_position(TaskbarPlugin * tb)
 {
     Task * tk;
@@ -1043,7 +1263,29 @@ static void taskbar_update_x_window_position(TaskbarPlugin * tb)
 
 /******************************************************************************/
 
-/* Draw the label and tooltip on a taskbar button. */
+/* Store a copy of the string just drawn.  Return FALSE if it is the same as the one drawn before. */
+static gboolean task_update_drawn_string(char ** drawn, const char * value)
+{
+    if (*drawn != NULL && value != NULL && strcmp(*drawn, value) == 0)
+        return FALSE;
+    g_free(*drawn);
+    *drawn = g_strdup(value);
+    return TRUE;
+}
+
+/* Forget what has been drawn on a task button, so that everything is drawn again.
+ * Used when the widgets are recreated or the panel style changes. */
+static void task_forget_drawn_state(Task * tk)
+{
+    g_free(tk->drawn_label);
+    tk->drawn_label = NULL;
+    g_free(tk->drawn_tooltip);
+    tk->drawn_tooltip = NULL;
+    g_free(tk->drawn_preview_name);
+    tk->drawn_preview_name = NULL;
+}
+
+/* Draw the label and tooltip on a taskbar button.  Parts that did not change since the last call are left alone. */
 static void task_draw_label(Task * tk)
 {
     TaskClass * tc = tk->task_class;
@@ -1070,29 +1312,35 @@ static void task_draw_label(Task * tk)
     if (task_button_is_really_flat(tk))
         label_style |= STYLE_CUSTOM_COLOR;
 
+    char * name = task_get_displayed_name(tk);
+    char * group_label = NULL;
     if (task_is_folded(tk) && (tc) && (tc->visible_task == tk))
-    {
-        char * label = g_strdup_printf("(%d) %s", tc->visible_count, tc->visible_name);
+        group_label = g_strdup_printf("(%d) %s", tc->visible_count, tc->visible_name);
+    char * label = group_label ? group_label : name;
+
+    if (task_update_drawn_string(&tk->drawn_tooltip, label))
         gtk_widget_set_tooltip_text(tk->button, label);
-        if (tk->label)
-            panel_draw_label_text(plugin_panel(tk->tb->plug), tk->label, label, label_style);
-        g_free(label);
-    }
-    else
+
+    if (tk->label)
     {
-        char * name = task_get_displayed_name(tk);
-        gtk_widget_set_tooltip_text(tk->button, name);
-        if (tk->label)
-            panel_draw_label_text(plugin_panel(tk->tb->plug), tk->label, name, label_style);
+        gboolean style_changed = tk->drawn_label_style != label_style;
+        if (task_update_drawn_string(&tk->drawn_label, label) || style_changed)
+        {
+            tk->drawn_label_style = label_style;
+            panel_draw_label_text(plugin_panel(tk->tb->plug), tk->label, label, label_style);
+        }
     }
 
-    char * name = task_get_displayed_name(tk);
-    if (tk->preview_item.button)
+    g_free(group_label);
+
+    if ((tk->preview_item.button || tk->preview_item.label)
+    && task_update_drawn_string(&tk->drawn_preview_name, name))
     {
-        gtk_widget_set_tooltip_text(tk->preview_item.button, name);
-    }
-    if (tk->preview_item.label)
+        if (tk->preview_item.button)
+            gtk_widget_set_tooltip_text(tk->preview_item.button, name);
+        if (tk->preview_item.label)
             gtk_label_set_text(GTK_LABEL(tk->preview_item.label), name);
+    }
 }
 
 static void task_button_redraw_button_state(Task * tk, TaskbarPlugin * tb)
@@ -1125,49 +1373,103 @@ static gboolean task_adapt_to_allocated_size(Task * tk)
     return FALSE;
 }
 
-/* Redraw a task button. */
-static void task_button_redraw(Task * tk)
+/* Apply the dirty parts of a task button.
+ * A hidden button only has its visibility applied; the other parts stay dirty until it is shown. */
+static void task_render(Task * tk)
 {
     TaskbarPlugin * tb = tk->tb;
 
     if (task_is_visible(tk))
     {
-        task_button_redraw_button_state(tk, tb);
-        if (tk->deferred_iconified_update)
+        if (tk->dirty & TASK_DIRTY_STATE)
+            task_button_redraw_button_state(tk, tb);
+        if (tk->dirty & TASK_DIRTY_ICON)
         {
-            tk->deferred_iconified_update = FALSE;
+            tk->dirty &= ~TASK_DIRTY_ICON;
             task_update_icon(tk, None, FALSE);
         }
-        task_draw_label(tk);
-        icon_grid_set_visible(tb->icon_grid, tk->button, TRUE);
+        if (tk->dirty & (TASK_DIRTY_LABEL | TASK_DIRTY_TOOLTIP))
+            task_draw_label(tk);
+        if (tk->dirty & TASK_DIRTY_VISIBILITY)
+            icon_grid_set_visible(tb->icon_grid, tk->button, TRUE);
+        tk->dirty = 0;
     }
     else
     {
-        icon_grid_set_visible(tb->icon_grid, tk->button, FALSE);
+        if (tk->dirty & TASK_DIRTY_VISIBILITY)
+            icon_grid_set_visible(tb->icon_grid, tk->button, FALSE);
+        tk->dirty &= ~TASK_DIRTY_VISIBILITY;
     }
-
 }
 
-/* Redraw all tasks in the taskbar. */
-static void taskbar_redraw(TaskbarPlugin * tb)
+/* Flush the dirty task buttons once per main loop iteration, ahead of GTK's own resize and redraw. */
+static gboolean taskbar_render_idle(TaskbarPlugin * tb)
 {
+    tb->render_idle_cb = 0;
+
     if (!tb->icon_grid)
-        return;
+        return FALSE;
 
     icon_grid_defer_updates(tb->icon_grid);
 
-    taskbar_recompute_fold_by_count(tb);
-
     Task * tk;
     for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
-        task_button_redraw(tk);
+    {
+        if (tk->dirty & TASK_DIRTY_VISIBILITY)
+            task_render(tk);
+    }
 
-    taskbar_update_separators(tb);
+    if (tb->render_layout)
+    {
+        tb->render_layout = FALSE;
+        taskbar_update_separators(tb);
+    }
 
     icon_grid_resume_updates(tb->icon_grid);
 
     taskbar_update_x_window_position(tb);
 
+    /* Labels and icons of the open window list are computed on draw. */
+    if (tb->group_menu && tb->window_list_view)
+        gtk_widget_queue_draw(tb->window_list_view);
+
+    return FALSE;
+}
+
+static void taskbar_schedule_render(TaskbarPlugin * tb)
+{
+    if (tb->render_idle_cb == 0)
+        tb->render_idle_cb = plugin_idle_add_full(tb->plug, G_PRIORITY_HIGH_IDLE, (GSourceFunc) taskbar_render_idle, tb, NULL);
+}
+
+/* Mark parts of a task button dirty.  They are redrawn on the next flush. */
+static void task_invalidate(Task * tk, unsigned dirty)
+{
+    /* Every redraw rechecks visibility, since that is what decides whether the rest is drawn. */
+    tk->dirty |= dirty | TASK_DIRTY_VISIBILITY;
+    taskbar_schedule_render(tk->tb);
+}
+
+/* Redraw a task button. */
+static void task_button_redraw(Task * tk)
+{
+    task_invalidate(tk, TASK_DIRTY_STATE | TASK_DIRTY_LABEL | TASK_DIRTY_TOOLTIP);
+}
+
+/* Redraw all tasks in the taskbar. */
+static void taskbar_redraw(TaskbarPlugin * tb)
+{
+    if (!tb->icon_grid)
+        return;
+
+    taskbar_recompute_fold_by_count(tb);
+
+    Task * tk;
+    for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
+        tk->dirty |= TASK_DIRTY_STATE | TASK_DIRTY_LABEL | TASK_DIRTY_TOOLTIP | TASK_DIRTY_VISIBILITY;
+
+    tb->render_layout = TRUE;
+    taskbar_schedule_render(tb);
 }
 
 /******************************************************************************/
@@ -1196,8 +1498,9 @@ static void task_free_names(Task * tk)
 }
 
 /* Set the names associated with a task.
- * This is expected to be the same as the title the window manager is displaying. */
-static void task_set_names(Task * tk, Atom source)
+ * This is expected to be the same as the title the window manager is displaying.
+ * Returns TRUE if the name has changed. */
+static gboolean task_set_names(Task * tk, Atom source)
 {
     char * name = NULL;
 
@@ -1247,7 +1550,67 @@ static void task_set_names(Task * tk, Atom source)
 
         /* Redraw the button. */
         task_button_redraw(tk);
+
+        return TRUE;
+    }
+
+    g_free(name);
+    return FALSE;
+}
+
+/* Minimal intervals between title fetches for a task.
+ * Some windows, such as terminals showing build progress, retitle themselves many times a second. */
+#define TITLE_UPDATE_INTERVAL_VISIBLE 250
+#define TITLE_UPDATE_INTERVAL_HIDDEN 2000
+#define TITLE_UPDATE_FRAME 16
+
+static gboolean task_update_names_timeout(Task * tk)
+{
+    tk->name_update_timer = 0;
+    tk->name_pending = FALSE;
+    tk->name_fetch_time = g_get_monotonic_time();
+
+    /* The window may be gone by now. */
+    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+    gboolean changed = task_set_names(tk, tk->pending_name_source);
+    XSetErrorHandler(previous_error_handler);
+
+    if (!changed)
+        return FALSE;
+
+    if (tk->task_class != NULL)
+    {
+        /* A change to the window name may change the visible name of the class. */
+        recompute_group_visibility_for_class(tk->tb, tk->task_class);
+        if (tk->task_class->visible_task != NULL)
+            task_draw_label(tk->task_class->visible_task);
     }
+    task_update_sorting(tk, SORT_BY_TITLE);
+
+    return FALSE;
+}
+
+/* Note that the title has changed and fetch it later, once for any number of changes in between.
+ * Visible buttons are updated on the next frame unless they have been updated very recently;
+ * hidden and folded ones less often. */
+static void task_defer_set_names(Task * tk, Atom source)
+{
+    if (!tk->name_pending)
+        tk->pending_name_source = source;
+    else if (tk->pending_name_source != source)
+        tk->pending_name_source = None;
+    tk->name_pending = TRUE;
+
+    if (tk->name_update_timer)
+        return;
+
+    gint64 interval = task_is_visible(tk) ? TITLE_UPDATE_INTERVAL_VISIBLE : TITLE_UPDATE_INTERVAL_HIDDEN;
+    gint64 elapsed = (g_get_monotonic_time() - tk->name_fetch_time) / 1000;
+    gint64 delay = (elapsed < interval) ? interval - elapsed : 0;
+    if (delay < TITLE_UPDATE_FRAME)
+        delay = TITLE_UPDATE_FRAME;
+
+    tk->name_update_timer = plugin_timeout_add(tk->tb->plug, delay, (GSourceFunc) task_update_names_timeout, tk);
 }
 
 /******************************************************************************/
@@ -1260,6 +1623,7 @@ static void task_unlink_class(Task * tk)
     TaskClass * tc = tk->task_class;
     if (tc != NULL)
     {
+        task_class_count_desktop(tk->tb, tc, tk->desktop, -1);
         tk->task_class = NULL;
 
         if (tc->visible_task == tk)
@@ -1426,6 +1790,8 @@ static void task_set_class(Task * tk)
                 task_button_redraw(tk);
             }
             tk->task_class = tc;
+            task_class_count_desktop(tb, tc, tk->desktop, 1);
+            task_window_list_row_changed(tk);
 
             /* Recompute group visibility. */
             recompute_group_visibility_for_class(tb, tc);
@@ -1472,6 +1838,10 @@ static void task_delete(TaskbarPlugin * tb, Task * tk, gboolean unlink)
     if (tk->run_path && tk->run_path != (gchar *)-1)
         g_free(tk->run_path);
 
+    /* The preview panel keeps its items between openings. */
+    if (tk->preview_item.button && gtk_widget_get_parent(tk->preview_item.button))
+        gtk_container_remove(GTK_CONTAINER(gtk_widget_get_parent(tk->preview_item.button)), tk->preview_item.button);
+
     UNREF_AND_NULL(tk->preview_item.button);
     UNREF_AND_NULL(tk->preview_item.container);
     UNREF_AND_NULL(tk->preview_item.inner_container);
@@ -1495,16 +1865,13 @@ static void task_delete(TaskbarPlugin * tb, Task * tk, gboolean unlink)
 
 
     /* Free thumbnails. */
-    if (tk->backing_pixmap != 0)
-        XFreePixmap(wtl_x11_display(), tk->backing_pixmap);
+    wtl_thumbnail_unwatch(tk->thumbnail_watch);
     if (tk->thumbnail)
         g_object_unref(G_OBJECT(tk->thumbnail));
     if (tk->thumbnail_icon)
         g_object_unref(G_OBJECT(tk->thumbnail_icon));
     if (tk->thumbnail_preview)
         g_object_unref(G_OBJECT(tk->thumbnail_preview));
-    if (tk->update_composite_thumbnail_timeout)
-        g_source_remove(tk->update_composite_thumbnail_timeout);
     if (tk->update_thumbnail_preview_idle)
         g_source_remove(tk->update_thumbnail_preview_idle);
 
@@ -1520,9 +1887,17 @@ static void task_delete(TaskbarPlugin * tb, Task * tk, gboolean unlink)
         g_source_remove(tk->adapt_to_allocated_size_idle_cb);
     if (tk->update_icon_idle_cb != 0)
         g_source_remove(tk->update_icon_idle_cb);
+    if (tk->name_update_timer != 0)
+        g_source_remove(tk->name_update_timer);
     if (tk->show_popup_delay_timer != 0)
         g_source_remove(tk->show_popup_delay_timer);
 
+    wtl_x11_cancel_property_requests(tk);
+
+    task_remove_from_window_list(tk);
+
+    task_forget_drawn_state(tk);
+
     if (tk->override_class_name != (char*) -1 && tk->override_class_name)
          g_free(tk->override_class_name);
 
@@ -1587,9 +1962,7 @@ static gboolean task_update_thumbnail_preview_real(Task * tk)
     {
         gint64 scale_start_time = g_get_monotonic_time();
 
-        int preview_width = 150;
-        int preview_height = 100;
-        tk->thumbnail_preview = su_gdk_pixbuf_scale_in_rect(tk->thumbnail, preview_width, preview_height, TRUE);
+        tk->thumbnail_preview = su_gdk_pixbuf_scale_in_rect(tk->thumbnail, THUMBNAIL_PREVIEW_WIDTH, THUMBNAIL_PREVIEW_HEIGHT, TRUE);
         if (tk->thumbnail_preview && tk->preview_item.image)
         {
             gtk_image_set_from_pixbuf(GTK_IMAGE(tk->preview_item.image), tk->thumbnail_preview);
@@ -1612,144 +1985,60 @@ static void task_update_thumbnail_preview(Task * tk)
         return;
 
     if (tk->update_thumbnail_preview_idle == 0)
-        tk->update_thumbnail_preview_idle = g_idle_add((GSourceFunc) task_update_thumbnail_preview_real, tk);
+        tk->update_thumbnail_preview_idle = plugin_idle_add(tk->tb->plug, (GSourceFunc) task_update_thumbnail_preview_real, tk);
 }
 
-static gboolean task_update_composite_thumbnail_real(Task * tk)
+/* Handler for a refresh of the window content by the shared thumbnail cache. */
+static void task_thumbnail_changed(GdkPixbuf * pixbuf, Task * tk)
 {
-    if (!tk->tb->thumbnails)
-    {
-        tk->update_composite_thumbnail_timeout = 0;
-        return FALSE;
-    }
-
-    if (tk->backing_pixmap != 0)
-    {
-        XFreePixmap(wtl_x11_display(), tk->backing_pixmap);
-        tk->backing_pixmap = 0;
-    }
-
-    //Status status;
-
-    gboolean skip = tk->iconified || tk->shaded;
-    if (!skip)
-    {
-        XWindowAttributes window_attributes;
-        window_attributes.map_state = IsUnmapped;
-        /*status =*/ XGetWindowAttributes(wtl_x11_display(), tk->win, &window_attributes);
-        if (window_attributes.map_state == IsUnmapped)
-        {
-            skip = TRUE;
-        }
-    }
-
-    if (!skip)
-    {
-        Window w = tk->win;
-        Window w1 = 0;
+    /* Keep the last image of an iconified or shaded window rather than its title bar. */
+    if (tk->iconified || tk->shaded)
+        return;
 
-        Window root_return = 0;
-        Window parent_return = 0;
-        Window *children_return = NULL;
-        unsigned int nchildren_return;
+    if (tk->thumbnail)
+        g_object_unref(G_OBJECT(tk->thumbnail));
+    if (tk->thumbnail_icon)
+        g_object_unref(G_OBJECT(tk->thumbnail_icon));
+    if (tk->thumbnail_preview)
+        g_object_unref(G_OBJECT(tk->thumbnail_preview));
 
-        /*status =*/ XQueryTree(wtl_x11_display(), w, &root_return, &parent_return, &children_return, &nchildren_return);
-        if (children_return)
-            XFree(children_return);
+    tk->thumbnail = g_object_ref(pixbuf);
+    tk->thumbnail_icon = NULL;
+    tk->thumbnail_preview = NULL;
 
-        if (parent_return != root_return)
-            w1 = parent_return;
+    if (tk->tb->use_thumbnails_as_icons)
+        task_defer_update_icon(tk, TRUE);
+    if (tk->tb->thumbnails_preview)
+        task_update_thumbnail_preview(tk);
+}
 
-        if (w1)
-           w = w1;
+/* Start watching the window content, or ask for a refresh after a state change that XDamage does not report. */
+static void task_update_composite_thumbnail(Task * tk)
+{
+    TaskbarPlugin * tb = tk->tb;
 
-        if (w)
-        {
-            XWindowAttributes window_attributes;
-            window_attributes.map_state = IsUnmapped;
-            /*status =*/ XGetWindowAttributes(wtl_x11_display(), w, &window_attributes);
-            if (window_attributes.map_state != IsUnmapped)
-            {
-                tk->backing_pixmap = XCompositeNameWindowPixmap(wtl_x11_display(), w);
-            }
-        }
+    if (!tb->thumbnails)
+        return;
 
-    }
+    /* Large enough for both the preview and the icon. */
+    int width = MAX(THUMBNAIL_PREVIEW_WIDTH, tb->icon_size);
+    int height = MAX(THUMBNAIL_PREVIEW_HEIGHT, tb->icon_size);
 
-    if (!skip && tk->backing_pixmap != 0)
+    if (!tk->thumbnail_watch)
     {
-        gint64 update_start_time = g_get_monotonic_time();
-
-        GdkPixbuf * pixbuf = su_gdk_pixbuf_get_from_pixmap(tk->backing_pixmap, -1, -1);
-
-        gint64 update_end_time = g_get_monotonic_time();
-        gint64 update_time = update_end_time - update_start_time;
+        tk->thumbnail_watch = wtl_thumbnail_watch(tk->win, width, height, THUMBNAIL_REFRESH_INTERVAL,
+            (WtlThumbnailFunc) task_thumbnail_changed, tk);
 
+        /* Another plugin may have been watching the window already. */
+        GdkPixbuf * pixbuf = wtl_thumbnail_watch_get_pixbuf(tk->thumbnail_watch);
         if (pixbuf)
-        {
-
-            SU_LOG_DEBUG("converting [%lux%lu] pixmap to pixbuf takes %f s",
-                gdk_pixbuf_get_width(pixbuf),
-                gdk_pixbuf_get_height(pixbuf),
-                update_time / 1000000.0);
-
-            if (tk->thumbnail)
-                g_object_unref(G_OBJECT(tk->thumbnail));
-            if (tk->thumbnail_icon)
-                g_object_unref(G_OBJECT(tk->thumbnail_icon));
-            if (tk->thumbnail_preview)
-                g_object_unref(G_OBJECT(tk->thumbnail_preview));
-
-            tk->thumbnail = pixbuf;
-            tk->thumbnail_icon = NULL;
-            tk->thumbnail_preview = NULL;
-
-            if (tk->tb->use_thumbnails_as_icons)
-                task_defer_update_icon(tk, TRUE);
-            if (tk->tb->thumbnails_preview)
-                task_update_thumbnail_preview(tk);
-
-            tk->require_update_composite_thumbnail = FALSE;
-        }
+            task_thumbnail_changed(pixbuf, tk);
     }
-
-    tk->update_composite_thumbnail_idle = 0;
-
-    return FALSE;
-}
-
-static gboolean task_update_composite_thumbnail_timeout(Task * tk)
-{
-    if (!tk->tb->thumbnails || !tk->require_update_composite_thumbnail)
-    {
-        tk->update_composite_thumbnail_timeout = 0;
-        return FALSE;
-    }
-
-    tk->update_composite_thumbnail_repeat_count++;
-    if (tk->update_composite_thumbnail_repeat_count > 5)
+    else
     {
-        tk->update_composite_thumbnail_repeat_count = 0;
-        tk->require_update_composite_thumbnail = FALSE;
+        wtl_thumbnail_watch_set_size(tk->thumbnail_watch, width, height);
+        wtl_thumbnail_watch_refresh(tk->thumbnail_watch);
     }
-
-
-    if (tk->update_composite_thumbnail_idle == 0)
-        tk->update_composite_thumbnail_idle = g_idle_add((GSourceFunc) task_update_composite_thumbnail_real, tk);
-
-    return TRUE;
-}
-
-static void task_update_composite_thumbnail(Task * tk)
-{
-    if (!tk->tb->thumbnails)
-        return;
-
-    tk->require_update_composite_thumbnail = TRUE;
-
-    if (tk->update_composite_thumbnail_timeout == 0)
-        tk->update_composite_thumbnail_timeout = g_timeout_add(1000 + rand() % 1000,
-            (GSourceFunc) task_update_composite_thumbnail_timeout, tk);
 }
 
 static gboolean task_update_bgcolor_idle(Task * tk)
@@ -1816,18 +2105,18 @@ static GdkPixbuf * get_window_icon(Task * tk, int icon_size, Atom source)
     {
         /* try to guess an icon from window class name */
         gchar* classname = g_utf8_strdown(tk->wm_class, -1);
-        pixbuf = wtl_load_icon(classname, icon_size, icon_size, FALSE);
+        pixbuf = wtl_icon_cache_load(classname, icon_size, FALSE);
         g_free(classname);
     }
 
     if (!pixbuf && !su_str_empty(tb->custom_fallback_icon))
-        pixbuf = wtl_load_icon(tb->custom_fallback_icon, tb->icon_size, tb->icon_size, FALSE);
+        pixbuf = wtl_icon_cache_load(tb->custom_fallback_icon, tb->icon_size, FALSE);
 
     if (!pixbuf)
-        pixbuf = wtl_load_icon("applications-other", tb->icon_size, tb->icon_size, FALSE);
+        pixbuf = wtl_icon_cache_load("applications-other", tb->icon_size, FALSE);
 
     if (!pixbuf)
-        pixbuf = wtl_load_icon("gtk-file", tb->icon_size, tb->icon_size, TRUE);
+        pixbuf = wtl_icon_cache_load("gtk-file", tb->icon_size, TRUE);
 
     if (tk->icon_for_bgcolor)
         g_object_unref(G_OBJECT(tk->icon_for_bgcolor));
@@ -1835,7 +2124,7 @@ static GdkPixbuf * get_window_icon(Task * tk, int icon_size, Atom source)
     tk->icon_for_bgcolor = pixbuf;
 
     if (!tk->update_bgcolor_cb)
-        tk->update_bgcolor_cb = g_idle_add((GSourceFunc) task_update_bgcolor_idle, tk);
+        tk->update_bgcolor_cb = plugin_idle_add(tk->tb->plug, (GSourceFunc) task_update_bgcolor_idle, tk);
 
     return pixbuf;
 }
@@ -1933,8 +2222,8 @@ static void task_update_icon(Task * tk, Atom source, gboolean forse_icon_erase)
         {
             if (!tk->icon_pixbuf_iconified)
             {
-                tk->icon_pixbuf_iconified = gdk_pixbuf_add_alpha(tk->icon_pixbuf, FALSE, 0, 0, 0);;
-                su_gdk_pixbuf_dim(tk->icon_pixbuf_iconified);
+                tk->icon_pixbuf_iconified = gdk_pixbuf_add_alpha(tk->icon_pixbuf, FALSE, 0, 0, 0);
+                wtl_pixbuf_dim(tk->icon_pixbuf_iconified);
             }
             pixbuf = tk->icon_pixbuf_iconified;
         }
@@ -1954,7 +2243,18 @@ static void task_defer_update_icon(Task * tk, gboolean forse_icon_erase)
 {
     tk->forse_icon_erase |= forse_icon_erase;
     if (tk->update_icon_idle_cb == 0)
-        tk->update_icon_idle_cb = g_idle_add((GSourceFunc) task_update_icon_cb, tk);
+        tk->update_icon_idle_cb = plugin_idle_add(tk->tb->plug, (GSourceFunc) task_update_icon_cb, tk);
+}
+
+/* Icon theme changed. Only the icons guessed from the theme need reloading; those from the window manager stay. */
+static void taskbar_icon_theme_changed(TaskbarPlugin * tb)
+{
+    Task * tk;
+    for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
+    {
+        if (tk->image_source == None)
+            task_defer_update_icon(tk, TRUE);
+    }
 }
 
 
@@ -2029,7 +2329,7 @@ static void task_set_iconified(Task * tk, gboolean iconified)
                 * Schedule icon update.
             */
             if (tb->dim_iconified)
-                tk->deferred_iconified_update = TRUE;
+                tk->dirty |= TASK_DIRTY_ICON;
         }
         else
         {
@@ -2037,134 +2337,446 @@ static void task_set_iconified(Task * tk, gboolean iconified)
                 No deferred desktop switching.
                 Update label and icon right now.
             */
-            tk->deferred_iconified_update = FALSE;
+            tk->dirty &= ~TASK_DIRTY_ICON;
             task_draw_label(tk);
             task_update_icon(tk, None, FALSE);
         }
-        task_update_grouping(tk, GROUP_BY_STATE);
-        task_update_sorting(tk, SORT_BY_STATE);
-        task_update_composite_thumbnail(tk);
+        task_update_grouping(tk, GROUP_BY_STATE);
+        task_update_sorting(tk, SORT_BY_STATE);
+        task_update_composite_thumbnail(tk);
+    }
+}
+
+/******************************************************************************/
+
+/* group menu */
+
+/* Remove the grouped-task popup menu from the screen. */
+static void taskbar_group_menu_destroy(TaskbarPlugin * tb)
+{
+    if (tb->hide_popup_delay_timer != 0)
+    {
+        g_source_remove(tb->hide_popup_delay_timer);
+        tb->hide_popup_delay_timer = 0;
+    }
+
+    tb->group_menu_opened_as_popup = FALSE;
+
+    if (tb->group_menu != NULL)
+    {
+        if (tb->window_list_grabbed)
+        {
+            tb->window_list_grabbed = FALSE;
+            gtk_grab_remove(tb->group_menu);
+            gdk_pointer_ungrab(GDK_CURRENT_TIME);
+            gdk_keyboard_ungrab(GDK_CURRENT_TIME);
+        }
+        gtk_widget_hide(tb->group_menu);
+        tb->group_menu = NULL;
+    }
+}
+
+/* Handler for "leave" event from group menu. */
+static gboolean group_menu_motion(GtkWidget * widget, GdkEvent  *event, TaskbarPlugin * tb)
+{
+    taskbar_check_hide_popup(tb);
+    return FALSE;
+}
+
+static void group_menu_size_allocate(GtkWidget * w, GtkAllocation * alloc, TaskbarPlugin * tb)
+{
+    tb->group_menu_alloc = *alloc;
+}
+
+/* Window list.
+ *
+ * The list is a GtkTreeView over a persistent model with one row per task, kept in taskbar order.
+ * Once the list has been built, rows follow the tasks as they are added, moved and deleted,
+ * and a row is reported changed when its desktop, class or urgency changes, so that the filter
+ * re-evaluates just that row.  Opening the list refilters only if the selection or desktop changed.
+ * The view runs in fixed height mode and computes labels and icons in cell data functions,
+ * so only the rows on screen are ever measured or drawn, however many windows there are.
+ * Menu-sized icons are cached per task. */
+
+enum {
+    WINDOW_LIST_COL_TASK,
+    WINDOW_LIST_N_COLS
+};
+
+#define WINDOW_LIST_MONITOR_FRACTION 4   /* The list takes this fraction of the monitor width */
+#define WINDOW_LIST_MIN_WIDTH_ROWS   12  /* Minimum width, in row heights */
+#define WINDOW_LIST_MAX_ROWS         24  /* Rows shown before the list scrolls */
+
+/* Label of a task in the window list.  Returns a newly allocated string. */
+static gchar * task_get_window_list_label(Task * tk)
+{
+    TaskbarPlugin * tb = tk->tb;
+    gchar * name = task_get_displayed_name(tk);
+
+    if (tk->desktop != tb->current_desktop && tk->desktop != ALL_WORKSPACES && tb->_group_by != GROUP_BY_WORKSPACE)
+    {
+        gchar * wname = task_get_desktop_name(tk, NULL);
+        gchar * label = g_strdup_printf("%s [%s]", name, wname);
+        g_free(wname);
+        return label;
+    }
+    else if (tk->focused)
+    {
+        return g_strdup_printf("* %s *", name);
+    }
+    return g_strdup(name);
+}
+
+/* The button icon scaled to menu size.  Rescaled only when the button icon changes. */
+static GdkPixbuf * task_get_window_list_icon(Task * tk)
+{
+    GdkPixbuf * source = NULL;
+    if (tk->image && gtk_image_get_storage_type(GTK_IMAGE(tk->image)) == GTK_IMAGE_PIXBUF)
+        source = gtk_image_get_pixbuf(GTK_IMAGE(tk->image));
+
+    if (source != tk->window_list_icon_source)
+    {
+        UNREF_AND_NULL(tk->window_list_icon);
+        UNREF_AND_NULL(tk->window_list_icon_source);
+
+        if (source)
+        {
+            gint w = 16, h = 16;
+            gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &w, &h);
+            int sw = gdk_pixbuf_get_width(source);
+            int sh = gdk_pixbuf_get_height(source);
+            if (sw > w || sh > h)
+            {
+                double scale = MIN((double) w / sw, (double) h / sh);
+                tk->window_list_icon = gdk_pixbuf_scale_simple(source,
+                    MAX(1, (int) (sw * scale)), MAX(1, (int) (sh * scale)), GDK_INTERP_BILINEAR);
+            }
+            else
+            {
+                tk->window_list_icon = g_object_ref(source);
+            }
+            tk->window_list_icon_source = g_object_ref(source);
+        }
     }
-}
-
-/******************************************************************************/
 
-/* group menu */
+    return tk->window_list_icon;
+}
 
-/* Remove the grouped-task popup menu from the screen. */
-static void taskbar_group_menu_destroy(TaskbarPlugin * tb)
+static void task_remove_from_window_list(Task * tk)
 {
-    if (tb->hide_popup_delay_timer != 0)
+    if (tk->tb->window_list_single_task == tk)
     {
-        g_source_remove(tb->hide_popup_delay_timer);
-        tb->hide_popup_delay_timer = 0;
+        tk->tb->window_list_single_task = NULL;
+        tk->tb->window_list_filter_valid = FALSE;
+    }
+    if (tk->window_list_row)
+    {
+        gtk_list_store_remove(tk->tb->window_list_store, &tk->window_list_iter);
+        tk->window_list_row = FALSE;
     }
+    UNREF_AND_NULL(tk->window_list_icon);
+    UNREF_AND_NULL(tk->window_list_icon_source);
+}
 
-    tb->group_menu_opened_as_popup = FALSE;
+/* Put the row of a task before the row of its successor in the task list, adding the row if there is none. */
+static void task_place_in_window_list(Task * tk)
+{
+    TaskbarPlugin * tb = tk->tb;
+    if (!tb->window_list_store)
+        return;
 
-    if (tb->group_menu != NULL)
+    Task * tk_succ = tk->task_flink;
+    while (tk_succ && !tk_succ->window_list_row)
+        tk_succ = tk_succ->task_flink;
+    GtkTreeIter * sibling = tk_succ ? &tk_succ->window_list_iter : NULL;
+
+    if (tk->window_list_row)
     {
-        gtk_widget_destroy(tb->group_menu);
-        tb->group_menu = NULL;
+        gtk_list_store_move_before(tb->window_list_store, &tk->window_list_iter, sibling);
+    }
+    else
+    {
+        gtk_list_store_insert_before(tb->window_list_store, &tk->window_list_iter, sibling);
+        gtk_list_store_set(tb->window_list_store, &tk->window_list_iter, WINDOW_LIST_COL_TASK, tk, -1);
+        tk->window_list_row = TRUE;
     }
 }
 
-static void task_show_window_list_helper(Task * tk_cursor, GtkWidget * menu, TaskbarPlugin * tb)
+/* Let the filter re-evaluate the row of a task whose visibility may have changed. */
+static void task_window_list_row_changed(Task * tk)
 {
-    if (task_is_visible_on_current_desktop(tk_cursor))
-    {
-        /* The menu item has the name, or the iconified name, and the icon of the application window. */
+    if (!tk->window_list_row)
+        return;
 
-        gchar * name = task_get_displayed_name(tk_cursor);
-        GtkWidget * mi = NULL;
-        if (tk_cursor->desktop != tb->current_desktop && tk_cursor->desktop != ALL_WORKSPACES && tb->_group_by != GROUP_BY_WORKSPACE) {
-            gchar* wname = task_get_desktop_name(tk_cursor, NULL);
-            name = g_strdup_printf("%s [%s]", name, wname);
-            mi = gtk_image_menu_item_new_with_label(name);
-            g_free(name);
-            g_free(wname);
-        } else if (tk_cursor->focused) {
-            name = g_strdup_printf("* %s *", name);
-            mi = gtk_image_menu_item_new_with_label(name);
-            g_free(name);
-        } else {
-            mi = gtk_image_menu_item_new_with_label(name);
-        }
+    GtkTreeModel * model = GTK_TREE_MODEL(tk->tb->window_list_store);
+    GtkTreePath * path = gtk_tree_model_get_path(model, &tk->window_list_iter);
+    gtk_tree_model_row_changed(model, path, &tk->window_list_iter);
+    gtk_tree_path_free(path);
+}
 
-        GtkWidget * im = gtk_image_new_from_pixbuf(gtk_image_get_pixbuf(GTK_IMAGE(tk_cursor->image)));
-        gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(mi), im);
+static gboolean window_list_row_visible(GtkTreeModel * model, GtkTreeIter * iter, TaskbarPlugin * tb)
+{
+    Task * tk = NULL;
+    gtk_tree_model_get(model, iter, WINDOW_LIST_COL_TASK, &tk, -1);
+    if (!tk)
+        return FALSE;
 
-        g_signal_connect(mi, "button_press_event", G_CALLBACK(taskbar_popup_activate_event), (gpointer) tk_cursor);
+    if (tb->window_list_single_task)
+        return tk == tb->window_list_single_task && task_is_visible_on_current_desktop(tk);
 
-        gtk_menu_shell_append(GTK_MENU_SHELL(menu), mi);
-    }
-}
+    if (tb->window_list_by_class && tk->task_class != tb->window_list_class)
+        return FALSE;
 
+    return task_is_visible_on_current_desktop(tk);
+}
 
-/* Handler for "leave" event from group menu. */
-static gboolean group_menu_motion(GtkWidget * widget, GdkEvent  *event, TaskbarPlugin * tb)
+static void window_list_icon_data_func(GtkTreeViewColumn * column, GtkCellRenderer * cell, GtkTreeModel * model, GtkTreeIter * iter, gpointer data)
 {
-    taskbar_check_hide_popup(tb);
-    return FALSE;
+    Task * tk = NULL;
+    gtk_tree_model_get(model, iter, WINDOW_LIST_COL_TASK, &tk, -1);
+    g_object_set(cell, "pixbuf", tk ? task_get_window_list_icon(tk) : NULL, NULL);
 }
 
-static void group_menu_size_allocate(GtkWidget * w, GtkAllocation * alloc, TaskbarPlugin * tb)
+static void window_list_label_data_func(GtkTreeViewColumn * column, GtkCellRenderer * cell, GtkTreeModel * model, GtkTreeIter * iter, gpointer data)
 {
-    tb->group_menu_alloc = *alloc;
+    Task * tk = NULL;
+    gtk_tree_model_get(model, iter, WINDOW_LIST_COL_TASK, &tk, -1);
+    gchar * label = tk ? task_get_window_list_label(tk) : NULL;
+    g_object_set(cell, "text", label, NULL);
+    g_free(label);
 }
 
-static void task_show_window_list(Task * tk, GdkEventButton * event, gboolean similar, gboolean menu_opened_as_popup)
+/* Close the list and act on a task as if it were clicked in a group menu. */
+static gboolean window_list_activate_task(TaskbarPlugin * tb, GtkWidget * widget, GdkEventButton * event, Task * tk)
 {
-    TaskbarPlugin * tb = tk->tb;
-    TaskClass * tc = tk->task_class;
-
-    GtkWidget * menu = gtk_menu_new();
-    Task * tk_cursor;
+    if (tb->group_menu_opened_as_popup)
+        taskbar_hide_popup(tb);
+    else
+        taskbar_group_menu_destroy(tb);
+    return taskbar_popup_activate_event(widget, event, tk);
+}
 
-    if (similar && task_is_folded(tk))
+/* Handler for "button-press-event" from the window list.  Acts like a click on a group menu item. */
+static gboolean window_list_button_press_event(GtkWidget * widget, GdkEventButton * event, TaskbarPlugin * tb)
+{
+    GtkTreePath * path = NULL;
+    Task * tk = NULL;
+    if (event->window == gtk_tree_view_get_bin_window(GTK_TREE_VIEW(tb->window_list_view))
+    &&  gtk_tree_view_get_path_at_pos(GTK_TREE_VIEW(tb->window_list_view), event->x, event->y, &path, NULL, NULL, NULL))
     {
-        if (tc)
-        {
-            for (tk_cursor = tc->task_class_head; tk_cursor != NULL; tk_cursor = tk_cursor->task_class_flink)
-            {
-                task_show_window_list_helper(tk_cursor, menu, tb);
-            }
-        }
-        else
-        {
-            task_show_window_list_helper(tk, menu, tb);
-        }
+        GtkTreeIter iter;
+        if (gtk_tree_model_get_iter(tb->window_list_filter, &iter, path))
+            gtk_tree_model_get(tb->window_list_filter, &iter, WINDOW_LIST_COL_TASK, &tk, -1);
+        gtk_tree_path_free(path);
     }
-    else
+
+    if (tk)
+        return window_list_activate_task(tb, widget, event, tk);
+
+    /* A click outside of the list dismisses it. */
+    GtkAllocation * a = &tb->group_menu_alloc;
+    int x = 0, y = 0;
+    gtk_widget_get_pointer(tb->window_list_window, &x, &y);
+    if (x < 0 || y < 0 || x >= a->width || y >= a->height)
+        taskbar_group_menu_destroy(tb);
+    return TRUE;
+}
+
+/* Handler for "key-press-event" from the window list.
+ * The view has the focus and moves the selection; Return acts like a click on the selected row. */
+static gboolean window_list_key_press_event(GtkWidget * widget, GdkEventKey * event, TaskbarPlugin * tb)
+{
+    switch (event->keyval)
     {
-        for (tk_cursor = tb->task_list; tk_cursor != NULL; tk_cursor = tk_cursor->task_flink)
+        case GDK_Escape:
+            taskbar_group_menu_destroy(tb);
+            return TRUE;
+
+        case GDK_Return:
+        case GDK_KP_Enter:
+        case GDK_ISO_Enter:
         {
-            if (!similar || tk_cursor->task_class == tc)
-                task_show_window_list_helper(tk_cursor, menu, tb);
+            GtkTreeModel * model = NULL;
+            GtkTreeIter iter;
+            Task * tk = NULL;
+            if (gtk_tree_selection_get_selected(gtk_tree_view_get_selection(GTK_TREE_VIEW(tb->window_list_view)), &model, &iter))
+                gtk_tree_model_get(model, &iter, WINDOW_LIST_COL_TASK, &tk, -1);
+            if (!tk)
+                return TRUE;
+
+            /* Shift+Return does what Shift+click does. */
+            GdkEventButton button_event;
+            memset(&button_event, 0, sizeof(button_event));
+            button_event.type = GDK_BUTTON_RELEASE;
+            button_event.window = event->window;
+            button_event.send_event = TRUE;
+            button_event.time = event->time;
+            button_event.state = event->state;
+            button_event.button = 1;
+            return window_list_activate_task(tb, widget, &button_event, tk);
         }
     }
+    return FALSE;
+}
+
+static gboolean window_list_grab_broken_event(GtkWidget * widget, GdkEvent * event, TaskbarPlugin * tb)
+{
+    tb->window_list_grabbed = FALSE;
+    taskbar_group_menu_destroy(tb);
+    return FALSE;
+}
+
+static void taskbar_build_window_list(TaskbarPlugin * tb)
+{
+    tb->window_list_store = gtk_list_store_new(WINDOW_LIST_N_COLS, G_TYPE_POINTER);
+    tb->window_list_filter = gtk_tree_model_filter_new(GTK_TREE_MODEL(tb->window_list_store), NULL);
+    gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(tb->window_list_filter),
+        (GtkTreeModelFilterVisibleFunc) window_list_row_visible, tb, NULL);
+
+    GtkWidget * view = tb->window_list_view = gtk_tree_view_new_with_model(tb->window_list_filter);
+    gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), FALSE);
+    gtk_tree_view_set_hover_selection(GTK_TREE_VIEW(view), TRUE);
+
+    GtkTreeViewColumn * column = gtk_tree_view_column_new();
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+
+    gint icon_w = 16, icon_h = 16;
+    gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &icon_w, &icon_h);
+    GtkCellRenderer * cell = gtk_cell_renderer_pixbuf_new();
+    gtk_cell_renderer_set_fixed_size(cell, icon_w + 4, icon_h + 2);
+    gtk_tree_view_column_pack_start(column, cell, FALSE);
+    gtk_tree_view_column_set_cell_data_func(column, cell, window_list_icon_data_func, tb, NULL);
+
+    cell = tb->window_list_text_renderer = gtk_cell_renderer_text_new();
+    g_object_set(cell, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+    gtk_tree_view_column_pack_start(column, cell, TRUE);
+    gtk_tree_view_column_set_cell_data_func(column, cell, window_list_label_data_func, tb, NULL);
+
+    gtk_tree_view_append_column(GTK_TREE_VIEW(view), column);
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(view), TRUE);
+
+    GtkWidget * scroll = tb->window_list_scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(scroll), GTK_SHADOW_OUT);
+    gtk_container_add(GTK_CONTAINER(scroll), view);
+
+    GtkWidget * win = tb->window_list_window = gtk_window_new(GTK_WINDOW_POPUP);
+    gtk_window_set_resizable(GTK_WINDOW(win), FALSE);
+    gtk_container_add(GTK_CONTAINER(win), scroll);
+    gtk_widget_add_events(win, GDK_BUTTON_PRESS_MASK | GDK_POINTER_MOTION_MASK | GDK_KEY_PRESS_MASK | GDK_LEAVE_NOTIFY_MASK);
 
-    if (menu_opened_as_popup)
+    g_signal_connect(G_OBJECT(view), "button-press-event", G_CALLBACK(window_list_button_press_event), (gpointer) tb);
+    g_signal_connect(G_OBJECT(win), "button-press-event", G_CALLBACK(window_list_button_press_event), (gpointer) tb);
+    g_signal_connect(G_OBJECT(win), "key-press-event", G_CALLBACK(window_list_key_press_event), (gpointer) tb);
+    g_signal_connect(G_OBJECT(win), "grab-broken-event", G_CALLBACK(window_list_grab_broken_event), (gpointer) tb);
+    g_signal_connect_after(G_OBJECT(view), "motion-notify-event", G_CALLBACK(group_menu_motion), (gpointer) tb);
+    g_signal_connect_after(G_OBJECT(win), "leave-notify-event", G_CALLBACK(group_menu_motion), (gpointer) tb);
+    g_signal_connect(G_OBJECT(win), "size-allocate", G_CALLBACK(group_menu_size_allocate), (gpointer) tb);
+
+    gtk_widget_show_all(scroll);
+
+    /* From now on the model follows the task list. */
+    Task * tk;
+    for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
     {
-        g_signal_connect_after(G_OBJECT (menu), "motion-notify-event", G_CALLBACK(group_menu_motion), (gpointer) tb);
-        g_signal_connect(G_OBJECT (menu), "size-allocate", G_CALLBACK(group_menu_size_allocate), (gpointer) tb);
-        tb->group_menu_opened_as_popup = TRUE;
+        gtk_list_store_append(tb->window_list_store, &tk->window_list_iter);
+        gtk_list_store_set(tb->window_list_store, &tk->window_list_iter, WINDOW_LIST_COL_TASK, tk, -1);
+        tk->window_list_row = TRUE;
     }
+}
+
+/* Width of the window list: a fraction of the monitor the button is on, but not narrower than a few rows are high. */
+static int taskbar_get_window_list_width(GtkWidget * button, int row_height)
+{
+    GdkScreen * screen = gtk_widget_get_screen(button);
+    GdkWindow * window = gtk_widget_get_window(button);
+    int monitor = window ? gdk_screen_get_monitor_at_window(screen, window) : 0;
+    GdkRectangle geometry;
+    gdk_screen_get_monitor_geometry(screen, monitor, &geometry);
+
+    int width = geometry.width / WINDOW_LIST_MONITOR_FRACTION;
+    width = MAX(width, row_height * WINDOW_LIST_MIN_WIDTH_ROWS);
+    return MIN(width, geometry.width);
+}
+
+static void task_show_window_list(Task * tk, GdkEventButton * event, gboolean similar, gboolean menu_opened_as_popup)
+{
+    TaskbarPlugin * tb = tk->tb;
+    TaskClass * tc = tk->task_class;
 
     /* Destroy already opened menu, if any. */
     taskbar_group_menu_destroy(tb);
     gtk_menu_popdown(GTK_MENU(tb->menu));
 
-    /* Show the menu.  Set context so we can find the menu later to dismiss it.
-     * Use a position-calculation callback to get the menu nicely positioned with respect to the button. */
-    gtk_widget_show_all(menu);
-    tb->group_menu = menu;
+    if (!tb->window_list_window)
+        taskbar_build_window_list(tb);
+
+    /* Select the rows.  Rows of tasks that changed since are already up to date. */
+    Task * single_task = (similar && task_is_folded(tk) && !tc) ? tk : NULL;
+    if (!tb->window_list_filter_valid
+    ||  tb->window_list_single_task != single_task
+    ||  tb->window_list_by_class != similar
+    ||  tb->window_list_class != tc
+    ||  tb->window_list_filter_desktop != tb->current_desktop)
+    {
+        tb->window_list_single_task = single_task;
+        tb->window_list_by_class = similar;
+        tb->window_list_class = tc;
+        tb->window_list_filter_desktop = tb->current_desktop;
+        tb->window_list_filter_valid = TRUE;
+        gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(tb->window_list_filter));
+    }
+
+    /* Size the list to its rows, up to WINDOW_LIST_MAX_ROWS. */
+    int rows = gtk_tree_model_iter_n_children(tb->window_list_filter, NULL);
+    if (rows < 1)
+        return;
 
-    guint event_button = event ? event->button : 0;
-    guint32 event_time = event ? event->time: gtk_get_current_event_time();
+    gint row_height = 0;
+    g_object_set(tb->window_list_text_renderer, "text", "Xg", NULL);
+    gtk_cell_renderer_get_size(tb->window_list_text_renderer, tb->window_list_view, NULL, NULL, NULL, NULL, &row_height);
+    gint icon_w = 16, icon_h = 16;
+    gtk_icon_size_lookup(GTK_ICON_SIZE_MENU, &icon_w, &icon_h);
+    row_height = MAX(row_height, icon_h + 2);
+    gint separator = 0;
+    gtk_widget_style_get(tb->window_list_view, "vertical-separator", &separator, NULL);
+    row_height += separator;
 
-    gtk_menu_popup(GTK_MENU(menu), NULL, NULL,
-        (GtkMenuPositionFunc) taskbar_popup_set_position, (gpointer) tk, event_button, event_time);
+    gtk_widget_set_size_request(tb->window_list_view, taskbar_get_window_list_width(tk->button, row_height), -1);
+    gtk_widget_set_size_request(tb->window_list_scroll, -1, MIN(rows, WINDOW_LIST_MAX_ROWS) * row_height + 4);
+    gtk_adjustment_set_value(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(tb->window_list_scroll)), 0);
+    gtk_tree_selection_unselect_all(gtk_tree_view_get_selection(GTK_TREE_VIEW(tb->window_list_view)));
+
+    tb->group_menu_opened_as_popup = menu_opened_as_popup;
+
+    /* Show the list next to the button. */
+    GtkRequisition requisition;
+    gtk_widget_size_request(tb->window_list_window, &requisition);
+    gint px, py;
+    plugin_popup_set_position_helper(tb->plug, tk->button, tb->window_list_window, &requisition, &px, &py);
+    gtk_window_move(GTK_WINDOW(tb->window_list_window), px, py);
+    gtk_widget_show(tb->window_list_window);
+    tb->group_menu = tb->window_list_window;
+
+    /* Opened by a click, the list behaves like a menu: it takes the pointer and keyboard until dismissed. */
+    if (!menu_opened_as_popup)
+    {
+        guint32 event_time = event ? event->time : gtk_get_current_event_time();
+        GdkWindow * window = gtk_widget_get_window(tb->window_list_window);
+        if (gdk_pointer_grab(window, TRUE, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK,
+                NULL, NULL, event_time) == GDK_GRAB_SUCCESS)
+        {
+            gdk_keyboard_grab(window, TRUE, event_time);
+            gtk_grab_add(tb->window_list_window);
+            tb->window_list_grabbed = TRUE;
+
+            /* Give the keyboard to the view, starting at the first row. */
+            GtkTreePath * path = gtk_tree_path_new_first();
+            gtk_tree_view_set_cursor(GTK_TREE_VIEW(tb->window_list_view), path, NULL, FALSE);
+            gtk_tree_path_free(path);
+            gtk_widget_grab_focus(tb->window_list_view);
+        }
+    }
 }
 
 /******************************************************************************/
@@ -2517,7 +3129,7 @@ static void preview_panel_setup_rgba_transparency(TaskbarPlugin * tb)
     {
         if (!tb->preview_panel_expose_event_connected)
         {
-            g_signal_connect(G_OBJECT(widget), "expose_event", G_CALLBACK(preview_panel_expose_event), tb);
+            plugin_signal_connect(tb->plug, G_OBJECT(widget), "expose_event", G_CALLBACK(preview_panel_expose_event), tb);
             tb->preview_panel_expose_event_connected = TRUE;
         }
     }
@@ -2671,7 +3283,7 @@ static gboolean preview_panel_motion_event(GtkWidget * widget, GdkEventMotion *
 
     if (tb->preview_panel_speed && tb->preview_panel_motion_timer == 0)
     {
-        tb->preview_panel_motion_timer = g_timeout_add(10, (GSourceFunc) preview_panel_motion_timer, tb);
+        tb->preview_panel_motion_timer = plugin_timeout_add(tb->plug, 10, (GSourceFunc) preview_panel_motion_timer, tb);
     }
 
     return FALSE;
@@ -2771,6 +3383,8 @@ static void task_update_preview_item(Task * tk, gboolean create)
     {
         I->label = gtk_label_new(task_get_displayed_name(tk));
         g_object_ref(G_OBJECT(I->label));
+        g_free(tk->drawn_preview_name);
+        tk->drawn_preview_name = NULL;
 
         gtk_label_set_ellipsize(GTK_LABEL(I->label), PANGO_ELLIPSIZE_END);
         gtk_widget_set_size_request(I->label, 1, -1);
@@ -2779,15 +3393,18 @@ static void task_update_preview_item(Task * tk, gboolean create)
 
     if (create)
     {
-        if (I->image)
+        GdkPixbuf * pixbuf = tk->thumbnail_preview ? tk->thumbnail_preview : tk->icon_pixbuf;
+        if (!I->image)
+        {
+            I->image = gtk_image_new_from_pixbuf(pixbuf);
+            g_object_ref(G_OBJECT(I->image));
+            gtk_box_pack_start(GTK_BOX(I->inner_container), I->image, TRUE, TRUE, 0);
+        }
+        else if (gtk_image_get_storage_type(GTK_IMAGE(I->image)) != GTK_IMAGE_PIXBUF
+             ||  gtk_image_get_pixbuf(GTK_IMAGE(I->image)) != pixbuf)
         {
-            gtk_widget_destroy(I->image);
-            g_object_unref(G_OBJECT(I->image));
+            gtk_image_set_from_pixbuf(GTK_IMAGE(I->image), pixbuf);
         }
-        I->image = gtk_image_new_from_pixbuf(
-           tk->thumbnail_preview ? tk->thumbnail_preview : tk->icon_pixbuf);
-        g_object_ref(G_OBJECT(I->image));
-        gtk_box_pack_start(GTK_BOX(I->inner_container), I->image, TRUE, TRUE, 0);
     }
 
     if (I->button)
@@ -2832,40 +3449,38 @@ static void task_show_preview_panel(Task * tk)
 
     preview_panel_setup_rgba_transparency(tb);
 
-    if (tb->preview_panel_box1)
+    /* The boxes are kept between openings; they are only rebuilt when the panel orientation changes. */
+    int orientation = plugin_get_orientation(tb->plug);
+    if (tb->preview_panel_box && tb->preview_panel_orientation != orientation)
     {
         gtk_container_foreach(GTK_CONTAINER(tb->preview_panel_box1), _remove_from_container, tb->preview_panel_box1);
-    }
-
-    if (tb->preview_panel_box)
-    {
         gtk_widget_destroy(tb->preview_panel_box);
         g_object_unref(G_OBJECT(tb->preview_panel_box));
         tb->preview_panel_box = NULL;
+        tb->preview_panel_box1 = NULL;
     }
 
-    tb->preview_panel_box = gtk_event_box_new();
-    gtk_widget_set_has_window(tb->preview_panel_box, FALSE);
-    g_object_ref(G_OBJECT(tb->preview_panel_box));
-    //gtk_container_set_border_width(GTK_CONTAINER(tb->preview_panel_window), 5);
-    gtk_container_add(GTK_CONTAINER(tb->preview_panel_window), tb->preview_panel_box);
-/*
-    if (tb->colorize_buttons)
+    if (!tb->preview_panel_box)
     {
-        if (tk->bgcolor1.pixel)
-        {
-            gtk_widget_modify_bg(tb->preview_panel_box, GTK_STATE_NORMAL, &tk->bgcolor1);
-        }
+        tb->preview_panel_box = gtk_event_box_new();
+        gtk_widget_set_has_window(tb->preview_panel_box, FALSE);
+        g_object_ref(G_OBJECT(tb->preview_panel_box));
+        //gtk_container_set_border_width(GTK_CONTAINER(tb->preview_panel_window), 5);
+        gtk_container_add(GTK_CONTAINER(tb->preview_panel_window), tb->preview_panel_box);
+
+        tb->preview_panel_box1 =
+            (orientation == ORIENT_HORIZ) ?
+            gtk_hbox_new(TRUE, 5):
+            gtk_vbox_new(TRUE, 5);
+        gtk_container_set_border_width(GTK_CONTAINER(tb->preview_panel_box1), 5);
+        gtk_container_add(GTK_CONTAINER(tb->preview_panel_box), tb->preview_panel_box1);
+        tb->preview_panel_orientation = orientation;
     }
-*/
-    GtkWidget * box = tb->preview_panel_box1 =
-        (plugin_get_orientation(tb->plug) == ORIENT_HORIZ) ?
-        gtk_hbox_new(TRUE, 5):
-        gtk_vbox_new(TRUE, 5);
-    gtk_container_set_border_width(GTK_CONTAINER(box), 5);
-    gtk_container_add(GTK_CONTAINER(tb->preview_panel_box), box);
 
+    GtkWidget * box = tb->preview_panel_box1;
 
+    /* Collect the items to show.  Items already in place are kept; the box is only repacked if the set changed. */
+    GList * wanted = NULL;
     Task* tk_cursor = tk;
     if (tk->task_class)
         tk_cursor = tk->task_class->task_class_head;
@@ -2874,8 +3489,21 @@ static void task_show_preview_panel(Task * tk)
         if (!task_is_visible_on_current_desktop(tk_cursor))
             continue;
         task_update_preview_item(tk_cursor, TRUE);
-        gtk_box_pack_start(GTK_BOX(box), tk_cursor->preview_item.button, TRUE, TRUE, 0);
+        wanted = g_list_prepend(wanted, tk_cursor->preview_item.button);
+    }
+    wanted = g_list_reverse(wanted);
+
+    GList * children = gtk_container_get_children(GTK_CONTAINER(box));
+    GList * w, * c;
+    for (w = wanted, c = children; w && c && w->data == c->data; w = w->next, c = c->next) ;
+    if (w || c)
+    {
+        gtk_container_foreach(GTK_CONTAINER(box), _remove_from_container, box);
+        for (w = wanted; w; w = w->next)
+            gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(w->data), TRUE, TRUE, 0);
     }
+    g_list_free(children);
+    g_list_free(wanted);
 
     gtk_widget_show_all(tb->preview_panel_box);
 
@@ -2959,7 +3587,7 @@ static void taskbar_check_hide_popup(TaskbarPlugin * tb)
     {
         if (tb->hide_popup_delay_timer == 0)
         tb->hide_popup_delay_timer =
-        g_timeout_add(OPEN_GROUP_MENU_DELAY / 2, (GSourceFunc) taskbar_hide_popup_timeout, tb);
+        plugin_timeout_add(tb->plug, OPEN_GROUP_MENU_DELAY / 2, (GSourceFunc) taskbar_hide_popup_timeout, tb);
     }
     else
     {
@@ -3284,7 +3912,7 @@ static gboolean taskbar_button_drag_motion(GtkWidget * widget, GdkDragContext *
 {
     /* Prevent excessive motion notification. */
     if (tk->tb->dnd_delay_timer == 0)
-        tk->tb->dnd_delay_timer = g_timeout_add(DRAG_ACTIVE_DELAY, (GSourceFunc) taskbar_button_drag_motion_timeout, tk);
+        tk->tb->dnd_delay_timer = plugin_timeout_add(tk->tb->plug, DRAG_ACTIVE_DELAY, (GSourceFunc) taskbar_button_drag_motion_timeout, tk);
     gdk_drag_status(drag_context, 0, time);
     return TRUE;
 }
@@ -3324,7 +3952,7 @@ static void taskbar_button_enter(GtkWidget * widget, Task * tk)
     {
         if (tk->show_popup_delay_timer == 0)
             tk->show_popup_delay_timer =
-                g_timeout_add(OPEN_GROUP_MENU_DELAY, (GSourceFunc) taskbar_show_popup_timeout, tk);
+                plugin_timeout_add(tk->tb->plug, OPEN_GROUP_MENU_DELAY, (GSourceFunc) taskbar_show_popup_timeout, tk);
     }
 }
 
@@ -3378,7 +4006,7 @@ static void taskbar_button_size_allocate(GtkWidget * btn, GtkAllocation * alloc,
     tk->button_alloc = *alloc;
 
     if (size_changed)
-        tk->adapt_to_allocated_size_idle_cb = g_idle_add((GSourceFunc) task_adapt_to_allocated_size, tk);
+        tk->adapt_to_allocated_size_idle_cb = plugin_idle_add(tk->tb->plug, (GSourceFunc) task_adapt_to_allocated_size, tk);
 
     if (gtk_widget_get_realized(btn))
     {
@@ -3477,6 +4105,8 @@ static void task_build_gui_label(TaskbarPlugin * tb, Task* tk)
 {
     /* Create a label to contain the window title and add it to the box. */
     tk->label = gtk_label_new(NULL);
+    g_free(tk->drawn_label);
+    tk->drawn_label = NULL;
     gtk_misc_set_alignment(GTK_MISC(tk->label), 0.0, 0.5);
     gtk_label_set_ellipsize(GTK_LABEL(tk->label), PANGO_ELLIPSIZE_END);
     gtk_box_pack_start(GTK_BOX(tk->container), tk->label, TRUE, TRUE, 0);
@@ -3727,6 +4357,7 @@ static void task_insert_after(Task * tk, Task * tk_prev_new)
                 tb, tk->name, tk, tk_prev_new->name, tk_prev_new);
 
             icon_grid_place_child_after(tb->icon_grid, tk->button, tk_prev_new->button);
+            task_place_in_window_list(tk);
         } else {
             SU_LOG_DEBUG2("[0x%x] task \"%s\" (0x%x) is in rigth place\n", tb, tk->name, tk);
         }
@@ -3742,6 +4373,7 @@ static void task_insert_after(Task * tk, Task * tk_prev_new)
         SU_LOG_DEBUG2("[0x%x] task \"%s\" (0x%x) moved to head\n", tb, tk->name, tk);
 
         icon_grid_place_child_after(tb->icon_grid, tk->button, NULL);
+        task_place_in_window_list(tk);
     }
 
 }
@@ -3916,6 +4548,7 @@ static void taskbar_net_client_list(GtkWidget * widget, TaskbarPlugin * tb)
 
                     tk->desktop = wtl_x11_get_net_wm_desktop(tk->win);
                     tk->override_class_name = (char*) -1;
+                    task_update_wm_hints(tk);
                     if (tb->use_urgency_hint)
                         tk->urgency = task_has_urgency(tk);
 
@@ -3938,6 +4571,7 @@ static void taskbar_net_client_list(GtkWidget * widget, TaskbarPlugin * tb)
                         tk->task_flink = tk_pred->task_flink;
                         tk_pred->task_flink = tk;
                     }
+                    task_place_in_window_list(tk);
                     task_reorder(tk, FALSE);
                     task_update_composite_thumbnail(tk);
                     icon_grid_set_visible(tb->icon_grid, tk->button, TRUE);
@@ -4040,7 +4674,15 @@ static void taskbar_set_active_window(TaskbarPlugin * tb, Window f)
 
     if (tb->_unfold_focused_group || tb->_show_single_group)
     {
-        recompute_group_visibility_on_current_desktop(tb);
+        /* Only the classes that lost or gained focus change their folding state. */
+        TaskClass * ctc = ctk ? ctk->task_class : NULL;
+        TaskClass * ntc = tb->focused ? tb->focused->task_class : NULL;
+        if (ctc != ntc)
+        {
+            recompute_group_visibility_for_class(tb, ctc);
+            if (!make_new)
+                recompute_group_visibility_for_class(tb, ntc);
+        }
         taskbar_redraw(tb);
     }
 
@@ -4055,9 +4697,11 @@ static void taskbar_set_current_desktop(TaskbarPlugin * tb, int desktop)
     icon_grid_defer_updates(tb->icon_grid);
 
     /* Store the local copy of current desktops.  Redisplay the taskbar. */
+    int old_desktop = tb->current_desktop;
     tb->current_desktop = desktop;
     //g_print("[0x%x] taskbar_set_current_desktop %d\n", (int) tb, tb->current_desktop);
-    recompute_group_visibility_on_current_desktop(tb);
+    if (old_desktop != desktop)
+        recompute_group_visibility_on_desktop_switch(tb, old_desktop, desktop);
     taskbar_redraw(tb);
 
     icon_grid_resume_updates(tb->icon_grid);
@@ -4096,7 +4740,7 @@ static void taskbar_net_current_desktop(GtkWidget * widget, TaskbarPlugin * tb)
     /* If target desktop has visible tasks, use deferred switching to redice blinking. */
     if (desktop_switch_timeout > 0 && taskbar_has_visible_tasks_on_desktop(tb, desktop)) {
         tb->deferred_current_desktop = desktop;
-        tb->deferred_desktop_switch_timer = g_timeout_add(desktop_switch_timeout, (GSourceFunc) taskbar_switch_desktop_and_window, (gpointer) tb);
+        tb->deferred_desktop_switch_timer = plugin_timeout_add(tb->plug, desktop_switch_timeout, (GSourceFunc) taskbar_switch_desktop_and_window, (gpointer) tb);
     } else {
         taskbar_set_current_desktop(tb, desktop);
     }
@@ -4140,17 +4784,56 @@ static void taskbar_net_active_window(GtkWidget * widget, TaskbarPlugin * tb)
 }
 
 /* Determine if the "urgency" hint is set on a window. */
-static gboolean task_has_urgency(Task * tk)
+/* Items of the raw WM_HINTS property.  Unlike XWMHints, every field is a long. */
+#define WM_HINTS_FLAGS       0
+#define WM_HINTS_ICON_PIXMAP 3
+#define WM_HINTS_ICON_MASK   7
+#define WM_HINTS_ELEMENTS    9
+
+/* Remember the parts of WM_HINTS we use.
+ * Return TRUE if the icon pixmap or mask differs from the previous value. */
+static gboolean task_set_wm_hints(Task * tk, const long * hints, int nitems)
 {
-    gboolean result = FALSE;
-    XWMHints * hints = (XWMHints *) wtl_x11_get_xa_property(tk->win, XA_WM_HINTS, XA_WM_HINTS, 0);
-    if (hints != NULL)
+    long flags = 0;
+    Pixmap icon_pixmap = None;
+    Pixmap icon_mask = None;
+
+    if (hints != NULL && nitems > WM_HINTS_FLAGS)
     {
-        if (hints->flags & XUrgencyHint)
-            result = TRUE;
-        XFree(hints);
+        flags = hints[WM_HINTS_FLAGS];
+        if ((flags & IconPixmapHint) && nitems > WM_HINTS_ICON_PIXMAP)
+            icon_pixmap = hints[WM_HINTS_ICON_PIXMAP];
+        if ((flags & IconMaskHint) && nitems > WM_HINTS_ICON_MASK)
+            icon_mask = hints[WM_HINTS_ICON_MASK];
     }
-    return result;
+
+    gboolean icon_changed = !tk->wm_hints_valid
+        || icon_pixmap != tk->wm_hints_icon_pixmap
+        || icon_mask != tk->wm_hints_icon_mask;
+
+    tk->wm_hints_valid = TRUE;
+    tk->wm_hints_flags = flags;
+    tk->wm_hints_icon_pixmap = icon_pixmap;
+    tk->wm_hints_icon_mask = icon_mask;
+
+    return icon_changed;
+}
+
+/* Fetch WM_HINTS synchronously.  Return TRUE if the icon changed. */
+static gboolean task_update_wm_hints(Task * tk)
+{
+    int nitems = 0;
+    long * hints = (long *) wtl_x11_get_xa_property(tk->win, XA_WM_HINTS, XA_WM_HINTS, &nitems);
+    gboolean icon_changed = task_set_wm_hints(tk, hints, nitems);
+    if (hints != NULL)
+        XFree(hints);
+    return icon_changed;
+}
+
+/* Urgency from the last fetched WM_HINTS. */
+static gboolean task_has_urgency(Task * tk)
+{
+    return (tk->wm_hints_flags & XUrgencyHint) != 0;
 }
 
 /* Handler for desktop_name event from window manager. */
@@ -4164,6 +4847,131 @@ static void taskbar_net_desktop_names(FbEv * fbev, TaskbarPlugin * tb)
     tb->desktop_names = wtl_x11_get_utf8_property_list(wtl_x11_root(), a_NET_DESKTOP_NAMES, &tb->number_of_desktop_names);
 }
 
+/* Replies to the property reads issued by taskbar_property_notify_event().
+ * A window that is gone is left alone; it disappears with the next client list update.
+ * Follow-up work that talks to the X server synchronously still runs under the BadWindow trap. */
+
+static void task_net_wm_desktop_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    TaskbarPlugin * tb = tk->tb;
+
+    int desktop = 0;
+    if (property->data && property->nitems > 0)
+        desktop = (int) (guint32) ((long *) property->data)[0];
+
+    task_set_desktop(tk, desktop);
+    task_update_grouping(tk, GROUP_BY_WORKSPACE);
+    recompute_group_visibility_for_class(tb, tk->task_class);
+    task_update_sorting(tk, SORT_BY_WORKSPACE);
+    taskbar_redraw(tb);
+    taskbar_notify_panel_class_visibility_changed(tb, FALSE);
+}
+
+static void task_wm_state_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    /* This event can be safely ignored for all the tested WMs
+       except for fluxbox.
+       Fluxbox is somewhat special, see
+       <https://github.com/sde-gui/waterline/issues/1>.
+       I didn't get into details whose bug it is, fluxbox's or ours.
+       Just restoring the code here.
+    */
+    gboolean iconified = property->data && property->nitems > 0 && ((long *) property->data)[0] == IconicState;
+
+    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+    task_set_iconified(tk, iconified);
+    XSetErrorHandler(previous_error_handler);
+}
+
+static void task_wm_hints_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    TaskbarPlugin * tb = tk->tb;
+
+    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+
+    /* Some windows set their WM_HINTS icon after mapping, but most changes
+     * just flip the urgency bit.  Reload the icon only if the pixmap or mask changed. */
+    if (task_set_wm_hints(tk, (long *) property->data, property->nitems))
+        task_update_icon(tk, None, TRUE);
+
+    if (tb->use_urgency_hint && tk->urgency != task_has_urgency(tk))
+    {
+        tk->urgency = task_has_urgency(tk);
+        if (tk->urgency)
+            task_set_urgency(tk);
+        else
+            task_clear_urgency(tk);
+        task_window_list_row_changed(tk);
+        task_update_grouping(tk, GROUP_BY_STATE);
+        task_update_sorting(tk, SORT_BY_STATE);
+        taskbar_notify_panel_class_visibility_changed(tb, FALSE);
+    }
+
+    XSetErrorHandler(previous_error_handler);
+}
+
+static void task_net_wm_state_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    TaskbarPlugin * tb = tk->tb;
+
+    NetWMState nws;
+    wtl_x11_decode_net_wm_state((Atom *) property->data, property->nitems, &nws);
+    if ( ! accept_net_wm_state(&nws))
+    {
+        task_delete(tb, tk, TRUE);
+        taskbar_redraw(tb);
+        return;
+    }
+
+    tk->maximized = nws.maximized_vert || nws.maximized_horz;
+    tk->shaded    = nws.shaded;
+
+    /* Without _OB_WM_STATE_UNDECORATED, decorations come from _MOTIF_WM_HINTS, which has its own notification. */
+    if (wtl_x11_check_net_supported(a_OB_WM_STATE_UNDECORATED))
+        tk->decorated = !nws.ob_undecorated;
+
+    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+    task_update_composite_thumbnail(tk);
+    task_set_iconified(tk, nws.hidden);
+    XSetErrorHandler(previous_error_handler);
+}
+
+static void task_motif_wm_hints_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    tk->decorated = wtl_x11_decode_mvm_decorations(property->data, property->nitems) != 0;
+}
+
+static void task_net_wm_window_type_reply(const WtlX11Property * property, Task * tk)
+{
+    if (property->window_gone)
+        return;
+
+    TaskbarPlugin * tb = tk->tb;
+
+    NetWMWindowType nwwt;
+    wtl_x11_decode_net_wm_window_type((Atom *) property->data, property->nitems, &nwwt);
+    if ( ! accept_net_wm_window_type(&nwwt))
+    {
+        task_delete(tb, tk, TRUE);
+        taskbar_redraw(tb);
+    }
+}
+
 /* Handle PropertyNotify event.
  * http://tronche.com/gui/x/icccm/
  * http://standards.freedesktop.org/wm-spec/wm-spec-1.4.html */
@@ -4187,116 +4995,59 @@ static void taskbar_property_notify_event(TaskbarPlugin *tb, XEvent *ev)
                     XFree(atom_name);
                 }
 
-                /* Install an error handler that ignores BadWindow.
-                 * We frequently get a PropertyNotify event on deleted windows. */
-                XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
-
-                /* Dispatch on atom. */
+                /* Dispatch on atom.
+                 * Most properties are read asynchronously; the reads for a burst of events go out together
+                 * and the replies are handled in the task_*_reply functions above. */
                 if (at == a_NET_WM_DESKTOP)
                 {
                     /* Window changed desktop. */
-                    tk->desktop = wtl_x11_get_net_wm_desktop(win);
-                    task_update_grouping(tk, GROUP_BY_WORKSPACE);
-                    task_update_sorting(tk, SORT_BY_WORKSPACE);
-                    taskbar_redraw(tb);
-                    taskbar_notify_panel_class_visibility_changed(tb, FALSE);
+                    wtl_x11_request_property(win, a_NET_WM_DESKTOP, XA_CARDINAL, (WtlX11PropertyFunc) task_net_wm_desktop_reply, tk);
                 }
                 else if ((at == XA_WM_NAME) || (at == a_NET_WM_NAME) || (at == a_NET_WM_VISIBLE_NAME))
                 {
                     /* Window changed name. */
-                    task_set_names(tk, at);
-                    if (tk->task_class != NULL)
-                    {
-                        /* A change to the window name may change the visible name of the class. */
-                        recompute_group_visibility_for_class(tb, tk->task_class);
-                        if (tk->task_class->visible_task != NULL)
-                            task_draw_label(tk->task_class->visible_task);
-                    }
-                    task_update_sorting(tk, SORT_BY_TITLE);
+                    task_defer_set_names(tk, at);
                 }
                 else if (at == XA_WM_CLASS)
                 {
                     /* Window changed class. */
+                    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
                     task_update_wm_class(tk);
                     task_update_grouping(tk, GROUP_BY_CLASS);
                     taskbar_notify_panel_class_visibility_changed(tb, FALSE);
+                    XSetErrorHandler(previous_error_handler);
                 }
                 else if (at == aWM_STATE)
                 {
                     /* Window changed state. */
-
-                    /* This event can be safely ignored for all the tested WMs
-                       except for fluxbox.
-                       Fluxbox is somewhat special, see
-                       <https://github.com/sde-gui/waterline/issues/1>.
-                       I didn't get into details whose bug it is, fluxbox's or ours.
-                       Just restoring the code here.
-                    */
-                    gboolean iconified = wtl_x11_get_wm_state(win) == IconicState;
-                    task_set_iconified(tk, iconified);
+                    wtl_x11_request_property(win, aWM_STATE, aWM_STATE, (WtlX11PropertyFunc) task_wm_state_reply, tk);
                 }
                 else if (at == XA_WM_HINTS)
                 {
-                    /* Window changed "window manager hints".
-                     * Some windows set their WM_HINTS icon after mapping. */
-                    //task_update_icon(tk, XA_WM_HINTS);
-                    task_update_icon(tk, None, TRUE);
-
-                    if (tb->use_urgency_hint)
-                    {
-                        tk->urgency = task_has_urgency(tk);
-                        if (tk->urgency)
-                            task_set_urgency(tk);
-                        else
-                            task_clear_urgency(tk);
-                        task_update_grouping(tk, GROUP_BY_STATE);
-                        task_update_sorting(tk, SORT_BY_STATE);
-                        taskbar_notify_panel_class_visibility_changed(tb, FALSE);
-                    }
+                    /* Window changed "window manager hints". */
+                    wtl_x11_request_property(win, XA_WM_HINTS, XA_WM_HINTS, (WtlX11PropertyFunc) task_wm_hints_reply, tk);
                 }
                 else if (at == a_NET_WM_STATE)
                 {
                     /* Window changed EWMH state. */
-                    NetWMState nws;
-                    wtl_x11_get_net_wm_state(tk->win, &nws);
-                    if ( ! accept_net_wm_state(&nws))
-                    {
-                        task_delete(tb, tk, TRUE);
-                        taskbar_redraw(tb);
-                        tk = NULL;
-                    }
-                    else
-                    {
-                        tk->maximized = nws.maximized_vert || nws.maximized_horz;
-                        tk->shaded    = nws.shaded;
-                        tk->decorated = get_decorations(tk->win, &nws);
-                        task_update_composite_thumbnail(tk);
-
-                        gboolean iconified = nws.hidden;
-                        task_set_iconified(tk, iconified);
-                    }
+                    wtl_x11_request_property(win, a_NET_WM_STATE, XA_ATOM, (WtlX11PropertyFunc) task_net_wm_state_reply, tk);
                 }
                 else if (at == a_MOTIF_WM_HINTS)
                 {
-                    tk->decorated = get_mvm_decorations(tk->win) != 0;
+                    wtl_x11_request_property(win, a_MOTIF_WM_HINTS, a_MOTIF_WM_HINTS, (WtlX11PropertyFunc) task_motif_wm_hints_reply, tk);
                 }
                 else if (at == a_NET_WM_ICON)
                 {
                     /* Window changed EWMH icon. */
+                    XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
                     task_update_icon(tk, a_NET_WM_ICON, TRUE);
+                    XSetErrorHandler(previous_error_handler);
                 }
                 else if (at == a_NET_WM_WINDOW_TYPE)
                 {
                     /* Window changed EWMH window type. */
-                    NetWMWindowType nwwt;
-                    wtl_x11_get_net_wm_window_type(tk->win, &nwwt);
-                    if ( ! accept_net_wm_window_type(&nwwt))
-                    {
-                        task_delete(tb, tk, TRUE);
-                        taskbar_redraw(tb);
-                    }
+                    wtl_x11_request_property(win, a_NET_WM_WINDOW_TYPE, XA_ATOM, (WtlX11PropertyFunc) task_net_wm_window_type_reply, tk);
                 }
-                XSetErrorHandler(previous_error_handler);
             }
         }
     }
@@ -4420,7 +5171,7 @@ static void menu_unfold_group_window(GtkWidget * widget, TaskbarPlugin * tb)
         tc->manual_unfold_state = TRUE;
 
         icon_grid_defer_updates(tb->icon_grid);
-        recompute_group_visibility_on_current_desktop(tb);
+        recompute_group_visibility_for_class(tb, tc);
         taskbar_redraw(tb);
         icon_grid_resume_updates(tb->icon_grid);
     }
@@ -4436,7 +5187,7 @@ static void menu_fold_group_window(GtkWidget * widget, TaskbarPlugin * tb)
         tc->manual_unfold_state = TRUE;
 
         icon_grid_defer_updates(tb->icon_grid);
-        recompute_group_visibility_on_current_desktop(tb);
+        recompute_group_visibility_for_class(tb, tc);
         taskbar_redraw(tb);
         icon_grid_resume_updates(tb->icon_grid);
     }
@@ -4923,7 +5674,9 @@ static void taskbar_build_gui(Plugin * p)
     taskbar_update_style(tb);
 
     /* Add GDK event filter. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) taskbar_event_filter, tb);
+    plugin_add_event_filter(tb->plug, (GdkFilterFunc) taskbar_event_filter, tb);
+
+    tb->icon_theme_watch = wtl_icon_theme_add_watch(pwid, (WtlIconThemeChangedFunc) taskbar_icon_theme_changed, tb);
 
     /* Connect signal to receive mouse events on the unused portion of the taskbar. */
     g_signal_connect(pwid, "button-press-event", G_CALLBACK(plugin_button_press_event), p);
@@ -4931,11 +5684,11 @@ static void taskbar_build_gui(Plugin * p)
     /* Connect signals to receive root window events and initialize root window properties. */
     tb->number_of_desktops = wtl_x11_get_net_number_of_desktops();
     tb->current_desktop = wtl_x11_get_net_current_desktop();
-    g_signal_connect(G_OBJECT(fbev), "current_desktop", G_CALLBACK(taskbar_net_current_desktop), (gpointer) tb);
-    g_signal_connect(G_OBJECT(fbev), "active_window", G_CALLBACK(taskbar_net_active_window), (gpointer) tb);
-    g_signal_connect(G_OBJECT(fbev), "number_of_desktops", G_CALLBACK(taskbar_net_number_of_desktops), (gpointer) tb);
-    g_signal_connect(G_OBJECT(fbev), "desktop_names", G_CALLBACK(taskbar_net_desktop_names), (gpointer) tb);
-    g_signal_connect(G_OBJECT(fbev), "client_list", G_CALLBACK(taskbar_net_client_list), (gpointer) tb);
+    plugin_signal_connect(tb->plug, G_OBJECT(fbev), "current_desktop", G_CALLBACK(taskbar_net_current_desktop), (gpointer) tb);
+    plugin_signal_connect(tb->plug, G_OBJECT(fbev), "active_window", G_CALLBACK(taskbar_net_active_window), (gpointer) tb);
+    plugin_signal_connect(tb->plug, G_OBJECT(fbev), "number_of_desktops", G_CALLBACK(taskbar_net_number_of_desktops), (gpointer) tb);
+    plugin_signal_connect(tb->plug, G_OBJECT(fbev), "desktop_names", G_CALLBACK(taskbar_net_desktop_names), (gpointer) tb);
+    plugin_signal_connect(tb->plug, G_OBJECT(fbev), "client_list", G_CALLBACK(taskbar_net_client_list), (gpointer) tb);
 
     /* Make right-click menu for task buttons.
      * It is retained for the life of the taskbar and will be shown as needed.
@@ -5022,7 +5775,7 @@ static void taskbar_config_updated(TaskbarPlugin * tb)
         Task * tk;
         for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
         {
-            tk->deferred_iconified_update = TRUE;
+            tk->dirty |= TASK_DIRTY_ICON;
         }
         taskbar_redraw(tb);
     }
@@ -5041,6 +5794,9 @@ static void taskbar_config_updated(TaskbarPlugin * tb)
         recompute_group_visibility_on_current_desktop(tb);
         taskbar_redraw(tb);
     }
+
+    /* Desktop and urgency preferences change which rows are shown. */
+    tb->window_list_filter_valid = FALSE;
 }
 
 /* Plugin constructor. */
@@ -5155,7 +5911,9 @@ static void taskbar_destructor(Plugin * p)
         g_source_remove(tb->deferred_desktop_switch_timer);
 
     /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) taskbar_event_filter, tb);
+    plugin_remove_event_filter(tb->plug, (GdkFilterFunc) taskbar_event_filter, tb);
+
+    wtl_icon_theme_remove_watch(tb->icon_theme_watch);
 
     /* Remove root window signal handlers. */
     g_signal_handlers_disconnect_by_func(fbev, taskbar_net_current_desktop, tb);
@@ -5183,9 +5941,29 @@ static void taskbar_destructor(Plugin * p)
         TaskClass * tc = tb->task_class_list;
         tb->task_class_list = tc->task_class_flink;
         g_free(tc->class_name);
+        g_free(tc->desktop_task_count);
         g_free(tc);
     }
 
+    int slot;
+    for (slot = 0; slot <= MAX_COUNTED_DESKTOPS; slot++)
+    {
+        if (tb->desktop_classes[slot])
+            g_hash_table_destroy(tb->desktop_classes[slot]);
+        tb->desktop_classes[slot] = NULL;
+    }
+
+    if (tb->window_list_window)
+    {
+        gtk_widget_destroy(tb->window_list_window);
+        g_object_unref(G_OBJECT(tb->window_list_filter));
+        g_object_unref(G_OBJECT(tb->window_list_store));
+    }
+
+    /* Deleting the tasks may have scheduled a flush. */
+    if (tb->render_idle_cb != 0)
+        g_source_remove(tb->render_idle_cb);
+
     if (tb->menu_config)
         g_strfreev(tb->menu_config);
 
@@ -5222,7 +6000,10 @@ static void taskbar_apply_configuration(Plugin * p)
     /* Update styles on each button. */
     Task * tk;
     for (tk = tb->task_list; tk != NULL; tk = tk->task_flink)
+    {
+        task_forget_drawn_state(tk);
         task_update_style(tk, tb);
+    }
 
     /* Refetch the client list and redraw. */
     recompute_group_visibility_on_current_desktop(tb);
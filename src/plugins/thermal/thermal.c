@@ -167,10 +167,9 @@ static void update_display(thermal *th, gboolean force)
     }
     else
     {
-        gchar * buffer = g_strdup_printf("<span color=\"#%06x\"><b>%02d°C</b></span>",
-            wtl_util_gdkcolor_to_uint32(&color), temp);
-        gtk_label_set_markup (GTK_LABEL(th->namew), buffer);
-        g_free(buffer);
+        gchar buffer[16];
+        g_snprintf(buffer, sizeof(buffer), "%02d°C", temp);
+        panel_draw_label_text_full(plugin_panel(th->plugin), th->namew, buffer, STYLE_BOLD, NULL, &color);
     }
 }
 
@@ -292,7 +291,7 @@ thermal_constructor(Plugin *p)
     gtk_widget_show(th->namew);
 
     update_display(th, TRUE);
-    th->timer = g_timeout_add(2000, (GSourceFunc) update_display_timeout, (gpointer)th);
+    th->timer = plugin_timeout_add(p, 2000, (GSourceFunc) update_display_timeout, (gpointer)th);
 
     return TRUE;
 }
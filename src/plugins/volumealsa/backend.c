@@ -81,6 +81,13 @@ void volume_control_backend_set_volume(volume_control_backend_t * backend, long
         backend->impl_vtable->set_volume(backend, volume);
 }
 
+const char * volume_control_backend_get_device_name(volume_control_backend_t * backend)
+{
+    if (CHECK_SANITY_FN(get_device_name))
+        return backend->impl_vtable->get_device_name(backend);
+    return NULL;
+}
+
 void volume_control_backend_free(volume_control_backend_t * backend)
 {
     if (CHECK_SANITY_FN(destroy))
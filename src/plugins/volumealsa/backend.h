@@ -37,6 +37,7 @@ struct volume_control_backend_impl_vtable {
     void     (*set_mute)(volume_control_backend_t * backend, gboolean value);
     long     (*get_volume)(volume_control_backend_t * backend);
     void     (*set_volume)(volume_control_backend_t * backend, long volume);
+    const char * (*get_device_name)(volume_control_backend_t * backend);
     void     (*destroy)(volume_control_backend_t * backend);
 };
 
@@ -58,6 +59,7 @@ extern SYMBOL_HIDDEN gboolean volume_control_backend_is_muted(volume_control_bac
 extern SYMBOL_HIDDEN void volume_control_backend_set_mute(volume_control_backend_t * backend, gboolean value);
 extern SYMBOL_HIDDEN long volume_control_backend_get_volume(volume_control_backend_t * backend);
 extern SYMBOL_HIDDEN void volume_control_backend_set_volume(volume_control_backend_t * backend, long volume);
+extern SYMBOL_HIDDEN const char * volume_control_backend_get_device_name(volume_control_backend_t * backend);
 extern SYMBOL_HIDDEN void volume_control_backend_free(volume_control_backend_t * backend);
 
 /*extern SYMBOL_HIDDEN gboolean volume_control_backend_set_frontend(volume_control_backend_t * backend, gpointer frontend);
@@ -17,226 +17,547 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #define BACKEND_IMPLEMENTATION
 #include "backend.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <alsa/asoundlib.h>
 #include <poll.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
+/* One mixer device with the element we control on it. */
 typedef struct {
-    volume_control_backend_t * backend;
+    gchar * device;                 /* ALSA mixer device, such as "default" or "hw:1" */
+    gchar * element_name;           /* Element to control, or NULL to pick Master, Front, PCM or LineOut */
     snd_mixer_t * mixer;
-    snd_mixer_selem_id_t * sid;
-    snd_mixer_elem_t * master_element;
-    guint mixer_evt_idle;
-    guint restart_idle;
+    snd_mixer_elem_t * element;
+    guint poll_index;               /* Position of the descriptors in the common poll set */
+    guint poll_count;
+} alsa_mixer_t;
+
+typedef struct {
+    volume_control_backend_t * backend;
 
-    GIOChannel ** channels;
-    guint * watches;
-    guint num_channels;
+    alsa_mixer_t * mixers;          /* In order of preference */
+    guint num_mixers;
+    alsa_mixer_t * active;          /* The first open mixer; this is what the plugin shows and controls */
 
-    gboolean valid;
+    GSource * poll_source;          /* Polls the descriptors of all the open mixers */
+    GPollFD * poll_fds;
+    guint num_poll_fds;
 
-    gpointer frontend;
-    void (*frontend_callback_state_changed)(gpointer frontend, gpointer backend);
+    int inotify_fd;                 /* Watches /dev/snd for cards coming and going */
+    int inotify_wd;
+    gboolean inotify_on_dev;        /* /dev/snd does not exist yet; watching /dev for it to appear */
+    guint inotify_watch;
+
+    guint restart_timer;
+    guint restart_delay;            /* Seconds; doubles with every failed attempt */
 } backend_alsa_t;
 
-static gboolean alsa_find_element(backend_alsa_t * impl, const char * ename);
-static gboolean alsa_reset_mixer_evt_idle(backend_alsa_t * impl);
-static gboolean alsa_mixer_event(GIOChannel * channel, GIOCondition cond, backend_alsa_t * impl);
+typedef struct {
+    GSource source;
+    backend_alsa_t * impl;
+} alsa_poll_source_t;
+
+static gboolean alsa_mixer_open(alsa_mixer_t * m);
+static void alsa_mixer_close(alsa_mixer_t * m);
+static void alsa_update_poll_set(backend_alsa_t * impl);
+static gboolean alsa_select_active(backend_alsa_t * impl);
+static void alsa_schedule_restart(backend_alsa_t * impl, guint delay);
 static gboolean alsa_restart(gpointer impl_gpointer);
-static gboolean alsa_initialize(backend_alsa_t * backend);
-static void alsa_deinitialize(backend_alsa_t * backend);
-static gboolean alsa_has_mute(volume_control_backend_t * backend);
-static gboolean alsa_is_muted(volume_control_backend_t * backend);
-static long alsa_get_volume(volume_control_backend_t * backend);
-static void alsa_set_volume(volume_control_backend_t * backend, long volume);
 
 #define MY_NAME "volume control: alsa backend"
 
-static gboolean alsa_find_element(backend_alsa_t * impl, const char * ename)
+#define RESTART_DELAY_MIN 3
+#define RESTART_DELAY_MAX 60
+
+/* Let udev finish setting up the device nodes before trying them. */
+#define HOTPLUG_SETTLE_DELAY_MS 500
+
+/******************************************************************************/
+
+static gboolean alsa_find_element(alsa_mixer_t * m, snd_mixer_selem_id_t * sid, const char * ename)
 {
     for (
-      impl->master_element = snd_mixer_first_elem(impl->mixer);
-      impl->master_element != NULL;
-      impl->master_element = snd_mixer_elem_next(impl->master_element))
+      m->element = snd_mixer_first_elem(m->mixer);
+      m->element != NULL;
+      m->element = snd_mixer_elem_next(m->element))
     {
-        snd_mixer_selem_get_id(impl->master_element, impl->sid);
-        if ((snd_mixer_selem_is_active(impl->master_element))
-        && (g_strcmp0(ename, snd_mixer_selem_id_get_name(impl->sid)) == 0))
+        snd_mixer_selem_get_id(m->element, sid);
+        if ((snd_mixer_selem_is_active(m->element))
+        && (g_strcmp0(ename, snd_mixer_selem_id_get_name(sid)) == 0))
             return TRUE;
     }
     return FALSE;
 }
 
-/* NOTE by PCMan:
- * This is magic! Since ALSA uses its own machanism to handle this part.
- * After polling of mixer fds, it requires that we should call
- * snd_mixer_handle_events to clear all pending mixer events.
- * However, when using the glib IO channels approach, we don't have
- * poll() and snd_mixer_poll_descriptors_revents(). Due to the design of
- * glib, on_mixer_event() will be called for every fd whose status was
- * changed. So, after each poll(), it's called for several times,
- * not just once. Therefore, we cannot call snd_mixer_handle_events()
- * directly in the event handler. Otherwise, it will get called for
- * several times, which might clear unprocessed pending events in the queue.
- * So, here we call it once in the event callback for the first fd.
- * Then, we don't call it for the following fds. After all fds with changed
- * status are handled, we remove this restriction in an idle handler.
- * The next time the event callback is involked for the first fs, we can
- * call snd_mixer_handle_events() again. Racing shouldn't happen here
- * because the idle handler has the same priority as the io channel callback.
- * So, io callbacks for future pending events should be in the next gmain
- * iteration, and won't be affected.
- */
+static gboolean alsa_mixer_open(alsa_mixer_t * m)
+{
+    snd_mixer_selem_id_t * sid;
+    snd_mixer_selem_id_alloca(&sid);
+
+    if (snd_mixer_open(&m->mixer, 0) != 0)
+    {
+        m->mixer = NULL;
+        return FALSE;
+    }
+    if (snd_mixer_attach(m->mixer, m->device) != 0)
+        goto err;
+    if (snd_mixer_selem_register(m->mixer, NULL, NULL) != 0)
+        goto err;
+    if (snd_mixer_load(m->mixer) != 0)
+        goto err;
+
+    /* Find the configured element, or else Master, Front, PCM or LineOut. */
+    if (m->element_name)
+    {
+        if (!alsa_find_element(m, sid, m->element_name))
+            goto err;
+    }
+    else
+    {
+        if (!alsa_find_element(m, sid, "Master"))
+            if (!alsa_find_element(m, sid, "Front"))
+                if (!alsa_find_element(m, sid, "PCM"))
+                    if (!alsa_find_element(m, sid, "LineOut"))
+                        goto err;
+    }
+
+    /* Set the playback volume range as we wish it. */
+    snd_mixer_selem_set_playback_volume_range(m->element, 0, 100);
+    return TRUE;
 
-static gboolean alsa_reset_mixer_evt_idle(backend_alsa_t * impl)
+err:
+    alsa_mixer_close(m);
+    return FALSE;
+}
+
+static void alsa_mixer_close(alsa_mixer_t * m)
 {
-    if (!g_source_is_destroyed(g_main_current_source()))
-        impl->mixer_evt_idle = 0;
+    if (m->mixer)
+        snd_mixer_close(m->mixer);
+    m->mixer = NULL;
+    m->element = NULL;
+    m->poll_index = 0;
+    m->poll_count = 0;
+}
+
+/******************************************************************************/
+
+/* All the mixers are polled from one GSource. Unlike a watch per descriptor,
+ * this sees all the descriptors of a mixer at once, so snd_mixer_handle_events()
+ * is called exactly once per mixer and main loop iteration. */
+
+static gboolean alsa_poll_source_prepare(GSource * source, gint * timeout)
+{
+    *timeout = -1;
+    return FALSE;
+}
+
+static gboolean alsa_poll_source_check(GSource * source)
+{
+    backend_alsa_t * impl = ((alsa_poll_source_t *) source)->impl;
+    guint i;
+    for (i = 0; i < impl->num_poll_fds; i++)
+    {
+        if (impl->poll_fds[i].revents)
+            return TRUE;
+    }
     return FALSE;
 }
 
-/* Handler for I/O event on ALSA channel. */
-static gboolean alsa_mixer_event(GIOChannel * channel, GIOCondition cond, backend_alsa_t * impl)
+static gboolean alsa_poll_source_dispatch(GSource * source, GSourceFunc callback, gpointer user_data)
 {
-    int res = 0;
+    backend_alsa_t * impl = ((alsa_poll_source_t *) source)->impl;
+
+    gboolean changed = FALSE;
+    gboolean failed = FALSE;
 
-    if (impl->mixer_evt_idle == 0)
+    guint i;
+    for (i = 0; i < impl->num_mixers; i++)
     {
-        impl->mixer_evt_idle = g_idle_add_full(G_PRIORITY_DEFAULT, (GSourceFunc) alsa_reset_mixer_evt_idle, impl, NULL);
-        res = snd_mixer_handle_events(impl->mixer);
+        alsa_mixer_t * m = &impl->mixers[i];
+        if (!m->mixer || m->poll_count == 0)
+            continue;
+
+        struct pollfd fds[m->poll_count];
+        guint j;
+        gboolean any = FALSE;
+        for (j = 0; j < m->poll_count; j++)
+        {
+            GPollFD * pfd = &impl->poll_fds[m->poll_index + j];
+            fds[j].fd = pfd->fd;
+            fds[j].events = pfd->events;
+            fds[j].revents = pfd->revents;
+            any |= pfd->revents != 0;
+        }
+        if (!any)
+            continue;
+
+        unsigned short revents = 0;
+        int res = snd_mixer_poll_descriptors_revents(m->mixer, fds, m->poll_count, &revents);
+        if (res >= 0 && (revents & POLLIN))
+            res = snd_mixer_handle_events(m->mixer);
+
+        if (res < 0 || (revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            /* The card has gone away, or ALSA (or pulseaudio) had a problem. */
+            g_warning(MY_NAME ": mixer %s failed: res %d, revents 0x%x.", m->device, res, revents);
+            alsa_mixer_close(m);
+            failed = TRUE;
+        }
+        else if (revents & POLLIN)
+        {
+            changed = TRUE;
+        }
     }
 
-    if (cond & G_IO_IN)
+    if (failed)
     {
+        alsa_update_poll_set(impl);
+        alsa_select_active(impl);
+        alsa_schedule_restart(impl, RESTART_DELAY_MIN * 1000);
+        changed = TRUE;
+    }
+
+    if (changed)
         volume_control_backend_notify_state_changed(impl->backend);
+
+    return TRUE;
+}
+
+static GSourceFuncs alsa_poll_source_funcs = {
+    alsa_poll_source_prepare,
+    alsa_poll_source_check,
+    alsa_poll_source_dispatch,
+    NULL
+};
+
+/* Rebuild the poll set from the descriptors of the open mixers. */
+static void alsa_update_poll_set(backend_alsa_t * impl)
+{
+    guint i;
+
+    if (!impl->poll_source)
+    {
+        impl->poll_source = g_source_new(&alsa_poll_source_funcs, sizeof(alsa_poll_source_t));
+        ((alsa_poll_source_t *) impl->poll_source)->impl = impl;
+        g_source_attach(impl->poll_source, NULL);
     }
 
-    if ((cond & G_IO_HUP) || (res < 0))
+    for (i = 0; i < impl->num_poll_fds; i++)
+        g_source_remove_poll(impl->poll_source, &impl->poll_fds[i]);
+    g_free(impl->poll_fds);
+    impl->poll_fds = NULL;
+    impl->num_poll_fds = 0;
+
+    guint total = 0;
+    for (i = 0; i < impl->num_mixers; i++)
     {
-        /* This means there're some problems with alsa. */
-        g_warning(
-            MY_NAME ": ALSA (or pulseaudio) had a problem:\n"
-            "snd_mixer_handle_events() = %d,  cond 0x%x (IN: 0x%x, HUP: 0x%x).",
-            res, cond, G_IO_IN, G_IO_HUP);
-        if (impl->restart_idle == 0)
-            impl->restart_idle = g_timeout_add_seconds(3, alsa_restart, impl);
-        impl->valid = FALSE;
-        volume_control_backend_notify_state_changed(impl->backend);
-        return FALSE;
+        alsa_mixer_t * m = &impl->mixers[i];
+        int count = m->mixer ? snd_mixer_poll_descriptors_count(m->mixer) : 0;
+        m->poll_index = total;
+        m->poll_count = count > 0 ? count : 0;
+        total += m->poll_count;
     }
 
-    return TRUE;
+    if (total == 0)
+        return;
+
+    impl->poll_fds = g_new0(GPollFD, total);
+    impl->num_poll_fds = total;
+
+    for (i = 0; i < impl->num_mixers; i++)
+    {
+        alsa_mixer_t * m = &impl->mixers[i];
+        if (m->poll_count == 0)
+            continue;
+
+        struct pollfd fds[m->poll_count];
+        int count = snd_mixer_poll_descriptors(m->mixer, fds, m->poll_count);
+        guint j;
+        for (j = 0; j < m->poll_count; j++)
+        {
+            GPollFD * pfd = &impl->poll_fds[m->poll_index + j];
+            if ((int) j < count)
+            {
+                pfd->fd = fds[j].fd;
+                pfd->events = fds[j].events | G_IO_HUP | G_IO_ERR;
+            }
+            else
+            {
+                pfd->fd = -1;
+            }
+            g_source_add_poll(impl->poll_source, pfd);
+        }
+    }
 }
 
-static gboolean alsa_restart(gpointer impl_gpointer)
+/* Make the first open mixer the active one. Returns TRUE if it changed. */
+static gboolean alsa_select_active(backend_alsa_t * impl)
 {
-    backend_alsa_t * impl = impl_gpointer;
+    alsa_mixer_t * active = NULL;
+    guint i;
+    for (i = 0; i < impl->num_mixers && !active; i++)
+    {
+        if (impl->mixers[i].mixer)
+            active = &impl->mixers[i];
+    }
 
-    if (!impl)
+    if (active == impl->active)
         return FALSE;
 
-    if (g_source_is_destroyed(g_main_current_source()))
-        return FALSE;
+    impl->active = active;
+    if (active && impl->num_mixers > 1)
+        g_message(MY_NAME ": controlling %s.", active->device);
+    return TRUE;
+}
 
-    alsa_deinitialize(impl);
+/******************************************************************************/
 
-    if (!alsa_initialize(impl)) {
-        g_warning(MY_NAME ": Re-initialization failed.");
-        return TRUE; // try again
+/* Try to open the mixers that are not open. Returns TRUE if all of them are open now. */
+static gboolean alsa_open_mixers(backend_alsa_t * impl)
+{
+    gboolean opened = FALSE;
+    gboolean all = TRUE;
+    guint i;
+    for (i = 0; i < impl->num_mixers; i++)
+    {
+        alsa_mixer_t * m = &impl->mixers[i];
+        if (m->mixer)
+            continue;
+        if (alsa_mixer_open(m))
+            opened = TRUE;
+        else
+            all = FALSE;
     }
 
-    g_warning(MY_NAME ": Restarted ALSA interface...");
+    if (opened)
+    {
+        alsa_update_poll_set(impl);
+        alsa_select_active(impl);
+        volume_control_backend_notify_state_changed(impl->backend);
+    }
 
-    impl->restart_idle = 0;
-    return FALSE;
+    return all;
 }
 
-/* Initialize the ALSA interface. */
-static gboolean alsa_initialize(backend_alsa_t * impl)
+/* Whether cards coming and going are reported by inotify. */
+static gboolean alsa_hotplug_watched(backend_alsa_t * impl)
 {
-    impl->valid = FALSE;
+    return impl->inotify_watch != 0 && impl->inotify_wd >= 0;
+}
 
-    /* Access the "default" device. */
-    if (snd_mixer_selem_id_malloc(&impl->sid) != 0)
+/* Whether a mixer is missing because its card has been removed: it is a hw:N or plughw:N device
+ * and the control node of card N is gone. Sound servers and other devices never show up in /dev/snd. */
+static gboolean alsa_mixer_card_removed(alsa_mixer_t * m)
+{
+    const char * p = m->device;
+    if (g_str_has_prefix(p, "hw:"))
+        p += 3;
+    else if (g_str_has_prefix(p, "plughw:"))
+        p += 7;
+    else
         return FALSE;
-    if (snd_mixer_open(&impl->mixer, 0) != 0)
+
+    char * end = NULL;
+    long card = strtol(p, &end, 10);
+    if (end == p || card < 0 || (*end != 0 && *end != ','))
         return FALSE;
-    if (snd_mixer_attach(impl->mixer, "default") != 0)
+
+    gchar * path = g_strdup_printf("/dev/snd/controlC%ld", card);
+    gboolean removed = !g_file_test(path, G_FILE_TEST_EXISTS);
+    g_free(path);
+    return removed;
+}
+
+/* Whether inotify will tell when every missing mixer can be opened again. */
+static gboolean alsa_recovery_by_hotplug(backend_alsa_t * impl)
+{
+    if (!alsa_hotplug_watched(impl))
         return FALSE;
-    if (snd_mixer_selem_register(impl->mixer, NULL, NULL) != 0)
+
+    guint i;
+    for (i = 0; i < impl->num_mixers; i++)
+    {
+        alsa_mixer_t * m = &impl->mixers[i];
+        if (!m->mixer && !alsa_mixer_card_removed(m))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean alsa_restart(gpointer impl_gpointer)
+{
+    backend_alsa_t * impl = impl_gpointer;
+
+    impl->restart_timer = 0;
+
+    if (alsa_open_mixers(impl))
+    {
+        impl->restart_delay = 0;
         return FALSE;
-    if (snd_mixer_load(impl->mixer) != 0)
+    }
+
+    /* Removed cards are reported by inotify when they come back, so stop polling for them.
+     * Anything else, such as a restarted sound server, is only noticed by trying again:
+     * back off instead of retrying every few seconds forever. */
+    if (alsa_recovery_by_hotplug(impl))
+    {
+        impl->restart_delay = 0;
         return FALSE;
+    }
 
-    /* Find Master element, or Front element, or PCM element, or LineOut element.
-     * If one of these succeeds, master_element is valid. */
-    if (!alsa_find_element(impl, "Master"))
-        if (!alsa_find_element(impl, "Front"))
-            if (!alsa_find_element(impl, "PCM"))
-                if (!alsa_find_element(impl, "LineOut"))
-                    return FALSE;
+    impl->restart_delay = impl->restart_delay ? MIN(impl->restart_delay * 2, RESTART_DELAY_MAX) : RESTART_DELAY_MIN;
+    alsa_schedule_restart(impl, impl->restart_delay * 1000);
+    return FALSE;
+}
 
-    /* Set the playback volume range as we wish it. */
-    snd_mixer_selem_set_playback_volume_range(impl->master_element, 0, 100);
+/* Schedule an attempt to open the missing mixers. A sooner attempt replaces a later one. */
+static void alsa_schedule_restart(backend_alsa_t * impl, guint delay)
+{
+    if (impl->restart_timer)
+    {
+        if (delay >= RESTART_DELAY_MIN * 1000)
+            return;
+        g_source_remove(impl->restart_timer);
+    }
+    impl->restart_timer = g_timeout_add(delay, alsa_restart, impl);
+}
 
-    /* Listen to events from ALSA. */
-    int n_fds = snd_mixer_poll_descriptors_count(impl->mixer);
-    struct pollfd * fds = g_new0(struct pollfd, n_fds);
+/******************************************************************************/
 
-    impl->channels = g_new0(GIOChannel *, n_fds);
-    impl->watches  = g_new0(guint, n_fds);
-    impl->num_channels = n_fds;
+#ifdef HAVE_SYS_INOTIFY_H
 
-    snd_mixer_poll_descriptors(impl->mixer, fds, n_fds);
-    int i;
-    for (i = 0; i < n_fds; ++i)
+static void alsa_inotify_add_watch(backend_alsa_t * impl)
+{
+    impl->inotify_wd = inotify_add_watch(impl->inotify_fd, "/dev/snd",
+        IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_TO | IN_DELETE_SELF);
+    impl->inotify_on_dev = FALSE;
+    if (impl->inotify_wd < 0 && errno == ENOENT)
     {
-        GIOChannel* channel = g_io_channel_unix_new(fds[i].fd);
-        impl->watches[i] = g_io_add_watch(channel, G_IO_IN | G_IO_HUP, (GIOFunc) alsa_mixer_event, impl);
-        impl->channels[i] = channel;
+        impl->inotify_wd = inotify_add_watch(impl->inotify_fd, "/dev", IN_CREATE | IN_MOVED_TO);
+        impl->inotify_on_dev = TRUE;
     }
-    g_free(fds);
-    impl->valid = TRUE;
-    volume_control_backend_notify_state_changed(impl->backend);
-    return TRUE;
 }
 
-static void alsa_deinitialize(backend_alsa_t * impl)
+static gboolean alsa_inotify_event(GIOChannel * channel, GIOCondition cond, backend_alsa_t * impl)
 {
-    if (!impl)
-        return;
+    if (cond & (G_IO_HUP | G_IO_ERR))
+    {
+        impl->inotify_watch = 0;
+        return FALSE;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(impl->inotify_fd, buffer, sizeof(buffer));
+    if (len <= 0)
+        return TRUE;
+
+    gboolean relevant = FALSE;
+    gboolean rewatch = FALSE;
+
+    char * p = buffer;
+    while (p < buffer + len)
+    {
+        struct inotify_event * event = (struct inotify_event *) p;
+        p += sizeof(struct inotify_event) + event->len;
+
+        if (impl->inotify_on_dev)
+        {
+            if (event->len && strcmp(event->name, "snd") == 0)
+                rewatch = relevant = TRUE;
+        }
+        else if (event->mask & (IN_DELETE_SELF | IN_IGNORED))
+        {
+            rewatch = TRUE;
+        }
+        else if (event->len && strncmp(event->name, "controlC", 8) == 0)
+        {
+            /* Every card has a control device; other nodes do not tell anything new. */
+            relevant = TRUE;
+        }
+    }
 
-    if (impl->mixer_evt_idle != 0) {
-        g_source_remove(impl->mixer_evt_idle);
-        impl->mixer_evt_idle = 0;
+    if (rewatch)
+    {
+        if (impl->inotify_wd >= 0)
+            inotify_rm_watch(impl->inotify_fd, impl->inotify_wd);
+        alsa_inotify_add_watch(impl);
+        /* Lost the watch: fall back to the restart timer. */
+        if (impl->inotify_wd < 0)
+            relevant = TRUE;
     }
 
-    guint i;
-    for (i = 0; i < impl->num_channels; i++) {
-        g_source_remove(impl->watches[i]);
-        g_io_channel_shutdown(impl->channels[i], FALSE, NULL);
-        g_io_channel_unref(impl->channels[i]);
+    /* A card has come or gone. If it is one we are missing, pick it up shortly.
+     * Removal of an open card is noticed by its mixer descriptors. */
+    if (relevant)
+    {
+        guint i;
+        for (i = 0; i < impl->num_mixers; i++)
+        {
+            if (!impl->mixers[i].mixer)
+            {
+                alsa_schedule_restart(impl, HOTPLUG_SETTLE_DELAY_MS);
+                break;
+            }
+        }
     }
-    g_free(impl->channels);
-    g_free(impl->watches);
-    impl->channels = NULL;
-    impl->watches = NULL;
-    impl->num_channels = 0;
 
-    snd_mixer_close(impl->mixer);
-    impl->master_element = NULL;
+    return TRUE;
+}
+
+static void alsa_inotify_start(backend_alsa_t * impl)
+{
+    impl->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (impl->inotify_fd < 0)
+        return;
+
+    alsa_inotify_add_watch(impl);
 
-    snd_mixer_selem_id_free(impl->sid);
+    GIOChannel * channel = g_io_channel_unix_new(impl->inotify_fd);
+    impl->inotify_watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, (GIOFunc) alsa_inotify_event, impl);
+    g_io_channel_unref(channel);
 }
 
+static void alsa_inotify_stop(backend_alsa_t * impl)
+{
+    if (impl->inotify_watch)
+        g_source_remove(impl->inotify_watch);
+    impl->inotify_watch = 0;
+    if (impl->inotify_fd >= 0)
+        close(impl->inotify_fd);
+    impl->inotify_fd = -1;
+}
+
+#else
+
+static void alsa_inotify_start(backend_alsa_t * impl)
+{
+}
+
+static void alsa_inotify_stop(backend_alsa_t * impl)
+{
+}
+
+#endif
+
+/******************************************************************************/
+
 /* Get the presence of the mute control from the sound system. */
 static gboolean alsa_has_mute(volume_control_backend_t * backend)
 {
@@ -245,7 +566,7 @@ static gboolean alsa_has_mute(volume_control_backend_t * backend)
 
     backend_alsa_t * impl = backend->impl;
 
-    return ((impl->master_element != NULL) ? snd_mixer_selem_has_playback_switch(impl->master_element) : FALSE);
+    return ((impl->active != NULL) ? snd_mixer_selem_has_playback_switch(impl->active->element) : FALSE);
 }
 
 /* Get the condition of the mute control from the sound system. */
@@ -259,8 +580,8 @@ static gboolean alsa_is_muted(volume_control_backend_t * backend)
     /* The switch is on if sound is not muted, and off if the sound is muted.
      * Initialize so that the sound appears unmuted if the control does not exist. */
     int value = 1;
-    if (impl->master_element != NULL)
-        snd_mixer_selem_get_playback_switch(impl->master_element, 0, &value);
+    if (impl->active != NULL)
+        snd_mixer_selem_get_playback_switch(impl->active->element, 0, &value);
     return (value == 0);
 }
 
@@ -275,10 +596,10 @@ static long alsa_get_volume(volume_control_backend_t * backend)
 
     long aleft = 0;
     long aright = 0;
-    if (impl->master_element != NULL)
+    if (impl->active != NULL)
     {
-        snd_mixer_selem_get_playback_volume(impl->master_element, SND_MIXER_SCHN_FRONT_LEFT, &aleft);
-        snd_mixer_selem_get_playback_volume(impl->master_element, SND_MIXER_SCHN_FRONT_RIGHT, &aright);
+        snd_mixer_selem_get_playback_volume(impl->active->element, SND_MIXER_SCHN_FRONT_LEFT, &aleft);
+        snd_mixer_selem_get_playback_volume(impl->active->element, SND_MIXER_SCHN_FRONT_RIGHT, &aright);
     }
     return (aleft + aright) >> 1;
 }
@@ -295,12 +616,8 @@ static void alsa_set_volume(volume_control_backend_t * backend, long volume)
     if (alsa_get_volume(backend) == volume)
         return;
 
-    if (impl->master_element != NULL)
-    {
-        /*snd_mixer_selem_set_playback_volume(impl->master_element, SND_MIXER_SCHN_FRONT_LEFT, volume);
-        snd_mixer_selem_set_playback_volume(impl->master_element, SND_MIXER_SCHN_FRONT_RIGHT, volume);*/
-        snd_mixer_selem_set_playback_volume_all(impl->master_element, volume);
-    }
+    if (impl->active != NULL)
+        snd_mixer_selem_set_playback_volume_all(impl->active->element, volume);
     volume_control_backend_notify_state_changed(backend);
 }
 
@@ -312,11 +629,11 @@ static void alsa_set_mute(volume_control_backend_t * backend, gboolean value)
     backend_alsa_t * impl = backend->impl;
 
     /* Reflect the mute toggle to the sound system. */
-    if (impl->master_element != NULL)
+    if (impl->active != NULL)
     {
         int chn;
         for (chn = 0; chn <= SND_MIXER_SCHN_LAST; chn++)
-            snd_mixer_selem_set_playback_switch(impl->master_element, chn, (value) ? 0 : 1);
+            snd_mixer_selem_set_playback_switch(impl->active->element, chn, (value) ? 0 : 1);
     }
     volume_control_backend_notify_state_changed(backend);
 }
@@ -327,7 +644,19 @@ static gboolean alsa_is_valid(volume_control_backend_t * backend)
         return FALSE;
 
     backend_alsa_t * impl = backend->impl;
-    return impl->valid;
+    return impl->active != NULL;
+}
+
+/* Name of the controlled device, if there is a choice of several. */
+static const char * alsa_get_device_name(volume_control_backend_t * backend)
+{
+    if (!backend || !backend->impl)
+        return NULL;
+
+    backend_alsa_t * impl = backend->impl;
+    if (impl->num_mixers < 2 || !impl->active)
+        return NULL;
+    return impl->active->device;
 }
 
 static void alsa_destroy(volume_control_backend_t * backend)
@@ -337,12 +666,28 @@ static void alsa_destroy(volume_control_backend_t * backend)
 
     backend_alsa_t * impl = backend->impl;
 
-    alsa_deinitialize(impl);
+    alsa_inotify_stop(impl);
+
+    if (impl->restart_timer != 0) {
+        g_source_remove(impl->restart_timer);
+        impl->restart_timer = 0;
+    }
+
+    if (impl->poll_source)
+    {
+        g_source_destroy(impl->poll_source);
+        g_source_unref(impl->poll_source);
+    }
+    g_free(impl->poll_fds);
 
-    if (impl->restart_idle != 0) {
-        g_source_remove(impl->restart_idle);
-        impl->restart_idle = 0;
+    guint i;
+    for (i = 0; i < impl->num_mixers; i++)
+    {
+        alsa_mixer_close(&impl->mixers[i]);
+        g_free(impl->mixers[i].device);
+        g_free(impl->mixers[i].element_name);
     }
+    g_free(impl->mixers);
 
     g_free(impl);
     backend->impl = NULL;
@@ -357,10 +702,13 @@ static volume_control_backend_impl_vtable_t alsa_vtable =
     .set_mute = alsa_set_mute,
     .get_volume = alsa_get_volume,
     .set_volume = alsa_set_volume,
+    .get_device_name = alsa_get_device_name,
     .destroy = alsa_destroy
 };
 
-void volume_control_backend_alsa_new(volume_control_backend_t * backend)
+/* devices is a list of mixer devices in order of preference, separated by commas.
+ * Each may name an element after a slash, as in "hw:1/Line Out". Empty means "default". */
+void volume_control_backend_alsa_new(volume_control_backend_t * backend, const char * devices)
 {
     if (!backend)
         return;
@@ -369,5 +717,39 @@ void volume_control_backend_alsa_new(volume_control_backend_t * backend)
     backend_alsa_t * impl = g_new0(backend_alsa_t, 1);
     backend->impl = impl;
     impl->backend = backend;
-    alsa_initialize(impl);
+    impl->inotify_fd = -1;
+    impl->inotify_wd = -1;
+
+    /* Element names may contain spaces, so only commas separate entries. */
+    gchar ** names = g_strsplit(devices ? devices : "", ",", -1);
+    guint n = g_strv_length(names);
+    impl->mixers = g_new0(alsa_mixer_t, MAX(n, 1));
+
+    guint i;
+    for (i = 0; i < n; i++)
+    {
+        gchar * name = g_strstrip(names[i]);
+        if (name[0] == 0)
+            continue;
+        alsa_mixer_t * m = &impl->mixers[impl->num_mixers++];
+        gchar * slash = strrchr(name, '/');
+        if (slash)
+        {
+            *slash = 0;
+            g_strstrip(name);
+            g_strstrip(slash + 1);
+            if (slash[1])
+                m->element_name = g_strdup(slash + 1);
+        }
+        m->device = g_strdup(name[0] ? name : "default");
+    }
+    g_strfreev(names);
+
+    if (impl->num_mixers == 0)
+        impl->mixers[impl->num_mixers++].device = g_strdup("default");
+
+    alsa_inotify_start(impl);
+
+    if (!alsa_open_mixers(impl))
+        alsa_schedule_restart(impl, RESTART_DELAY_MIN * 1000);
 }
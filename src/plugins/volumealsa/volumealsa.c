@@ -37,6 +37,8 @@
 #include <waterline/gtkcompat.h>
 #include <waterline/misc.h>
 #include <waterline/launch.h>
+#include <waterline/icon_cache.h>
+#include <waterline/pixbuf_ops.h>
 #include <waterline/paths.h>
 #include <waterline/plugin.h>
 
@@ -56,7 +58,7 @@ typedef struct {
     guint volume_scale_handler;     /* Handler for vscale widget */
     guint mute_check_handler;       /* Handler for mute_check widget */
 
-    guint theme_changed_handler_id;
+    guint icon_theme_watch;
 
     GdkPixbuf * pixbuf_mute;
     GdkPixbuf * pixbuf_level_0;
@@ -80,9 +82,11 @@ typedef struct {
     /* Settings. */
     gchar * volume_control_command;
     gboolean alpha_blending_enabled;
+    gchar * mixer_devices;
 
     /* Backend. */
     volume_control_backend_t * backend;
+    gchar * backend_mixer_devices;  /* mixer_devices the backend was started with */
 } VolumeALSAPlugin;
 
 static void volumealsa_update_display(VolumeALSAPlugin * vol, gboolean force);
@@ -104,6 +108,7 @@ static void volumealsa_panel_configuration_changed(Plugin * p);
 static su_json_option_definition option_definitions[] = {
     SU_JSON_OPTION(string, volume_control_command),
     SU_JSON_OPTION(bool, alpha_blending_enabled),
+    SU_JSON_OPTION(string, mixer_devices),
     {0,}
 };
 
@@ -149,66 +154,6 @@ static const char * volumealsa_get_volume_control_command(VolumeALSAPlugin * vol
         return vol->volume_control_command;
 }
 
-static GdkPixbuf * pixbuf_blend(GdkPixbuf * pixbuf_src1, GdkPixbuf * pixbuf_src2, float level)
-{
-    if (gdk_pixbuf_get_colorspace(pixbuf_src1) != GDK_COLORSPACE_RGB)
-        return NULL;
-    if (gdk_pixbuf_get_bits_per_sample(pixbuf_src1) != 8)
-        return NULL;
-
-    if (gdk_pixbuf_get_colorspace(pixbuf_src2) != GDK_COLORSPACE_RGB)
-        return NULL;
-    if (gdk_pixbuf_get_bits_per_sample(pixbuf_src2) != 8)
-        return NULL;
-
-    int src1_n_channels = gdk_pixbuf_get_n_channels(pixbuf_src1);
-    gboolean src1_has_alpha = gdk_pixbuf_get_has_alpha(pixbuf_src1);
-    int src2_n_channels = gdk_pixbuf_get_n_channels(pixbuf_src2);
-    gboolean src2_has_alpha = gdk_pixbuf_get_has_alpha(pixbuf_src2);
-
-    int w = MIN(gdk_pixbuf_get_width(pixbuf_src1), gdk_pixbuf_get_width(pixbuf_src2));
-    int h = MIN(gdk_pixbuf_get_height(pixbuf_src1), gdk_pixbuf_get_height(pixbuf_src2));
-
-    GdkPixbuf * pixbuf_dst = gdk_pixbuf_new(
-        GDK_COLORSPACE_RGB,
-        src1_has_alpha || src2_has_alpha,
-        8,
-        w, h);
-
-    if (!pixbuf_dst)
-        return NULL;
-
-    int dst_n_channels = gdk_pixbuf_get_n_channels(pixbuf_dst);
-
-    guchar * dst = gdk_pixbuf_get_pixels(pixbuf_dst);
-    guchar * src1 = gdk_pixbuf_get_pixels(pixbuf_src1);
-    guchar * src2 = gdk_pixbuf_get_pixels(pixbuf_src2);
-
-    int dst_stride = gdk_pixbuf_get_rowstride(pixbuf_dst);
-    int src1_stride = gdk_pixbuf_get_rowstride(pixbuf_src1);
-    int src2_stride = gdk_pixbuf_get_rowstride(pixbuf_src2);
-
-    int i;
-    for (i = 0; i < h; i += 1)
-    {
-        int j;
-        for (j = 0; j < w; j += 1)
-        {
-            guchar * s1 = src1 + i * src1_stride + j * 4;
-            guchar * s2 = src2 + i * src2_stride + j * 4;
-            guchar * d = dst + i * dst_stride + j * 4;
-            int n;
-            for (n = 0; n < dst_n_channels; n++) {
-                guchar v1 = (n < src1_n_channels) ? s1[n] : 0xFF;
-                guchar v2 = (n < src2_n_channels) ? s2[n] : 0xFF;
-                d[n] = v1 * (1 - level) + v2 * (level);
-            }
-        }
-    }
-
-    return pixbuf_dst;
-}
-
 static void load_icon(GdkPixbuf ** p_pixbuf, int icon_size, ...)
 {
     if (*p_pixbuf) {
@@ -222,7 +167,7 @@ static void load_icon(GdkPixbuf ** p_pixbuf, int icon_size, ...)
         const char * name = va_arg(ap, const char *);
         if (!name)
             break;
-        *p_pixbuf = wtl_load_icon(name, icon_size, icon_size, FALSE);
+        *p_pixbuf = wtl_icon_cache_load(name, icon_size, FALSE);
     }
     va_end(ap);
 }
@@ -271,13 +216,13 @@ static void volumealsa_load_icons(VolumeALSAPlugin * vol)
 
     if (!vol->pixbuf_mute) {
         gchar * icon_path = wtl_resolve_own_resource("", "images", "mute.png", 0);
-        vol->pixbuf_mute = wtl_load_icon(icon_path, icon_size, icon_size, TRUE);
+        vol->pixbuf_mute = wtl_icon_cache_load(icon_path, icon_size, TRUE);
         g_free(icon_path);
     }
 
     if (!vol->pixbuf_level_0 || !vol->pixbuf_level_33 || !vol->pixbuf_level_66 || !vol->pixbuf_level_100) {
         gchar * icon_path = wtl_resolve_own_resource("", "images", "volume.png", 0);
-        GdkPixbuf * pixbuf = wtl_load_icon(icon_path, icon_size, icon_size, TRUE);
+        GdkPixbuf * pixbuf = wtl_icon_cache_load(icon_path, icon_size, TRUE);
         if (!vol->pixbuf_level_0)
             vol->pixbuf_level_0 = g_object_ref(pixbuf);
         if (!vol->pixbuf_level_33)
@@ -350,7 +295,7 @@ static GdkPixbuf * volumealsa_get_icon_for_level(VolumeALSAPlugin * vol, int lev
     if (l > 1.0)
         l = 1.0;
 
-    GdkPixbuf * result = pixbuf_blend(pixbuf_level_low, pixbuf_level_high, l);
+    GdkPixbuf * result = wtl_pixbuf_blend(pixbuf_level_low, pixbuf_level_high, l);
     if (!result)
         result = g_object_ref(pixbuf_level_high);
 
@@ -372,7 +317,7 @@ static void volumealsa_update_icon(VolumeALSAPlugin * vol)
     }
 }
 
-static void on_theme_changed(GtkIconTheme * theme, VolumeALSAPlugin * vol)
+static void on_theme_changed(VolumeALSAPlugin * vol)
 {
     volumealsa_load_icons(vol);
     volumealsa_update_display(vol, TRUE);
@@ -423,6 +368,18 @@ static void volumealsa_update_display(VolumeALSAPlugin * vol, gboolean force)
         tooltip = g_strdup_printf(_("Volume <b>%ld%%</b> (muted)"), vol->displayed_scaled_volume);
     else
         tooltip = g_strdup_printf(_("Volume <b>%ld%%</b>"), vol->displayed_scaled_volume);
+
+    /* With several mixer devices configured, tell which one is in control. */
+    const char * device_name = vol->displayed_valid ? volume_control_backend_get_device_name(vol->backend) : NULL;
+    if (device_name)
+    {
+        gchar * escaped = g_markup_escape_text(device_name, -1);
+        gchar * t = g_strdup_printf("%s\n%s", tooltip, escaped);
+        g_free(escaped);
+        g_free(tooltip);
+        tooltip = t;
+    }
+
     gtk_widget_set_tooltip_markup(plugin_widget(vol->plugin), tooltip);
     g_free(tooltip);
 }
@@ -573,6 +530,17 @@ static void volumealsa_build_popup_window(VolumeALSAPlugin * vol)
     volumealsa_update_display(vol, TRUE);
 }
 
+static void volumealsa_start_backend(VolumeALSAPlugin * vol)
+{
+    extern void volume_control_backend_alsa_new(volume_control_backend_t * backend, const char * devices);
+    vol->backend = volume_control_backend_new();
+    vol->backend->frontend = vol;
+    vol->backend->frontend_callback_state_changed = (frontend_callback_state_changed_t) volumealsa_state_changed;
+    g_free(vol->backend_mixer_devices);
+    vol->backend_mixer_devices = g_strdup(vol->mixer_devices);
+    volume_control_backend_alsa_new(vol->backend, vol->backend_mixer_devices);
+}
+
 /* Plugin constructor. */
 static int volumealsa_constructor(Plugin * p)
 {
@@ -600,16 +568,11 @@ static int volumealsa_constructor(Plugin * p)
     /* Connect signals. */
     g_signal_connect(G_OBJECT(pwid), "button-press-event", G_CALLBACK(volumealsa_button_press_event), vol);
     g_signal_connect(G_OBJECT(pwid), "scroll-event", G_CALLBACK(volumealsa_popup_scale_scrolled), vol);
-    vol->theme_changed_handler_id =
-        g_signal_connect(gtk_icon_theme_get_default(), "changed", G_CALLBACK(on_theme_changed), vol);
+    vol->icon_theme_watch = wtl_icon_theme_add_watch(pwid, (WtlIconThemeChangedFunc) on_theme_changed, vol);
 
     volumealsa_load_icons(vol);
 
-    extern void volume_control_backend_alsa_new(volume_control_backend_t * backend);
-    vol->backend = volume_control_backend_new();
-    vol->backend->frontend = vol;
-    vol->backend->frontend_callback_state_changed = (frontend_callback_state_changed_t) volumealsa_state_changed;
-    volume_control_backend_alsa_new(vol->backend);
+    volumealsa_start_backend(vol);
 
     volumealsa_update_display(vol, TRUE);
     gtk_widget_show_all(pwid);
@@ -621,7 +584,7 @@ static void volumealsa_destructor(Plugin * p)
 {
     VolumeALSAPlugin * vol = PRIV(p);
 
-    g_signal_handler_disconnect(gtk_icon_theme_get_default(), vol->theme_changed_handler_id);
+    wtl_icon_theme_remove_watch(vol->icon_theme_watch);
 
     volume_control_backend_free(vol->backend);
     vol->backend = NULL;
@@ -633,6 +596,8 @@ static void volumealsa_destructor(Plugin * p)
     }
 
     g_free(vol->volume_control_command);
+    g_free(vol->mixer_devices);
+    g_free(vol->backend_mixer_devices);
 
     /* Deallocate all memory. */
     g_free(vol);
@@ -641,6 +606,15 @@ static void volumealsa_destructor(Plugin * p)
 /* Callback when the configuration dialog has recorded a configuration change. */
 static void volumealsa_apply_configuration(Plugin * p)
 {
+    VolumeALSAPlugin * vol = PRIV(p);
+
+    if (g_strcmp0(vol->mixer_devices, vol->backend_mixer_devices) != 0)
+    {
+        volume_control_backend_free(vol->backend);
+        volumealsa_start_backend(vol);
+        volumealsa_state_changed(vol, vol->backend);
+    }
+
     volumealsa_panel_configuration_changed(p);
 }
 
@@ -666,6 +640,9 @@ static void volumealsa_configure(Plugin * p, GtkWindow * parent)
         _("Alpha-blending"), &vol->alpha_blending_enabled, (GType)CONF_TYPE_BOOL,
         "tooltip-text", _("An icon theme typically includes only 3 or 4 distinct icons intended to indicate the sound volume. This option enables alpha-blending mode that allows Volume Control Plugin to smoothly display the full range of the sound volume. May not interact well with some icon themes."), (GType)CONF_TYPE_SET_PROPERTY,
 
+        _("Mixer devices"), &vol->mixer_devices, (GType)CONF_TYPE_STR,
+        "tooltip-text", _("ALSA mixer devices to control, in order of preference, separated by commas. The first one present is used, so a USB or docking station card can take over while it is plugged in. A device may be followed by an element name, as in \"hw:1/Speaker\". \"default\" if empty."), (GType)CONF_TYPE_SET_PROPERTY,
+
         NULL);
 
     g_free(tooltip);
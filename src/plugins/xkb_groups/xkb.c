@@ -233,6 +233,7 @@ static GdkFilterReturn xkb_groups_event_filter(GdkXEvent * xevent, GdkEvent * ev
         if (xkbev->any.xkb_type == XkbNewKeyboardNotify)
         {
             initialize_keyboard_description(xkb);
+            xkb_groups_flag_cache_invalidate(xkb);
             refresh_group_xkb(xkb);
             xkb_groups_update(xkb);
             xkb_groups_enter_locale_by_process(xkb);
@@ -267,7 +268,7 @@ void xkb_groups_mechanism_constructor(xkb_groups_t * xkb)
         initialize_keyboard_description(xkb);
 
         /* Establish GDK event filter. */
-        gdk_window_add_filter(NULL, (GdkFilterFunc) xkb_groups_event_filter, (gpointer) xkb);
+        plugin_add_event_filter(xkb->plugin, (GdkFilterFunc) xkb_groups_event_filter, (gpointer) xkb);
 
         /* Specify events we will receive. */
         XkbSelectEvents(wtl_x11_display(), XkbUseCoreKbd, XkbNewKeyboardNotifyMask, XkbNewKeyboardNotifyMask);
@@ -282,7 +283,7 @@ void xkb_groups_mechanism_constructor(xkb_groups_t * xkb)
 void xkb_groups_mechanism_destructor(xkb_groups_t * xkb) 
 {
     /* Remove event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) xkb_groups_event_filter, xkb);
+    plugin_remove_event_filter(xkb->plugin, (GdkFilterFunc) xkb_groups_event_filter, xkb);
 
     /* Free group and symbol name memory. */
     int i;
@@ -44,6 +44,11 @@ typedef struct {
     guint source_id;                /* Source ID for channel listening to XKB events */
     GtkWidget * config_dlg;         /* Configuration dialog */
     GtkWidget * per_app_default_layout_menu; /* Combo box of all available layouts */
+    GHashTable * flag_cache;        /* Pre-scaled flag images by symbol name; NULL value if there is no flag */
+    int flag_cache_icon_size;       /* Icon size the cached flags are scaled to */
+    gchar * displayed_tooltip;      /* Copy of the group name currently set as tooltip */
+    gboolean displayed_tooltip_valid; /* FALSE if the tooltip has to be set again */
+    guint icon_theme_watch;         /* Icon theme change notification */
 
     /* Mechanism. */
     int base_event_code;            /* Result of initializing Xkb extension */
@@ -57,6 +62,7 @@ typedef struct {
 } xkb_groups_t;
 
 extern SYMBOL_HIDDEN void xkb_groups_update(xkb_groups_t * xkb);
+extern SYMBOL_HIDDEN void xkb_groups_flag_cache_invalidate(xkb_groups_t * xkb);
 
 extern SYMBOL_HIDDEN int xkb_groups_get_current_group_xkb_no(xkb_groups_t * xkb);
 extern SYMBOL_HIDDEN int xkb_groups_get_group_count(xkb_groups_t * xkb);
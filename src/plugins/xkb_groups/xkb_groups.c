@@ -30,6 +30,8 @@
 #include <ctype.h>
 #include <sde-utils-jansson.h>
 
+#include <waterline/icon_cache.h>
+
 #include "xkb.h"
 
 /******************************************************************************/
@@ -58,6 +60,79 @@ static void xkb_groups_configure(Plugin * p, GtkWindow * parent);
 static void xkb_groups_save_configuration(Plugin * p);
 static void xkb_groups_panel_configuration_changed(Plugin * p);
 
+/******************************************************************************/
+
+static void xkb_groups_flag_free(gpointer pixbuf)
+{
+    if (pixbuf)
+        g_object_unref(G_OBJECT(pixbuf));
+}
+
+/* Drop all cached flag images, e.g. after the icon size or the keyboard description changed. */
+void xkb_groups_flag_cache_invalidate(xkb_groups_t * xkb_groups)
+{
+    if (xkb_groups->flag_cache != NULL)
+    {
+        g_hash_table_destroy(xkb_groups->flag_cache);
+        xkb_groups->flag_cache = NULL;
+    }
+    g_free(xkb_groups->displayed_tooltip);
+    xkb_groups->displayed_tooltip = NULL;
+    xkb_groups->displayed_tooltip_valid = FALSE;
+}
+
+/* Get the flag image for a symbol name scaled to the given size.
+ * Images are decoded and scaled once; missing flags are remembered as well. */
+static GdkPixbuf * xkb_groups_get_flag(xkb_groups_t * xkb_groups, const char * symbol_name, int size)
+{
+    if (xkb_groups->flag_cache != NULL && xkb_groups->flag_cache_icon_size != size)
+        xkb_groups_flag_cache_invalidate(xkb_groups);
+
+    if (xkb_groups->flag_cache == NULL)
+    {
+        xkb_groups->flag_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, xkb_groups_flag_free);
+        xkb_groups->flag_cache_icon_size = size;
+    }
+
+    gpointer pixbuf = NULL;
+    if (g_hash_table_lookup_extended(xkb_groups->flag_cache, symbol_name, NULL, &pixbuf))
+        return (GdkPixbuf *) pixbuf;
+
+    gchar * group_name = g_utf8_strdown(symbol_name, -1);
+    gchar * pngname = g_strdup_printf("%s.png", group_name);
+    gchar * filename = wtl_resolve_own_resource("", "images", "xkb-flags", pngname, 0);
+    GdkPixbuf * unscaled_pixbuf = gdk_pixbuf_new_from_file(filename, NULL);
+    g_free(filename);
+    g_free(pngname);
+    g_free(group_name);
+
+    if (unscaled_pixbuf != NULL)
+    {
+        /* Loaded successfully. */
+        int width = gdk_pixbuf_get_width(unscaled_pixbuf);
+        int height = gdk_pixbuf_get_height(unscaled_pixbuf);
+        //pixbuf = gdk_pixbuf_scale_simple(unscaled_pixbuf, size * width / height, size, GDK_INTERP_BILINEAR);
+        pixbuf = gdk_pixbuf_scale_simple(unscaled_pixbuf, size, size * height / width, GDK_INTERP_BILINEAR);
+        g_object_unref(unscaled_pixbuf);
+    }
+
+    g_hash_table_insert(xkb_groups->flag_cache, g_strdup(symbol_name), pixbuf);
+    return (GdkPixbuf *) pixbuf;
+}
+
+static void xkb_groups_set_tooltip(xkb_groups_t * xkb_groups)
+{
+    const char * tooltip = xkb_groups_get_current_group_name(xkb_groups);
+    /* Group names are rebuilt when the keyboard description changes, so compare the text, not the pointer. */
+    if (!xkb_groups->displayed_tooltip_valid || g_strcmp0(tooltip, xkb_groups->displayed_tooltip) != 0)
+    {
+        g_free(xkb_groups->displayed_tooltip);
+        xkb_groups->displayed_tooltip = g_strdup(tooltip);
+        xkb_groups->displayed_tooltip_valid = TRUE;
+        gtk_widget_set_tooltip_text(xkb_groups->btn, tooltip);
+    }
+}
+
 /* Redraw the graphics. */
 void xkb_groups_update(xkb_groups_t * xkb_groups) 
 {
@@ -66,35 +141,21 @@ void xkb_groups_update(xkb_groups_t * xkb_groups)
     if (!xkb_groups->display_as_text)
     {
         int size = plugin_get_icon_size(xkb_groups->plugin);
-        char * group_name = (char *) xkb_groups_get_current_symbol_name_lowercase(xkb_groups);
-        if (group_name != NULL)
+        const char * symbol_name = xkb_groups_get_current_symbol_name(xkb_groups);
+        GdkPixbuf * pixbuf = (symbol_name != NULL) ? xkb_groups_get_flag(xkb_groups, symbol_name, size) : NULL;
+        if (pixbuf != NULL)
         {
-            gchar * pngname = g_strdup_printf("%s.png", group_name);
-            gchar * filename = wtl_resolve_own_resource("", "images", "xkb-flags", pngname, 0);
-            GdkPixbuf * unscaled_pixbuf = gdk_pixbuf_new_from_file(filename, NULL);
-            g_free(filename);
-            g_free(pngname);
-            g_free(group_name);
-
-            if (unscaled_pixbuf != NULL)
+            /* Switching between already cached flags does not reload anything. */
+            if (gtk_image_get_storage_type(GTK_IMAGE(xkb_groups->image)) != GTK_IMAGE_PIXBUF
+            || gtk_image_get_pixbuf(GTK_IMAGE(xkb_groups->image)) != pixbuf)
             {
-                /* Loaded successfully. */
-                int width = gdk_pixbuf_get_width(unscaled_pixbuf);
-                int height = gdk_pixbuf_get_height(unscaled_pixbuf);
-                //GdkPixbuf * pixbuf = gdk_pixbuf_scale_simple(unscaled_pixbuf, size * width / height, size, GDK_INTERP_BILINEAR);
-                GdkPixbuf * pixbuf = gdk_pixbuf_scale_simple(unscaled_pixbuf, size, size * height / width, GDK_INTERP_BILINEAR);
-                if (pixbuf != NULL)
-                {
-                    gtk_image_set_from_pixbuf(GTK_IMAGE(xkb_groups->image), pixbuf);
-                    g_object_unref(G_OBJECT(pixbuf));
-                    gtk_widget_hide(xkb_groups->label);
-                    gtk_widget_show(xkb_groups->image);
-                    gtk_widget_set_tooltip_text(xkb_groups->btn, xkb_groups_get_current_group_name(xkb_groups));
-                    gtk_widget_queue_draw(plugin_widget(xkb_groups->plugin));
-                    valid_image = TRUE;
-                }
-                g_object_unref(unscaled_pixbuf);
+                gtk_image_set_from_pixbuf(GTK_IMAGE(xkb_groups->image), pixbuf);
+                gtk_widget_queue_draw(plugin_widget(xkb_groups->plugin));
             }
+            gtk_widget_hide(xkb_groups->label);
+            gtk_widget_show(xkb_groups->image);
+            xkb_groups_set_tooltip(xkb_groups);
+            valid_image = TRUE;
         }
     }
 
@@ -107,11 +168,18 @@ void xkb_groups_update(xkb_groups_t * xkb_groups)
             panel_draw_label_text(plugin_panel(xkb_groups->plugin), xkb_groups->label, (char *) group_name, STYLE_BOLD | STYLE_CUSTOM_COLOR);
             gtk_widget_hide(xkb_groups->image);
             gtk_widget_show(xkb_groups->label);
-            gtk_widget_set_tooltip_text(xkb_groups->btn, xkb_groups_get_current_group_name(xkb_groups));
+            xkb_groups_set_tooltip(xkb_groups);
         }
     }
 }
 
+/* Called back when the icon theme changes. */
+static void xkb_groups_icon_theme_changed(xkb_groups_t * xkb_groups)
+{
+    xkb_groups_flag_cache_invalidate(xkb_groups);
+    xkb_groups_update(xkb_groups);
+}
+
 /* Handler for "active_window" event on root window listener. */
 static void xkb_groups_active_window_event(FbEv * ev, gpointer data) 
 {
@@ -206,7 +274,8 @@ static int xkb_groups_constructor(Plugin * plugin)
     g_signal_connect(xkb_groups->btn, "button-press-event", G_CALLBACK(xkb_groups_button_press_event), xkb_groups);
     g_signal_connect(xkb_groups->btn, "scroll-event", G_CALLBACK(xkb_groups_scroll_event), xkb_groups);
     g_signal_connect_after(G_OBJECT(xkb_groups->btn), "enter", G_CALLBACK(xkb_groups_button_enter), (gpointer) xkb_groups);
-    g_signal_connect(G_OBJECT(fbev), "active_window", G_CALLBACK(xkb_groups_active_window_event), xkb_groups);
+    plugin_signal_connect(xkb_groups->plugin, G_OBJECT(fbev), "active_window", G_CALLBACK(xkb_groups_active_window_event), xkb_groups);
+    xkb_groups->icon_theme_watch = wtl_icon_theme_add_watch(pwid, (WtlIconThemeChangedFunc) xkb_groups_icon_theme_changed, xkb_groups);
 
     /* Show the widget and return. */
     xkb_groups_update(xkb_groups);
@@ -221,6 +290,7 @@ static void xkb_groups_destructor(Plugin * plugin)
 
     /* Disconnect root window event handler. */
     g_signal_handlers_disconnect_by_func(G_OBJECT(fbev), xkb_groups_active_window_event, xkb_groups);
+    wtl_icon_theme_remove_watch(xkb_groups->icon_theme_watch);
 
     /* Disconnect from the XKB mechanism. */
     g_source_remove(xkb_groups->source_id);
@@ -231,6 +301,7 @@ static void xkb_groups_destructor(Plugin * plugin)
         gtk_widget_destroy(xkb_groups->config_dlg);
 
     /* Deallocate all memory. */
+    xkb_groups_flag_cache_invalidate(xkb_groups);
     g_free(xkb_groups);
 }
 
@@ -393,6 +464,7 @@ static void xkb_groups_panel_configuration_changed(Plugin * p)
 {
     /* Do a full redraw. */
     xkb_groups_t * xkb_groups = PRIV(p);
+    xkb_groups_flag_cache_invalidate(xkb_groups);
     xkb_groups_update(xkb_groups);
 }
 
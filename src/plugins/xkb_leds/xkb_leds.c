@@ -169,7 +169,7 @@ static int xkb_leds_constructor(Plugin * p)
     }
 
     /* Add GDK event filter and enable XkbIndicatorStateNotify events. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) xkb_leds_event_filter, p);
+    plugin_add_event_filter(p, (GdkFilterFunc) xkb_leds_event_filter, p);
     if ( ! XkbSelectEvents(wtl_x11_display(), XkbUseCoreKbd, XkbIndicatorStateNotifyMask, XkbIndicatorStateNotifyMask))
         return 0;
 
@@ -191,7 +191,7 @@ static void xkb_leds_destructor(Plugin * p)
     xkb_leds_t * kl = PRIV(p);
 
     /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) xkb_leds_event_filter, p);
+    plugin_remove_event_filter(p, (GdkFilterFunc) xkb_leds_event_filter, p);
     icon_grid_free(kl->icon_grid);
     g_free(kl);
 }
@@ -249,7 +249,7 @@ static int xkb_locks_constructor(Plugin * p)
     xkb_locks_init_masks(xkb_locks);
 
     /* Add GDK event filter and enable XkbIndicatorStateNotify events. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) xkb_locks_event_filter, p);
+    plugin_add_event_filter(p, (GdkFilterFunc) xkb_locks_event_filter, p);
     if (!XkbSelectEvents(wtl_x11_display(), XkbUseCoreKbd, XkbStateNotifyMask, XkbStateNotifyMask))
         return 0;
 
@@ -266,7 +266,7 @@ static void xkb_locks_destructor(Plugin * p)
     xkb_locks_t * xkb_locks = PRIV(p);
 
     /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) xkb_locks_event_filter, p);
+    plugin_remove_event_filter(p, (GdkFilterFunc) xkb_locks_event_filter, p);
     icon_grid_free(xkb_locks->icon_grid);
     g_free(xkb_locks);
 }
@@ -0,0 +1,771 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifdef __FreeBSD__
+#include <termios.h>
+#include <libutil.h>
+#else
+#include <pty.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#if HAVE_DECL_SYS_PIDFD_OPEN
+#include <sys/syscall.h>
+#define USE_PIDFD
+#endif
+#endif
+
+#include <glib.h>
+#include <sde-utils.h>
+
+#include <waterline/line_buffer.h>
+#include <waterline/supervisor.h>
+
+/********************************************************************/
+
+#define READ_SIZE 4096
+#define MAX_LINE_LENGTH (64 * 1024)
+
+#define CRASH_LOOP_FAILURES 5             /* Consecutive failures after which a command is reported as throttled */
+#define MAX_RESTART_DELAY (5 * 60 * 1000) /* Upper bound of the backoff, in milliseconds */
+#define FAILURE_RESTART_DELAY 1000        /* Minimal delay before restarting a failed command, in milliseconds */
+#define STOP_GRACE_TIMEOUT 2000           /* Delay between SIGTERM and SIGKILL when stopping a command, in milliseconds */
+
+typedef enum {
+    WATCH_OUTPUT,
+    WATCH_PID
+} WatchKind;
+
+typedef struct {
+    WtlProcess * process;
+    WatchKind kind;
+} Watch;
+
+struct _WtlProcess {
+    int ref_count;
+    gboolean freed;                 /* wtl_process_free() has been called; only callbacks in progress hold references */
+
+    gchar * command;
+    WtlProcessFlags flags;
+    WtlProcessLineFunc line_func;
+    WtlProcessExitFunc exit_func;
+    gpointer user_data;
+
+    int restart_interval;
+    int lines_per_iteration;
+
+    pid_t pid;
+    gint64 start_time;
+    gboolean exited;
+    int exit_status;
+
+    int output_fd;
+    gboolean output_epoll;          /* output_fd is in the epoll set rather than watched by output_source */
+    gboolean output_paused;
+    WtlLineBuffer * output;
+    Watch output_watch;
+
+    int pid_fd;
+    Watch pid_watch;
+
+    guint output_source;            /* Fallback when epoll is not available */
+    guint child_watch_source;       /* Fallback when pidfd is not available */
+    guint backlog_source;
+    guint restart_source;
+
+    guint64 finished_cpu_time;
+    gsize max_rss;
+    guint runs;
+    guint failures;
+};
+
+/* A stopped child that is being terminated in the background. */
+typedef struct {
+    pid_t pid;
+    guint child_watch_source;
+    guint kill_source;
+} StoppingChild;
+
+static GList * all_processes = NULL;
+
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_fd = -1;
+static guint epoll_source = 0;
+#endif
+
+static void wtl_process_output_resume(WtlProcess * process);
+static void wtl_process_check_finished(WtlProcess * process);
+
+/********************************************************************/
+
+static void wtl_process_ref(WtlProcess * process)
+{
+    process->ref_count++;
+}
+
+static void wtl_process_unref(WtlProcess * process)
+{
+    if (--process->ref_count > 0)
+        return;
+
+    all_processes = g_list_remove(all_processes, process);
+    wtl_line_buffer_free(process->output);
+    g_free(process->command);
+    g_free(process);
+}
+
+/********************************************************************/
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static void wtl_process_dispatch(Watch * watch);
+
+static gboolean wtl_process_on_epoll(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    struct epoll_event events[32];
+    int n = epoll_wait(epoll_fd, events, G_N_ELEMENTS(events), 0);
+    if (n <= 0)
+        return TRUE;
+
+    /* A callback may free any process, so keep all of them alive until the batch is done. */
+    int i;
+    for (i = 0; i < n; i++)
+        wtl_process_ref(((Watch *) events[i].data.ptr)->process);
+
+    for (i = 0; i < n; i++)
+    {
+        Watch * watch = (Watch *) events[i].data.ptr;
+        if (!watch->process->freed)
+            wtl_process_dispatch(watch);
+    }
+
+    for (i = 0; i < n; i++)
+        wtl_process_unref(((Watch *) events[i].data.ptr)->process);
+
+    return TRUE;
+}
+
+static gboolean wtl_process_epoll_add(int fd, Watch * watch)
+{
+    if (epoll_fd < 0)
+    {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0)
+            return FALSE;
+
+        GIOChannel * channel = g_io_channel_unix_new(epoll_fd);
+        epoll_source = g_io_add_watch(channel, G_IO_IN, wtl_process_on_epoll, NULL);
+        g_io_channel_unref(channel);
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = watch;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+static void wtl_process_epoll_remove(int fd)
+{
+    if (epoll_fd >= 0)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+#endif
+
+/********************************************************************/
+
+/* Pass the received lines to the owner. Returns TRUE if lines are left for the next main loop iteration. */
+static gboolean wtl_process_handle_lines(WtlProcess * process)
+{
+    gboolean flush = process->output_fd < 0;
+    int handled = 0;
+    gboolean backlog = FALSE;
+
+    wtl_process_ref(process);
+
+    gchar * line;
+    while (!process->freed && (line = wtl_line_buffer_next_line(process->output, flush)) != NULL)
+    {
+        if (process->line_func)
+            process->line_func(process, line, process->user_data);
+        handled++;
+        if (process->lines_per_iteration > 0 && handled >= process->lines_per_iteration)
+        {
+            backlog = flush || wtl_line_buffer_has_line(process->output);
+            break;
+        }
+    }
+
+    backlog = backlog && !process->freed;
+    wtl_process_unref(process);
+    return backlog;
+}
+
+static gboolean wtl_process_on_backlog(gpointer data)
+{
+    WtlProcess * process = (WtlProcess *) data;
+
+    wtl_process_ref(process);
+
+    /* If the process is freed from a callback, the source has been removed already. */
+    gboolean backlog = wtl_process_handle_lines(process);
+    if (!backlog && !process->freed)
+    {
+        process->backlog_source = 0;
+        wtl_process_output_resume(process);
+        wtl_process_check_finished(process);
+    }
+
+    wtl_process_unref(process);
+    return backlog;
+}
+
+static void wtl_process_output_close(WtlProcess * process)
+{
+    if (process->output_fd < 0)
+        return;
+
+    if (process->output_source)
+    {
+        g_source_remove(process->output_source);
+        process->output_source = 0;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (process->output_epoll && !process->output_paused)
+        wtl_process_epoll_remove(process->output_fd);
+#endif
+
+    close(process->output_fd);
+    process->output_fd = -1;
+    process->output_paused = FALSE;
+}
+
+/* Stop reading while there is a backlog, so that a runaway child blocks on write instead of starving the main loop.
+ * The fd is removed from the epoll set rather than disabled, since EPOLLHUP would be reported anyway. */
+static void wtl_process_output_pause(WtlProcess * process)
+{
+    if (process->output_fd < 0 || process->output_paused)
+        return;
+
+    process->output_paused = TRUE;
+
+    if (process->output_source)
+    {
+        g_source_remove(process->output_source);
+        process->output_source = 0;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    if (process->output_epoll)
+        wtl_process_epoll_remove(process->output_fd);
+#endif
+}
+
+static gboolean wtl_process_on_output(GIOChannel * source, GIOCondition condition, gpointer data);
+
+static void wtl_process_output_watch(WtlProcess * process)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    process->output_epoll = wtl_process_epoll_add(process->output_fd, &process->output_watch);
+    if (process->output_epoll)
+        return;
+#endif
+    GIOChannel * channel = g_io_channel_unix_new(process->output_fd);
+    process->output_source = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, wtl_process_on_output, process);
+    g_io_channel_unref(channel);
+}
+
+static void wtl_process_output_resume(WtlProcess * process)
+{
+    if (process->output_fd < 0 || !process->output_paused)
+        return;
+
+    process->output_paused = FALSE;
+    wtl_process_output_watch(process);
+}
+
+static void wtl_process_read_output(WtlProcess * process)
+{
+    gchar * buffer = wtl_line_buffer_reserve(process->output, READ_SIZE);
+    ssize_t bytes_read = read(process->output_fd, buffer, READ_SIZE);
+
+    if (bytes_read > 0)
+    {
+        wtl_line_buffer_commit(process->output, bytes_read);
+    }
+    else if (bytes_read == 0 || (errno != EAGAIN && errno != EINTR))
+    {
+        /* End of stream. A pty reports EIO once the child side is closed. */
+        wtl_process_output_close(process);
+    }
+
+    if (wtl_process_handle_lines(process))
+    {
+        wtl_process_output_pause(process);
+        process->backlog_source = g_idle_add(wtl_process_on_backlog, process);
+        return;
+    }
+
+    if (!process->freed)
+        wtl_process_check_finished(process);
+}
+
+static gboolean wtl_process_on_output(GIOChannel * source, GIOCondition condition, gpointer data)
+{
+    WtlProcess * process = (WtlProcess *) data;
+
+    /* The watch is removed when the output is closed or paused. */
+    wtl_process_ref(process);
+    wtl_process_read_output(process);
+    gboolean keep = !process->freed && process->output_source != 0;
+    wtl_process_unref(process);
+    return keep;
+}
+
+/********************************************************************/
+
+/* Read CPU time in milliseconds and resident set size in KiB of a running process. */
+static gboolean wtl_process_read_proc_usage(pid_t pid, guint64 * cpu_time, gsize * rss)
+{
+    gchar * path = g_strdup_printf("/proc/%d/stat", (int) pid);
+    gchar * contents = NULL;
+    gboolean result = g_file_get_contents(path, &contents, NULL, NULL);
+    g_free(path);
+    if (!result)
+        return FALSE;
+
+    /* The command name may contain spaces and parentheses; fields follow the last ')'. */
+    unsigned long utime = 0, stime = 0;
+    long rss_pages = 0;
+    char * p = strrchr(contents, ')');
+    result = p && sscanf(p + 2,
+        "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+        &utime, &stime, &rss_pages) == 3;
+    g_free(contents);
+    if (!result)
+        return FALSE;
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    long page_size = sysconf(_SC_PAGESIZE);
+    *cpu_time = (guint64) (utime + stime) * 1000 / (ticks > 0 ? ticks : 100);
+    *rss = (gsize) rss_pages * (page_size > 0 ? page_size : 4096) / 1024;
+    return TRUE;
+}
+
+static void wtl_process_account_rusage(WtlProcess * process, struct rusage * usage)
+{
+    process->finished_cpu_time +=
+        (guint64) (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000 +
+        (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1000;
+    process->max_rss = MAX(process->max_rss, (gsize) usage->ru_maxrss);
+}
+
+/********************************************************************/
+
+static gboolean wtl_process_on_restart(gpointer data)
+{
+    WtlProcess * process = (WtlProcess *) data;
+    process->restart_source = 0;
+    wtl_process_start(process);
+    return FALSE;
+}
+
+/* Called when the child has exited and all of its output has been handled. */
+static void wtl_process_check_finished(WtlProcess * process)
+{
+    if (!process->exited || process->output_fd >= 0 || process->backlog_source)
+        return;
+
+    process->exited = FALSE;
+    process->pid = 0;
+    gint64 run_time = (g_get_monotonic_time() - process->start_time) / 1000;
+
+    int status = process->exit_status;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        process->failures = 0;
+    }
+    else
+    {
+        process->failures++;
+        if (process->failures == CRASH_LOOP_FAILURES)
+            su_print_error_message("%s: command keeps failing, delaying restarts\n", process->command);
+    }
+
+    if (process->exit_func)
+    {
+        wtl_process_ref(process);
+        process->exit_func(process, status, process->user_data);
+        gboolean freed = process->freed;
+        wtl_process_unref(process);
+        if (freed)
+            return;
+    }
+
+    /* Started again from the exit handler. */
+    if (process->pid || process->restart_source)
+        return;
+
+    if (process->restart_interval <= 0)
+        return;
+
+    /* Periodic commands keep their schedule; failing ones back off exponentially. */
+    gint64 delay = process->restart_interval - run_time;
+    if (process->failures > 0)
+    {
+        delay = MAX(process->restart_interval, FAILURE_RESTART_DELAY);
+        guint i;
+        for (i = 1; i < process->failures && delay < MAX_RESTART_DELAY; i++)
+            delay *= 2;
+        delay = MIN(delay, MAX(MAX_RESTART_DELAY, process->restart_interval));
+    }
+    if (delay < 0)
+        delay = 0;
+
+    process->restart_source = g_timeout_add(delay, wtl_process_on_restart, process);
+}
+
+static void wtl_process_on_exit(WtlProcess * process, int status)
+{
+    process->exited = TRUE;
+    process->exit_status = status;
+    wtl_process_check_finished(process);
+}
+
+#ifdef USE_PIDFD
+
+static void wtl_process_pid_fd_close(WtlProcess * process)
+{
+    if (process->pid_fd < 0)
+        return;
+
+    wtl_process_epoll_remove(process->pid_fd);
+    close(process->pid_fd);
+    process->pid_fd = -1;
+}
+
+static void wtl_process_reap(WtlProcess * process)
+{
+    int status = 0;
+    struct rusage usage;
+    if (wait4(process->pid, &status, WNOHANG, &usage) != process->pid)
+        return;
+
+    wtl_process_account_rusage(process, &usage);
+    wtl_process_pid_fd_close(process);
+    wtl_process_on_exit(process, status);
+}
+
+#endif
+
+static void wtl_process_on_child_watch(GPid pid, gint status, gpointer data)
+{
+    WtlProcess * process = (WtlProcess *) data;
+    process->child_watch_source = 0; /* Glib will reap the watch source for us. */
+    wtl_process_on_exit(process, status);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static void wtl_process_dispatch(Watch * watch)
+{
+    WtlProcess * process = watch->process;
+
+    if (watch->kind == WATCH_OUTPUT)
+    {
+        if (process->output_fd >= 0 && !process->output_paused)
+            wtl_process_read_output(process);
+    }
+#ifdef USE_PIDFD
+    else if (watch->kind == WATCH_PID)
+    {
+        if (process->pid_fd >= 0)
+            wtl_process_reap(process);
+    }
+#endif
+}
+
+#endif
+
+/********************************************************************/
+
+/* The stopped child runs in its own process group, so that the whole pipeline started by sh is signalled,
+ * not just sh itself. The group gets SIGTERM at once and SIGKILL after a grace period; the child is reaped
+ * by a child watch meanwhile. The group ID cannot be reused while any of its members are alive,
+ * so SIGKILL never reaches an unrelated process, even if sh has been reaped already. */
+
+static void stopping_child_free_if_done(StoppingChild * child)
+{
+    if (!child->child_watch_source && !child->kill_source)
+        g_free(child);
+}
+
+static void stopping_child_on_exit(GPid pid, gint status, gpointer data)
+{
+    StoppingChild * child = (StoppingChild *) data;
+    child->child_watch_source = 0;
+    stopping_child_free_if_done(child);
+}
+
+static gboolean stopping_child_on_timeout(gpointer data)
+{
+    StoppingChild * child = (StoppingChild *) data;
+    child->kill_source = 0;
+    kill(-child->pid, SIGKILL);
+    stopping_child_free_if_done(child);
+    return FALSE;
+}
+
+static void wtl_process_terminate(pid_t pid, gboolean reap)
+{
+    /* Without a child to reap, there is nothing left to do once the whole group is gone. */
+    if (kill(-pid, SIGTERM) < 0 && !reap)
+        return;
+
+    StoppingChild * child = g_new0(StoppingChild, 1);
+    child->pid = pid;
+    if (reap)
+        child->child_watch_source = g_child_watch_add(pid, stopping_child_on_exit, child);
+    child->kill_source = g_timeout_add(STOP_GRACE_TIMEOUT, stopping_child_on_timeout, child);
+}
+
+/********************************************************************/
+
+WtlProcess * wtl_process_new(const char * command, WtlProcessFlags flags,
+    WtlProcessLineFunc line_func, WtlProcessExitFunc exit_func, gpointer user_data)
+{
+    WtlProcess * process = g_new0(WtlProcess, 1);
+    process->ref_count = 1;
+    process->command = g_strdup(command);
+    process->flags = flags;
+    process->line_func = line_func;
+    process->exit_func = exit_func;
+    process->user_data = user_data;
+    process->output_fd = -1;
+    process->pid_fd = -1;
+    process->output = wtl_line_buffer_new(MAX_LINE_LENGTH);
+    process->output_watch.process = process;
+    process->output_watch.kind = WATCH_OUTPUT;
+    process->pid_watch.process = process;
+    process->pid_watch.kind = WATCH_PID;
+    all_processes = g_list_append(all_processes, process);
+    return process;
+}
+
+void wtl_process_free(WtlProcess * process)
+{
+    if (!process)
+        return;
+
+    wtl_process_stop(process);
+    process->freed = TRUE;
+    wtl_process_unref(process);
+}
+
+void wtl_process_set_restart_interval(WtlProcess * process, int interval)
+{
+    process->restart_interval = MAX(interval, 0);
+}
+
+void wtl_process_set_lines_per_iteration(WtlProcess * process, int lines)
+{
+    process->lines_per_iteration = MAX(lines, 0);
+}
+
+gboolean wtl_process_start(WtlProcess * process)
+{
+    if (process->pid)
+        return TRUE;
+
+    if (process->restart_source)
+    {
+        g_source_remove(process->restart_source);
+        process->restart_source = 0;
+    }
+
+    if (su_str_empty(process->command))
+        return FALSE;
+
+    gboolean use_pty = process->flags & WTL_PROCESS_USE_PTY;
+
+    int fds[2];
+    if (use_pty)
+    {
+        if (openpty(&fds[0], &fds[1], NULL, NULL, NULL) < 0)
+            return FALSE;
+    }
+    else
+    {
+        if (pipe(fds) < 0)
+            return FALSE;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        if (use_pty)
+        {
+            setsid();
+            ioctl(fds[1], TIOCSCTTY, (char *)NULL);
+        }
+        else
+        {
+            setpgid(0, 0);
+        }
+
+        close(fds[0]);
+
+        dup2(fds[1],1);
+        close(fds[1]);
+
+        execlp ("sh", "sh", "-c", process->command, (char *) NULL);
+        _exit(-1);
+    }
+
+    close(fds[1]);
+
+    if (pid < 0)
+    {
+        close(fds[0]);
+        return FALSE;
+    }
+
+    /* Also set in the parent, so that the group exists before wtl_process_stop() may signal it. */
+    if (!use_pty)
+        setpgid(pid, pid);
+
+    process->pid = pid;
+    process->exited = FALSE;
+    process->start_time = g_get_monotonic_time();
+    process->runs++;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    process->output_fd = fds[0];
+    process->output_paused = FALSE;
+    wtl_line_buffer_clear(process->output);
+    wtl_process_output_watch(process);
+
+#ifdef USE_PIDFD
+    process->pid_fd = syscall(SYS_pidfd_open, pid, 0);
+    if (process->pid_fd >= 0)
+    {
+        fcntl(process->pid_fd, F_SETFD, FD_CLOEXEC);
+        if (wtl_process_epoll_add(process->pid_fd, &process->pid_watch))
+            return TRUE;
+        close(process->pid_fd);
+        process->pid_fd = -1;
+    }
+#endif
+
+    process->child_watch_source = g_child_watch_add(pid, wtl_process_on_child_watch, process);
+    return TRUE;
+}
+
+void wtl_process_stop(WtlProcess * process)
+{
+    if (process->restart_source)
+    {
+        g_source_remove(process->restart_source);
+        process->restart_source = 0;
+    }
+
+    if (process->backlog_source)
+    {
+        g_source_remove(process->backlog_source);
+        process->backlog_source = 0;
+    }
+
+    wtl_process_output_close(process);
+    wtl_line_buffer_clear(process->output);
+
+#ifdef USE_PIDFD
+    wtl_process_pid_fd_close(process);
+#endif
+
+    if (process->child_watch_source)
+    {
+        g_source_remove(process->child_watch_source);
+        process->child_watch_source = 0;
+    }
+
+    /* Nothing else reaps the child from now on. Resource usage of the interrupted run is not accounted. */
+    if (process->pid)
+        wtl_process_terminate(process->pid, !process->exited);
+
+    process->pid = 0;
+    process->exited = FALSE;
+}
+
+gboolean wtl_process_is_running(WtlProcess * process)
+{
+    return process->pid != 0;
+}
+
+const char * wtl_process_get_command(WtlProcess * process)
+{
+    return process->command;
+}
+
+void wtl_process_get_usage(WtlProcess * process, WtlProcessUsage * usage)
+{
+    memset(usage, 0, sizeof(WtlProcessUsage));
+
+    usage->cpu_time = process->finished_cpu_time;
+    usage->max_rss = process->max_rss;
+    usage->runs = process->runs;
+    usage->failures = process->failures;
+    usage->throttled = process->failures >= CRASH_LOOP_FAILURES;
+
+    guint64 cpu_time;
+    gsize rss;
+    if (process->pid && !process->exited && wtl_process_read_proc_usage(process->pid, &cpu_time, &rss))
+    {
+        usage->cpu_time += cpu_time;
+        usage->rss = rss;
+    }
+}
+
+void wtl_process_foreach(WtlProcessFunc func, gpointer user_data)
+{
+    GList * l;
+    for (l = all_processes; l; l = l->next)
+    {
+        WtlProcess * process = (WtlProcess *) l->data;
+        if (!process->freed)
+            func(process, user_data);
+    }
+}
@@ -0,0 +1,423 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <cairo-xlib.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+
+#include <sde-utils-gtk.h>
+
+#include <waterline/thumbnail_cache.h>
+#include <waterline/x11_utils.h>
+#include <waterline/x11_wrappers.h>
+#include "wtl_private.h"
+
+/********************************************************************/
+
+/* Upper bound on either side of a stored image, whatever the watches ask for. */
+#define THUMBNAIL_MAX_SIZE 512
+
+/* Lower bound on the refresh interval, in milliseconds. */
+#define THUMBNAIL_MIN_REFRESH_INTERVAL 100
+
+typedef struct {
+    Window win;                  /* Client window */
+    Window target;               /* Window the contents are taken from: the frame, or the client if it has none; 0 until resolved */
+    Damage damage;               /* Damage object on target, 0 if none */
+    GdkPixbuf * pixbuf;          /* Latest image, NULL until the first successful refresh */
+    GList * watches;
+    int max_width;               /* Largest size asked for by the watches */
+    int max_height;
+    guint refresh_interval;      /* Shortest interval asked for by the watches */
+    gint64 last_refresh_time;
+    guint refresh_timeout;
+    gboolean dispatching;        /* Watch callbacks are running; removals wait until they are done */
+} Thumbnail;
+
+struct _WtlThumbnailWatch {
+    Thumbnail * thumbnail;
+    int max_width;
+    int max_height;
+    guint refresh_interval;
+    WtlThumbnailFunc func;
+    gpointer user_data;
+    gboolean removed;            /* Unwatched from a callback; freed when the dispatch is over */
+};
+
+static GHashTable * thumbnails_by_window = NULL;   /* Window -> Thumbnail */
+static GHashTable * thumbnails_by_damage = NULL;   /* Damage -> Thumbnail */
+static int damage_event_base = -1;                 /* -1 if not queried, 0 if unavailable */
+
+/********************************************************************/
+
+static GdkFilterReturn thumbnail_event_filter(GdkXEvent * xevent, GdkEvent * event, gpointer data);
+static void thumbnail_schedule_refresh(Thumbnail * th, gboolean now);
+static gboolean thumbnail_update_limits(Thumbnail * th);
+static void thumbnail_free(Thumbnail * th);
+
+gboolean wtl_thumbnail_is_available(void)
+{
+    if (damage_event_base < 0)
+    {
+        int event_base, error_base;
+        if (wtl_x11_is_composite_available()
+         && XDamageQueryExtension(wtl_x11_display(), &event_base, &error_base))
+        {
+            damage_event_base = event_base;
+            gdk_window_add_filter(NULL, thumbnail_event_filter, NULL);
+        }
+        else
+        {
+            damage_event_base = 0;
+        }
+    }
+
+    return damage_event_base > 0;
+}
+
+static GdkFilterReturn thumbnail_event_filter(GdkXEvent * xevent, GdkEvent * event, gpointer data)
+{
+    XEvent * xev = (XEvent *) xevent;
+    if (xev->type == damage_event_base + XDamageNotify && thumbnails_by_damage)
+    {
+        XDamageNotifyEvent * dev = (XDamageNotifyEvent *) xev;
+        Thumbnail * th = g_hash_table_lookup(thumbnails_by_damage, GUINT_TO_POINTER(dev->damage));
+        if (th)
+        {
+            thumbnail_schedule_refresh(th, FALSE);
+            return GDK_FILTER_REMOVE;
+        }
+    }
+    return GDK_FILTER_CONTINUE;
+}
+
+/********************************************************************/
+
+static void thumbnail_release_target(Thumbnail * th)
+{
+    if (th->damage)
+    {
+        g_hash_table_remove(thumbnails_by_damage, GUINT_TO_POINTER(th->damage));
+        /* The damage object is already gone if the window was destroyed. */
+        gdk_error_trap_push();
+        XDamageDestroy(wtl_x11_display(), th->damage);
+        gdk_error_trap_pop();
+        th->damage = 0;
+    }
+    th->target = 0;
+}
+
+/* Find the window that holds the contents and start tracking its damage. */
+static gboolean thumbnail_resolve_target(Thumbnail * th)
+{
+    if (th->target)
+        return TRUE;
+
+    Window root_return = 0;
+    Window parent_return = 0;
+    Window * children_return = NULL;
+    unsigned int nchildren_return = 0;
+    if (!XQueryTree(wtl_x11_display(), th->win, &root_return, &parent_return, &children_return, &nchildren_return))
+        return FALSE;
+    if (children_return)
+        XFree(children_return);
+
+    th->target = (parent_return != 0 && parent_return != root_return) ? parent_return : th->win;
+    th->damage = XDamageCreate(wtl_x11_display(), th->target, XDamageReportNonEmpty);
+    if (th->damage)
+        g_hash_table_insert(thumbnails_by_damage, GUINT_TO_POINTER(th->damage), th);
+    return TRUE;
+}
+
+/* Scale the contents of the target down on the server side and read back the small image. */
+static GdkPixbuf * thumbnail_grab(Thumbnail * th)
+{
+    Display * dpy = wtl_x11_display();
+
+    XWindowAttributes attributes;
+    if (!XGetWindowAttributes(dpy, th->target, &attributes) || attributes.map_state != IsViewable)
+        return NULL;
+
+    int width = attributes.width + attributes.border_width * 2;
+    int height = attributes.height + attributes.border_width * 2;
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    /* Fit into the requested size, keeping the aspect ratio and never scaling up. */
+    double scale = MIN((double) th->max_width / width, (double) th->max_height / height);
+    if (scale > 1.0)
+        scale = 1.0;
+    int scaled_width = MAX(1, (int) (width * scale));
+    int scaled_height = MAX(1, (int) (height * scale));
+
+    Pixmap pixmap = XCompositeNameWindowPixmap(dpy, th->target);
+    if (!pixmap)
+        return NULL;
+
+    Pixmap scaled_pixmap = XCreatePixmap(dpy, attributes.root, scaled_width, scaled_height, attributes.depth);
+
+    cairo_surface_t * source = cairo_xlib_surface_create(dpy, pixmap, attributes.visual, width, height);
+    cairo_surface_t * destination = cairo_xlib_surface_create(dpy, scaled_pixmap, attributes.visual, scaled_width, scaled_height);
+    cairo_t * cr = cairo_create(destination);
+    cairo_scale(cr, (double) scaled_width / width, (double) scaled_height / height);
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(destination);
+    cairo_surface_destroy(source);
+
+    GdkPixbuf * pixbuf = su_gdk_pixbuf_get_from_pixmap(scaled_pixmap, -1, -1);
+
+    XFreePixmap(dpy, scaled_pixmap);
+    XFreePixmap(dpy, pixmap);
+
+    return pixbuf;
+}
+
+/* Free the watches unwatched during a dispatch, and the thumbnail if none is left.
+ * Returns FALSE if the thumbnail has been freed. */
+static gboolean thumbnail_remove_pending_watches(Thumbnail * th)
+{
+    gboolean removed = FALSE;
+    GList * l = th->watches;
+    while (l)
+    {
+        GList * next = l->next;
+        WtlThumbnailWatch * watch = (WtlThumbnailWatch *) l->data;
+        if (watch->removed)
+        {
+            th->watches = g_list_delete_link(th->watches, l);
+            g_free(watch);
+            removed = TRUE;
+        }
+        l = next;
+    }
+
+    if (!th->watches)
+    {
+        thumbnail_free(th);
+        return FALSE;
+    }
+
+    if (removed)
+        thumbnail_update_limits(th);
+    return TRUE;
+}
+
+static gboolean thumbnail_refresh_timeout(Thumbnail * th)
+{
+    th->refresh_timeout = 0;
+    th->last_refresh_time = g_get_monotonic_time();
+
+    gdk_error_trap_push();
+
+    GdkPixbuf * pixbuf = NULL;
+    if (thumbnail_resolve_target(th))
+    {
+        /* Re-arm the damage report before reading, so that changes made meanwhile are not lost. */
+        if (th->damage)
+            XDamageSubtract(wtl_x11_display(), th->damage, None, None);
+        pixbuf = thumbnail_grab(th);
+    }
+
+    if (gdk_error_trap_pop())
+    {
+        /* The window is gone, or it was reparented and the old frame destroyed.
+         * Look for the target again next time. */
+        if (pixbuf)
+            g_object_unref(pixbuf);
+        pixbuf = NULL;
+        thumbnail_release_target(th);
+    }
+
+    if (pixbuf)
+    {
+        if (th->pixbuf)
+            g_object_unref(th->pixbuf);
+        th->pixbuf = pixbuf;
+
+        /* A callback may unwatch any watch of this thumbnail, including the last one.
+         * Such watches stay in the list until the loop is over. */
+        th->dispatching = TRUE;
+        GList * l;
+        for (l = th->watches; l; l = l->next)
+        {
+            WtlThumbnailWatch * watch = (WtlThumbnailWatch *) l->data;
+            if (!watch->removed)
+                watch->func(th->pixbuf, watch->user_data);
+        }
+        th->dispatching = FALSE;
+
+        thumbnail_remove_pending_watches(th);
+    }
+
+    return FALSE;
+}
+
+/* Refresh as soon as the budget of the window allows. */
+static void thumbnail_schedule_refresh(Thumbnail * th, gboolean now)
+{
+    if (th->refresh_timeout)
+    {
+        if (!now)
+            return;
+        g_source_remove(th->refresh_timeout);
+        th->refresh_timeout = 0;
+    }
+
+    guint delay = 0;
+    if (!now && th->last_refresh_time)
+    {
+        gint64 elapsed = (g_get_monotonic_time() - th->last_refresh_time) / 1000;
+        if (elapsed < th->refresh_interval)
+            delay = th->refresh_interval - elapsed;
+    }
+
+    th->refresh_timeout = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, delay, (GSourceFunc) thumbnail_refresh_timeout, th, NULL);
+}
+
+/* Recompute the size and interval from the watches. Returns TRUE if the image should grow. */
+static gboolean thumbnail_update_limits(Thumbnail * th)
+{
+    int max_width = 1;
+    int max_height = 1;
+    guint refresh_interval = G_MAXUINT;
+
+    GList * l;
+    for (l = th->watches; l; l = l->next)
+    {
+        WtlThumbnailWatch * watch = (WtlThumbnailWatch *) l->data;
+        if (watch->removed)
+            continue;
+        max_width = MAX(max_width, watch->max_width);
+        max_height = MAX(max_height, watch->max_height);
+        refresh_interval = MIN(refresh_interval, watch->refresh_interval);
+    }
+
+    max_width = MIN(max_width, THUMBNAIL_MAX_SIZE);
+    max_height = MIN(max_height, THUMBNAIL_MAX_SIZE);
+
+    gboolean grow = max_width > th->max_width || max_height > th->max_height;
+
+    th->max_width = max_width;
+    th->max_height = max_height;
+    th->refresh_interval = MAX(refresh_interval, THUMBNAIL_MIN_REFRESH_INTERVAL);
+
+    return grow;
+}
+
+static void thumbnail_free(Thumbnail * th)
+{
+    g_hash_table_remove(thumbnails_by_window, GUINT_TO_POINTER(th->win));
+    thumbnail_release_target(th);
+    if (th->refresh_timeout)
+        g_source_remove(th->refresh_timeout);
+    if (th->pixbuf)
+        g_object_unref(th->pixbuf);
+    g_free(th);
+}
+
+/********************************************************************/
+
+WtlThumbnailWatch * wtl_thumbnail_watch(Window win, int max_width, int max_height, guint refresh_interval,
+    WtlThumbnailFunc func, gpointer user_data)
+{
+    if (!win || !wtl_thumbnail_is_available())
+        return NULL;
+
+    if (!thumbnails_by_window)
+    {
+        thumbnails_by_window = g_hash_table_new(g_direct_hash, g_direct_equal);
+        thumbnails_by_damage = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    Thumbnail * th = g_hash_table_lookup(thumbnails_by_window, GUINT_TO_POINTER(win));
+    if (!th)
+    {
+        th = g_new0(Thumbnail, 1);
+        th->win = win;
+        g_hash_table_insert(thumbnails_by_window, GUINT_TO_POINTER(win), th);
+    }
+
+    WtlThumbnailWatch * watch = g_new0(WtlThumbnailWatch, 1);
+    watch->thumbnail = th;
+    watch->max_width = max_width;
+    watch->max_height = max_height;
+    watch->refresh_interval = refresh_interval;
+    watch->func = func;
+    watch->user_data = user_data;
+    th->watches = g_list_append(th->watches, watch);
+
+    if (thumbnail_update_limits(th) || !th->pixbuf)
+        thumbnail_schedule_refresh(th, TRUE);
+
+    return watch;
+}
+
+void wtl_thumbnail_unwatch(WtlThumbnailWatch * watch)
+{
+    if (!watch)
+        return;
+
+    Thumbnail * th = watch->thumbnail;
+    if (th->dispatching)
+    {
+        watch->removed = TRUE;
+        return;
+    }
+
+    th->watches = g_list_remove(th->watches, watch);
+    g_free(watch);
+
+    if (th->watches)
+        thumbnail_update_limits(th);
+    else
+        thumbnail_free(th);
+}
+
+void wtl_thumbnail_watch_set_size(WtlThumbnailWatch * watch, int max_width, int max_height)
+{
+    if (!watch || (watch->max_width == max_width && watch->max_height == max_height))
+        return;
+
+    watch->max_width = max_width;
+    watch->max_height = max_height;
+    if (thumbnail_update_limits(watch->thumbnail))
+        thumbnail_schedule_refresh(watch->thumbnail, FALSE);
+}
+
+void wtl_thumbnail_watch_refresh(WtlThumbnailWatch * watch)
+{
+    if (watch)
+        thumbnail_schedule_refresh(watch->thumbnail, FALSE);
+}
+
+GdkPixbuf * wtl_thumbnail_watch_get_pixbuf(WtlThumbnailWatch * watch)
+{
+    return watch ? watch->thumbnail->pixbuf : NULL;
+}
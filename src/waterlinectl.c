@@ -21,72 +21,262 @@
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 static Display * dpy;
 
 static const char usage[] =
     "\nwaterlinectl - Waterline Panel Controller\n"
-    "Usage: waterlinectl <command>\n\n"
+    "Usage: waterlinectl [--x11] <command> [arguments...]\n"
+    "       waterlinectl --batch < requests\n\n"
+    "Options:\n"
+    "--batch\tread requests from standard input, one per line\n"
+    "--x11\tsend the command through the root window property (no reply)\n\n"
     "Available commands:\n"
     "menu\tshow system menu\n"
     "run\tshow run dialog\n"
     "config\tshow configuration dialog\n"
     "restart\trestart waterline\n"
-    "exit\texit waterline\n\n";
+    "exit\texit waterline\n"
+    "panel <panel> visible|autohide [true|false]\n"
+    "panel <panel> plugin <plugin> <command> [arguments...]\n\n"
+    "Queries:\n"
+    "panels\tlist panels\n"
+    "plugins <panel>\tlist plugins of a panel\n"
+    "geometry <panel>\tprint position and size of a panel\n"
+    "state <panel>\tprint visibility state of a panel\n"
+    "stats [panel]\tprint plugin startup timings, callback times and wakeups\n"
+    "stats-reset [panel]\trestart callback accounting\n"
+    "event-stats [on|off|reset]\tprint X event latency percentiles and round trips\n"
+    "processes\tprint CPU time, memory and restart counters of supervised commands\n"
+    "subscribe [event...]\tprint events as they happen\n\n";
 
-int main(int argc, const char** argv)
+/* Commands that need a reply and so cannot go through the X property. */
+static const char * const queries[] = {
+    "panels", "plugins", "geometry", "state", "stats", "stats-reset", "event-stats", "processes", "subscribe", "ping", NULL
+};
+
+/* Must match get_socket_path() in control.c. */
+static int connect_control_socket(const char * display_name)
 {
-    const char * display_name = (char *) getenv("DISPLAY");
-    Window root;
-    Atom cmd_atom;
+    const char * runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || !*runtime_dir || !display_name || !*display_name)
+        return -1;
 
-    if( argc < 2 )
+    char display[256];
+    snprintf(display, sizeof(display), "%s", display_name);
+    char * colon = strrchr(display, ':');
+    if (colon)
     {
-        printf( usage );
-        return 1;
+        char * dot = strchr(colon, '.');
+        if (dot)
+            *dot = 0;
+    }
+    char * c;
+    for (c = display; *c; c++)
+    {
+        if (*c == '/')
+            *c = '_';
     }
 
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    int length = snprintf(address.sun_path, sizeof(address.sun_path), "%s/waterline-%s.socket", runtime_dir, display);
+    if (length < 0 || (size_t) length >= sizeof(address.sun_path))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0)
     {
-        size_t buff_size = 0;
-        int i;
-        for (i = 1; i < argc; i++)
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void write_all(int fd, const char * data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0)
         {
-            buff_size += strlen(argv[i]) + 1;
+            if (errno == EINTR)
+                continue;
+            err(1, "cannot write to control socket");
         }
+        data += n;
+        size -= n;
+    }
+}
 
-        char * buff = (char *) calloc(buff_size, sizeof(char));
-        if (buff == NULL) {
-            errx(1, "memory allocation failure (%zu bytes)", buff_size);
-            return 1;
+/* Send argv as one request line, quoting every word for the shell-like parser on the other side. */
+static void write_request(int fd, int argc, const char ** argv)
+{
+    int i;
+    for (i = 0; i < argc; i++)
+    {
+        const char * c;
+        write_all(fd, i > 0 ? " '" : "'", i > 0 ? 2 : 1);
+        for (c = argv[i]; *c; c++)
+        {
+            if (*c == '\'')
+                write_all(fd, "'\\''", 4);
+            else if (*c == '\n')
+                write_all(fd, " ", 1);
+            else
+                write_all(fd, c, 1);
         }
+        write_all(fd, "'", 1);
+    }
+    write_all(fd, "\n", 1);
+}
+
+static void copy_stdin(int fd)
+{
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+        write_all(fd, buffer, n);
+}
 
-        size_t buff_pos = 0;
-        for (i = 1; i < argc; i++)
+/* Print the replies until the panel closes the connection.
+ * Returns the exit status: nonzero if any request failed. */
+static int read_replies(int fd)
+{
+    FILE * input = fdopen(fd, "r");
+    if (!input)
+        err(1, "fdopen");
+
+    int status = 0;
+    char * line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_size, input)) >= 0)
+    {
+        if (length > 0 && line[length - 1] == '\n')
+            line[length - 1] = 0;
+
+        if (strncmp(line, "DATA ", 5) == 0)
+            printf("%s\n", line + 5);
+        else if (strncmp(line, "EVENT ", 6) == 0)
+            printf("%s\n", line + 6);
+        else if (strncmp(line, "ERROR ", 6) == 0)
         {
-            size_t s = strlen(argv[i]) + 1;
-            memcpy(buff + buff_pos, argv[i], s * sizeof(char));
-            buff_pos += s;
+            fprintf(stderr, "waterlinectl: %s\n", line + 6);
+            status = 1;
         }
+        fflush(stdout);
+    }
 
-        dpy = XOpenDisplay(display_name);
-        if (dpy == NULL) {
-            err(1, "cannot open display: %s", display_name);
-            return 1;
-        }
-        root = DefaultRootWindow(dpy);
-        cmd_atom = XInternAtom(dpy, "_WATERLINE_TEXT_CMD", False);
+    free(line);
+    fclose(input);
+    return status;
+}
 
-        Atom type_atom = XInternAtom(dpy, "UTF8_STRING", False);
+static void send_x11_command(const char * display_name, int argc, const char ** argv)
+{
+    Window root;
+    Atom cmd_atom;
+
+    size_t buff_size = 0;
+    int i;
+    for (i = 0; i < argc; i++)
+    {
+        buff_size += strlen(argv[i]) + 1;
+    }
 
-        XChangeProperty (dpy, root, cmd_atom, type_atom, 8, PropModeReplace,
-                         (unsigned char *) buff, buff_size);
-        XSync(dpy, False);
-        XCloseDisplay(dpy);
+    char * buff = (char *) calloc(buff_size, sizeof(char));
+    if (buff == NULL) {
+        errx(1, "memory allocation failure (%zu bytes)", buff_size);
     }
 
-    return 0;
+    size_t buff_pos = 0;
+    for (i = 0; i < argc; i++)
+    {
+        size_t s = strlen(argv[i]) + 1;
+        memcpy(buff + buff_pos, argv[i], s * sizeof(char));
+        buff_pos += s;
+    }
+
+    dpy = XOpenDisplay(display_name);
+    if (dpy == NULL) {
+        err(1, "cannot open display: %s", display_name);
+    }
+    root = DefaultRootWindow(dpy);
+    cmd_atom = XInternAtom(dpy, "_WATERLINE_TEXT_CMD", False);
+
+    Atom type_atom = XInternAtom(dpy, "UTF8_STRING", False);
+
+    XChangeProperty (dpy, root, cmd_atom, type_atom, 8, PropModeReplace,
+                     (unsigned char *) buff, buff_size);
+    XSync(dpy, False);
+    XCloseDisplay(dpy);
+    free(buff);
 }
 
+int main(int argc, const char** argv)
+{
+    const char * display_name = (char *) getenv("DISPLAY");
+    int batch = 0;
+    int force_x11 = 0;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "--batch") == 0)
+            batch = 1;
+        else if (strcmp(argv[i], "--x11") == 0)
+            force_x11 = 1;
+        else
+            break;
+    }
+
+    argc -= i;
+    argv += i;
+
+    if (argc < 1 && !batch)
+    {
+        printf( usage );
+        return 1;
+    }
+
+    int fd = force_x11 ? -1 : connect_control_socket(display_name);
+
+    if (fd < 0)
+    {
+        int j;
+        for (j = 0; batch == 0 && queries[j]; j++)
+        {
+            if (strcmp(argv[0], queries[j]) == 0)
+                break;
+        }
+        if (batch || queries[j])
+            errx(1, "cannot connect to the waterline control socket");
+
+        send_x11_command(display_name, argc, argv);
+        return 0;
+    }
+
+    if (batch)
+        copy_stdin(fd);
+    else
+        write_request(fd, argc, argv);
+
+    /* The panel answers everything sent so far, then closes the connection
+     * unless we have subscribed to events. */
+    shutdown(fd, SHUT_WR);
+
+    return read_replies(fd);
+}
@@ -31,6 +31,8 @@
 
 #include <waterline/global.h>
 #include <waterline/misc.h>
+#include <waterline/icon_cache.h>
+#include <waterline/pixbuf_ops.h>
 #include <waterline/panel.h>
 #include "panel_internal.h"
 #include <waterline/gtkcompat.h>
@@ -56,12 +58,12 @@ typedef struct {
 
     gboolean mouse_over;
 
-    guint theme_changed_handler;
+    guint icon_theme_watch;
 } WtlButtonData;
 
 /********************************************************************/
 
-static void on_theme_changed(GtkIconTheme* theme, WtlButtonData * button_data);
+static void on_theme_changed(WtlButtonData * button_data);
 
 /********************************************************************/
 
@@ -90,8 +92,8 @@ static void wtl_button_data_free(WtlButtonData * button_data)
 {
     wtl_button_data_free_pixbufs(button_data);
 
-    if (button_data->theme_changed_handler != 0)
-        g_signal_handler_disconnect(gtk_icon_theme_get_default(), button_data->theme_changed_handler);
+    if (button_data->icon_theme_watch != 0)
+        wtl_icon_theme_remove_watch(button_data->icon_theme_watch);
 
     g_free(button_data->image_name);
     g_free(button_data->label_text);
@@ -100,44 +102,16 @@ static void wtl_button_data_free(WtlButtonData * button_data)
 
 /********************************************************************/
 
-static GdkPixbuf * draw_highlighted_pixbuf(GdkPixbuf * source_pixbuf, gulong highlight_color)
+static void load_pixbufs(WtlButtonData * button_data)
 {
-    if (!source_pixbuf)
-        return NULL;
-
-    int height = gdk_pixbuf_get_height(source_pixbuf);
-    int rowstride = gdk_pixbuf_get_rowstride(source_pixbuf);
-
-    GdkPixbuf * pixbuf = gdk_pixbuf_add_alpha(source_pixbuf, FALSE, 0, 0, 0);
-    if (pixbuf)
-    {
-        guchar extra[3];
-        int i;
-        for (i = 2; i >= 0; i--, highlight_color >>= 8)
-            extra[i] = highlight_color & 0xFF;
-
-        guchar * src = gdk_pixbuf_get_pixels(pixbuf);
-        guchar * up;
-        for (up = src + height * rowstride; src < up; src += 4)
-        {
-            if (src[3] != 0)
-            {
-                for (i = 0; i < 3; i++)
-                {
-                    int value = src[i] + extra[i];
-                    if (value > 255)
-                        value = 255;
-                    src[i] = value;
-                }
-            }
-        }
-    }
+    if (button_data->pixbuf || button_data->pixbuf_fallback)
+        return;
 
-    return pixbuf;
+    /* The shared cache makes switching between recently used names and buttons with the same icon cheap. */
+    button_data->pixbuf = wtl_icon_cache_load(button_data->image_name, button_data->image_size, FALSE);
+    button_data->pixbuf_fallback = wtl_icon_cache_load(button_data->image_name, button_data->image_size, TRUE);
 }
 
-/********************************************************************/
-
 static void apply_pixbuf(WtlButtonData * button_data)
 {
     if (!button_data->image)
@@ -147,7 +121,7 @@ static void apply_pixbuf(WtlButtonData * button_data)
     {
         gulong highlight_color = (TRUE /* TODO: read setting from plugin object */) ? PANEL_ICON_HIGHLIGHT : 0;
         if (!button_data->pixbuf_highlighted)
-            button_data->pixbuf_highlighted = draw_highlighted_pixbuf(
+            button_data->pixbuf_highlighted = wtl_pixbuf_highlight(
                 button_data->pixbuf ? button_data->pixbuf : button_data->pixbuf_fallback, highlight_color);
         if (button_data->pixbuf_highlighted)
             gtk_image_set_from_pixbuf(GTK_IMAGE(button_data->image), button_data->pixbuf_highlighted);
@@ -189,17 +163,7 @@ static void apply_image_and_label(WtlButtonData * button_data)
     }
     else
     {
-        if (!button_data->pixbuf)
-        {
-            button_data->pixbuf = wtl_load_icon(button_data->image_name,
-                button_data->image_size, button_data->image_size, FALSE);
-        }
-
-        if (!button_data->pixbuf_fallback)
-        {
-            button_data->pixbuf_fallback = wtl_load_icon(button_data->image_name,
-                button_data->image_size, button_data->image_size, TRUE);
-        }
+        load_pixbufs(button_data);
 
         if (!button_data->image)
         {
@@ -217,15 +181,15 @@ static void apply_image_and_label(WtlButtonData * button_data)
             gtk_widget_hide(button_data->image);
 
 
-        if (button_data->theme_changed_handler == 0)
-            button_data->theme_changed_handler = g_signal_connect(
-                gtk_icon_theme_get_default(), "changed", G_CALLBACK(on_theme_changed), button_data);
+        if (button_data->icon_theme_watch == 0)
+            button_data->icon_theme_watch = wtl_icon_theme_add_watch(button_data->event_box,
+                (WtlIconThemeChangedFunc) on_theme_changed, button_data);
     }
 }
 
 /********************************************************************/
 
-static void on_theme_changed(GtkIconTheme * theme, WtlButtonData * button_data)
+static void on_theme_changed(WtlButtonData * button_data)
 {
     wtl_button_data_free_pixbufs(button_data);
     apply_image_and_label(button_data);
@@ -320,8 +284,13 @@ void wtl_button_set_image_name(GtkWidget * button, const char * image_name, int
     if (!button_data)
         return;
 
-    if (size >= 0)
-        button_data->image_size = size;
+    if (size < 0)
+        size = button_data->image_size;
+
+    if (size == button_data->image_size && g_strcmp0(image_name, button_data->image_name) == 0)
+        return;
+
+    button_data->image_size = size;
 
     g_free(button_data->image_name);
     button_data->image_name = g_strdup(image_name);
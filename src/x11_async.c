@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+
+#include <waterline/x11_async.h>
+#include <waterline/x11_wrappers.h>
+#include "wtl_private.h"
+
+/********************************************************************/
+
+/* Largest property value fetched, in 32-bit units. */
+#define PROPERTY_MAX_LENGTH 0x1FFFFFFF
+
+/* Run after the events of the current burst, ahead of the resize and redraw of GTK and the plugins. */
+#define PROPERTY_FLUSH_PRIORITY (G_PRIORITY_HIGH_IDLE - 10)
+
+typedef struct {
+    Window window;
+    Atom property;
+    Atom type;
+    WtlX11PropertyFunc func;   /* NULL once cancelled */
+    gpointer user_data;
+    xcb_get_property_cookie_t cookie;
+} PropertyRequest;
+
+static GQueue pending_requests = G_QUEUE_INIT;     /* Queued, not sent yet */
+static GHashTable * pending_index = NULL;          /* The queued requests, to find duplicates */
+static GQueue in_flight_requests = G_QUEUE_INIT;   /* Sent, replies being delivered */
+static guint flush_idle_cb = 0;
+
+/********************************************************************/
+
+static gboolean flush_idle(gpointer data)
+{
+    flush_idle_cb = 0;
+    wtl_x11_flush_property_requests();
+    return FALSE;
+}
+
+/* Requests are the same if they ask for the same property and deliver it to the same handler. */
+static guint property_request_hash(gconstpointer key)
+{
+    const PropertyRequest * r = (const PropertyRequest *) key;
+    guint hash = (guint) r->window;
+    hash = hash * 31 + (guint) r->property;
+    hash = hash * 31 + (guint) r->type;
+    hash = hash * 31 + (guint) (guintptr) r->func;
+    hash = hash * 31 + GPOINTER_TO_UINT(r->user_data);
+    return hash;
+}
+
+static gboolean property_request_equal(gconstpointer a, gconstpointer b)
+{
+    const PropertyRequest * r1 = (const PropertyRequest *) a;
+    const PropertyRequest * r2 = (const PropertyRequest *) b;
+    return r1->window == r2->window && r1->property == r2->property && r1->type == r2->type
+        && r1->func == r2->func && r1->user_data == r2->user_data;
+}
+
+void wtl_x11_request_property(Window win, Atom prop, Atom type, WtlX11PropertyFunc func, gpointer user_data)
+{
+    if (!pending_index)
+        pending_index = g_hash_table_new(property_request_hash, property_request_equal);
+
+    PropertyRequest key;
+    memset(&key, 0, sizeof(key));
+    key.window = win;
+    key.property = prop;
+    key.type = type;
+    key.func = func;
+    key.user_data = user_data;
+    if (g_hash_table_lookup(pending_index, &key))
+        return;
+
+    PropertyRequest * r = g_slice_new0(PropertyRequest);
+    *r = key;
+    g_queue_push_tail(&pending_requests, r);
+    g_hash_table_insert(pending_index, r, r);
+
+    if (flush_idle_cb == 0)
+        flush_idle_cb = g_idle_add_full(PROPERTY_FLUSH_PRIORITY, flush_idle, NULL, NULL);
+}
+
+void wtl_x11_cancel_property_requests(gpointer user_data)
+{
+    GList * l = pending_requests.head;
+    while (l)
+    {
+        GList * next = l->next;
+        PropertyRequest * r = (PropertyRequest *) l->data;
+        if (r->user_data == user_data)
+        {
+            g_queue_delete_link(&pending_requests, l);
+            g_hash_table_remove(pending_index, r);
+            g_slice_free(PropertyRequest, r);
+        }
+        l = next;
+    }
+
+    /* The replies to in-flight requests still have to be read; just stop delivering them. */
+    for (l = in_flight_requests.head; l; l = l->next)
+    {
+        PropertyRequest * r = (PropertyRequest *) l->data;
+        if (r->user_data == user_data)
+            r->func = NULL;
+    }
+}
+
+/********************************************************************/
+
+/* Convert the value to the layout XGetWindowProperty uses, so that the same decoders work on both. */
+static void * property_value_copy(xcb_get_property_reply_t * reply, int * nitems)
+{
+    int length = xcb_get_property_value_length(reply);
+    void * value = xcb_get_property_value(reply);
+    void * data = NULL;
+    int i;
+
+    switch (reply->format)
+    {
+        case 8:
+            *nitems = length;
+            data = g_malloc(length + 1);
+            memcpy(data, value, length);
+            ((char *) data)[length] = 0;
+            break;
+        case 16:
+            *nitems = length / 2;
+            data = g_new(short, *nitems + 1);
+            for (i = 0; i < *nitems; i++)
+                ((short *) data)[i] = ((gint16 *) value)[i];
+            break;
+        case 32:
+            *nitems = length / 4;
+            data = g_new(long, *nitems + 1);
+            for (i = 0; i < *nitems; i++)
+                ((long *) data)[i] = ((guint32 *) value)[i];
+            break;
+        default:
+            *nitems = 0;
+            break;
+    }
+
+    return data;
+}
+
+static void deliver_reply(xcb_connection_t * c, PropertyRequest * r)
+{
+    if (!r->func)
+    {
+        xcb_discard_reply(c, r->cookie.sequence);
+        return;
+    }
+
+    WtlX11Property property;
+    memset(&property, 0, sizeof(property));
+    property.window = r->window;
+    property.property = r->property;
+
+    xcb_generic_error_t * error = NULL;
+    xcb_get_property_reply_t * reply = xcb_get_property_reply(c, r->cookie, &error);
+    if (error)
+    {
+        property.window_gone = error->error_code == BadWindow;
+        free(error);
+    }
+    else if (reply)
+    {
+        property.type = reply->type;
+        property.format = reply->format;
+        if (reply->type != None && (r->type == AnyPropertyType || r->type == reply->type))
+            property.data = property_value_copy(reply, &property.nitems);
+    }
+
+    r->func(&property, r->user_data);
+
+    g_free(property.data);
+    free(reply);
+}
+
+void wtl_x11_flush_property_requests(void)
+{
+    if (flush_idle_cb != 0)
+    {
+        g_source_remove(flush_idle_cb);
+        flush_idle_cb = 0;
+    }
+
+    /* Called again from a reply handler; the requests it queued go out with the next flush. */
+    if (!g_queue_is_empty(&in_flight_requests))
+    {
+        if (!g_queue_is_empty(&pending_requests) && flush_idle_cb == 0)
+            flush_idle_cb = g_idle_add_full(PROPERTY_FLUSH_PRIORITY, flush_idle, NULL, NULL);
+        return;
+    }
+
+    if (g_queue_is_empty(&pending_requests))
+        return;
+
+    xcb_connection_t * c = XGetXCBConnection(wtl_x11_display());
+
+    /* Send everything, then wait once. */
+    g_hash_table_remove_all(pending_index);
+
+    PropertyRequest * r;
+    while ((r = g_queue_pop_head(&pending_requests)) != NULL)
+    {
+        r->cookie = xcb_get_property(c, 0, r->window, r->property, r->type, 0, PROPERTY_MAX_LENGTH);
+        g_queue_push_tail(&in_flight_requests, r);
+    }
+    xcb_flush(c);
+    wtl_x11_round_trips++;
+
+    /* Keep each request in the in-flight queue while its handler runs, so that it can be cancelled. */
+    while ((r = g_queue_peek_head(&in_flight_requests)) != NULL)
+    {
+        deliver_reply(c, r);
+        g_queue_pop_head(&in_flight_requests);
+        g_slice_free(PropertyRequest, r);
+    }
+
+    /* Requests queued by the handlers above. */
+    if (!g_queue_is_empty(&pending_requests) && flush_idle_cb == 0)
+        flush_idle_cb = g_idle_add_full(PROPERTY_FLUSH_PRIORITY, flush_idle, NULL, NULL);
+}
@@ -26,15 +26,21 @@
 #include <sde-utils.h>
 #include <waterline/x11_utils.h>
 #include <waterline/x11_wrappers.h>
+#include <waterline/pixbuf_ops.h>
 #include "wtl_private.h"
 
+/* Replies waited for by the helpers below; reported by the event statistics. */
+guint64 wtl_x11_round_trips = 0;
+
 void * wtl_x11_get_xa_property(Window xid, Atom prop, Atom type, int * nitems)
 {
+    wtl_x11_round_trips++;
     return su_x11_get_xa_property(wtl_x11_display(), xid, prop, type, nitems);
 }
 
 char * wtl_x11_get_utf8_property(Window win, Atom atom)
 {
+    wtl_x11_round_trips++;
     return su_x11_get_utf8_property(wtl_x11_display(), win, atom);
 }
 
@@ -50,6 +56,7 @@ char ** wtl_x11_get_utf8_property_list(Window win, Atom atom, int *count)
     guchar *tmp = NULL;
 
     *count = 0;
+    wtl_x11_round_trips++;
     result = XGetWindowProperty(wtl_x11_display(), win, atom, 0, G_MAXLONG, False,
           aUTF8_STRING, &type, &format, &nitems,
           &bytes_after, &tmp);
@@ -113,6 +120,7 @@ char * wtl_x11_get_text_property(Window win, Atom atom)
     XTextProperty text_prop;
     char *retval;
 
+    wtl_x11_round_trips++;
     if (XGetTextProperty(wtl_x11_display(), win, &text_prop, atom)) {
         su_log_debug("format=%d enc=%d nitems=%d value=%s   \n",
               text_prop.format,
@@ -214,6 +222,14 @@ void wtl_x11_get_net_wm_state(Window win, NetWMState *nws)
         return;
 
     SU_LOG_DEBUG2( "%x: netwm state = { ", (unsigned int)win);
+    wtl_x11_decode_net_wm_state(state, num3, nws);
+    XFree(state);
+    SU_LOG_DEBUG2( "}\n");
+}
+
+void wtl_x11_decode_net_wm_state(const Atom * state, int num3, NetWMState *nws)
+{
+    memset(nws, 0, sizeof(*nws));
     while (--num3 >= 0) {
 
         if (state[num3] == a_NET_WM_STATE_SKIP_PAGER) {
@@ -259,8 +275,6 @@ void wtl_x11_get_net_wm_state(Window win, NetWMState *nws)
             SU_LOG_DEBUG2( "... ");
         }
     }
-    XFree(state);
-    SU_LOG_DEBUG2( "}\n");
 }
 
 void wtl_x11_get_net_wm_window_type(Window win, NetWMWindowType *nwwt)
@@ -273,6 +287,14 @@ void wtl_x11_get_net_wm_window_type(Window win, NetWMWindowType *nwwt)
         return;
 
     SU_LOG_DEBUG2( "%x: netwm state = { ", (unsigned int)win);
+    wtl_x11_decode_net_wm_window_type(state, num3, nwwt);
+    XFree(state);
+    SU_LOG_DEBUG2( "}\n");
+}
+
+void wtl_x11_decode_net_wm_window_type(const Atom * state, int num3, NetWMWindowType *nwwt)
+{
+    memset(nwwt, 0, sizeof(*nwwt));
     while (--num3 >= 0)
     {
         if (state[num3] == a_NET_WM_WINDOW_TYPE_DESKTOP) {
@@ -303,8 +325,6 @@ void wtl_x11_get_net_wm_window_type(Window win, NetWMWindowType *nwwt)
             SU_LOG_DEBUG2( "... ");
         }
     }
-    XFree(state);
-    SU_LOG_DEBUG2( "}\n");
 }
 
 int wtl_x11_get_wm_state (Window win)
@@ -365,12 +385,22 @@ set_decorations (Window win, gboolean decorate)
 int
 get_mvm_decorations(Window win)
 {
-    gboolean result = -1;
-
-    struct MwmHints * hints;
     int nitems = 0;
+    void * hints = wtl_x11_get_xa_property(win, a_MOTIF_WM_HINTS, a_MOTIF_WM_HINTS, &nitems);
 
-    hints = (struct MwmHints *) wtl_x11_get_xa_property(win, a_MOTIF_WM_HINTS, a_MOTIF_WM_HINTS, &nitems);
+    int result = wtl_x11_decode_mvm_decorations(hints, nitems);
+
+    if (hints)
+        XFree(hints);
+
+    return result;
+}
+
+int wtl_x11_decode_mvm_decorations(const void * data, int nitems)
+{
+    int result = -1;
+
+    const struct MwmHints * hints = (const struct MwmHints *) data;
 
     if (!hints || nitems < PROP_MOTIF_WM_HINTS_ELEMENTS)
     {
@@ -388,9 +418,6 @@ get_mvm_decorations(Window win)
         }
     }
 
-    if (hints)
-        XFree(hints);
-
     return result;
 }
 
@@ -579,33 +606,7 @@ static GdkPixbuf * get_net_wm_icon(Window task_win, int required_width, int requ
 
     /* Сonvert the icon to GdkPixbuf. */
     if (best_icon != NULL)
-    {
-        /* Allocate enough space for the pixel data. */
-        gulong len = best_w * best_h;
-        guchar * pixdata = g_new(guchar, len * 4);
-
-        /* Loop to convert the pixel data. */
-        guchar * p = pixdata;
-        int i;
-        for (i = 0; i < len; p += 4, i += 1)
-        {
-            guint argb = best_icon[i];
-            p[0] = (argb >> 16) & 0xff;
-            p[1] = (argb >>  8) & 0xff;
-            p[2] = (argb >>  0) & 0xff;
-            p[3] = (argb >> 24) & 0xff;
-        }
-
-        /* Initialize a pixmap with the pixel data. */
-        if (pixdata)
-            pixmap = gdk_pixbuf_new_from_data(
-                pixdata,
-                GDK_COLORSPACE_RGB,
-                TRUE, 8, /* has_alpha, bits_per_sample */
-                best_w, best_h, best_w * 4,
-                (GdkPixbufDestroyNotify) g_free,
-                NULL);
-    }
+        pixmap = wtl_pixbuf_new_from_argb(best_icon, (int) best_w, (int) best_h);
 
     /*g_print("required_width %d, required_height %d\nbest_w %lu, best_h %lu\nmax_w %lu, max_h %lu\n",
         required_width, required_height, best_w, best_h, max_w, max_h);*/
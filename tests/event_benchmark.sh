@@ -0,0 +1,134 @@
+#!/bin/sh
+
+# Replays a scripted window manager session against the panel under Xvfb
+# and prints X event latency percentiles and round trips per handler.
+#
+# BENCHMARK_WINDOWS    number of synthetic windows (default 200)
+# BENCHMARK_RATE       operations per second, 0 for no pacing (default 500)
+# BENCHMARK_SEED       seed of the operation sequence (default 1)
+# BENCHMARK_MAX_P99    fail if the p99 latency of any handler exceeds this many milliseconds
+
+set -e
+
+WINDOWS="${BENCHMARK_WINDOWS:-200}"
+RATE="${BENCHMARK_RATE:-500}"
+SEED="${BENCHMARK_SEED:-1}"
+MAX_P99="${BENCHMARK_MAX_P99:-}"
+
+TOP_BUILDDIR="${top_builddir:-..}"
+WATERLINE="$TOP_BUILDDIR/src/waterline"
+WATERLINECTL="$TOP_BUILDDIR/src/waterlinectl"
+REPLAY="./ewmh_replay"
+
+# Automake treats exit status 77 as a skipped test.
+if ! command -v Xvfb >/dev/null 2>&1 ; then
+    echo "Xvfb not found, skipping the event benchmark"
+    exit 77
+fi
+
+WORK_DIR="`mktemp -d`"
+XVFB_PID=
+PANEL_PID=
+
+cleanup()
+{
+    test -n "$PANEL_PID" && kill "$PANEL_PID" 2>/dev/null || true
+    test -n "$XVFB_PID" && kill "$XVFB_PID" 2>/dev/null || true
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT INT TERM
+
+# Pick a display nobody uses.
+DISPLAY_NUMBER=90
+while test -e "/tmp/.X$DISPLAY_NUMBER-lock" -o -e "/tmp/.X11-unix/X$DISPLAY_NUMBER" ; do
+    DISPLAY_NUMBER=`expr $DISPLAY_NUMBER + 1`
+done
+
+Xvfb ":$DISPLAY_NUMBER" -screen 0 1280x1024x24 -nolisten tcp >"$WORK_DIR/xvfb.log" 2>&1 &
+XVFB_PID=$!
+
+export DISPLAY=":$DISPLAY_NUMBER"
+export HOME="$WORK_DIR"
+export XDG_CONFIG_HOME="$WORK_DIR/config"
+export XDG_RUNTIME_DIR="$WORK_DIR/run"
+mkdir -p "$XDG_RUNTIME_DIR"
+chmod 700 "$XDG_RUNTIME_DIR"
+
+wait_for()
+{
+    tries=100
+    while ! "$@" >/dev/null 2>&1 ; do
+        tries=`expr $tries - 1`
+        if test $tries -le 0 ; then
+            return 1
+        fi
+        sleep 0.1
+    done
+}
+
+if ! wait_for test -e "/tmp/.X11-unix/X$DISPLAY_NUMBER" ; then
+    echo "Xvfb did not start:"
+    cat "$WORK_DIR/xvfb.log"
+    exit 1
+fi
+
+# A panel with just the plugins under test.
+PROFILE_DIR="$XDG_CONFIG_HOME/sde/waterline/benchmark"
+mkdir -p "$PROFILE_DIR/panels"
+cat > "$PROFILE_DIR/panels/benchmark" <<END_OF_CONFIG
+{
+  "global": {
+    "edge": "bottom",
+    "oriented_width_type": "percent",
+    "oriented_width": 100,
+    "oriented_height": 26
+  },
+  "plugins": [
+    { "type": "taskbar", "expand": true, "settings": { "show_all_desks": true } },
+    { "type": "pager" }
+  ]
+}
+END_OF_CONFIG
+
+"$WATERLINE" --profile benchmark >"$WORK_DIR/waterline.log" 2>&1 &
+PANEL_PID=$!
+
+if ! wait_for "$WATERLINECTL" ping ; then
+    echo "waterline did not start:"
+    cat "$WORK_DIR/waterline.log"
+    exit 1
+fi
+
+PLUGINS="`"$WATERLINECTL" plugins benchmark`"
+case "$PLUGINS" in
+    *taskbar*pager*) ;;
+    *)
+        echo "taskbar and pager plugins are not available, skipping the event benchmark"
+        exit 77
+        ;;
+esac
+
+"$WATERLINECTL" event-stats on
+"$WATERLINECTL" event-stats reset
+
+"$REPLAY" -n "$WINDOWS" -r "$RATE" -s "$SEED"
+
+# Let the panel drain the event queue before reading the statistics.
+sleep 1
+wait_for "$WATERLINECTL" ping
+"$WATERLINECTL" event-stats > "$WORK_DIR/event-stats"
+
+echo "X event handlers, latency in milliseconds, requests and round trips per event:"
+cat "$WORK_DIR/event-stats"
+
+if test -n "$MAX_P99" ; then
+    awk -v limit="$MAX_P99" '
+        {
+            for (i = 1; i < NF; i++)
+                if ($i == "p99" && $(i + 1) + 0 > limit + 0) {
+                    printf("%s: p99 %s ms exceeds %s ms\n", $1, $(i + 1), limit)
+                    failed = 1
+                }
+        }
+        END { exit failed }' "$WORK_DIR/event-stats"
+fi
@@ -0,0 +1,377 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* A scripted EWMH "window manager" for the event benchmark.
+ *
+ * Announces itself through _NET_SUPPORTING_WM_CHECK, then creates, retitles, restacks,
+ * iconifies and destroys synthetic windows at a fixed rate, keeping _NET_CLIENT_LIST,
+ * _NET_CLIENT_LIST_STACKING and _NET_ACTIVE_WINDOW up to date the way a real window
+ * manager does. The sequence of operations depends only on the seed, so runs are comparable. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+/********************************************************************/
+
+enum {
+    NET_SUPPORTED,
+    NET_SUPPORTING_WM_CHECK,
+    NET_NUMBER_OF_DESKTOPS,
+    NET_CURRENT_DESKTOP,
+    NET_CLIENT_LIST,
+    NET_CLIENT_LIST_STACKING,
+    NET_ACTIVE_WINDOW,
+    NET_WM_NAME,
+    NET_WM_DESKTOP,
+    NET_WM_STATE,
+    NET_WM_STATE_HIDDEN,
+    NET_WM_WINDOW_TYPE,
+    NET_WM_WINDOW_TYPE_NORMAL,
+    UTF8_STRING,
+    WM_STATE,
+    ATOM_COUNT
+};
+
+static const char * atom_names[ATOM_COUNT] = {
+    "_NET_SUPPORTED",
+    "_NET_SUPPORTING_WM_CHECK",
+    "_NET_NUMBER_OF_DESKTOPS",
+    "_NET_CURRENT_DESKTOP",
+    "_NET_CLIENT_LIST",
+    "_NET_CLIENT_LIST_STACKING",
+    "_NET_ACTIVE_WINDOW",
+    "_NET_WM_NAME",
+    "_NET_WM_DESKTOP",
+    "_NET_WM_STATE",
+    "_NET_WM_STATE_HIDDEN",
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_WINDOW_TYPE_NORMAL",
+    "UTF8_STRING",
+    "WM_STATE"
+};
+
+#define DESKTOPS 4
+
+typedef struct {
+    Window window;
+    unsigned long serial;       /* Bumped on every retitle */
+    int iconified;
+} Client;
+
+static Display * dpy;
+static Window root;
+static Atom atoms[ATOM_COUNT];
+
+static Client * clients;        /* In stacking order, bottom to top */
+static int client_count;
+static unsigned long next_serial;
+
+static unsigned long random_state;
+static long delay_ns;
+static unsigned long operations;
+
+/********************************************************************/
+
+/* Deterministic across platforms, unlike rand(). */
+static unsigned long next_random(unsigned long limit)
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return ((random_state >> 16) & 0x7fff) % limit;
+}
+
+static void pace(void)
+{
+    XFlush(dpy);
+    operations++;
+    if (delay_ns > 0)
+    {
+        struct timespec ts;
+        ts.tv_sec = delay_ns / 1000000000L;
+        ts.tv_nsec = delay_ns % 1000000000L;
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void set_cardinal(Window window, Atom property, unsigned long value)
+{
+    XChangeProperty(dpy, window, property, XA_CARDINAL, 32, PropModeReplace, (unsigned char *) &value, 1);
+}
+
+static void set_window(Window window, Atom property, Window value)
+{
+    XChangeProperty(dpy, window, property, XA_WINDOW, 32, PropModeReplace, (unsigned char *) &value, 1);
+}
+
+/********************************************************************/
+
+static int compare_windows(const void * a, const void * b)
+{
+    Window wa = *(const Window *) a;
+    Window wb = *(const Window *) b;
+    return wa < wb ? -1 : wa > wb;
+}
+
+static void update_client_lists(void)
+{
+    Window * windows = malloc(sizeof(Window) * (client_count + 1));
+    int i;
+
+    for (i = 0; i < client_count; i++)
+        windows[i] = clients[i].window;
+    XChangeProperty(dpy, root, atoms[NET_CLIENT_LIST_STACKING], XA_WINDOW, 32, PropModeReplace,
+        (unsigned char *) windows, client_count);
+
+    /* _NET_CLIENT_LIST is in mapping order. The server allocates XIDs upwards,
+     * so sorting by XID gives the order the windows were created in. */
+    qsort(windows, client_count, sizeof(Window), compare_windows);
+    XChangeProperty(dpy, root, atoms[NET_CLIENT_LIST], XA_WINDOW, 32, PropModeReplace,
+        (unsigned char *) windows, client_count);
+
+    Window active = None;
+    for (i = client_count - 1; i >= 0; i--)
+    {
+        if (!clients[i].iconified)
+        {
+            active = clients[i].window;
+            break;
+        }
+    }
+    set_window(root, atoms[NET_ACTIVE_WINDOW], active);
+
+    free(windows);
+}
+
+static void set_title(Client * client)
+{
+    char title[64];
+    snprintf(title, sizeof(title), "Replay window %lu", client->serial);
+    XChangeProperty(dpy, client->window, atoms[NET_WM_NAME], atoms[UTF8_STRING], 8, PropModeReplace,
+        (unsigned char *) title, strlen(title));
+    XStoreName(dpy, client->window, title);
+}
+
+static void set_iconified(Client * client, int iconified)
+{
+    client->iconified = iconified;
+
+    long wm_state[2] = { iconified ? IconicState : NormalState, None };
+    XChangeProperty(dpy, client->window, atoms[WM_STATE], atoms[WM_STATE], 32, PropModeReplace,
+        (unsigned char *) wm_state, 2);
+
+    if (iconified)
+    {
+        Atom hidden = atoms[NET_WM_STATE_HIDDEN];
+        XChangeProperty(dpy, client->window, atoms[NET_WM_STATE], XA_ATOM, 32, PropModeReplace,
+            (unsigned char *) &hidden, 1);
+        XUnmapWindow(dpy, client->window);
+    }
+    else
+    {
+        XChangeProperty(dpy, client->window, atoms[NET_WM_STATE], XA_ATOM, 32, PropModeReplace, NULL, 0);
+        XMapWindow(dpy, client->window);
+    }
+}
+
+/********************************************************************/
+
+static void op_create(void)
+{
+    Client * client = &clients[client_count++];
+    client->window = XCreateSimpleWindow(dpy, root,
+        next_random(800), next_random(600), 100 + next_random(300), 100 + next_random(200),
+        0, 0, WhitePixel(dpy, DefaultScreen(dpy)));
+    client->serial = next_serial++;
+    client->iconified = 0;
+
+    static const char * classes[] = { "xterm", "firefox", "gimp", "geany", "mpv" };
+    XClassHint class_hint;
+    class_hint.res_name = (char *) classes[client->serial % 5];
+    class_hint.res_class = (char *) classes[client->serial % 5];
+    XSetClassHint(dpy, client->window, &class_hint);
+
+    Atom type = atoms[NET_WM_WINDOW_TYPE_NORMAL];
+    XChangeProperty(dpy, client->window, atoms[NET_WM_WINDOW_TYPE], XA_ATOM, 32, PropModeReplace,
+        (unsigned char *) &type, 1);
+    set_cardinal(client->window, atoms[NET_WM_DESKTOP], client->serial % DESKTOPS);
+    set_title(client);
+    set_iconified(client, 0);
+
+    update_client_lists();
+    pace();
+}
+
+static void op_retitle(void)
+{
+    Client * client = &clients[next_random(client_count)];
+    client->serial = next_serial++;
+    set_title(client);
+    pace();
+}
+
+static void op_restack(void)
+{
+    int index = next_random(client_count);
+    Client client = clients[index];
+    memmove(&clients[index], &clients[index + 1], sizeof(Client) * (client_count - index - 1));
+    clients[client_count - 1] = client;
+
+    XRaiseWindow(dpy, client.window);
+    update_client_lists();
+    pace();
+}
+
+static void op_iconify(void)
+{
+    Client * client = &clients[next_random(client_count)];
+    set_iconified(client, !client->iconified);
+    update_client_lists();
+    pace();
+}
+
+static void op_switch_desktop(void)
+{
+    set_cardinal(root, atoms[NET_CURRENT_DESKTOP], next_random(DESKTOPS));
+    pace();
+}
+
+static void op_destroy(void)
+{
+    int index = next_random(client_count);
+    XDestroyWindow(dpy, clients[index].window);
+    memmove(&clients[index], &clients[index + 1], sizeof(Client) * (client_count - index - 1));
+    client_count--;
+
+    update_client_lists();
+    pace();
+}
+
+/********************************************************************/
+
+static void announce_wm(void)
+{
+    Window check = XCreateSimpleWindow(dpy, root, -1, -1, 1, 1, 0, 0, 0);
+    const char * name = "ewmh-replay";
+    XChangeProperty(dpy, check, atoms[NET_WM_NAME], atoms[UTF8_STRING], 8, PropModeReplace,
+        (unsigned char *) name, strlen(name));
+    set_window(check, atoms[NET_SUPPORTING_WM_CHECK], check);
+    set_window(root, atoms[NET_SUPPORTING_WM_CHECK], check);
+
+    XChangeProperty(dpy, root, atoms[NET_SUPPORTED], XA_ATOM, 32, PropModeReplace,
+        (unsigned char *) atoms, NET_WM_WINDOW_TYPE_NORMAL + 1);
+    set_cardinal(root, atoms[NET_NUMBER_OF_DESKTOPS], DESKTOPS);
+    set_cardinal(root, atoms[NET_CURRENT_DESKTOP], 0);
+    update_client_lists();
+    XSync(dpy, False);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "Usage: ewmh_replay [-n windows] [-o operations] [-r rate] [-s seed]\n"
+        "  -n  number of windows to create (default 200)\n"
+        "  -o  number of retitle/restack/iconify operations after that (default 10 per window)\n"
+        "  -r  operations per second; 0 means as fast as possible (default 500)\n"
+        "  -s  seed of the operation sequence (default 1)\n");
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    int windows = 200;
+    int steps = -1;
+    int rate = 500;
+    int opt;
+
+    random_state = 1;
+
+    while ((opt = getopt(argc, argv, "n:o:r:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': windows = atoi(optarg); break;
+            case 'o': steps = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 's': random_state = strtoul(optarg, NULL, 10); break;
+            default: usage();
+        }
+    }
+
+    if (windows <= 0)
+        usage();
+    if (steps < 0)
+        steps = windows * 10;
+    delay_ns = rate > 0 ? 1000000000L / rate : 0;
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy)
+    {
+        fprintf(stderr, "ewmh_replay: cannot open display\n");
+        return 1;
+    }
+    root = DefaultRootWindow(dpy);
+    XInternAtoms(dpy, (char **) atom_names, ATOM_COUNT, False, atoms);
+
+    clients = calloc(windows, sizeof(Client));
+    announce_wm();
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    while (client_count < windows)
+        op_create();
+
+    int i;
+    for (i = 0; i < steps; i++)
+    {
+        switch (next_random(16))
+        {
+            case 0: case 1: case 2: case 3: case 4: case 5: case 6:
+                op_retitle();
+                break;
+            case 7: case 8: case 9: case 10:
+                op_restack();
+                break;
+            case 11: case 12: case 13:
+                op_iconify();
+                break;
+            default:
+                op_switch_desktop();
+                break;
+        }
+    }
+
+    while (client_count > 0)
+        op_destroy();
+
+    XSync(dpy, False);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    double elapsed = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("replayed %lu operations on %d windows in %.2f s\n", operations, windows, elapsed);
+
+    free(clients);
+    XCloseDisplay(dpy);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Microbenchmark of the pixbuf_ops operations against the per-pixel reference.
+ *
+ * Usage: pixbuf_ops_benchmark [size [iterations]]
+ *
+ * Operates on size x size pixbufs (48 by default, a typical icon) and prints
+ * the throughput of each operation in megapixels per second. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <waterline/pixbuf_ops.h>
+
+#include "pixbuf_reference.h"
+
+typedef struct {
+    GdkPixbuf * rgba1;
+    GdkPixbuf * rgba2;
+    gulong * argb;
+    int size;
+} BenchmarkData;
+
+typedef void (*BenchmarkFunc)(BenchmarkData * data);
+
+/********************************************************************/
+
+static void unref(gpointer object)
+{
+    if (object)
+        g_object_unref(object);
+}
+
+static void run_blend(BenchmarkData * data)     { unref(wtl_pixbuf_blend(data->rgba1, data->rgba2, 0.3f)); }
+static void ref_blend(BenchmarkData * data)     { unref(reference_blend(data->rgba1, data->rgba2, 0.3f)); }
+static void run_highlight(BenchmarkData * data) { unref(wtl_pixbuf_highlight(data->rgba1, 0x202020)); }
+static void ref_highlight(BenchmarkData * data) { unref(reference_highlight(data->rgba1, 0x202020)); }
+/* In place; the changing contents do not affect the timing of either version. */
+static void run_dim(BenchmarkData * data)       { wtl_pixbuf_dim(data->rgba2); }
+static void ref_dim(BenchmarkData * data)       { reference_dim(data->rgba2); }
+static void run_argb(BenchmarkData * data)      { unref(wtl_pixbuf_new_from_argb(data->argb, data->size, data->size)); }
+static void ref_argb(BenchmarkData * data)      { unref(reference_new_from_argb(data->argb, data->size, data->size)); }
+
+static void run_surface(BenchmarkData * data)
+{
+    cairo_surface_t * surface = wtl_pixbuf_create_surface(data->rgba1);
+    if (surface)
+        cairo_surface_destroy(surface);
+}
+
+static void ref_surface(BenchmarkData * data)
+{
+    g_free(reference_premultiply(data->rgba1));
+}
+
+/********************************************************************/
+
+static double measure(BenchmarkFunc func, BenchmarkData * data, int iterations)
+{
+    gint64 started = g_get_monotonic_time();
+    int i;
+    for (i = 0; i < iterations; i++)
+        func(data);
+    gint64 elapsed = g_get_monotonic_time() - started;
+
+    /* Megapixels per second. */
+    return (double) data->size * data->size * iterations / MAX(elapsed, 1);
+}
+
+int main(int argc, char ** argv)
+{
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    int size = argc > 1 ? atoi(argv[1]) : 48;
+    int iterations = argc > 2 ? atoi(argv[2]) : 0;
+    if (size <= 0)
+    {
+        fprintf(stderr, "Usage: pixbuf_ops_benchmark [size [iterations]]\n");
+        return 2;
+    }
+    /* About 100 megapixels per operation by default. */
+    if (iterations <= 0)
+        iterations = MAX(1, 100 * 1000 * 1000 / (size * size));
+
+    GRand * rand = g_rand_new_with_seed(1);
+
+    BenchmarkData data;
+    data.size = size;
+    data.rgba1 = reference_random_pixbuf(rand, TRUE, size, size);
+    data.rgba2 = reference_random_pixbuf(rand, TRUE, size, size);
+    data.argb = g_new(gulong, size * size);
+    int i;
+    for (i = 0; i < size * size; i++)
+        data.argb[i] = g_rand_int(rand);
+
+    static const struct {
+        const char * name;
+        BenchmarkFunc run;
+        BenchmarkFunc reference;
+    } operations[] = {
+        { "blend",          run_blend,      ref_blend },
+        { "highlight",      run_highlight,  ref_highlight },
+        { "dim",            run_dim,        ref_dim },
+        { "create_surface", run_surface,    ref_surface },
+        { "new_from_argb",  run_argb,       ref_argb },
+    };
+
+    printf("%dx%d pixels, %d iterations, Mpixel/s\n", size, size, iterations);
+    printf("%-16s %12s %12s %8s\n", "operation", "pixbuf_ops", "reference", "speedup");
+
+    guint op;
+    for (op = 0; op < G_N_ELEMENTS(operations); op++)
+    {
+        double fast = measure(operations[op].run, &data, iterations);
+        /* The reference is much slower; fewer rounds give the same precision. */
+        double slow = measure(operations[op].reference, &data, MAX(1, iterations / 10));
+        printf("%-16s %12.1f %12.1f %7.1fx\n", operations[op].name, fast, slow, fast / slow);
+    }
+
+    g_object_unref(data.rgba1);
+    g_object_unref(data.rgba2);
+    g_free(data.argb);
+    g_rand_free(rand);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Checks every pixbuf_ops operation against the per-pixel reference, on widths
+ * that cover both the SIMD bulk and the scalar tail of the rows, on RGB and RGBA
+ * sources, and on sub-pixbufs whose rows are not contiguous. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <waterline/pixbuf_ops.h>
+
+#include "pixbuf_reference.h"
+
+static const int widths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 67, 255 };
+static const int heights[] = { 1, 3 };
+
+static int failures = 0;
+
+/********************************************************************/
+
+static void report(const char * op, gboolean has_alpha, int width, int height, int x, int y)
+{
+    if (failures++ < 20)
+        printf("FAIL: %s, %s %dx%d, first difference at %d,%d\n",
+            op, has_alpha ? "RGBA" : "RGB", width, height, x, y);
+}
+
+static void compare_pixbufs(const char * op, gboolean has_alpha, GdkPixbuf * expected, GdkPixbuf * actual)
+{
+    int w = gdk_pixbuf_get_width(expected);
+    int h = gdk_pixbuf_get_height(expected);
+
+    if (!actual || gdk_pixbuf_get_width(actual) != w || gdk_pixbuf_get_height(actual) != h
+    ||  gdk_pixbuf_get_n_channels(actual) != 4)
+    {
+        report(op, has_alpha, w, h, -1, -1);
+        return;
+    }
+
+    int x, y;
+    for (y = 0; y < h; y++)
+    {
+        const guchar * e = gdk_pixbuf_get_pixels(expected) + y * gdk_pixbuf_get_rowstride(expected);
+        const guchar * a = gdk_pixbuf_get_pixels(actual) + y * gdk_pixbuf_get_rowstride(actual);
+        for (x = 0; x < w; x++)
+        {
+            if (memcmp(e + x * 4, a + x * 4, 4) != 0)
+            {
+                report(op, has_alpha, w, h, x, y);
+                return;
+            }
+        }
+    }
+}
+
+/* A source whose rows start at an odd offset and are followed by padding. */
+static GdkPixbuf * new_source(GRand * rand, gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf * parent = reference_random_pixbuf(rand, has_alpha, width + 3, height + 1);
+    GdkPixbuf * pixbuf = gdk_pixbuf_new_subpixbuf(parent, 1, 1, width, height);
+    g_object_unref(parent);
+    return pixbuf;
+}
+
+/********************************************************************/
+
+static void test_blend(GRand * rand, gboolean has_alpha, int width, int height)
+{
+    static const float levels[] = { 0.0f, 0.25f, 0.5f, 0.77f, 1.0f };
+
+    GdkPixbuf * src1 = new_source(rand, has_alpha, width, height);
+    GdkPixbuf * src2 = new_source(rand, !has_alpha, width + 1, height);
+
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(levels); i++)
+    {
+        GdkPixbuf * expected = reference_blend(src1, src2, levels[i]);
+        GdkPixbuf * actual = wtl_pixbuf_blend(src1, src2, levels[i]);
+        compare_pixbufs("blend", has_alpha, expected, actual);
+        g_object_unref(expected);
+        if (actual)
+            g_object_unref(actual);
+    }
+
+    g_object_unref(src1);
+    g_object_unref(src2);
+}
+
+static void test_highlight(GRand * rand, gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf * src = new_source(rand, has_alpha, width, height);
+    gulong color = g_rand_int(rand) & 0xFFFFFF;
+
+    GdkPixbuf * expected = reference_highlight(src, color);
+    GdkPixbuf * actual = wtl_pixbuf_highlight(src, color);
+    compare_pixbufs("highlight", has_alpha, expected, actual);
+
+    g_object_unref(expected);
+    if (actual)
+        g_object_unref(actual);
+    g_object_unref(src);
+}
+
+static void test_dim(GRand * rand, int width, int height)
+{
+    GdkPixbuf * parent = reference_random_pixbuf(rand, TRUE, width + 3, height + 1);
+    GdkPixbuf * parent_copy = gdk_pixbuf_copy(parent);
+    GdkPixbuf * expected = gdk_pixbuf_new_subpixbuf(parent_copy, 1, 1, width, height);
+    GdkPixbuf * actual = gdk_pixbuf_new_subpixbuf(parent, 1, 1, width, height);
+
+    reference_dim(expected);
+    wtl_pixbuf_dim(actual);
+    compare_pixbufs("dim", TRUE, expected, actual);
+
+    /* Pixels around the sub-pixbuf must not be touched. */
+    if (memcmp(gdk_pixbuf_get_pixels(parent), gdk_pixbuf_get_pixels(parent_copy), gdk_pixbuf_get_rowstride(parent)) != 0)
+        report("dim outside of the pixbuf", TRUE, width, height, -1, -1);
+
+    g_object_unref(expected);
+    g_object_unref(actual);
+    g_object_unref(parent_copy);
+    g_object_unref(parent);
+}
+
+static void test_create_surface(GRand * rand, gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf * src = new_source(rand, has_alpha, width, height);
+    guint32 * expected = reference_premultiply(src);
+    cairo_surface_t * surface = wtl_pixbuf_create_surface(src);
+
+    if (!surface)
+    {
+        report("create_surface", has_alpha, width, height, -1, -1);
+    }
+    else
+    {
+        cairo_surface_flush(surface);
+        const guchar * data = cairo_image_surface_get_data(surface);
+        int stride = cairo_image_surface_get_stride(surface);
+        int x, y;
+        for (y = 0; y < height; y++)
+        {
+            const guint32 * row = (const guint32 *) (data + y * stride);
+            for (x = 0; x < width; x++)
+            {
+                if (row[x] != expected[y * width + x])
+                {
+                    report("create_surface", has_alpha, width, height, x, y);
+                    goto out;
+                }
+            }
+        }
+out:
+        cairo_surface_destroy(surface);
+    }
+
+    g_free(expected);
+    g_object_unref(src);
+}
+
+static void test_new_from_argb(GRand * rand, int width, int height)
+{
+    gulong * data = g_new(gulong, width * height);
+    int i;
+    for (i = 0; i < width * height; i++)
+    {
+        data[i] = g_rand_int(rand);
+        /* Only the low 32 bits of each long carry a pixel; the rest must be ignored. */
+        if (sizeof(gulong) > 4)
+            data[i] |= (gulong) g_rand_int(rand) << 16 << 16;
+    }
+
+    GdkPixbuf * expected = reference_new_from_argb(data, width, height);
+    GdkPixbuf * actual = wtl_pixbuf_new_from_argb(data, width, height);
+    compare_pixbufs("new_from_argb", TRUE, expected, actual);
+
+    g_object_unref(expected);
+    if (actual)
+        g_object_unref(actual);
+    g_free(data);
+}
+
+/********************************************************************/
+
+int main(int argc, char ** argv)
+{
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    GRand * rand = g_rand_new_with_seed(1);
+
+    guint w, h;
+    for (w = 0; w < G_N_ELEMENTS(widths); w++)
+    {
+        for (h = 0; h < G_N_ELEMENTS(heights); h++)
+        {
+            int width = widths[w];
+            int height = heights[h];
+            int has_alpha;
+            for (has_alpha = 0; has_alpha <= 1; has_alpha++)
+            {
+                test_blend(rand, has_alpha, width, height);
+                test_highlight(rand, has_alpha, width, height);
+                test_create_surface(rand, has_alpha, width, height);
+            }
+            test_dim(rand, width, height);
+            test_new_from_argb(rand, width, height);
+        }
+    }
+
+    g_rand_free(rand);
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("all pixbuf operations match the reference\n");
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "pixbuf_reference.h"
+
+/********************************************************************/
+
+static guchar get_channel(GdkPixbuf * pixbuf, int x, int y, int channel)
+{
+    int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+    if (channel == 3 && n_channels < 4)
+        return 255;
+    return gdk_pixbuf_get_pixels(pixbuf)[y * gdk_pixbuf_get_rowstride(pixbuf) + x * n_channels + channel];
+}
+
+static void set_channel(GdkPixbuf * pixbuf, int x, int y, int channel, guchar value)
+{
+    int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+    gdk_pixbuf_get_pixels(pixbuf)[y * gdk_pixbuf_get_rowstride(pixbuf) + x * n_channels + channel] = value;
+}
+
+/********************************************************************/
+
+GdkPixbuf * reference_blend(GdkPixbuf * src1, GdkPixbuf * src2, float level)
+{
+    int w = MIN(gdk_pixbuf_get_width(src1), gdk_pixbuf_get_width(src2));
+    int h = MIN(gdk_pixbuf_get_height(src1), gdk_pixbuf_get_height(src2));
+    GdkPixbuf * dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w, h);
+
+    level = CLAMP(level, 0, 1);
+    unsigned int weight = level * 256 + 0.5;
+
+    int x, y, c;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            for (c = 0; c < 4; c++)
+                set_channel(dst, x, y, c,
+                    (get_channel(src1, x, y, c) * (256 - weight) + get_channel(src2, x, y, c) * weight) / 256);
+
+    return dst;
+}
+
+GdkPixbuf * reference_highlight(GdkPixbuf * src, gulong color)
+{
+    int w = gdk_pixbuf_get_width(src);
+    int h = gdk_pixbuf_get_height(src);
+    GdkPixbuf * dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w, h);
+    unsigned int add[3] = { (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF };
+
+    int x, y, c;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+        {
+            guchar alpha = get_channel(src, x, y, 3);
+            for (c = 0; c < 3; c++)
+            {
+                unsigned int value = get_channel(src, x, y, c);
+                if (alpha != 0)
+                    value = MIN(value + add[c], 255);
+                set_channel(dst, x, y, c, value);
+            }
+            set_channel(dst, x, y, 3, alpha);
+        }
+
+    return dst;
+}
+
+void reference_dim(GdkPixbuf * pixbuf)
+{
+    int w = gdk_pixbuf_get_width(pixbuf);
+    int h = gdk_pixbuf_get_height(pixbuf);
+
+    int x, y, c;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+        {
+            unsigned int gray = (get_channel(pixbuf, x, y, 0) * 77
+                               + get_channel(pixbuf, x, y, 1) * 151
+                               + get_channel(pixbuf, x, y, 2) * 28) / 256;
+            for (c = 0; c < 3; c++)
+                set_channel(pixbuf, x, y, c, (get_channel(pixbuf, x, y, c) + gray) / 2);
+            set_channel(pixbuf, x, y, 3, get_channel(pixbuf, x, y, 3) / 2);
+        }
+}
+
+guint32 * reference_premultiply(GdkPixbuf * src)
+{
+    int w = gdk_pixbuf_get_width(src);
+    int h = gdk_pixbuf_get_height(src);
+    guint32 * dst = g_new(guint32, w * h);
+
+    int x, y, c;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+        {
+            unsigned int alpha = get_channel(src, x, y, 3);
+            guint32 value = alpha << 24;
+            for (c = 0; c < 3; c++)
+            {
+                /* c * a / 255 is never exactly halfway between two integers. */
+                unsigned int premultiplied = (get_channel(src, x, y, c) * alpha + 127) / 255;
+                value |= premultiplied << (16 - c * 8);
+            }
+            dst[y * w + x] = value;
+        }
+
+    return dst;
+}
+
+GdkPixbuf * reference_new_from_argb(const gulong * data, int width, int height)
+{
+    GdkPixbuf * dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+
+    int x, y;
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+        {
+            gulong argb = data[y * width + x];
+            set_channel(dst, x, y, 0, (argb >> 16) & 0xFF);
+            set_channel(dst, x, y, 1, (argb >> 8) & 0xFF);
+            set_channel(dst, x, y, 2, argb & 0xFF);
+            set_channel(dst, x, y, 3, (argb >> 24) & 0xFF);
+        }
+
+    return dst;
+}
+
+/********************************************************************/
+
+GdkPixbuf * reference_random_pixbuf(GRand * rand, gboolean has_alpha, int width, int height)
+{
+    GdkPixbuf * pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+    int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+
+    int x, y, c;
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            for (c = 0; c < n_channels; c++)
+            {
+                guchar value = g_rand_int_range(rand, 0, 256);
+                /* Exercise the edge cases of alpha handling and saturation. */
+                switch (g_rand_int_range(rand, 0, 8))
+                {
+                    case 0: value = 0; break;
+                    case 1: value = 255; break;
+                }
+                set_channel(pixbuf, x, y, c, value);
+            }
+
+    return pixbuf;
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2015 Vadim Ushakov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __WATERLINE__TESTS__PIXBUF_REFERENCE_H
+#define __WATERLINE__TESTS__PIXBUF_REFERENCE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+/* Straightforward per-pixel versions of the pixbuf_ops operations, written the way
+ * the panel did it before the shared kernels: one pixel at a time, channel counts
+ * checked inside the loop, divisions instead of shifts. They define the expected
+ * results for tests and the baseline for the benchmark. */
+
+extern GdkPixbuf * reference_blend(GdkPixbuf * src1, GdkPixbuf * src2, float level);
+extern GdkPixbuf * reference_highlight(GdkPixbuf * src, gulong color);
+extern void reference_dim(GdkPixbuf * pixbuf);
+/* Premultiplied native-endian 0xAARRGGBB values, width * height of them. */
+extern guint32 * reference_premultiply(GdkPixbuf * src);
+extern GdkPixbuf * reference_new_from_argb(const gulong * data, int width, int height);
+
+/* A pixbuf with deterministic pseudo-random contents. Some pixels are fully transparent or opaque. */
+extern GdkPixbuf * reference_random_pixbuf(GRand * rand, gboolean has_alpha, int width, int height);
+
+#endif